@@ -0,0 +1,474 @@
+#include "callGraph.h"
+#include "jasmCode.h"
+#include "memoize.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool Enable_Unused_Function_Elim = true;
+bool Print_Call_Graph = false;
+
+// Helper /////////////////////////////////////////////////////////////////////////////////////////
+
+// `invokestatic <type> <name>(...)` 的 name（呼叫者負責 free），格式不對時回傳 NULL
+static char* getCallee(const JasmLine_t* line)
+{
+    const char* begin = strchr(line->operand, ' ');
+    const char* end = strchr(line->operand, '(');
+    if (begin == NULL || end == NULL || begin > end)
+        return NULL;
+    return strndup(begin + 1, end - begin - 1);
+}
+
+// `getstatic / putstatic <type> <name>` 的 name；System.out 和 memo table 不算全域變數，回傳 NULL
+static const char* getFieldName(const JasmLine_t* line)
+{
+    const char* name = strchr(line->operand, ' ');
+    if (name == NULL)
+        return NULL;
+
+    ++name;
+    if (strcmp(name, "java.lang.System.out") == 0 || strncmp(name, MEMO_FIELD_PREFIX, strlen(MEMO_FIELD_PREFIX)) == 0)
+        return NULL;
+    return name;
+}
+
+// lines[begin, end) 本身（不含呼叫的函數）的副作用
+static unsigned getLocalEffects(const JasmLine_t* lines, unsigned begin, unsigned end)
+{
+    unsigned effects = 0;
+
+    for (unsigned i = begin; i < end; ++i) {
+        if (isJasmOpcode(&lines[i], "getstatic"))
+            effects |= getFieldName(&lines[i]) ? EFFECT_READ_GLOBAL : EFFECT_IO;
+        else if (isJasmOpcode(&lines[i], "putstatic") && getFieldName(&lines[i]))
+            effects |= EFFECT_WRITE_GLOBAL;
+        else if (isJasmOpcode(&lines[i], "invokevirtual"))
+            effects |= EFFECT_IO;
+    }
+    return effects;
+}
+
+// 名稱的集合 ///////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct NameSet_t {
+    const char** names;
+    unsigned num, capacity;
+} NameSet_t;
+
+static bool hasName(const NameSet_t* set, const char* name)
+{
+    for (unsigned i = 0; i < set->num; ++i)
+        if (strcmp(set->names[i], name) == 0)
+            return true;
+    return false;
+}
+
+static void addName(NameSet_t* set, const char* name)
+{
+    if (hasName(set, name))
+        return;
+
+    if (set->num == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 8;
+        set->names = realloc(set->names, set->capacity * sizeof(const char*));
+    }
+    set->names[set->num++] = name;
+}
+
+static void printNames(FILE* file, const char* title, const NameSet_t* set)
+{
+    if (set->num == 0)
+        return;
+
+    fprintf(file, "; %s ", title);
+    for (unsigned i = 0; i < set->num; ++i)
+        fprintf(file, i ? ", %s" : "%s", set->names[i]);
+}
+
+// Effect Summary /////////////////////////////////////////////////////////////////////////////////
+
+typedef struct FunctionEffects_t {
+    char* name;
+    unsigned effects;
+    struct FunctionEffects_t* next;
+} FunctionEffects_t;
+
+static FunctionEffects_t* Function_Effects = NULL;
+
+void registerFunctionEffects(const char* name, const char* body)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+    unsigned effects = getLocalEffects(lines, 0, lineNum);
+
+    // 呼叫的函數都已經定義過了（自己除外）
+    for (unsigned i = 0; i < lineNum; ++i) {
+        if (!isJasmOpcode(&lines[i], "invokestatic"))
+            continue;
+
+        char* callee = getCallee(&lines[i]);
+        if (callee == NULL)
+            effects |= EFFECT_UNKNOWN;
+        else if (strcmp(callee, name) != 0)
+            effects |= getFunctionEffects(callee);
+        free(callee);
+    }
+    freeJasmLines(lines, lineNum);
+
+    FunctionEffects_t* function = malloc(sizeof(FunctionEffects_t));
+    function->name = strdup(name);
+    function->effects = effects;
+    function->next = Function_Effects;
+    Function_Effects = function;
+}
+
+unsigned getFunctionEffects(const char* name)
+{
+    for (FunctionEffects_t* function = Function_Effects; function; function = function->next)
+        if (strcmp(function->name, name) == 0)
+            return function->effects;
+    return EFFECT_UNKNOWN;
+}
+
+// Call Graph /////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct CallGraphNode_t {
+    char* name;
+    unsigned begin, end;     // lines[begin] 是 `method ...`，lines[end] 是 `} /* end of ... */`
+    unsigned* callees;       // 呼叫的函數（nodes 的 index，不重複）
+    unsigned calleeNum;
+    unsigned effects;        // 包含呼叫的函數
+    NameSet_t reads, writes; // 讀 / 寫的全域變數（包含呼叫的函數）
+    bool isReachable;        // 是否可以從 main 呼叫到
+    bool isRecursive;        // 是否在一個 cycle 上（SCC 有兩個以上的函數，或呼叫自己）
+
+    // Tarjan's algorithm
+    int index, lowLink;
+    bool isOnStack;
+    unsigned scc;
+} CallGraphNode_t;
+
+typedef struct CallGraph_t {
+    JasmLine_t* lines;
+    unsigned lineNum;
+    CallGraphNode_t* nodes;
+    unsigned nodeNum;
+    unsigned sccNum;
+} CallGraph_t;
+
+static int findNode(const CallGraph_t* graph, const char* name)
+{
+    for (unsigned i = 0; i < graph->nodeNum; ++i)
+        if (strcmp(graph->nodes[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+// `method public static <type> <name> (...)` 的 name
+static char* getMethodName(const JasmLine_t* line)
+{
+    const char* end = strchr(line->operand, '(');
+    if (end == NULL)
+        return NULL;
+    while (end > line->operand && end[-1] == ' ')
+        --end;
+
+    const char* begin = end;
+    while (begin > line->operand && begin[-1] != ' ')
+        --begin;
+    return begin < end ? strndup(begin, end - begin) : NULL;
+}
+
+// 找出所有 method 的範圍，失敗（格式不對）時回傳 false
+static bool findMethods(CallGraph_t* graph)
+{
+    unsigned capacity = 16;
+    graph->nodes = calloc(capacity, sizeof(CallGraphNode_t));
+
+    for (unsigned i = 0; i < graph->lineNum; ++i) {
+        if (!isJasmOpcode(&graph->lines[i], "method"))
+            continue;
+
+        char* name = getMethodName(&graph->lines[i]);
+        unsigned end = i + 1;
+        while (end < graph->lineNum && !(graph->lines[end].text && strncmp(graph->lines[end].text, "} /* end of ", 12) == 0))
+            ++end;
+        if (name == NULL || end == graph->lineNum) {
+            free(name);
+            return false;
+        }
+
+        if (graph->nodeNum == capacity) {
+            capacity *= 2;
+            graph->nodes = realloc(graph->nodes, capacity * sizeof(CallGraphNode_t));
+        }
+        CallGraphNode_t* node = &graph->nodes[graph->nodeNum++];
+        memset(node, 0, sizeof(CallGraphNode_t));
+        node->name = name;
+        node->begin = i;
+        node->end = end;
+        i = end;
+    }
+    return true;
+}
+
+// 建出每個 method 的 callee 和本身的副作用，失敗（呼叫了不存在的 method）時回傳 false
+static bool findCallees(CallGraph_t* graph)
+{
+    for (unsigned n = 0; n < graph->nodeNum; ++n) {
+        CallGraphNode_t* node = &graph->nodes[n];
+        node->callees = malloc((node->end - node->begin + 1) * sizeof(unsigned));
+        node->effects = getLocalEffects(graph->lines, node->begin, node->end);
+
+        for (unsigned i = node->begin; i < node->end; ++i) {
+            const JasmLine_t* line = &graph->lines[i];
+
+            if (isJasmOpcode(line, "getstatic") && getFieldName(line))
+                addName(&node->reads, getFieldName(line));
+            else if (isJasmOpcode(line, "putstatic") && getFieldName(line))
+                addName(&node->writes, getFieldName(line));
+            else if (isJasmOpcode(line, "invokestatic")) {
+                char* callee = getCallee(line);
+                int index = callee ? findNode(graph, callee) : -1;
+                free(callee);
+                if (index < 0)
+                    return false;
+
+                bool isNew = true;
+                for (unsigned k = 0; k < node->calleeNum; ++k)
+                    isNew = isNew && node->callees[k] != (unsigned)index;
+                if (isNew)
+                    node->callees[node->calleeNum++] = index;
+
+                if ((unsigned)index == n)
+                    node->isRecursive = true;
+            }
+        }
+    }
+    return true;
+}
+
+static void markReachable(CallGraph_t* graph, unsigned n)
+{
+    CallGraphNode_t* node = &graph->nodes[n];
+    if (node->isReachable)
+        return;
+
+    node->isReachable = true;
+    for (unsigned k = 0; k < node->calleeNum; ++k)
+        markReachable(graph, node->callees[k]);
+}
+
+// Tarjan's algorithm
+static void findSCC(CallGraph_t* graph, unsigned n, unsigned* stack, unsigned* stackSize, int* nextIndex)
+{
+    CallGraphNode_t* node = &graph->nodes[n];
+    node->index = node->lowLink = (*nextIndex)++;
+    stack[(*stackSize)++] = n;
+    node->isOnStack = true;
+
+    for (unsigned k = 0; k < node->calleeNum; ++k) {
+        CallGraphNode_t* callee = &graph->nodes[node->callees[k]];
+        if (callee->index < 0) {
+            findSCC(graph, node->callees[k], stack, stackSize, nextIndex);
+            if (callee->lowLink < node->lowLink)
+                node->lowLink = callee->lowLink;
+        }
+        else if (callee->isOnStack && callee->index < node->lowLink)
+            node->lowLink = callee->index;
+    }
+
+    if (node->lowLink != node->index)
+        return;
+
+    // node 是 SCC 的 root，stack 上 node 和它以上的都是同一個 SCC
+    unsigned first = *stackSize - 1;
+    while (stack[first] != n)
+        --first;
+
+    for (unsigned i = first; i < *stackSize; ++i) {
+        CallGraphNode_t* member = &graph->nodes[stack[i]];
+        member->isOnStack = false;
+        member->scc = graph->sccNum;
+        if (*stackSize - first > 1)
+            member->isRecursive = true;
+    }
+    *stackSize = first;
+    ++graph->sccNum;
+}
+
+// 副作用、讀寫的全域變數加上所有呼叫得到的函數的（不斷合併直到不再改變，cycle 也沒問題）
+static void propagateEffects(CallGraph_t* graph)
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (unsigned n = 0; n < graph->nodeNum; ++n) {
+            CallGraphNode_t* node = &graph->nodes[n];
+
+            for (unsigned k = 0; k < node->calleeNum; ++k) {
+                const CallGraphNode_t* callee = &graph->nodes[node->callees[k]];
+                const unsigned readNum = node->reads.num, writeNum = node->writes.num, effects = node->effects;
+
+                node->effects |= callee->effects;
+                for (unsigned i = 0; i < callee->reads.num; ++i)
+                    addName(&node->reads, callee->reads.names[i]);
+                for (unsigned i = 0; i < callee->writes.num; ++i)
+                    addName(&node->writes, callee->writes.names[i]);
+
+                changed = changed || readNum != node->reads.num || writeNum != node->writes.num || effects != node->effects;
+            }
+        }
+    }
+}
+
+static void printReport(FILE* file, const CallGraph_t* graph, bool isRemoved)
+{
+    fprintf(file, "Call Graph (%u functions, %u strongly connected components)\n", graph->nodeNum, graph->sccNum);
+
+    for (unsigned n = 0; n < graph->nodeNum; ++n) {
+        const CallGraphNode_t* node = &graph->nodes[n];
+
+        fprintf(file, "\t%s [SCC %u%s]", node->name, node->scc, node->isRecursive ? ", recursive" : "");
+        if (node->calleeNum) {
+            fprintf(file, " -> ");
+            for (unsigned k = 0; k < node->calleeNum; ++k)
+                fprintf(file, k ? ", %s" : "%s", graph->nodes[node->callees[k]].name);
+        }
+
+        if (node->effects == 0)
+            fprintf(file, "; pure");
+        if (node->effects & EFFECT_IO)
+            fprintf(file, "; I/O");
+        printNames(file, "reads", &node->reads);
+        printNames(file, "writes", &node->writes);
+
+        if (!node->isReachable)
+            fprintf(file, isRemoved ? "; unreachable (removed)" : "; unreachable");
+        fprintf(file, "\n");
+    }
+}
+
+// Elimination ////////////////////////////////////////////////////////////////////////////////////
+
+static void removeLine(JasmLine_t* line)
+{
+    setJasmInstruction(line, NULL, NULL);
+    free(line->label);
+    line->label = NULL;
+}
+
+static bool isBlankLine(const JasmLine_t* line)
+{
+    return line->label == NULL && line->opcode == NULL && line->text && line->text[0] == '\0';
+}
+
+// `field static <type> <name> [= <value>]` 的 name 是否在 set 中
+static bool isFieldIn(const JasmLine_t* line, const NameSet_t* set)
+{
+    char type[64], name[256];
+    return sscanf(line->operand, "static %63s %255s", type, name) == 2 && hasName(set, name);
+}
+
+// 刪掉無法呼叫到的 method，以及只有它們用到的 field
+static void removeUnreachable(CallGraph_t* graph)
+{
+    NameSet_t used = { 0 }, unused = { 0 };
+
+    for (unsigned n = 0; n < graph->nodeNum; ++n) {
+        const CallGraphNode_t* node = &graph->nodes[n];
+        NameSet_t* set = node->isReachable ? &used : &unused;
+
+        for (unsigned i = node->begin; i < node->end; ++i) {
+            const JasmLine_t* line = &graph->lines[i];
+            if ((isJasmOpcode(line, "getstatic") || isJasmOpcode(line, "putstatic")) && strchr(line->operand, ' '))
+                addName(set, strchr(line->operand, ' ') + 1);
+        }
+    }
+
+    // field 前面的註解（`/* int g */`, `/* memo table of f */`）和後面的空行，在整組 field 都刪掉時一起刪掉
+    for (unsigned i = 0; i < graph->lineNum; ++i) {
+        if (!isJasmOpcode(&graph->lines[i], "field"))
+            continue;
+
+        unsigned end = i;
+        bool isAllRemoved = true;
+        for (; end < graph->lineNum && isJasmOpcode(&graph->lines[end], "field"); ++end) {
+            const JasmLine_t* line = &graph->lines[end];
+            isAllRemoved = isAllRemoved && isFieldIn(line, &unused) && !isFieldIn(line, &used);
+        }
+
+        for (unsigned k = i; k < end; ++k)
+            if (isFieldIn(&graph->lines[k], &unused) && !isFieldIn(&graph->lines[k], &used))
+                removeLine(&graph->lines[k]);
+
+        if (isAllRemoved) {
+            if (i > 0 && graph->lines[i - 1].text && strncmp(graph->lines[i - 1].text, "/*", 2) == 0 && graph->lines[i - 1].label == NULL)
+                removeLine(&graph->lines[i - 1]);
+            if (end < graph->lineNum && isBlankLine(&graph->lines[end]))
+                removeLine(&graph->lines[end]);
+        }
+        i = end;
+    }
+
+    // Note: used, unused 中的名稱指向 method 的 code，最後才能刪掉 method
+    for (unsigned n = 0; n < graph->nodeNum; ++n) {
+        const CallGraphNode_t* node = &graph->nodes[n];
+        if (node->isReachable)
+            continue;
+
+        for (unsigned i = node->begin; i <= node->end; ++i)
+            removeLine(&graph->lines[i]);
+        if (node->end + 1 < graph->lineNum && isBlankLine(&graph->lines[node->end + 1]))
+            removeLine(&graph->lines[node->end + 1]);
+    }
+
+    free(used.names);
+    free(unused.names);
+}
+
+char* analyzeCallGraph(const char* classBody, FILE* report)
+{
+    CallGraph_t graph = { 0 };
+    graph.lines = parseJasmLines(classBody, &graph.lineNum);
+
+    const int mainNode = findMethods(&graph) && findCallees(&graph) ? findNode(&graph, "main") : -1;
+
+    char* result = NULL;
+    if (mainNode >= 0) {
+        markReachable(&graph, mainNode);
+
+        unsigned* stack = malloc((graph.nodeNum + 1) * sizeof(unsigned));
+        unsigned stackSize = 0;
+        int nextIndex = 0;
+        for (unsigned n = 0; n < graph.nodeNum; ++n)
+            graph.nodes[n].index = -1;
+        for (unsigned n = 0; n < graph.nodeNum; ++n)
+            if (graph.nodes[n].index < 0)
+                findSCC(&graph, n, stack, &stackSize, &nextIndex);
+        free(stack);
+
+        propagateEffects(&graph);
+
+        if (report)
+            printReport(report, &graph, Enable_Unused_Function_Elim);
+        if (Enable_Unused_Function_Elim)
+            removeUnreachable(&graph);
+
+        result = joinJasmLines(graph.lines, graph.lineNum);
+    }
+    else
+        result = strdup(classBody);
+
+    for (unsigned n = 0; n < graph.nodeNum; ++n) {
+        free(graph.nodes[n].name);
+        free(graph.nodes[n].callees);
+        free(graph.nodes[n].reads.names);
+        free(graph.nodes[n].writes.names);
+    }
+    free(graph.nodes);
+    freeJasmLines(graph.lines, graph.lineNum);
+    return result;
+}
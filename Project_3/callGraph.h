@@ -0,0 +1,48 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+
+/**
+ * 整個程式的 call graph
+ *
+ * @details 整個 class 都產生完之後，從每個 method 的 invokestatic 建出 call graph
+ *          （inline、編譯時期計算掉的呼叫已經不存在，特化的呼叫則指向 `<name>$spec_<n>`，所以和實際執行的呼叫相同）：
+ *          - 用 Tarjan's algorithm 找出 strongly connected component（互相遞迴的函數）
+ *          - 每個函數的副作用：讀 / 寫哪些全域變數、是否有 I/O（print, read），包含它呼叫的所有函數
+ *          - 從 main 無法呼叫到的函數整個刪掉，只被這些函數使用的 field 也一起刪掉
+ *
+ *          每個函數定義完時也會先記下它的副作用（函數只能呼叫已經定義過的函數，所以那時候就能決定），
+ *          讓 memoization 等最佳化可以判斷呼叫的函數有沒有副作用
+ */
+
+// 副作用（可以 | 起來）
+#define EFFECT_READ_GLOBAL  1u  // getstatic
+#define EFFECT_WRITE_GLOBAL 2u  // putstatic
+#define EFFECT_IO           4u  // print, read
+#define EFFECT_UNKNOWN      8u  // 呼叫了不認得的函數
+
+/**
+ * 是否刪除從 main 無法呼叫到的函數（--no-unused-function-elim 可關閉），預設為 true
+ */
+extern bool Enable_Unused_Function_Elim;
+
+/**
+ * 是否輸出 call graph 的報告（--call-graph），預設為 false
+ */
+extern bool Print_Call_Graph;
+
+/**
+ * 函數 name 定義結束時呼叫，body 是 `{` 和 `}` 之間的 JASM，記下它（和它呼叫的函數）的副作用
+ */
+void registerFunctionEffects(const char* name, const char* body);
+
+/**
+ * 已經定義的函數 name 的副作用（EFFECT_XXX），沒有定義過回傳 EFFECT_UNKNOWN
+ */
+unsigned getFunctionEffects(const char* name);
+
+/**
+ * classBody 是 class 的 `{` 和 `}` 之間所有的 JASM code，建出 call graph 並刪掉無法呼叫到的函數，回傳處理後的 code（呼叫者負責 free）
+ * report 不為 NULL 時輸出 call graph 的報告
+ */
+char* analyzeCallGraph(const char* classBody, FILE* report);
@@ -0,0 +1,704 @@
+#include "cfg.h"
+#include <stdlib.h>
+#include <string.h>
+
+FILE* Cfg_Dot_File = NULL;
+bool Enable_Block_Layout = true;
+
+// jump threading 最多跟著幾個 goto 走（避免 goto 形成的環）
+#define THREAD_MAX_HOPS 16
+
+// Opcode Helper //////////////////////////////////////////////////////////////////////////////////
+
+static bool isConditionalBranch(const JasmLine_t* line)
+{
+    return line->opcode && strncmp(line->opcode, "if", 2) == 0;
+}
+
+static bool isBranch(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "goto") || isConditionalBranch(line);
+}
+
+static bool isSwitch(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "tableswitch") || isJasmOpcode(line, "lookupswitch");
+}
+
+// 執行完這個指令後不會執行下一行（goto, athrow, return, ireturn, ...）
+static bool isUnconditionalJump(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    size_t len = strlen(line->opcode);
+    return isJasmOpcode(line, "goto") || isJasmOpcode(line, "athrow") || (len >= 6 && strcmp(line->opcode + len - 6, "return") == 0);
+}
+
+// 目前無法分析的控制流程
+static bool isUnsupportedJump(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "jsr") || isJasmOpcode(line, "ret");
+}
+
+/**
+ * 標出 tableswitch / lookupswitch 之後的跳躍表（每個 case 一行 `<label>` 或 `<值> : <label>`，最後一行是 `default: <label>`），
+ * 它們屬於 switch 指令，不是指令也不是 label 的定義；跳躍表的格式不對時回傳 NULL
+ */
+static bool* markSwitchTables(const JasmLine_t* lines, unsigned lineNum)
+{
+    bool* isSwitchTable = calloc(lineNum + 1, sizeof(bool));
+
+    for (unsigned i = 0; i < lineNum; ++i) {
+        if (!isSwitch(&lines[i]))
+            continue;
+
+        unsigned j = i + 1;
+        for (; j < lineNum && lines[j].label == NULL && getJasmSwitchTarget(&lines[j]); ++j)
+            isSwitchTable[j] = true;
+
+        if (j >= lineNum || lines[j].label == NULL || strcmp(lines[j].label, "default") != 0 || lines[j].opcode == NULL) {
+            free(isSwitchTable);
+            return NULL;
+        }
+        isSwitchTable[j] = true;
+        i = j;
+    }
+    return isSwitchTable;
+}
+
+static void removeInstruction(JasmLine_t* line)
+{
+    setJasmInstruction(line, NULL, NULL);
+}
+
+// 從 lines[line] 開始（包含自己）第一個不是 nop 的指令，沒有則回傳 lineNum
+static unsigned firstInstruction(const JasmLine_t* lines, unsigned lineNum, unsigned line)
+{
+    while (line < lineNum && (lines[line].opcode == NULL || isJasmOpcode(&lines[line], "nop")))
+        ++line;
+    return line;
+}
+
+// 執行完 lines[line] 之後，跳到 label 和繼續往下執行是否相同（label 在 line 和下一個不是 nop 的指令之間）
+static bool isLabelNext(const JasmLine_t* lines, unsigned lineNum, unsigned line, const char* label)
+{
+    const unsigned next = firstInstruction(lines, lineNum, line + 1);
+    for (unsigned i = line + 1; i <= next && i < lineNum; ++i)
+        if (lines[i].label && strcmp(lines[i].label, label) == 0)
+            return true;
+    return false;
+}
+
+// CFG ////////////////////////////////////////////////////////////////////////////////////////////
+
+// 執行完 lines[line] 之後要開始新的 block：跳躍、return，以及 switch 跳躍表的最後一行（switch 指令本身還沒結束）
+static bool isBlockEnd(const JasmLine_t* lines, const bool* isSwitchTable, unsigned line)
+{
+    if (isSwitchTable[line])
+        return lines[line].label != NULL;
+    return isBranch(&lines[line]) || isUnconditionalJump(&lines[line]);
+}
+
+// block b 的最後一個指令（不含 switch 的跳躍表），沒有則回傳 -1
+static int lastInstruction(const Cfg_t* cfg, unsigned b)
+{
+    for (int i = (int)cfg->blocks[b].end - 1; i >= (int)cfg->blocks[b].begin; --i)
+        if (cfg->lines[i].opcode && !cfg->isSwitchTable[i])
+            return i;
+    return -1;
+}
+
+// block b 執行完是否會繼續執行下一個 block
+static bool isFallThrough(const Cfg_t* cfg, unsigned b)
+{
+    int last = lastInstruction(cfg, b);
+    return last < 0 || !(isUnconditionalJump(&cfg->lines[last]) || isSwitch(&cfg->lines[last]));
+}
+
+static void addEdge(Cfg_t* cfg, int from, int to)
+{
+    BasicBlock_t* A = &cfg->blocks[from];
+    for (unsigned i = 0; i < A->succNum; ++i)
+        if (A->succs[i] == to)
+            return;
+
+    A->succs = realloc(A->succs, (A->succNum + 1) * sizeof(int));
+    A->succs[A->succNum++] = to;
+
+    BasicBlock_t* B = &cfg->blocks[to];
+    B->preds = realloc(B->preds, (B->predNum + 1) * sizeof(int));
+    B->preds[B->predNum++] = from;
+}
+
+// 加上 from 到 label 所在的 block 的 edge，找不到 label 時回傳 false
+static bool addJumpEdge(Cfg_t* cfg, int from, const char* label)
+{
+    const int target = label ? findJasmLabel(cfg->labels, label) : -1;
+    if (target < 0)
+        return false;
+
+    addEdge(cfg, from, cfg->blockOf[target]);
+    return true;
+}
+
+// 從 block 開始 DFS，依照 postorder 存進 order
+static void postorder(Cfg_t* cfg, int block, int* order, unsigned* orderNum)
+{
+    cfg->blocks[block].isReachable = true;
+    for (unsigned i = 0; i < cfg->blocks[block].succNum; ++i)
+        if (!cfg->blocks[cfg->blocks[block].succs[i]].isReachable)
+            postorder(cfg, cfg->blocks[block].succs[i], order, orderNum);
+    order[(*orderNum)++] = block;
+}
+
+static void computeDominators(Cfg_t* cfg)
+{
+    int* order = malloc((cfg->blockNum + 1) * sizeof(int));
+    int* number = malloc((cfg->blockNum + 1) * sizeof(int));  // postorder 的編號
+    unsigned orderNum = 0;
+    postorder(cfg, 0, order, &orderNum);
+    for (unsigned i = 0; i < orderNum; ++i)
+        number[order[i]] = i;
+
+    for (unsigned b = 0; b < cfg->blockNum; ++b)
+        cfg->blocks[b].idom = -1;
+    cfg->blocks[0].idom = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        // reverse postorder，跳過 entry
+        for (int k = (int)orderNum - 2; k >= 0; --k) {
+            BasicBlock_t* B = &cfg->blocks[order[k]];
+            int newIdom = -1;
+
+            for (unsigned p = 0; p < B->predNum; ++p) {
+                int pred = B->preds[p];
+                if (!cfg->blocks[pred].isReachable || cfg->blocks[pred].idom < 0)
+                    continue;
+                if (newIdom < 0) {
+                    newIdom = pred;
+                    continue;
+                }
+
+                // intersect：兩邊沿著 dominator tree 往上走到同一個 block
+                int X = pred, Y = newIdom;
+                while (X != Y) {
+                    while (number[X] < number[Y]) X = cfg->blocks[X].idom;
+                    while (number[Y] < number[X]) Y = cfg->blocks[Y].idom;
+                }
+                newIdom = X;
+            }
+
+            if (B->idom != newIdom) {
+                B->idom = newIdom;
+                changed = true;
+            }
+        }
+    }
+
+    cfg->blocks[0].idom = -1;
+    free(order);
+    free(number);
+}
+
+static void computeLoops(Cfg_t* cfg)
+{
+    const unsigned N = cfg->blockNum;
+    bool* inLoop = malloc((N + 1) * sizeof(bool));
+    unsigned* loopSize = calloc(N + 1, sizeof(unsigned));  // 目前 loopHeader 的迴圈大小
+    int* stack = malloc((N + 1) * sizeof(int));
+
+    for (unsigned b = 0; b < N; ++b)
+        cfg->blocks[b].loopHeader = -1;
+
+    // 每個 header 的 natural loop（所有指向它的 back edge 合併）
+    for (unsigned h = 0; h < N; ++h) {
+        memset(inLoop, 0, (N + 1) * sizeof(bool));
+        unsigned stackSize = 0, size = 0;
+        bool isHeader = false;
+
+        // 從 back edge 的起點往回走，不經過 header
+        inLoop[h] = true;
+        for (unsigned p = 0; p < cfg->blocks[h].predNum; ++p) {
+            int A = cfg->blocks[h].preds[p];
+            if (!cfg->blocks[A].isReachable || !isDominator(cfg, h, A))
+                continue;
+
+            isHeader = true;
+            if (!inLoop[A]) {
+                inLoop[A] = true;
+                stack[stackSize++] = A;
+            }
+        }
+        if (!isHeader)
+            continue;
+
+        while (stackSize > 0) {
+            int B = stack[--stackSize];
+            for (unsigned p = 0; p < cfg->blocks[B].predNum; ++p) {
+                int pred = cfg->blocks[B].preds[p];
+                if (cfg->blocks[pred].isReachable && !inLoop[pred]) {
+                    inLoop[pred] = true;
+                    stack[stackSize++] = pred;
+                }
+            }
+        }
+
+        for (unsigned b = 0; b < N; ++b)
+            size += inLoop[b];
+
+        for (unsigned b = 0; b < N; ++b) {
+            if (!inLoop[b])
+                continue;
+            ++cfg->blocks[b].loopDepth;
+            if (cfg->blocks[b].loopHeader < 0 || size < loopSize[b]) {
+                cfg->blocks[b].loopHeader = h;
+                loopSize[b] = size;
+            }
+        }
+    }
+
+    free(inLoop);
+    free(loopSize);
+    free(stack);
+}
+
+Cfg_t* buildCfg(const char* body)
+{
+    Cfg_t* cfg = calloc(1, sizeof(Cfg_t));
+    cfg->lines = parseJasmLines(body, &cfg->lineNum);
+    cfg->blockOf = malloc((cfg->lineNum + 1) * sizeof(int));
+    cfg->labels = indexJasmLabels(cfg->lines, cfg->lineNum);
+    cfg->isSwitchTable = markSwitchTables(cfg->lines, cfg->lineNum);
+    if (cfg->isSwitchTable == NULL) {
+        freeCfg(cfg);
+        return NULL;
+    }
+
+    // 切成 basic block（switch 的跳躍表和 switch 在同一個 block）
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        const JasmLine_t* line = &cfg->lines[i];
+        if (!cfg->isSwitchTable[i] && isUnsupportedJump(line)) {
+            freeCfg(cfg);
+            return NULL;
+        }
+
+        const bool isLeader = i == 0 || (line->label && !cfg->isSwitchTable[i]) || isBlockEnd(cfg->lines, cfg->isSwitchTable, i - 1);
+        if (isLeader) {
+            cfg->blocks = realloc(cfg->blocks, (cfg->blockNum + 1) * sizeof(BasicBlock_t));
+            memset(&cfg->blocks[cfg->blockNum], 0, sizeof(BasicBlock_t));
+            cfg->blocks[cfg->blockNum].begin = i;
+            ++cfg->blockNum;
+        }
+        cfg->blocks[cfg->blockNum - 1].end = i + 1;
+        cfg->blockOf[i] = cfg->blockNum - 1;
+    }
+
+    // 空的 body 也有一個 entry block
+    if (cfg->blockNum == 0) {
+        cfg->blocks = calloc(1, sizeof(BasicBlock_t));
+        cfg->blockNum = 1;
+    }
+
+    // edge：跳躍的目標（switch 是跳躍表的每一行），以及 fall-through
+    for (unsigned b = 0; b < cfg->blockNum; ++b) {
+        const BasicBlock_t* B = &cfg->blocks[b];
+        const int last = lastInstruction(cfg, b);
+        bool isValid = true;
+
+        if (last >= 0 && isBranch(&cfg->lines[last]))
+            isValid = addJumpEdge(cfg, b, cfg->lines[last].operand);
+        else if (last >= 0 && isSwitch(&cfg->lines[last]))
+            for (unsigned i = last + 1; isValid && i < B->end; ++i)
+                isValid = addJumpEdge(cfg, b, getJasmSwitchTarget(&cfg->lines[i]));
+
+        if (!isValid) {
+            freeCfg(cfg);
+            return NULL;
+        }
+        if (isFallThrough(cfg, b) && b + 1 < cfg->blockNum)
+            addEdge(cfg, b, b + 1);
+    }
+
+    computeDominators(cfg);
+    computeLoops(cfg);
+    return cfg;
+}
+
+bool isDominator(const Cfg_t* cfg, int A, int B)
+{
+    if (!cfg->blocks[B].isReachable)
+        return false;
+
+    for (; B >= 0; B = cfg->blocks[B].idom)
+        if (B == A)
+            return true;
+    return false;
+}
+
+void freeCfg(Cfg_t* cfg)
+{
+    for (unsigned b = 0; b < cfg->blockNum; ++b) {
+        free(cfg->blocks[b].succs);
+        free(cfg->blocks[b].preds);
+    }
+    free(cfg->blocks);
+    free(cfg->blockOf);
+    free(cfg->isSwitchTable);
+    freeJasmLabelIndex(cfg->labels);
+    freeJasmLines(cfg->lines, cfg->lineNum);
+    free(cfg);
+}
+
+// Graphviz ///////////////////////////////////////////////////////////////////////////////////////
+
+// 輸出 Graphviz 字串的內容（跳脫 " 和 \）
+static void printDotEscaped(FILE* file, const char* text)
+{
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', file);
+        fputc(*text, file);
+    }
+}
+
+void dumpCfgDot(FILE* file, const char* name, const char* body)
+{
+    Cfg_t* cfg = buildCfg(body);
+
+    fprintf(file, "  subgraph \"cluster_%s\" {\n", name);
+    fprintf(file, "    label = \"%s\";\n", name);
+
+    if (cfg == NULL) {
+        fprintf(file, "    \"%s\" [label = \"(CFG not supported)\"];\n  }\n", name);
+        return;
+    }
+
+    for (unsigned b = 0; b < cfg->blockNum; ++b) {
+        const BasicBlock_t* B = &cfg->blocks[b];
+
+        fprintf(file, "    \"%s.B%u\" [shape = box, fontname = monospace%s, label = \"B%u", name, b, B->isReachable ? "" : ", color = gray, fontcolor = gray", b);
+        if (B->idom >= 0)
+            fprintf(file, "  idom = B%d", B->idom);
+        if (B->loopDepth > 0)
+            fprintf(file, "  loop = B%d (depth %u)", B->loopHeader, B->loopDepth);
+        fprintf(file, "\\l");
+
+        for (unsigned i = B->begin; i < B->end; ++i) {
+            const JasmLine_t* line = &cfg->lines[i];
+            if (line->label) {
+                printDotEscaped(file, line->label);
+                fputc(':', file);
+            }
+            if (line->opcode) {
+                fprintf(file, "  ");
+                printDotEscaped(file, line->opcode);
+                if (*line->operand) {
+                    fputc(' ', file);
+                    printDotEscaped(file, line->operand);
+                }
+            }
+            if (line->label || line->opcode)
+                fprintf(file, "\\l");
+        }
+        fprintf(file, "\"];\n");
+
+        for (unsigned s = 0; s < B->succNum; ++s) {
+            const int to = B->succs[s];
+            const bool isBackEdge = B->isReachable && isDominator(cfg, to, b);
+            fprintf(file, "    \"%s.B%u\" -> \"%s.B%d\"%s;\n", name, b, name, to, isBackEdge ? " [color = red, penwidth = 2]" : "");
+        }
+    }
+
+    fprintf(file, "  }\n");
+    freeCfg(cfg);
+}
+
+// Block Layout ///////////////////////////////////////////////////////////////////////////////////
+
+// 跳到 `goto B` 的跳躍直接跳到 B；跳到 return 的 goto 換成 return
+static bool threadJumps(Cfg_t* cfg)
+{
+    JasmLine_t* lines = cfg->lines;
+    bool changed = false;
+
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (!isBranch(line) || cfg->isSwitchTable[i])
+            continue;
+
+        char* target = strdup(line->operand);
+        for (unsigned hop = 0; hop < THREAD_MAX_HOPS; ++hop) {
+            int labelLine = findJasmLabel(cfg->labels, target);
+            unsigned next = labelLine < 0 ? cfg->lineNum : firstInstruction(lines, cfg->lineNum, labelLine);
+            if (next >= cfg->lineNum || !isJasmOpcode(&lines[next], "goto") || strcmp(lines[next].operand, target) == 0)
+                break;
+            free(target);
+            target = strdup(lines[next].operand);
+        }
+
+        if (strcmp(target, line->operand) != 0) {
+            char* opcode = strdup(line->opcode);
+            setJasmInstruction(line, opcode, target);
+            free(opcode);
+            changed = true;
+        }
+        free(target);
+
+        if (isJasmOpcode(line, "goto")) {
+            int labelLine = findJasmLabel(cfg->labels, line->operand);
+            unsigned next = firstInstruction(lines, cfg->lineNum, labelLine);
+            if (next < cfg->lineNum && isJasmOpcode(&lines[next], "return")) {
+                setJasmInstruction(line, "return", NULL);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+// 條件相反的 conditional jump，不能反轉時回傳 NULL
+static const char* invertedBranch(const char* opcode)
+{
+    static const char* pairs[][2] = {
+        { "ifeq", "ifne" }, { "iflt", "ifge" }, { "ifgt", "ifle" },
+        { "if_icmpeq", "if_icmpne" }, { "if_icmplt", "if_icmpge" }, { "if_icmpgt", "if_icmple" },
+        { "if_acmpeq", "if_acmpne" }, { "ifnull", "ifnonnull" },
+    };
+
+    for (unsigned i = 0; i < sizeof(pairs) / sizeof(pairs[0]); ++i) {
+        if (strcmp(opcode, pairs[i][0]) == 0) return pairs[i][1];
+        if (strcmp(opcode, pairs[i][1]) == 0) return pairs[i][0];
+    }
+    return NULL;
+}
+
+// `ifXX A; goto B; A:` -> `ifNotXX B; A:`
+static bool invertBranches(Cfg_t* cfg)
+{
+    JasmLine_t* lines = cfg->lines;
+    bool changed = false;
+
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        const char* inverted = isConditionalBranch(line) && !cfg->isSwitchTable[i] ? invertedBranch(line->opcode) : NULL;
+        if (inverted == NULL)
+            continue;
+
+        int next = nextJasmInstruction(lines, cfg->lineNum, i);
+        if (next < 0 || !isJasmOpcode(&lines[next], "goto") || !isLabelNext(lines, cfg->lineNum, next, line->operand))
+            continue;
+
+        char* target = strdup(lines[next].operand);
+        setJasmInstruction(line, inverted, target);
+        removeInstruction(&lines[next]);
+        free(target);
+        changed = true;
+    }
+    return changed;
+}
+
+// 跳到下一個指令的 goto 刪掉，ifXX 換成 pop 掉比較的值
+static bool removeRedundantJumps(Cfg_t* cfg)
+{
+    JasmLine_t* lines = cfg->lines;
+    bool changed = false;
+
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (!isBranch(line) || cfg->isSwitchTable[i] || !isLabelNext(lines, cfg->lineNum, i, line->operand))
+            continue;
+
+        if (isJasmOpcode(line, "goto"))
+            removeInstruction(line);
+        else if (strncmp(line->opcode, "if_", 3) == 0)
+            setJasmInstruction(line, "pop2", NULL);
+        else
+            setJasmInstruction(line, "pop", NULL);
+        changed = true;
+    }
+    return changed;
+}
+
+static bool removeUnreachableBlocks(Cfg_t* cfg)
+{
+    bool changed = false;
+
+    for (unsigned b = 0; b < cfg->blockNum; ++b) {
+        if (cfg->blocks[b].isReachable)
+            continue;
+
+        for (unsigned i = cfg->blocks[b].begin; i < cfg->blocks[b].end; ++i) {
+            JasmLine_t* line = &cfg->lines[i];
+
+            // switch 的跳躍表整行刪掉（包含 `default:`）
+            if (cfg->isSwitchTable[i]) {
+                removeInstruction(line);
+                free(line->label);
+                line->label = NULL;
+                changed = true;
+            }
+            else if (line->opcode) {
+                removeInstruction(line);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+/**
+ * 以 fall-through 串起來的 block 為一組（chain），從 entry 所在的那組開始排列：
+ * 一組結尾是 `goto L`，而 L 是還沒排列的另一組的開頭時，接著排那一組並刪掉 goto；否則依照原本的順序選下一組
+ * 回傳新的 code，沒有可以刪掉的 goto 時回傳 NULL
+ */
+static char* placeChains(Cfg_t* cfg)
+{
+    const unsigned N = cfg->blockNum;
+    int* chainEnd = malloc((N + 1) * sizeof(int));   // chain 開頭 -> 結尾的 block，不是開頭為 -1
+    int* order = malloc((N + 1) * sizeof(int));      // 排列後的 chain 開頭
+    bool* isPlaced = calloc(N + 1, sizeof(bool));
+    unsigned orderNum = 0, removed = 0;
+
+    for (unsigned b = 0; b < N; ++b)
+        chainEnd[b] = -1;
+    for (unsigned b = 0; b < N; ) {
+        unsigned e = b;
+        while (e + 1 < N && isFallThrough(cfg, e))
+            ++e;
+        chainEnd[b] = e;
+        b = e + 1;
+    }
+
+    // 最後一組的結尾可能會直接執行到 body 的結尾（例如只剩 label），必須留在最後
+    int lastChain = N - 1;
+    while (chainEnd[lastChain] < 0)
+        --lastChain;
+    const bool isLastOpen = isFallThrough(cfg, N - 1);
+
+    int current = 0;
+    while (current >= 0) {
+        order[orderNum++] = current;
+        isPlaced[current] = true;
+
+        int next = -1;
+        int last = lastInstruction(cfg, chainEnd[current]);
+        if (last >= 0 && isJasmOpcode(&cfg->lines[last], "goto")) {
+            int target = cfg->blockOf[findJasmLabel(cfg->labels, cfg->lines[last].operand)];
+            if (chainEnd[target] >= 0 && !isPlaced[target] && !(isLastOpen && target == lastChain)) {
+                removeInstruction(&cfg->lines[last]);
+                ++removed;
+                next = target;
+            }
+        }
+
+        for (unsigned b = 0; next < 0 && b < N; ++b)
+            if (chainEnd[b] >= 0 && !isPlaced[b] && !(isLastOpen && (int)b == lastChain))
+                next = b;
+        if (next < 0 && isLastOpen && !isPlaced[lastChain])
+            next = lastChain;
+        current = next;
+    }
+
+    char* result = NULL;
+    if (removed > 0) {
+        size_t size = 0;
+        FILE* file = open_memstream(&result, &size);
+        for (unsigned k = 0; k < orderNum; ++k) {
+            const unsigned begin = cfg->blocks[order[k]].begin, end = cfg->blocks[chainEnd[order[k]]].end;
+            char* code = joinJasmLines(&cfg->lines[begin], end - begin);
+            fputs(code, file);
+            free(code);
+        }
+        fclose(file);
+    }
+
+    free(chainEnd);
+    free(order);
+    free(isPlaced);
+    return result;
+}
+
+// 是否有跳躍指令或 switch 的跳躍表跳到 label
+static bool isLabelUsed(const JasmLine_t* lines, unsigned lineNum, const bool* isSwitchTable, const char* label)
+{
+    for (unsigned i = 0; i < lineNum; ++i) {
+        const char* target = isSwitchTable[i] ? getJasmSwitchTarget(&lines[i]) : isBranch(&lines[i]) ? lines[i].operand : NULL;
+        if (target && strcmp(target, label) == 0)
+            return true;
+    }
+    return false;
+}
+
+// 刪掉沒有被跳到的 label 和 nop（後面還有其他指令時，label 會直接標在下一個指令上）
+static void removeTrivialBlocks(JasmLine_t* lines, unsigned lineNum)
+{
+    bool* isSwitchTable = markSwitchTables(lines, lineNum);
+    if (isSwitchTable == NULL)
+        return;
+
+    int lastLine = -1;
+    for (unsigned i = 0; i < lineNum; ++i)
+        if (lines[i].opcode && !isJasmOpcode(&lines[i], "nop"))
+            lastLine = i;
+
+    for (unsigned i = 0; i < lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (isSwitchTable[i])
+            continue;
+
+        if (line->label && !isLabelUsed(lines, lineNum, isSwitchTable, line->label)) {
+            free(line->label);
+            line->label = NULL;
+
+            // 只有 label 的行整行刪掉
+            if (line->text && *line->text == '\0') {
+                free(line->text);
+                line->text = NULL;
+            }
+        }
+        if (isJasmOpcode(line, "nop") && ((int)i < lastLine || line->label == NULL))
+            removeInstruction(line);
+    }
+    free(isSwitchTable);
+}
+
+char* layoutBlocks(const char* body)
+{
+    char* code = strdup(body);
+
+    for (bool changed = true; changed; ) {
+        Cfg_t* cfg = buildCfg(code);
+        if (cfg == NULL)
+            return code;
+
+        changed = threadJumps(cfg);
+        changed = invertBranches(cfg) || changed;
+        changed = removeRedundantJumps(cfg) || changed;
+        // Note: 上面的規則不會讓原本走不到的 block 變成走得到，所以 cfg 的 isReachable 仍然可以用
+        changed = removeUnreachableBlocks(cfg) || changed;
+
+        free(code);
+        code = joinJasmLines(cfg->lines, cfg->lineNum);
+        freeCfg(cfg);
+    }
+
+    Cfg_t* cfg = buildCfg(code);
+    char* placed = placeChains(cfg);
+    freeCfg(cfg);
+    if (placed) {
+        free(code);
+        code = placed;
+    }
+
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(code, &lineNum);
+    removeTrivialBlocks(lines, lineNum);
+    free(code);
+    code = joinJasmLines(lines, lineNum);
+    freeJasmLines(lines, lineNum);
+    return code;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+#include "jasmCode.h"
+
+/**
+ * 函數本體的 control-flow graph
+ *
+ * @details 把函數本體的 JASM 切成 basic block（有 label 的行、跳躍和 return 的下一行開始新的 block），
+ *          依照 fall-through、goto、ifXX、tableswitch / lookupswitch（跳躍表的每個 case 和 default）建出 edge，再算出：
+ *          - dominator tree（Cooper, Harvey, Kennedy 的 iterative algorithm，依照 reverse postorder 更新到不再改變）
+ *          - 迴圈：A -> H 且 H dominate A 的 back edge，H 為 header，能不經過 H 走到 A 的 block 都在迴圈中（natural loop）；
+ *                  同一個 header 的迴圈合併，每個 block 記錄所在最內層迴圈的 header 和巢狀的層數
+ *          Note: switch 的跳躍表和 switch 在同一個 block 的結尾；目前不處理 jsr, ret
+ */
+
+typedef struct BasicBlock_t {
+    unsigned begin, end;    // lines[begin, end)
+    int* succs;             // 後繼的 block
+    unsigned succNum;
+    int* preds;             // 前驅的 block
+    unsigned predNum;
+    bool isReachable;       // 從 entry（block 0）是否走得到
+    int idom;               // immediate dominator，entry 和走不到的 block 為 -1
+    int loopHeader;         // 所在最內層迴圈的 header（header 自己也算在迴圈中），不在迴圈中為 -1
+    unsigned loopDepth;     // 迴圈巢狀的層數
+} BasicBlock_t;
+
+typedef struct Cfg_t {
+    JasmLine_t* lines;
+    unsigned lineNum;
+    BasicBlock_t* blocks;
+    unsigned blockNum;
+    int* blockOf;               // 每一行所屬的 block
+    bool* isSwitchTable;        // 每一行是否為 tableswitch / lookupswitch 之後的跳躍表（不是指令，也不是 label 的定義）
+    JasmLabelIndex_t* labels;   // 建 CFG 時 lines 中的 label
+} Cfg_t;
+
+/**
+ * 建出 body（一個函數 `{` 和 `}` 之間的 JASM）的 CFG，用 freeCfg 䆁放；有無法分析的控制流程（例如找不到跳躍的目標）時回傳 NULL
+ * @note lines 可以修改（例如再用 joinJasmLines 組回 code），但 block 的資訊不會跟著更新
+ */
+Cfg_t* buildCfg(const char* body);
+
+/**
+ * block A 是否 dominate block B（從 entry 到 B 一定會經過 A，A dominate 自己）
+ */
+bool isDominator(const Cfg_t* cfg, int A, int B);
+
+/**
+ * 䆁放 buildCfg 的結果
+ */
+void freeCfg(Cfg_t* cfg);
+
+// Graphviz ///////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * --dump-cfg 時輸出 Graphviz 的檔案（<class 名稱>.dot），否則為 NULL
+ */
+extern FILE* Cfg_Dot_File;
+
+/**
+ * 把函數 name 的 CFG 輸出成 Graphviz 的 subgraph（cluster）：每個 block 列出指令、迴圈層數和 immediate dominator，
+ * back edge 為紅色，走不到的 block 為灰色
+ */
+void dumpCfgDot(FILE* file, const char* name, const char* body);
+
+// Block Layout ///////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * 是否整理 basic block 的排列（--no-block-layout 可關閉），預設為 true
+ */
+extern bool Enable_Block_Layout;
+
+/**
+ * 依照 CFG 整理 body 的跳躍，回傳新的 body（呼叫者負責 free）
+ *
+ * @details 反覆套用以下規則，直到沒有變化：
+ *          - 跳到 `goto B` 的跳躍直接跳到 B（jump threading），跳到 `return` 的 goto 直接換成 return
+ *          - `ifXX A; goto B; A:` -> `ifNotXX B`，fall-through 留給原本的 A
+ *          - 跳到下一個指令的 goto 刪掉（ifXX 換成 pop 掉比較的值）
+ *          - 走不到的 block 刪掉
+ *          接著把 block 重新排列：以 fall-through 串起來的 block 為一組，一組結尾 `goto L` 而 L 是另一組的開頭時，
+ *          把那一組接在後面並刪掉 goto（迴圈的 back edge 本來就是 conditional jump，不受影響）；
+ *          最後刪掉只剩 nop 的 block（合併進下一個 block）和沒有被跳到的 label
+ */
+char* layoutBlocks(const char* body);
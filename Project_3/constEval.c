@@ -0,0 +1,460 @@
+#include "constEval.h"
+#include "jasmCode.h"
+#include "parallelCodegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+bool Enable_Const_Eval = true;
+
+// Function ///////////////////////////////////////////////////////////////////////////////////////
+
+typedef enum Opcode_t {
+    opUnknown = 0,
+    opLdc, opIconst, opBipush,
+    opIload, opFload, opDload, opIstore, opFstore, opDstore, opIinc,
+    opIadd, opIsub, opImul, opIdiv, opIrem, opIneg, opIshl, opIshr, opIushr, opIand, opIor, opIxor,
+    opFadd, opFsub, opFmul, opFdiv, opFneg,
+    opDadd, opDsub, opDmul, opDdiv, opDneg,
+    opFcmpg, opFcmpl, opDcmpg, opDcmpl,
+    opIfeq, opIfne, opIflt, opIfge, opIfgt, opIfle,
+    opIfIcmpeq, opIfIcmpne, opIfIcmplt, opIfIcmpge, opIfIcmpgt, opIfIcmple,
+    opGoto, opDup, opDup2, opPop, opPop2, opSwap, opNop,
+    opInvokestatic, opReturn, opIreturn, opFreturn, opDreturn
+} Opcode_t;
+
+static const struct { const char* name; Opcode_t op; } Opcode_Table[] = {
+    { "ldc", opLdc }, { "bipush", opBipush }, { "sipush", opBipush },
+    { "iload", opIload }, { "fload", opFload }, { "dload", opDload },
+    { "istore", opIstore }, { "fstore", opFstore }, { "dstore", opDstore }, { "iinc", opIinc },
+    { "iadd", opIadd }, { "isub", opIsub }, { "imul", opImul }, { "idiv", opIdiv }, { "irem", opIrem }, { "ineg", opIneg },
+    { "ishl", opIshl }, { "ishr", opIshr }, { "iushr", opIushr }, { "iand", opIand }, { "ior", opIor }, { "ixor", opIxor },
+    { "fadd", opFadd }, { "fsub", opFsub }, { "fmul", opFmul }, { "fdiv", opFdiv }, { "fneg", opFneg },
+    { "dadd", opDadd }, { "dsub", opDsub }, { "dmul", opDmul }, { "ddiv", opDdiv }, { "dneg", opDneg },
+    { "fcmpg", opFcmpg }, { "fcmpl", opFcmpl }, { "dcmpg", opDcmpg }, { "dcmpl", opDcmpl },
+    { "ifeq", opIfeq }, { "ifne", opIfne }, { "iflt", opIflt }, { "ifge", opIfge }, { "ifgt", opIfgt }, { "ifle", opIfle },
+    { "if_icmpeq", opIfIcmpeq }, { "if_icmpne", opIfIcmpne }, { "if_icmplt", opIfIcmplt },
+    { "if_icmpge", opIfIcmpge }, { "if_icmpgt", opIfIcmpgt }, { "if_icmple", opIfIcmple },
+    { "goto", opGoto }, { "dup", opDup }, { "dup2", opDup2 }, { "pop", opPop }, { "pop2", opPop2 }, { "swap", opSwap },
+    { "nop", opNop }, { "invokestatic", opInvokestatic },
+    { "return", opReturn }, { "ireturn", opIreturn }, { "freturn", opFreturn }, { "dreturn", opDreturn },
+};
+
+// 一個 JVM 的值（double 在 stack 上只佔一格，用 kind 區分 dup2, pop2 的行為）
+typedef struct Value_t {
+    char kind;  // 'i', 'f', 'd'
+    union {
+        int i;
+        float f;
+        double d;
+    };
+} Value_t;
+
+typedef struct Instruction_t {
+    Opcode_t op;
+    Value_t constant;   // ldc, iconst_N, bipush 的值
+    int index;          // load, store, iinc 的區域變數 index；跳躍的目標（第幾個指令）
+    int delta;          // iinc 的增量
+    char* callee;       // invokestatic 的函數名稱
+    char* paramTypes;   // invokestatic 每個參數的型別（'i', 'f', 'd'）
+} Instruction_t;
+
+typedef struct ConstFunction_t {
+    char* name;
+    Instruction_t* code;
+    unsigned codeNum;
+    unsigned localNum;
+    struct ConstFunction_t* next;
+} ConstFunction_t;
+
+static ConstFunction_t* Functions = NULL;
+
+static ConstFunction_t* findFunction(const char* name)
+{
+    for (ConstFunction_t* F = Functions; F; F = F->next)
+        if (strcmp(F->name, name) == 0)
+            return F;
+    return NULL;
+}
+
+// 解析 ldc 的常數，字串或無法解析時回傳 false
+static bool parseConstant(const char* operand, Value_t* value)
+{
+    char* end = NULL;
+    size_t len = strlen(operand);
+
+    if (len == 0 || *operand == '"')
+        return false;
+
+    long i = strtol(operand, &end, 10);
+    if (*end == '\0') {
+        if (i < INT_MIN || i > INT_MAX)
+            return false;
+        value->kind = 'i';
+        value->i = (int)i;
+        return true;
+    }
+
+    if (operand[len - 1] == 'f') {
+        value->kind = 'f';
+        value->f = strtof(operand, &end);
+        return end == operand + len - 1;
+    }
+
+    value->kind = 'd';
+    value->d = strtod(operand, &end);
+    return *end == '\0';
+}
+
+// 解析 invokestatic 的參數型別，回傳由 'i', 'f', 'd' 組成的字串（呼叫者負責 free）
+static char* parseParameterTypes(const char* paren)
+{
+    char* types = calloc(strlen(paren) + 1, sizeof(char));
+    unsigned num = 0;
+
+    for (const char* p = paren + 1; *p && *p != ')'; ) {
+        while (*p == ' ' || *p == ',')
+            ++p;
+        if (*p == ')' || *p == '\0')
+            break;
+
+        types[num++] = strncmp(p, "double", 6) == 0 ? 'd' : strncmp(p, "float", 5) == 0 ? 'f' : 'i';
+        while (*p && *p != ',' && *p != ')')
+            ++p;
+    }
+    return types;
+}
+
+// 把一行 JASM 轉成 Instruction_t，lineToCode[i] 為第 i 行（之後的第一個指令）是第幾個指令
+static Instruction_t decodeLine(const JasmLine_t* line, const JasmLine_t* lines, unsigned lineNum, const int* lineToCode)
+{
+    Instruction_t I = { opUnknown };
+
+    if (strncmp(line->opcode, "iconst_", 7) == 0) {
+        I.op = opIconst;
+        I.constant.kind = 'i';
+        I.constant.i = strcmp(line->opcode + 7, "m1") == 0 ? -1 : atoi(line->opcode + 7);
+        return I;
+    }
+
+    for (unsigned i = 0; i < sizeof(Opcode_Table) / sizeof(Opcode_Table[0]); ++i)
+        if (strcmp(line->opcode, Opcode_Table[i].name) == 0)
+            I.op = Opcode_Table[i].op;
+
+    switch (I.op) {
+    case opLdc:
+        if (!parseConstant(line->operand, &I.constant))
+            I.op = opUnknown;
+        break;
+    case opBipush:
+        I.constant.kind = 'i';
+        I.constant.i = atoi(line->operand);
+        break;
+    case opIload: case opFload: case opDload: case opIstore: case opFstore: case opDstore:
+        I.index = atoi(line->operand);
+        break;
+    case opIinc:
+        sscanf(line->operand, "%d %d", &I.index, &I.delta);
+        break;
+    case opIfeq: case opIfne: case opIflt: case opIfge: case opIfgt: case opIfle:
+    case opIfIcmpeq: case opIfIcmpne: case opIfIcmplt: case opIfIcmpge: case opIfIcmpgt: case opIfIcmple:
+    case opGoto:
+        I.index = -1;
+        for (unsigned i = 0; i < lineNum; ++i)
+            if (lines[i].label && strcmp(lines[i].label, line->operand) == 0)
+                I.index = lineToCode[i];
+        if (I.index < 0)
+            I.op = opUnknown;
+        break;
+    case opInvokestatic: {
+        // invokestatic <type> <name>(<types>)
+        const char* name = strchr(line->operand, ' ');
+        const char* paren = strchr(line->operand, '(');
+        if (name == NULL || paren == NULL || paren < name) {
+            I.op = opUnknown;
+            break;
+        }
+        ++name;
+        I.callee = calloc(paren - name + 1, sizeof(char));
+        strncpy(I.callee, name, paren - name);
+        I.paramTypes = parseParameterTypes(paren);
+        break;
+    }
+    default:
+        break;
+    }
+
+    return I;
+}
+
+void registerConstEvalFunction(const char* name, const char* body)
+{
+    if (!Enable_Const_Eval)
+        return;
+
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+
+    // 第 i 行之後的第一個指令是第幾個指令（label 所在的行可能沒有指令）
+    int* lineToCode = malloc((lineNum + 1) * sizeof(int));
+    unsigned codeNum = 0;
+    for (unsigned i = 0; i < lineNum; ++i) {
+        lineToCode[i] = codeNum;
+        if (lines[i].opcode)
+            ++codeNum;
+    }
+
+    ConstFunction_t* F = calloc(1, sizeof(ConstFunction_t));
+    F->name = strdup(name);
+    F->code = calloc(codeNum + 1, sizeof(Instruction_t));
+    F->codeNum = codeNum;
+
+    for (unsigned i = 0, c = 0; i < lineNum; ++i) {
+        if (lines[i].opcode == NULL)
+            continue;
+
+        Instruction_t* I = &F->code[c++];
+        *I = decodeLine(&lines[i], lines, lineNum, lineToCode);
+
+        // 區域變數的數量
+        if (I->op == opIload || I->op == opFload || I->op == opDload || I->op == opIstore || I->op == opFstore || I->op == opDstore || I->op == opIinc)
+            if (F->localNum < (unsigned)I->index + 2)
+                F->localNum = I->index + 2;
+    }
+
+    F->next = Functions;
+    Functions = F;
+
+    free(lineToCode);
+    freeJasmLines(lines, lineNum);
+}
+
+// Interpreter ////////////////////////////////////////////////////////////////////////////////////
+
+#define CONST_EVAL_STACK_SIZE 256
+
+static unsigned long Steps = 0;
+
+static bool execute(const ConstFunction_t* F, Value_t* args, unsigned argNum, Value_t* result, unsigned depth);
+
+// 以 stack 最上面的值為參數呼叫 I（invokestatic），回傳值 push 到 stack 上
+static bool invoke(const Instruction_t* I, Value_t* stack, unsigned* sp, unsigned depth)
+{
+    const ConstFunction_t* F = findFunction(I->callee);
+    unsigned argNum = strlen(I->paramTypes);
+    if (F == NULL || *sp < argNum)
+        return false;
+
+    *sp -= argNum;
+    Value_t ret = { 0 };
+    if (!execute(F, &stack[*sp], argNum, &ret, depth + 1))
+        return false;
+
+    if (ret.kind)
+        stack[(*sp)++] = ret;
+    return true;
+}
+
+// Note: 跳躍的條件以 Java 的規則計算；float / double 的 NaN 比較由 fcmpg / fcmpl 決定
+static bool execute(const ConstFunction_t* F, Value_t* args, unsigned argNum, Value_t* result, unsigned depth)
+{
+    if (depth > CONST_EVAL_MAX_DEPTH)
+        return false;
+
+    Value_t stack[CONST_EVAL_STACK_SIZE];
+    unsigned sp = 0;
+    Value_t* locals = calloc(F->localNum + argNum * 2 + 1, sizeof(Value_t));
+    bool ok = false;
+
+    // 參數依序放進區域變數（double 佔兩格）
+    for (unsigned i = 0, index = 0; i < argNum; ++i) {
+        locals[index] = args[i];
+        index += args[i].kind == 'd' ? 2 : 1;
+    }
+
+#define POP()    (stack[--sp])
+#define PUSH(V)  (stack[sp++] = (V))
+#define NEED(N)  if (sp < (N)) goto done
+#define INT(V)   ((Value_t){ .kind = 'i', .i = (V) })
+#define FLOAT(V) ((Value_t){ .kind = 'f', .f = (V) })
+#define DOUBLE(V) ((Value_t){ .kind = 'd', .d = (V) })
+
+    for (unsigned pc = 0; pc < F->codeNum; ) {
+        const Instruction_t* I = &F->code[pc++];
+        Value_t A, B;
+
+        if (++Steps > CONST_EVAL_MAX_STEPS || sp + 2 >= CONST_EVAL_STACK_SIZE)
+            goto done;
+
+        switch (I->op) {
+        case opNop: break;
+        case opLdc: case opIconst: case opBipush: PUSH(I->constant); break;
+
+        case opIload: case opFload: case opDload:
+            if (locals[I->index].kind == 0) goto done;
+            PUSH(locals[I->index]);
+            break;
+        case opIstore: case opFstore: case opDstore: NEED(1); locals[I->index] = POP(); break;
+        case opIinc:
+            if (locals[I->index].kind != 'i') goto done;
+            locals[I->index].i = (int)((unsigned)locals[I->index].i + (unsigned)I->delta);
+            break;
+
+        // int
+        case opIadd: NEED(2); B = POP(); A = POP(); PUSH(INT((int)((unsigned)A.i + (unsigned)B.i))); break;
+        case opIsub: NEED(2); B = POP(); A = POP(); PUSH(INT((int)((unsigned)A.i - (unsigned)B.i))); break;
+        case opImul: NEED(2); B = POP(); A = POP(); PUSH(INT((int)((unsigned)A.i * (unsigned)B.i))); break;
+        case opIdiv: case opIrem:
+            NEED(2); B = POP(); A = POP();
+            if (B.i == 0) goto done;  // ArithmeticException 留到執行時期
+            if (A.i == INT_MIN && B.i == -1) PUSH(INT(I->op == opIdiv ? INT_MIN : 0));
+            else                             PUSH(INT(I->op == opIdiv ? A.i / B.i : A.i % B.i));
+            break;
+        case opIneg:  NEED(1); A = POP(); PUSH(INT((int)(0u - (unsigned)A.i))); break;
+        case opIshl:  NEED(2); B = POP(); A = POP(); PUSH(INT((int)((unsigned)A.i << (B.i & 31)))); break;
+        case opIshr:  NEED(2); B = POP(); A = POP(); PUSH(INT(A.i >> (B.i & 31))); break;
+        case opIushr: NEED(2); B = POP(); A = POP(); PUSH(INT((int)((unsigned)A.i >> (B.i & 31)))); break;
+        case opIand:  NEED(2); B = POP(); A = POP(); PUSH(INT(A.i & B.i)); break;
+        case opIor:   NEED(2); B = POP(); A = POP(); PUSH(INT(A.i | B.i)); break;
+        case opIxor:  NEED(2); B = POP(); A = POP(); PUSH(INT(A.i ^ B.i)); break;
+
+        // float & double
+        case opFadd: NEED(2); B = POP(); A = POP(); PUSH(FLOAT(A.f + B.f)); break;
+        case opFsub: NEED(2); B = POP(); A = POP(); PUSH(FLOAT(A.f - B.f)); break;
+        case opFmul: NEED(2); B = POP(); A = POP(); PUSH(FLOAT(A.f * B.f)); break;
+        case opFdiv: NEED(2); B = POP(); A = POP(); PUSH(FLOAT(A.f / B.f)); break;
+        case opFneg: NEED(1); A = POP(); PUSH(FLOAT(-A.f)); break;
+        case opDadd: NEED(2); B = POP(); A = POP(); PUSH(DOUBLE(A.d + B.d)); break;
+        case opDsub: NEED(2); B = POP(); A = POP(); PUSH(DOUBLE(A.d - B.d)); break;
+        case opDmul: NEED(2); B = POP(); A = POP(); PUSH(DOUBLE(A.d * B.d)); break;
+        case opDdiv: NEED(2); B = POP(); A = POP(); PUSH(DOUBLE(A.d / B.d)); break;
+        case opDneg: NEED(1); A = POP(); PUSH(DOUBLE(-A.d)); break;
+        case opFcmpg: case opFcmpl:
+            NEED(2); B = POP(); A = POP();
+            PUSH(INT(A.f > B.f ? 1 : A.f < B.f ? -1 : A.f == B.f ? 0 : (I->op == opFcmpg ? 1 : -1)));
+            break;
+        case opDcmpg: case opDcmpl:
+            NEED(2); B = POP(); A = POP();
+            PUSH(INT(A.d > B.d ? 1 : A.d < B.d ? -1 : A.d == B.d ? 0 : (I->op == opDcmpg ? 1 : -1)));
+            break;
+
+        // branch
+        case opIfeq: NEED(1); if (POP().i == 0) pc = I->index; break;
+        case opIfne: NEED(1); if (POP().i != 0) pc = I->index; break;
+        case opIflt: NEED(1); if (POP().i <  0) pc = I->index; break;
+        case opIfge: NEED(1); if (POP().i >= 0) pc = I->index; break;
+        case opIfgt: NEED(1); if (POP().i >  0) pc = I->index; break;
+        case opIfle: NEED(1); if (POP().i <= 0) pc = I->index; break;
+        case opIfIcmpeq: NEED(2); B = POP(); A = POP(); if (A.i == B.i) pc = I->index; break;
+        case opIfIcmpne: NEED(2); B = POP(); A = POP(); if (A.i != B.i) pc = I->index; break;
+        case opIfIcmplt: NEED(2); B = POP(); A = POP(); if (A.i <  B.i) pc = I->index; break;
+        case opIfIcmpge: NEED(2); B = POP(); A = POP(); if (A.i >= B.i) pc = I->index; break;
+        case opIfIcmpgt: NEED(2); B = POP(); A = POP(); if (A.i >  B.i) pc = I->index; break;
+        case opIfIcmple: NEED(2); B = POP(); A = POP(); if (A.i <= B.i) pc = I->index; break;
+        case opGoto: pc = I->index; break;
+
+        // stack
+        case opDup: NEED(1); A = stack[sp - 1]; PUSH(A); break;
+        case opDup2:
+            NEED(1);
+            if (stack[sp - 1].kind == 'd') { A = stack[sp - 1]; PUSH(A); }
+            else { NEED(2); A = stack[sp - 2]; B = stack[sp - 1]; PUSH(A); PUSH(B); }
+            break;
+        case opPop: NEED(1); --sp; break;
+        case opPop2:
+            NEED(1);
+            if (stack[sp - 1].kind == 'd') --sp;
+            else { NEED(2); sp -= 2; }
+            break;
+        case opSwap: NEED(2); A = stack[sp - 1]; stack[sp - 1] = stack[sp - 2]; stack[sp - 2] = A; break;
+
+        // call & return
+        case opInvokestatic:
+            if (!invoke(I, stack, &sp, depth))
+                goto done;
+            break;
+        case opReturn:
+            result->kind = 0;
+            ok = true;
+            goto done;
+        case opIreturn: case opFreturn: case opDreturn:
+            NEED(1);
+            *result = POP();
+            ok = true;
+            goto done;
+
+        default:
+            goto done;
+        }
+    }
+
+done:
+#undef POP
+#undef PUSH
+#undef NEED
+#undef INT
+#undef FLOAT
+#undef DOUBLE
+    free(locals);
+    return ok;
+}
+
+// Fold ///////////////////////////////////////////////////////////////////////////////////////////
+
+ExpressionNode_t* foldConstFuncCall(ExpressionNode_t* funcCall)
+{
+    if (!Enable_Const_Eval || funcCall == NULL || !funcCall->isFuncCallOP)
+        return funcCall;
+
+    PrimitiveType_t returnType = funcCall->resultTypeInfo.type;
+    if (returnType == pVoidType || returnType == pStringType || funcCall->resultTypeInfo.dimension > 0)
+        return funcCall;
+
+    // 參數都必須是常數
+    Value_t args[64];
+    unsigned argNum = 0;
+    for (ExpressionNode_t* param = funcCall->rightOperand; param; param = param->nextExpression) {
+        if (!param->isConstExpr || argNum == 64)
+            return funcCall;
+
+        switch (param->resultTypeInfo.type) {
+        case pIntType:    args[argNum++] = (Value_t){ .kind = 'i', .i = param->cIval }; break;
+        case pBoolType:   args[argNum++] = (Value_t){ .kind = 'i', .i = param->cBval }; break;
+        case pFloatType:  args[argNum++] = (Value_t){ .kind = 'f', .f = param->cFval }; break;
+        case pDoubleType: args[argNum++] = (Value_t){ .kind = 'd', .d = param->cDval }; break;
+        default: return funcCall;
+        }
+    }
+
+    // callee 可能還在執行 function pass（見 parallelCodegen.h）
+    waitForFunction(funcCall->sval);
+    const ConstFunction_t* F = findFunction(funcCall->sval);
+    if (F == NULL)
+        return funcCall;
+
+    Value_t result = { 0 };
+    Steps = 0;
+    if (!execute(F, args, argNum, &result, 0) || result.kind == 0)
+        return funcCall;
+
+    // inf, NaN 無法用 ldc 表示
+    if ((returnType == pFloatType && !isfinite(result.f)) || (returnType == pDoubleType && !isfinite(result.d)))
+        return funcCall;
+
+    ExpressionNode_t* constant = calloc(1, sizeof(ExpressionNode_t));
+    constant->isConstExpr = true;
+    constant->resultTypeInfo = funcCall->resultTypeInfo;
+
+    switch (returnType) {
+    case pIntType:    constant->ival = constant->cIval = result.i; break;
+    case pBoolType:   constant->bval = constant->cBval = result.i != 0; break;
+    case pFloatType:  constant->fval = constant->cFval = result.f; break;
+    case pDoubleType: constant->dval = constant->cDval = result.d; break;
+    default: break;
+    }
+
+    freeExprTree(funcCall);
+    return constant;
+}
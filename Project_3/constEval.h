@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include "expression.h"
+
+/**
+ * 在編譯時期執行沒有副作用的函數
+ *
+ * @details 每個函數定義完之後記下它的 JASM body；之後呼叫它、且所有參數都是常數時，直接用一個小的 JASM 直譯器執行 body，
+ *          成功的話整個呼叫換成回傳值的常數（所以 `const int N = sigma(1, 100);` 也可以通過）。
+ *          遇到以下狀況就放棄，照常產生 invokestatic：
+ *          - 有副作用或結果不固定：print / read（invokevirtual 等）、讀寫全域變數（getstatic, putstatic）
+ *          - 執行時才會發生的錯誤：除以 0
+ *          - 超過 CONST_EVAL_MAX_STEPS 個指令，或遞迴超過 CONST_EVAL_MAX_DEPTH 層
+ *          - 直譯器不認得的指令、字串
+ */
+
+// 一次編譯時期計算最多執行幾個指令
+#define CONST_EVAL_MAX_STEPS 1000000
+// 最多幾層函數呼叫
+#define CONST_EVAL_MAX_DEPTH 256
+
+/**
+ * 是否在編譯時期計算函數呼叫（--no-const-eval 可關閉），預設為 true
+ */
+extern bool Enable_Const_Eval;
+
+/**
+ * 函數 name 定義結束時呼叫，body 是 `{` 和 `}` 之間的 JASM
+ */
+void registerConstEvalFunction(const char* name, const char* body);
+
+/**
+ * 如果 funcCall 的參數都是常數且可以在編譯時期執行，回傳結果的常數節點（funcCall 會被䆁放）；否則直接回傳 funcCall
+ */
+ExpressionNode_t* foldConstFuncCall(ExpressionNode_t* funcCall);
@@ -0,0 +1,431 @@
+#include "constProp.h"
+#include "jasmCode.h"
+#include "constEval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+bool Enable_Const_Prop = true;
+
+// State //////////////////////////////////////////////////////////////////////////////////////////
+
+typedef enum ConstKind_t {
+    cvUnknown = 0,
+    cvConstant,   // 值為常數
+    cvCopy        // 值和另一個區域變數（copyOf）相同
+} ConstKind_t;
+
+typedef struct ConstValue_t {
+    ConstKind_t kind;
+    PrimitiveType_t type;
+    union {
+        int ival;
+        float fval;
+        double dval;
+        bool bval;
+        int copyOf;
+    };
+} ConstValue_t;
+
+// 每個區域變數（以 index 為 key）目前的值
+typedef struct ConstState_t {
+    ConstValue_t* values;
+    unsigned size;
+    struct ConstState_t* next;  // 串成 stack
+} ConstState_t;
+
+static ConstState_t Current = { NULL, 0, NULL };
+static ConstState_t* Saved_Stack = NULL;
+
+// 區域變數 index -> 名稱（copy propagation 改寫 ID 時使用）
+static char** Local_Names = NULL;
+static unsigned Local_Name_Num = 0;
+
+static void rememberName(int index, const char* name)
+{
+    if ((unsigned)index >= Local_Name_Num) {
+        Local_Names = realloc(Local_Names, (index + 1) * sizeof(char*));
+        memset(Local_Names + Local_Name_Num, 0, (index + 1 - Local_Name_Num) * sizeof(char*));
+        Local_Name_Num = index + 1;
+    }
+
+    if (Local_Names[index] == NULL || strcmp(Local_Names[index], name) != 0) {
+        free(Local_Names[index]);
+        Local_Names[index] = strdup(name);
+    }
+}
+
+static ConstValue_t getValue(int index)
+{
+    ConstValue_t unknown = { cvUnknown };
+    return (unsigned)index < Current.size ? Current.values[index] : unknown;
+}
+
+static void setValue(int index, ConstValue_t value)
+{
+    if ((unsigned)index >= Current.size) {
+        Current.values = realloc(Current.values, (index + 1) * sizeof(ConstValue_t));
+        memset(Current.values + Current.size, 0, (index + 1 - Current.size) * sizeof(ConstValue_t));
+        Current.size = index + 1;
+    }
+    Current.values[index] = value;
+}
+
+static void copyState(ConstState_t* dst, const ConstState_t* src)
+{
+    dst->values = realloc(dst->values, (src->size ? src->size : 1) * sizeof(ConstValue_t));
+    if (src->size)
+        memcpy(dst->values, src->values, src->size * sizeof(ConstValue_t));
+    dst->size = src->size;
+}
+
+static bool isSameValue(const ConstValue_t* A, const ConstValue_t* B)
+{
+    if (A->kind != B->kind)
+        return false;
+
+    switch (A->kind) {
+    case cvUnknown: return true;
+    case cvCopy:    return A->copyOf == B->copyOf;
+    case cvConstant:
+        if (A->type != B->type)
+            return false;
+
+        // Note: 用 memcmp 比較，-0.0 和 0.0 不同，NaN 和自己相同
+        switch (A->type) {
+        case pIntType:    return A->ival == B->ival;
+        case pBoolType:   return A->bval == B->bval;
+        case pFloatType:  return memcmp(&A->fval, &B->fval, sizeof(float)) == 0;
+        case pDoubleType: return memcmp(&A->dval, &B->dval, sizeof(double)) == 0;
+        default:          return false;
+        }
+    }
+    return false;
+}
+
+// dst = dst 和 src 的交集（值不同的變數變成未知）
+static void meetState(ConstState_t* dst, const ConstState_t* src)
+{
+    for (unsigned i = 0; i < dst->size; ++i) {
+        if (i >= src->size || !isSameValue(&dst->values[i], &src->values[i]))
+            dst->values[i].kind = cvUnknown;
+    }
+}
+
+static void killAllLocals(void)
+{
+    for (unsigned i = 0; i < Current.size; ++i)
+        Current.values[i].kind = cvUnknown;
+}
+
+void killLocalConstProp(int index)
+{
+    if (index < 0)
+        return;
+
+    setValue(index, (ConstValue_t){ cvUnknown });
+
+    // 複製 index 的變數也不再和它相同
+    for (unsigned i = 0; i < Current.size; ++i)
+        if (Current.values[i].kind == cvCopy && Current.values[i].copyOf == index)
+            Current.values[i].kind = cvUnknown;
+}
+
+bool isLocalConstKnown(int index)
+{
+    return index >= 0 && getValue(index).kind == cvConstant;
+}
+
+// 區域變數 index 被設為 value 的值
+static void assignLocal(int index, ExpressionNode_t* value)
+{
+    killLocalConstProp(index);
+
+    if (value == NULL)
+        return;
+
+    if (value->isConstExpr && value->resultTypeInfo.type != pStringType) {
+        ConstValue_t v = { cvConstant, value->resultTypeInfo.type, { 0 } };
+        switch (v.type) {
+        case pIntType:    v.ival = value->cIval; break;
+        case pFloatType:  v.fval = value->cFval; break;
+        case pDoubleType: v.dval = value->cDval; break;
+        case pBoolType:   v.bval = value->cBval; break;
+        default:          return;
+        }
+
+        // inf, NaN（例如很大的 literal）無法用 ldc 表示，不換進其他地方
+        if ((v.type == pFloatType && !isfinite(v.fval)) || (v.type == pDoubleType && !isfinite(v.dval)))
+            return;
+        setValue(index, v);
+    }
+    else if (value->isID && !value->isConstExpr && value->localVariableIndex >= 0 && value->localVariableIndex != index
+             && value->resultTypeInfo.type != pStringType) {
+        ConstValue_t v = { cvCopy, value->resultTypeInfo.type, { 0 } };
+        v.copyOf = value->localVariableIndex;
+        setValue(index, v);
+    }
+}
+
+// 忘記 expr 中 =, ++, -- 修改的區域變數
+static void killWrites(ExpressionNode_t* expr)
+{
+    for (; expr; expr = expr->nextExpression) {
+        ExpressionNode_t** order;
+        const unsigned nodeNum = postorderExprTree(expr, &order);
+
+        for (unsigned i = 0; i < nodeNum; ++i) {
+            ExpressionNode_t* node = order[i];
+            if (node->isOP && (strcmp(node->OP, "=") == 0 || strcmp(node->OP, "++") == 0 || strcmp(node->OP, "--") == 0)) {
+                ExpressionNode_t* lvalue = node->leftOperand ? node->leftOperand : node->rightOperand;
+                if (lvalue->isID)
+                    killLocalConstProp(lvalue->localVariableIndex);
+            }
+        }
+        free(order);
+    }
+}
+
+// Propagation ////////////////////////////////////////////////////////////////////////////////////
+
+// 將讀取變數的節點 N 換成常數 value
+static ExpressionNode_t* replaceWithConstant(ExpressionNode_t* N, ConstValue_t value)
+{
+    ExpressionNode_t* newNode = calloc(1, sizeof(ExpressionNode_t));
+    newNode->isConstExpr = true;
+    newNode->resultTypeInfo = N->resultTypeInfo;
+
+    switch (value.type) {
+    case pIntType:    newNode->ival = newNode->cIval = value.ival; break;
+    case pFloatType:  newNode->fval = newNode->cFval = value.fval; break;
+    case pDoubleType: newNode->dval = newNode->cDval = value.dval; break;
+    case pBoolType:   newNode->bval = newNode->cBval = value.bval; break;
+    default:          break;
+    }
+
+    freeExprTree(N);
+    return newNode;
+}
+
+// propagateNode 中「其他運算子」的節點
+static bool isSpineOperator(ExpressionNode_t* N)
+{
+    return N != NULL && !N->isConstExpr && N->isOP && !N->isArrayIndexOP && !N->isFuncCallOP
+        && strcmp(N->OP, "=") != 0 && strcmp(N->OP, "++") != 0 && strcmp(N->OP, "--") != 0;
+}
+
+static ExpressionNode_t* propagateNode(ExpressionNode_t* N)
+{
+    if (N == NULL || N->isConstExpr)
+        return N;
+
+    // 讀取變數（只處理區域變數，全域變數可能被呼叫的函數修改）
+    if (N->isID) {
+        if (N->localVariableIndex < 0)
+            return N;
+
+        rememberName(N->localVariableIndex, N->sval);
+        ConstValue_t value = getValue(N->localVariableIndex);
+
+        if (value.kind == cvConstant)
+            return replaceWithConstant(N, value);
+
+        if (value.kind == cvCopy) {
+            free(N->sval);
+            N->sval = strdup(Local_Names[value.copyOf]);
+            N->localVariableIndex = value.copyOf;
+        }
+        return N;
+    }
+
+    // 陣列存取、函數呼叫：依序處理每個 index / 參數
+    if (N->isArrayIndexOP || N->isFuncCallOP) {
+        for (ExpressionNode_t** link = &N->rightOperand; *link; link = &(*link)->nextExpression) {
+            ExpressionNode_t* next = (*link)->nextExpression;
+            (*link)->nextExpression = NULL;
+            *link = propagateNode(*link);
+            (*link)->nextExpression = next;
+        }
+
+        // 參數變成常數之後，函數呼叫也許可以在編譯時期執行
+        return N->isFuncCallOP ? foldConstFuncCall(N) : N;
+    }
+
+    // Assign：先計算右邊，再寫入左邊
+    if (strcmp(N->OP, "=") == 0) {
+        N->rightOperand = propagateNode(N->rightOperand);
+
+        if (N->leftOperand->isID && N->leftOperand->localVariableIndex >= 0) {
+            rememberName(N->leftOperand->localVariableIndex, N->leftOperand->sval);
+            assignLocal(N->leftOperand->localVariableIndex, N->rightOperand);
+        }
+        return N;
+    }
+
+    // INCR && DECR：值已知時記下新的值
+    if (strcmp(N->OP, "++") == 0 || strcmp(N->OP, "--") == 0) {
+        ExpressionNode_t* lvalue = N->leftOperand ? N->leftOperand : N->rightOperand;
+
+        if (lvalue->isID && lvalue->localVariableIndex >= 0) {
+            ConstValue_t value = getValue(lvalue->localVariableIndex);
+            killLocalConstProp(lvalue->localVariableIndex);
+
+            if (value.kind == cvConstant) {
+                // Note: 用 unsigned 計算，和 iinc 一樣 overflow
+                value.ival = (int)((unsigned)value.ival + (N->OP[0] == '+' ? 1u : -1u));
+                setValue(lvalue->localVariableIndex, value);
+            }
+        }
+        return N;
+    }
+
+    // 其他運算子：運算元換掉之後重新計算
+    // Note: 很長的 a + b + c + ... 是往左邊很深的樹，沿著左邊的運算子往下走，由下往上處理，遞迴深度只和右運算元的巢狀層數有關
+    ExpressionNode_t** spine = NULL;
+    unsigned spineNum = 0, capacity = 0;
+    for (ExpressionNode_t* node = N; isSpineOperator(node); node = node->leftOperand) {
+        if (spineNum == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            spine = realloc(spine, capacity * sizeof(ExpressionNode_t*));
+        }
+        spine[spineNum++] = node;
+    }
+
+    ExpressionNode_t* result = propagateNode(spine[spineNum - 1]->leftOperand);
+    while (spineNum > 0) {
+        ExpressionNode_t* node = spine[--spineNum];
+        node->leftOperand = result;
+        node->rightOperand = propagateNode(node->rightOperand);
+        result = refoldOperatorNode(node);
+    }
+
+    free(spine);
+    return result;
+}
+
+ExpressionNode_t* propagateConstants(ExpressionNode_t* expr)
+{
+    if (!Enable_Const_Prop)
+        return expr;
+
+    return propagateNode(expr);
+}
+
+void resetConstProp(void)
+{
+    Current.size = 0;
+
+    while (Saved_Stack) {
+        ConstState_t* next = Saved_Stack->next;
+        free(Saved_Stack->values);
+        free(Saved_Stack);
+        Saved_Stack = next;
+    }
+}
+
+void defineLocalConstProp(const char* identifier, int index, ExpressionNode_t* defaultValue)
+{
+    if (index < 0)
+        return;
+
+    rememberName(index, identifier);
+    assignLocal(index, Enable_Const_Prop ? defaultValue : NULL);
+}
+
+// Branch /////////////////////////////////////////////////////////////////////////////////////////
+
+void pushConstState(void)
+{
+    ConstState_t* saved = calloc(1, sizeof(ConstState_t));
+    copyState(saved, &Current);
+    saved->next = Saved_Stack;
+    Saved_Stack = saved;
+}
+
+void swapConstState(void)
+{
+    ConstState_t temp = Current;
+    Current.values = Saved_Stack->values;
+    Current.size = Saved_Stack->size;
+    Saved_Stack->values = temp.values;
+    Saved_Stack->size = temp.size;
+}
+
+void popConstState(bool useCurrent, bool useSaved)
+{
+    ConstState_t* saved = Saved_Stack;
+    Saved_Stack = saved->next;
+
+    if (useCurrent && useSaved)
+        meetState(&Current, saved);
+    else if (useSaved)
+        copyState(&Current, saved);
+
+    free(saved->values);
+    free(saved);
+}
+
+void meetConstState(bool useCurrent, bool useSaved)
+{
+    if (useCurrent && useSaved)
+        meetState(&Current, Saved_Stack);
+    else if (useSaved)
+        copyState(&Current, Saved_Stack);
+}
+
+// Loop ///////////////////////////////////////////////////////////////////////////////////////////
+
+void beginLoopConstProp(void)
+{
+    pushConstState();
+    killAllLocals();
+}
+
+void continueLoopConstProp(void)
+{
+    killAllLocals();
+}
+
+void endLoopConstProp(const char* body, ExpressionNode_t** headers, unsigned headerNum)
+{
+    popConstState(false, true);
+
+    for (unsigned i = 0; i < Current.size; ++i)
+        if (isJasmWritesLocal(body, i))
+            killLocalConstProp(i);
+
+    for (unsigned i = 0; i < headerNum; ++i)
+        killWrites(headers[i]);
+
+    // header 中的 =, ++, -- 不影響迴圈結束後的狀態（它們修改的變數都已經是未知了）
+    pushConstState();
+    for (unsigned i = 0; i < headerNum; ++i)
+        headers[i] = propagateConstants(headers[i]);
+    popConstState(false, true);
+}
+
+char* substituteConstLocals(char* body)
+{
+    char replacement[JASM_NUMBER_SIZE + 8], number[JASM_NUMBER_SIZE];
+
+    for (unsigned i = 0; i < Current.size; ++i) {
+        const ConstValue_t* value = &Current.values[i];
+        if (value->kind != cvConstant)
+            continue;
+
+        switch (value->type) {
+        case pIntType:    sprintf(replacement, "ldc %d",  value->ival); break;
+        case pFloatType:  formatJasmFloat(number, value->fval);  sprintf(replacement, "ldc %s", number); break;
+        case pDoubleType: formatJasmDouble(number, value->dval); sprintf(replacement, "ldc %s", number); break;
+        case pBoolType:   sprintf(replacement, "ldc %d",  value->bval); break;
+        default:          continue;
+        }
+
+        char* newBody = replaceJasmLocalLoads(body, i, replacement);
+        free(body);
+        body = newBody;
+    }
+
+    return body;
+}
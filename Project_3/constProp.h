@@ -0,0 +1,93 @@
+#pragma once
+#include <stdbool.h>
+#include "expression.h"
+
+/**
+ * 區域變數的 constant propagation 和 copy propagation
+ *
+ * @details 產生 JASM 時（見 stmtToJasm.h，依照程式執行的順序）記錄每個區域變數目前的值：
+ *          - 常數：之後讀取這個變數時直接換成常數，再交給 expression 原本的編譯時期計算
+ *          - 複製：`y = x` 之後 x, y 都沒被修改前，讀取 y 就改成讀取 x
+ *          - 未知
+ *
+ *          if / else 結束時取兩邊的交集，無法到達的那一邊（condition 為常數、或以 return, break, continue 結尾）不列入計算；
+ *          進入迴圈時還不知道 body 會修改哪些變數，所以先把所有區域變數都當成未知，迴圈結束後再把「迴圈中沒被修改的常數」換進 body 的 JASM 中
+ */
+
+/**
+ * 是否做 constant / copy propagation，預設為 true
+ */
+extern bool Enable_Const_Prop;
+
+/**
+ * 進入新的函數：所有區域變數（包含參數）都是未知
+ */
+void resetConstProp(void);
+
+/**
+ * 依照執行順序走訪 expr：把值已知的區域變數換成常數（或複製來源的變數）並重新計算，同時記錄 =, ++, -- 對區域變數的影響
+ * @return 新的樹（expr 可能會被䆁放）
+ */
+ExpressionNode_t* propagateConstants(ExpressionNode_t* expr);
+
+/**
+ * 宣告區域變數 index 時呼叫，defaultValue（已經 propagate 過，可為 NULL）是它的初始值
+ */
+void defineLocalConstProp(const char* identifier, int index, ExpressionNode_t* defaultValue);
+
+/**
+ * 忘記區域變數 index 的值
+ */
+void killLocalConstProp(int index);
+
+/**
+ * 區域變數 index 目前的值是否為已知的常數
+ */
+bool isLocalConstKnown(int index);
+
+// Branch /////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * 記下目前的狀態（if 的 condition 之後呼叫）
+ */
+void pushConstState(void);
+
+/**
+ * 交換目前的狀態和記下的狀態（else 開始時呼叫：記下 then 結束時的狀態，回到 condition 之後的狀態）
+ */
+void swapConstState(void);
+
+/**
+ * 合併目前的狀態和記下的狀態（只取 use 為 true 的那些），然後丟掉記下的狀態
+ */
+void popConstState(bool useCurrent, bool useSaved);
+
+/**
+ * 和 popConstState 相同，但不丟掉記下的狀態
+ * （switch 的每個 case 開始時呼叫：記下的是 dispatch 時的狀態，目前的狀態是從上一個 case 繼續執行下來的狀態）
+ */
+void meetConstState(bool useCurrent, bool useSaved);
+
+// Loop ///////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * 進入迴圈（condition 之前）：記下目前的狀態，然後所有區域變數都當成未知
+ */
+void beginLoopConstProp(void);
+
+/**
+ * do-while 的 body 之後、condition 之前（for 則是 update 之前）呼叫：continue 會從 body 中間帶著不同的值跳過來，所以所有區域變數都當成未知，
+ * condition / update 只用迴圈不變的值 propagate（在 endLoopConstProp 中）
+ */
+void continueLoopConstProp(void);
+
+/**
+ * 離開迴圈（或 switch）：回到進入迴圈前的狀態，並忘記 body 的 JASM 和 header 的 expressions（headers[0 ~ headerNum-1]，可為 NULL）會修改的變數。
+ * 之後每個 header 都會用「迴圈不變」的值重新 propagate（例如 body 沒修改到的 n，`i < n` 會變成 `i < 10`）
+ */
+void endLoopConstProp(const char* body, ExpressionNode_t** headers, unsigned headerNum);
+
+/**
+ * 把 body 中讀取「值已知的區域變數」的指令換成常數（在 endLoopConstProp 之後呼叫），回傳新的 body（原本的 body 會被䆁放）
+ */
+char* substituteConstLocals(char* body);
@@ -1,9 +1,14 @@
 #include "exprToJasm.h"
+#include "symbol_table.h"
+#include "inliner.h"
+#include "specialize.h"
+#include "jasmCode.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 extern FILE* JASM_FILE;
+extern SymbolTable_t* Symbol_Table;
 void yyerror(char*);
 
 void popExprResult(Type_Info_t type)
@@ -18,16 +23,509 @@ void popExprResult(Type_Info_t type)
     }
 }
 
+// Evaluation Order ///////////////////////////////////////////////////////////////////////////////
+
+bool Enable_Stack_Ordering = true;
+
+static int powerOfTwoExponent(ExpressionNode_t *R);
+
+// 結果在 operand stack 上佔幾格（double 佔 2 格）
+static unsigned stackSize(ExpressionNode_t* node)
+{
+    switch (node->resultTypeInfo.type) {
+    case pDoubleType: return 2;
+    case pVoidType:   return 0;
+    default:          return 1;
+    }
+}
+
+static unsigned maxNeed(unsigned a, unsigned b)
+{
+    return a > b ? a : b;
+}
+
+// 先計算需要 firstNeed 格、結果佔 firstSize 格的運算元，再計算需要 secondNeed 格的運算元時，operand stack 最多用到幾格
+static unsigned pairNeed(unsigned firstNeed, unsigned firstSize, unsigned secondNeed)
+{
+    return maxNeed(firstNeed, firstSize + secondNeed);
+}
+
+// 不可交換、先算右邊之後要用 swap 換回來的運算
+static bool isOrderedOperator(const char* OP)
+{
+    return strcmp(OP, "-") == 0 || strcmp(OP, "/") == 0 || strcmp(OP, "%") == 0;
+}
+
+// 二元運算的兩個運算元是否可以交換計算順序：兩邊都沒有副作用
+// Note: swap 只能交換兩個佔 1 格的值，所以 double 的 -, / 一定先算左邊；比較運算先算右邊時改用相反方向的比較
+static bool isReorderable(const char* OP, ExpressionNode_t* L, ExpressionNode_t* R)
+{
+    if (!Enable_Stack_Ordering || L->resultTypeInfo.type == pStringType)
+        return false;
+
+    if (isOrderedOperator(OP) && (stackSize(L) != 1 || stackSize(R) != 1))
+        return false;
+
+    return L->isPureTree && R->isPureTree;
+}
+
+// Sethi–Ullman 標號：計算 node 時 operand stack 最多用到幾格（以 JVM 的 word 計算），運算元的標號必須已經算好
+// Note: 只是用來決定運算元的順序，inline 的函數 body 和 CSE 的暫存變數不算在內
+static unsigned labelStackNeed(ExpressionNode_t* node)
+{
+    if (node->isConstExpr || node->isID)
+        return stackSize(node);
+
+    // 參數依序留在 stack 上
+    if (node->isFuncCallOP) {
+        unsigned need = stackSize(node), prefix = 0;
+        for (ExpressionNode_t* param = node->rightOperand; param; param = param->nextExpression) {
+            need = maxNeed(need, prefix + param->stackNeed);
+            prefix += stackSize(param);
+        }
+        return need;
+    }
+
+    if (!node->isOP)
+        return stackSize(node);
+
+    ExpressionNode_t* L = node->leftOperand;
+    ExpressionNode_t* R = node->rightOperand;
+
+    // 單元運算：`!` 會再放一個 iconst_1；全域變數的 ++, -- 最多同時有值、舊值和 1
+    if (L == NULL || R == NULL) {
+        if (strcmp(node->OP, "!") == 0)
+            return maxNeed(R->stackNeed, 2);
+        if (strcmp(node->OP, "++") == 0 || strcmp(node->OP, "--") == 0)
+            return (L ? L : R)->localVariableIndex >= 0 ? 1 : 3;
+        return (L ? L : R)->stackNeed;
+    }
+
+    if (strcmp(node->OP, "=") == 0)
+        return R->stackNeed;
+
+    // 乘、除、取餘 2 的次方的 strength reduction 只計算左邊（見 mulToJasm, divToJasm, modToJasm）
+    const int k = powerOfTwoExponent(R);
+    if (k > 0) {
+        if (node->OP[0] == '*')
+            return maxNeed(L->stackNeed, 2);
+        if (k < 31 && node->OP[0] == '/')
+            return maxNeed(L->stackNeed, 3);
+        if (k < 31 && node->OP[0] == '%')
+            return maxNeed(L->stackNeed, 4);
+    }
+
+    const unsigned need = pairNeed(L->stackNeed, stackSize(L), R->stackNeed);
+    if (!isReorderable(node->OP, L, R))
+        return need;
+
+    const unsigned reversedNeed = pairNeed(R->stackNeed, stackSize(R), L->stackNeed);
+    return reversedNeed < need ? reversedNeed : need;
+}
+
+// 二元運算是否先計算右邊：可以交換計算順序，而且先算右邊用到的 stack 格數比較少
+static bool isRightFirst(const char* OP, ExpressionNode_t* L, ExpressionNode_t* R)
+{
+    return isReorderable(OP, L, R)
+        && pairNeed(R->stackNeed, stackSize(R), L->stackNeed) < pairNeed(L->stackNeed, stackSize(L), R->stackNeed);
+}
+
+// 依照需要的 stack 格數決定算術、邏輯運算兩個運算元的計算順序
+// 可交換的運算（+, *, &&, ||）直接使用 R, L；-, /, % 先算右邊時用 swap 換回 L, R
+static void operandsToJasm(const char* OP, ExpressionNode_t* L, ExpressionNode_t* R)
+{
+    if (!isRightFirst(OP, L, R)) {
+        exprToJasm(L);
+        exprToJasm(R);
+        return;
+    }
+
+    exprToJasm(R);
+    exprToJasm(L);
+    if (isOrderedOperator(OP))
+        fprintf(JASM_FILE, "swap\n");
+}
+
+// Common Subexpression Elimination ////////////////////////////////////////////////////////////////
+
+bool Enable_CSE = true;
+
+// 一組結構相同的 subexpression
+typedef struct CseEntry_t {
+    ExpressionNode_t* node;  // 第一次出現的節點
+    unsigned hash;
+    unsigned visits;         // 實際會被計算的次數（被重複使用的 subexpression 內部不算）
+    int tempIndex;           // 存放結果的暫存區域變數，-1 代表不需要
+    bool isComputed;         // 結果是否已經存進 tempIndex
+} CseEntry_t;
+
+// 目前正在產生的 expression（一個 statement 中最外層的 expression）的 CSE 資訊
+// Note: 每個節點所屬的 entry 記在節點的 cseEntry
+static struct {
+    CseEntry_t* entries;
+    unsigned entryNum;
+    unsigned capacity;
+
+    // hash -> entry 的 index + 1（open addressing，0 代表空的），大小為 2 的次方
+    unsigned* buckets;
+    unsigned bucketMask;
+
+    // 整個 expression 中被寫入的變數，以及是否有函數呼叫（可能寫入任何全域變數）
+    const char** writtenNames;
+    unsigned writtenNum;
+    bool hasFuncCall;
+
+    unsigned scratchMark;
+} Cse;
+
+// exprToJasm / condJumpToJasm 的巢狀深度，0 代表最外層
+static unsigned Expr_Depth = 0;
+
+// 走訪運算樹用的 explicit stack
+typedef struct NodeStack_t {
+    ExpressionNode_t** nodes;
+    unsigned size;
+    unsigned capacity;
+} NodeStack_t;
+
+static void pushNode(NodeStack_t* stack, ExpressionNode_t* node)
+{
+    if (stack->size == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->nodes = realloc(stack->nodes, stack->capacity * sizeof(ExpressionNode_t*));
+    }
+    stack->nodes[stack->size++] = node;
+}
+
+// 記下 node 寫入的變數（=, ++, --）和函數呼叫
+static void collectWrite(ExpressionNode_t* node)
+{
+    if (node->isFuncCallOP)
+        Cse.hasFuncCall = true;
+
+    if (node->isOP && (strcmp(node->OP, "=") == 0 || strcmp(node->OP, "++") == 0 || strcmp(node->OP, "--") == 0)) {
+        ExpressionNode_t* lvalue = node->leftOperand ? node->leftOperand : node->rightOperand;
+        Cse.writtenNames = realloc(Cse.writtenNames, (Cse.writtenNum + 1) * sizeof(char*));
+        Cse.writtenNames[Cse.writtenNum++] = lvalue->sval;
+    }
+}
+
+// node 讀到的變數是否可能在同一個 expression 中被寫入（運算元的標號必須已經算好）
+static bool labelReadsWritten(ExpressionNode_t* node)
+{
+    if (node->isID && !node->isConstExpr) {
+        // 全域變數可能被函數修改
+        if (node->localVariableIndex < 0 && Cse.hasFuncCall)
+            return true;
+
+        for (unsigned i = 0; i < Cse.writtenNum; ++i)
+            if (strcmp(Cse.writtenNames[i], node->sval) == 0)
+                return true;
+        return false;
+    }
+
+    return (node->leftOperand && node->leftOperand->isReadsWritten) || (node->rightOperand && node->rightOperand->isReadsWritten);
+}
+
+// node 是否沒有副作用（同 isExprPure，運算元的標號必須已經算好）
+static bool labelPure(ExpressionNode_t* node)
+{
+    // 函數可能有副作用
+    if (node->isFuncCallOP)
+        return false;
+
+    if (node->isArrayIndexOP) {
+        for (ExpressionNode_t* index = node->rightOperand; index; index = index->nextExpression)
+            if (!index->isPureTree)
+                return false;
+        return true;
+    }
+
+    if (node->isOP && (strcmp(node->OP, "=") == 0 || strcmp(node->OP, "++") == 0 || strcmp(node->OP, "--") == 0))
+        return false;
+
+    return (node->leftOperand == NULL || node->leftOperand->isPureTree) && (node->rightOperand == NULL || node->rightOperand->isPureTree);
+}
+
+static unsigned labeledHash(ExpressionNode_t* operand)
+{
+    return operand ? operand->treeHash : 0;
+}
+
+// 值得共用的 subexpression：沒有副作用的二元運算，且讀到的變數在 expression 中不會被修改
+static bool isCseCandidate(ExpressionNode_t* node)
+{
+    return node->isOP && !node->isConstExpr && node->leftOperand && node->rightOperand
+        && node->resultTypeInfo.type != pStringType
+        && node->isPureTree && !node->isReadsWritten;
+}
+
+// 把候選節點歸到結構相同的 entry（依照後序呼叫，entry 的順序就是第一次出現的順序）
+static void addCseCandidate(ExpressionNode_t* node)
+{
+    const unsigned hash = node->treeHash;
+    unsigned bucket = hash & Cse.bucketMask;
+
+    for (; Cse.buckets[bucket]; bucket = (bucket + 1) & Cse.bucketMask) {
+        CseEntry_t* entry = &Cse.entries[Cse.buckets[bucket] - 1];
+        if (entry->hash == hash && isSameExprTree(entry->node, node)) {
+            node->cseEntry = Cse.buckets[bucket];
+            return;
+        }
+    }
+
+    // Note: entries 的大小不會超過節點數，事先分配好，避免 realloc 讓 entry 指標失效
+    Cse.entries[Cse.entryNum++] = (CseEntry_t){ node, hash, 0, -1, false };
+    Cse.buckets[bucket] = node->cseEntry = Cse.entryNum;
+}
+
+static CseEntry_t* findCseEntry(ExpressionNode_t* node)
+{
+    return node->cseEntry ? &Cse.entries[node->cseEntry - 1] : NULL;
+}
+
+// 依照產生 JASM 的順序（左運算元、右運算元）走訪，計算每個 entry 實際會被計算幾次
+// 第二次以後遇到同樣的 subexpression 時會直接載入暫存變數，所以不用再走進去
+static void countVisits(ExpressionNode_t* root)
+{
+    NodeStack_t stack = { 0 };
+    pushNode(&stack, root);
+
+    while (stack.size > 0) {
+        ExpressionNode_t* node = stack.nodes[--stack.size];
+        if (node == NULL || node->isConstExpr)
+            continue;
+
+        CseEntry_t* entry = findCseEntry(node);
+        if (entry && entry->visits++ > 0)
+            continue;
+
+        // assign 的左邊和 ++, -- 的運算元是 lvalue，不會被計算
+        if (node->isOP && (strcmp(node->OP, "=") == 0 || strcmp(node->OP, "++") == 0 || strcmp(node->OP, "--") == 0)) {
+            if (node->OP[0] == '=')
+                pushNode(&stack, node->rightOperand);
+            continue;
+        }
+
+        // 反過來放，左運算元最先 pop
+        const unsigned begin = stack.size;
+        pushNode(&stack, node->leftOperand);
+        for (ExpressionNode_t* operand = node->rightOperand; operand; operand = operand->nextExpression) {
+            pushNode(&stack, operand);
+            if (!node->isArrayIndexOP && !node->isFuncCallOP)
+                break;
+        }
+        for (unsigned i = begin, j = stack.size; i + 1 < j; ++i, --j) {
+            ExpressionNode_t* temp = stack.nodes[i];
+            stack.nodes[i] = stack.nodes[j - 1];
+            stack.nodes[j - 1] = temp;
+        }
+    }
+
+    free(stack.nodes);
+}
+
+// 最外層的 expression 開始產生之前：依照後序走訪一次整棵樹，算出每個節點的標號（見 ExpressionNode_t），並找出重複的 subexpression
+static void beginExpr(ExpressionNode_t* root)
+{
+    memset(&Cse, 0, sizeof(Cse));
+
+    ExpressionNode_t** order;
+    const unsigned nodeNum = postorderExprTree(root, &order);
+
+    // 在 global scope 沒有區域變數可以用
+    const bool isCseEnabled = Enable_CSE && Symbol_Table != NULL && Symbol_Table->parent != NULL;
+    if (isCseEnabled) {
+        Cse.capacity = nodeNum;
+        Cse.entries = calloc(Cse.capacity, sizeof(CseEntry_t));
+        Cse.bucketMask = 1;
+        while (Cse.bucketMask < 2 * nodeNum)
+            Cse.bucketMask <<= 1;
+        Cse.buckets = calloc(Cse.bucketMask--, sizeof(unsigned));
+        Cse.scratchMark = getScratchMark(Symbol_Table);
+
+        for (unsigned i = 0; i < nodeNum; ++i)
+            collectWrite(order[i]);
+    }
+
+    for (unsigned i = 0; i < nodeNum; ++i) {
+        ExpressionNode_t* node = order[i];
+        node->isPureTree = labelPure(node);
+        node->stackNeed = labelStackNeed(node);
+        node->cseEntry = 0;
+
+        if (!isCseEnabled)
+            continue;
+        node->isReadsWritten = labelReadsWritten(node);
+        node->treeHash = hashExprTree(node, labeledHash);
+        if (isCseCandidate(node))
+            addCseCandidate(node);
+    }
+    free(order);
+
+    if (!isCseEnabled)
+        return;
+
+    countVisits(root);
+
+    // 會被計算兩次以上的 subexpression 分配暫存變數
+    for (unsigned i = 0; i < Cse.entryNum; ++i) {
+        CseEntry_t* entry = &Cse.entries[i];
+        const unsigned size = entry->node->resultTypeInfo.type == pDoubleType ? 2 : 1;
+
+        if (entry->visits >= 2 && getScratchMark(Symbol_Table) + size <= JASM_MAX_LOCALS)
+            entry->tempIndex = assignScratchIndex(Symbol_Table, entry->node->resultTypeInfo.type);
+    }
+}
+
+static void endExpr(void)
+{
+    if (Cse.capacity > 0)
+        releaseScratchIndex(Symbol_Table, Cse.scratchMark);
+
+    free(Cse.entries);
+    free(Cse.buckets);
+    free(Cse.writtenNames);
+    memset(&Cse, 0, sizeof(Cse));
+}
+
+// 存進 / 載入暫存變數
+static void storeCseTemp(ExpressionNode_t* node, int index)
+{
+    switch (node->resultTypeInfo.type) {
+    case pIntType: case pBoolType: fprintf(JASM_FILE, "dup\nistore %d\n", index);  break;
+    case pFloatType:               fprintf(JASM_FILE, "dup\nfstore %d\n", index);  break;
+    case pDoubleType:              fprintf(JASM_FILE, "dup2\ndstore %d\n", index); break;
+    }
+}
+
+static void loadCseTemp(ExpressionNode_t* node, int index)
+{
+    switch (node->resultTypeInfo.type) {
+    case pIntType: case pBoolType: fprintf(JASM_FILE, "iload %d\n", index); break;
+    case pFloatType:               fprintf(JASM_FILE, "fload %d\n", index); break;
+    case pDoubleType:              fprintf(JASM_FILE, "dload %d\n", index); break;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static void exprNodeToJasm(ExpressionNode_t *expr);
+static void binaryOpcodeToJasm(const char* OP, PrimitiveType_t type);
+static int powerOfTwoExponent(ExpressionNode_t *R);
+
+// 計算完 node 之後，如果它是會被重複使用的 subexpression，把結果存進暫存變數
+static void saveCseResult(ExpressionNode_t* node, CseEntry_t* entry)
+{
+    if (entry && entry->tempIndex >= 0) {
+        storeCseTemp(node, entry->tempIndex);
+        entry->isComputed = true;
+    }
+}
+
+// exprToJasm 中還沒產生完的節點
+typedef struct ExprFrame_t {
+    ExpressionNode_t* node;
+    CseEntry_t* entry;
+    ExpressionNode_t* operands[2];  // 依照計算順序排列的運算元
+    unsigned state;                 // 已經開始計算幾個運算元
+} ExprFrame_t;
+
+static void pushExprFrame(ExprFrame_t** frames, unsigned* frameNum, unsigned* capacity, ExpressionNode_t* node)
+{
+    if (*frameNum == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        *frames = realloc(*frames, *capacity * sizeof(ExprFrame_t));
+    }
+    (*frames)[(*frameNum)++] = (ExprFrame_t){ node, NULL, { NULL, NULL }, 0 };
+}
+
+// 一般的二元運算（+, -, *, /, %, &&, ||），常數、2 的次方的乘、除、取餘（strength reduction）和字串除外
+static bool isPlainBinaryOperator(ExpressionNode_t* node)
+{
+    if (node->isConstExpr || !node->isOP || node->leftOperand == NULL || node->rightOperand == NULL || node->resultTypeInfo.type == pStringType)
+        return false;
+
+    const char* OP = node->OP;
+    if (strcmp(OP, "+") == 0 || strcmp(OP, "-") == 0 || strcmp(OP, "&&") == 0 || strcmp(OP, "||") == 0)
+        return true;
+
+    const int k = powerOfTwoExponent(node->rightOperand);
+    if (strcmp(OP, "*") == 0)
+        return k <= 0;
+    if (strcmp(OP, "/") == 0 || strcmp(OP, "%") == 0)
+        return k <= 0 || k >= 31;
+    return false;
+}
+
 void exprToJasm(ExpressionNode_t *expr)
+{
+    // 最外層：先算出標號、找出重複的 subexpression
+    if (Expr_Depth++ == 0)
+        beginExpr(expr);
+
+    // 一般的二元運算用 explicit stack 產生（機器產生的很深的 expression 通常是一長串 +），其他節點才遞迴（見 exprNodeToJasm），
+    // 所以 C 的 stack 只會隨著其他運算的巢狀層數增加
+    ExprFrame_t* frames = NULL;
+    unsigned frameNum = 0, capacity = 0;
+    pushExprFrame(&frames, &frameNum, &capacity, expr);
+
+    while (frameNum > 0) {
+        ExprFrame_t* frame = &frames[frameNum - 1];
+        ExpressionNode_t* node = frame->node;
+
+        if (frame->state == 0) {
+            frame->entry = findCseEntry(node);
+
+            if (frame->entry && frame->entry->tempIndex >= 0 && frame->entry->isComputed) {
+                loadCseTemp(node, frame->entry->tempIndex);
+                --frameNum;
+                continue;
+            }
+
+            if (!isPlainBinaryOperator(node)) {
+                exprNodeToJasm(node);
+                saveCseResult(node, frame->entry);
+                --frameNum;
+                continue;
+            }
+
+            const bool rightFirst = isRightFirst(node->OP, node->leftOperand, node->rightOperand);
+            frame->operands[0] = rightFirst ? node->rightOperand : node->leftOperand;
+            frame->operands[1] = rightFirst ? node->leftOperand : node->rightOperand;
+        }
+
+        // 依序計算兩個運算元
+        // Note: push 可能 realloc，之後不能再用 frame
+        if (frame->state < 2) {
+            ExpressionNode_t* operand = frame->operands[frame->state++];
+            pushExprFrame(&frames, &frameNum, &capacity, operand);
+            continue;
+        }
+
+        // -, /, % 先算右邊時用 swap 換回來（見 operandsToJasm）
+        if (frame->operands[0] == node->rightOperand && isOrderedOperator(node->OP))
+            fprintf(JASM_FILE, "swap\n");
+        binaryOpcodeToJasm(node->OP, node->leftOperand->resultTypeInfo.type);
+        saveCseResult(node, frame->entry);
+        --frameNum;
+    }
+
+    free(frames);
+
+    if (--Expr_Depth == 0)
+        endExpr();
+}
+
+static void exprNodeToJasm(ExpressionNode_t *expr)
 {
     // 直接載入常數 ////////////////////////////////////////////////////////////////////////////////
     if (expr->isConstExpr) {
+        char number[JASM_NUMBER_SIZE];
         switch (expr->resultTypeInfo.type) {
         case pIntType:    fprintf(JASM_FILE, "ldc %d\n",      expr->cIval); break;
-        case pFloatType:  fprintf(JASM_FILE, "ldc %ef\n",     expr->cFval); break;
-        case pDoubleType: fprintf(JASM_FILE, "ldc %e\n",      expr->cDval); break;
+        case pFloatType:  formatJasmFloat(number, expr->cFval);  fprintf(JASM_FILE, "ldc %s\n", number); break;
+        case pDoubleType: formatJasmDouble(number, expr->cDval); fprintf(JASM_FILE, "ldc %s\n", number); break;
         case pBoolType:   fprintf(JASM_FILE, "ldc %d\n",      expr->cBval); break;
         case pStringType: fprintf(JASM_FILE, "ldc \"%s\"\n",  expr->cSval); break;
         }
@@ -170,16 +668,14 @@ void assignToJasm(const char *identifier, int localVariableIndex, ExpressionNode
 
 void orToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    fprintf(JASM_FILE, "ior\n");
+    operandsToJasm("||", L, R);
+    binaryOpcodeToJasm("||", L->resultTypeInfo.type);
 }
 
 void andToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    fprintf(JASM_FILE, "iand\n");
+    operandsToJasm("&&", L, R);
+    binaryOpcodeToJasm("&&", L->resultTypeInfo.type);
 }
 
 void notToJasm(ExpressionNode_t *R)
@@ -192,41 +688,58 @@ void notToJasm(ExpressionNode_t *R)
 
 static unsigned Label_Id = 0;
 
-void lt_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+void resetExprLabels(void)
 {
-    exprToJasm(L);
-    exprToJasm(R);
+    Label_Id = 0;
+}
 
-    // compute L - R
-    switch (L->resultTypeInfo.type) {
-    case pIntType:    fprintf(JASM_FILE, "isub\n");  break;
-    case pFloatType:  fprintf(JASM_FILE, "fcmpg\n"); break;
-    case pDoubleType: fprintf(JASM_FILE, "dcmpg\n"); break;
-    }
+// 比較運算子 -> ifXX 的後綴，negate 為 true 時回傳相反條件
+static const char* compareSuffix(const char* OP, bool negate)
+{
+    static const char* ops[]        = { "<",  "<=", "==", ">=", ">",  "!=" };
+    static const char* suffixes[]   = { "lt", "le", "eq", "ge", "gt", "ne" };
+    static const char* negated[]    = { "ge", "gt", "ne", "lt", "le", "eq" };
+
+    for (int i = 0; i < 6; ++i)
+        if (strcmp(OP, ops[i]) == 0)
+            return negate ? negated[i] : suffixes[i];
+    return NULL;
+}
 
-    fprintf(JASM_FILE, "iflt TRUE%d\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_0\n");
-    fprintf(JASM_FILE, "\tgoto END_COMP%d\n", Label_Id);
-    fprintf(JASM_FILE, "TRUE%d:\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_1\n");
-    fprintf(JASM_FILE, "END_COMP%d: nop\n", Label_Id);
+// 交換比較的兩邊時的後綴（L < R 等於 R > L）
+static const char* mirrorCompareSuffix(const char* suffix)
+{
+    static const char* suffixes[]   = { "lt", "le", "eq", "ge", "gt", "ne" };
+    static const char* mirrored[]   = { "gt", "ge", "eq", "le", "lt", "ne" };
 
-    ++Label_Id;
+    for (int i = 0; i < 6; ++i)
+        if (strcmp(suffix, suffixes[i]) == 0)
+            return mirrored[i];
+    return NULL;
 }
 
-void le_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+// 計算 L OP R，結果為 0 或 1
+// Note: 先算右邊時，int 用 swap 換回來再相減；float, double 直接比較 R, L，改用 fcmpl / dcmpl 和相反方向的後綴，
+//       cmpl(R, L) 恰好是 cmpg(L, R) 的相反數（包含 NaN 的情況），所以結果完全相同
+static void compareToJasm(const char* OP, ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
+    // Note: boolean 的 ==, != 沒有相減，不交換
+    const bool rightFirst = L->resultTypeInfo.type != pBoolType && isRightFirst(OP, L, R);
+    const char* suffix = compareSuffix(OP, false);
+
+    exprToJasm(rightFirst ? R : L);
+    exprToJasm(rightFirst ? L : R);
 
     // compute L - R
     switch (L->resultTypeInfo.type) {
-    case pIntType:    fprintf(JASM_FILE, "isub\n");  break;
-    case pFloatType:  fprintf(JASM_FILE, "fcmpg\n"); break;
-    case pDoubleType: fprintf(JASM_FILE, "dcmpg\n"); break;
+    case pIntType:    fprintf(JASM_FILE, rightFirst ? "swap\nisub\n" : "isub\n"); break;
+    case pFloatType:  fprintf(JASM_FILE, rightFirst ? "fcmpl\n" : "fcmpg\n");       break;
+    case pDoubleType: fprintf(JASM_FILE, rightFirst ? "dcmpl\n" : "dcmpg\n");       break;
     }
+    if (rightFirst && L->resultTypeInfo.type != pIntType)
+        suffix = mirrorCompareSuffix(suffix);
 
-    fprintf(JASM_FILE, "ifle TRUE%d\n", Label_Id);
+    fprintf(JASM_FILE, "if%s TRUE%d\n", suffix, Label_Id);
     fprintf(JASM_FILE, "\ticonst_0\n");
     fprintf(JASM_FILE, "\tgoto END_COMP%d\n", Label_Id);
     fprintf(JASM_FILE, "TRUE%d:\n", Label_Id);
@@ -236,148 +749,210 @@ void le_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
     ++Label_Id;
 }
 
-void eq_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+void lt_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-
-    // compute L - R
-    switch (L->resultTypeInfo.type) {
-    case pIntType:    fprintf(JASM_FILE, "isub\n");  break;
-    case pFloatType:  fprintf(JASM_FILE, "fcmpg\n"); break;
-    case pDoubleType: fprintf(JASM_FILE, "dcmpg\n"); break;
-    }
+    compareToJasm("<", L, R);
+}
 
-    fprintf(JASM_FILE, "ifeq TRUE%d\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_0\n");
-    fprintf(JASM_FILE, "\tgoto END_COMP%d\n", Label_Id);
-    fprintf(JASM_FILE, "TRUE%d:\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_1\n");
-    fprintf(JASM_FILE, "END_COMP%d: nop\n", Label_Id);
+void le_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+{
+    compareToJasm("<=", L, R);
+}
 
-    ++Label_Id;
+void eq_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+{
+    compareToJasm("==", L, R);
 }
 
 void ge_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-
-    // compute L - R
-    switch (L->resultTypeInfo.type) {
-    case pIntType:    fprintf(JASM_FILE, "isub\n");  break;
-    case pFloatType:  fprintf(JASM_FILE, "fcmpg\n"); break;
-    case pDoubleType: fprintf(JASM_FILE, "dcmpg\n"); break;
-    }
-
-    fprintf(JASM_FILE, "ifge TRUE%d\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_0\n");
-    fprintf(JASM_FILE, "\tgoto END_COMP%d\n", Label_Id);
-    fprintf(JASM_FILE, "TRUE%d:\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_1\n");
-    fprintf(JASM_FILE, "END_COMP%d: nop\n", Label_Id);
-
-    ++Label_Id;
+    compareToJasm(">=", L, R);
 }
 
 void gt_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
+    compareToJasm(">", L, R);
+}
 
-    // compute L - R
-    switch (L->resultTypeInfo.type) {
-    case pIntType:    fprintf(JASM_FILE, "isub\n");  break;
-    case pFloatType:  fprintf(JASM_FILE, "fcmpg\n"); break;
-    case pDoubleType: fprintf(JASM_FILE, "dcmpg\n"); break;
-    }
+void ne_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+{
+    compareToJasm("!=", L, R);
+}
 
-    fprintf(JASM_FILE, "ifgt TRUE%d\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_0\n");
-    fprintf(JASM_FILE, "\tgoto END_COMP%d\n", Label_Id);
-    fprintf(JASM_FILE, "TRUE%d:\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_1\n");
-    fprintf(JASM_FILE, "END_COMP%d: nop\n", Label_Id);
+// CONDITIONAL JUMP /////////////////////////////////////////////////////////////////////
 
-    ++Label_Id;
+static void condJumpNodeToJasm(ExpressionNode_t *cond, bool jumpIfTrue, const char *labelPrefix, int labelID);
+
+void condJumpToJasm(ExpressionNode_t *cond, bool jumpIfTrue, const char *labelPrefix, int labelID)
+{
+    // 最外層：整個 condition 一起做 CSE
+    if (Expr_Depth++ == 0)
+        beginExpr(cond);
+
+    condJumpNodeToJasm(cond, jumpIfTrue, labelPrefix, labelID);
+
+    if (--Expr_Depth == 0)
+        endExpr();
 }
 
-void ne_ToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+static void condJumpNodeToJasm(ExpressionNode_t *cond, bool jumpIfTrue, const char *labelPrefix, int labelID)
 {
-    exprToJasm(L);
-    exprToJasm(R);
+    // 常數條件：無條件跳躍，或是不跳
+    if (cond->isConstExpr) {
+        if (cond->cBval == jumpIfTrue)
+            fprintf(JASM_FILE, "goto %s%d\n", labelPrefix, labelID);
+        return;
+    }
 
-    // compute L - R
-    switch (L->resultTypeInfo.type) {
-    case pIntType:    fprintf(JASM_FILE, "isub\n");  break;
-    case pFloatType:  fprintf(JASM_FILE, "fcmpg\n"); break;
-    case pDoubleType: fprintf(JASM_FILE, "dcmpg\n"); break;
+    // !R：反過來跳
+    if (cond->isOP && strcmp(cond->OP, "!") == 0) {
+        condJumpNodeToJasm(cond->rightOperand, !jumpIfTrue, labelPrefix, labelID);
+        return;
     }
 
-    fprintf(JASM_FILE, "ifne TRUE%d\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_0\n");
-    fprintf(JASM_FILE, "\tgoto END_COMP%d\n", Label_Id);
-    fprintf(JASM_FILE, "TRUE%d:\n", Label_Id);
-    fprintf(JASM_FILE, "\ticonst_1\n");
-    fprintf(JASM_FILE, "END_COMP%d: nop\n", Label_Id);
+    // 比較：直接用比較結果跳躍，不產生中間的 boolean
+    const char* suffix = cond->isOP ? compareSuffix(cond->OP, !jumpIfTrue) : NULL;
+    // Note: 先算右邊時比較 R, L，改用相反方向的後綴（float, double 用 fcmpl / dcmpl，見 compareToJasm）
+    if (suffix && cond->leftOperand->resultTypeInfo.type != pStringType) {
+        const bool rightFirst = isRightFirst(cond->OP, cond->leftOperand, cond->rightOperand);
+        exprToJasm(rightFirst ? cond->rightOperand : cond->leftOperand);
+        exprToJasm(rightFirst ? cond->leftOperand : cond->rightOperand);
+        if (rightFirst)
+            suffix = mirrorCompareSuffix(suffix);
+
+        switch (cond->leftOperand->resultTypeInfo.type) {
+        case pIntType: case pBoolType:
+            fprintf(JASM_FILE, "if_icmp%s %s%d\n", suffix, labelPrefix, labelID);
+            return;
+        case pFloatType:  fprintf(JASM_FILE, rightFirst ? "fcmpl\n" : "fcmpg\n"); break;
+        case pDoubleType: fprintf(JASM_FILE, rightFirst ? "dcmpl\n" : "dcmpg\n"); break;
+        }
 
-    ++Label_Id;
+        fprintf(JASM_FILE, "if%s %s%d\n", suffix, labelPrefix, labelID);
+        return;
+    }
+
+    // 其他：算出 boolean 後再跳
+    exprToJasm(cond);
+    fprintf(JASM_FILE, "%s %s%d\n", jumpIfTrue ? "ifne" : "ifeq", labelPrefix, labelID);
 }
 
 // ARITHMETIC ////////////////////////////////////////////////////////////////////////////
 
-void addToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+// 兩個運算元（型別為 type）都在 stack 上之後的運算指令（+, -, *, /, %, &&, ||）
+static void binaryOpcodeToJasm(const char* OP, PrimitiveType_t type)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    switch (L->resultTypeInfo.type) {
-        case pIntType:    fprintf(JASM_FILE, "iadd\n"); break;
-        case pFloatType:  fprintf(JASM_FILE, "fadd\n"); break;
-        case pDoubleType: fprintf(JASM_FILE, "dadd\n"); break;
-        case pStringType: yyerror("Not Implemented - String Concatanation"); exit(-1);
+    if (strcmp(OP, "&&") == 0) {
+        fprintf(JASM_FILE, "iand\n");
+        return;
+    }
+    if (strcmp(OP, "||") == 0) {
+        fprintf(JASM_FILE, "ior\n");
+        return;
+    }
+
+    if (type == pStringType && strcmp(OP, "+") == 0) {
+        yyerror("Not Implemented - String Concatanation");
+        exit(-1);
+    }
+
+    const char* name = strcmp(OP, "+") == 0 ? "add"
+                     : strcmp(OP, "-") == 0 ? "sub"
+                     : strcmp(OP, "*") == 0 ? "mul"
+                     : strcmp(OP, "/") == 0 ? "div"
+                     : "rem";
+    // Note: % 只有 int
+    const bool isIntOnly = strcmp(OP, "%") == 0;
+    switch (type) {
+        case pIntType:    fprintf(JASM_FILE, "i%s\n", name); break;
+        case pFloatType:  if (!isIntOnly) fprintf(JASM_FILE, "f%s\n", name); break;
+        case pDoubleType: if (!isIntOnly) fprintf(JASM_FILE, "d%s\n", name); break;
+        default: break;
     }
 }
 
+void addToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
+{
+    operandsToJasm("+", L, R);
+    binaryOpcodeToJasm("+", L->resultTypeInfo.type);
+}
+
 void subToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    switch (L->resultTypeInfo.type) {
-        case pIntType:    fprintf(JASM_FILE, "isub\n"); break;
-        case pFloatType:  fprintf(JASM_FILE, "fsub\n"); break;
-        case pDoubleType: fprintf(JASM_FILE, "dsub\n"); break;
-    }
+    operandsToJasm("-", L, R);
+    binaryOpcodeToJasm("-", L->resultTypeInfo.type);
+}
+
+// R 是否為 int 常數 2^k（回傳 k，不是的話回傳 -1）；只有開啟化簡時才做 strength reduction
+static int powerOfTwoExponent(ExpressionNode_t *R)
+{
+    if (!Enable_Expr_Simplification || !R->isConstExpr || R->resultTypeInfo.type != pIntType)
+        return -1;
+
+    const unsigned value = (unsigned)R->cIval;
+    if (value == 0 || (value & (value - 1)) != 0)
+        return -1;
+
+    int k = 0;
+    while ((1u << k) != value)
+        ++k;
+    return k;
+}
+
+// 產生 x 的 bias：x < 0 時為 2^k - 1，否則為 0（x 在 stack 最上面，執行後變成 x, bias）
+static void signedBiasToJasm(int k)
+{
+    fprintf(JASM_FILE, "dup\n");
+    fprintf(JASM_FILE, "ldc 31\nishr\n");       // 0 或 -1
+    fprintf(JASM_FILE, "ldc %d\niushr\n", 32 - k); // 0 或 2^k - 1
 }
 
 void mulToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    switch (L->resultTypeInfo.type) {
-        case pIntType:    fprintf(JASM_FILE, "imul\n"); break;
-        case pFloatType:  fprintf(JASM_FILE, "fmul\n"); break;
-        case pDoubleType: fprintf(JASM_FILE, "dmul\n"); break;
+    // x * 2^k -> x << k
+    const int k = powerOfTwoExponent(R);
+    if (k > 0) {
+        exprToJasm(L);
+        fprintf(JASM_FILE, "ldc %d\nishl\n", k);
+        return;
     }
+
+    operandsToJasm("*", L, R);
+    binaryOpcodeToJasm("*", L->resultTypeInfo.type);
 }
 
 void divToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    switch (L->resultTypeInfo.type) {
-        case pIntType:    fprintf(JASM_FILE, "idiv\n"); break;
-        case pFloatType:  fprintf(JASM_FILE, "fdiv\n"); break;
-        case pDoubleType: fprintf(JASM_FILE, "ddiv\n"); break;
+    // x / 2^k -> (x + bias) >> k，bias 讓負數也是向 0 取整
+    const int k = powerOfTwoExponent(R);
+    if (k > 0 && k < 31) {
+        exprToJasm(L);
+        signedBiasToJasm(k);
+        fprintf(JASM_FILE, "iadd\n");
+        fprintf(JASM_FILE, "ldc %d\nishr\n", k);
+        return;
     }
+
+    operandsToJasm("/", L, R);
+    binaryOpcodeToJasm("/", L->resultTypeInfo.type);
 }
 
 void modToJasm(ExpressionNode_t *L, ExpressionNode_t *R)
 {
-    exprToJasm(L);
-    exprToJasm(R);
-    switch (L->resultTypeInfo.type) {
-        case pIntType:    fprintf(JASM_FILE, "irem\n"); break;
+    // x % 2^k -> x - ((x + bias) & -2^k)，結果和 x 同號
+    const int k = powerOfTwoExponent(R);
+    if (k > 0 && k < 31) {
+        exprToJasm(L);
+        fprintf(JASM_FILE, "dup\n");
+        signedBiasToJasm(k);
+        fprintf(JASM_FILE, "iadd\n");
+        fprintf(JASM_FILE, "ldc %d\niand\n", -(1 << k));
+        fprintf(JASM_FILE, "isub\n");
+        return;
     }
+
+    operandsToJasm("%", L, R);
+    binaryOpcodeToJasm("%", L->resultTypeInfo.type);
 }
 
 void posToJasm(ExpressionNode_t *R)
@@ -469,6 +1044,14 @@ void suffixDecrToJasm(ExpressionNode_t *lvalue)
 
 void funcCallToJasm(ExpressionNode_t *funcCallExpr)
 {
+    // 小函數直接展開
+    if (inlineFuncCallToJasm(funcCallExpr))
+        return;
+
+    // 有常數參數時呼叫特化的版本
+    if (specializedFuncCallToJasm(funcCallExpr))
+        return;
+
     // parameters
     for (ExpressionNode_t* param = funcCallExpr->rightOperand; param; param = param->nextExpression) {
         exprToJasm(param);
@@ -1,6 +1,23 @@
 #pragma once
 #include "expression.h"
 
+// 每個 method 的 max_locals，以及無法計算 max_stack 時使用的 max_stack（見 computeJasmMaxStack）
+#define JASM_MAX_STACK  15
+#define JASM_MAX_LOCALS 15
+
+/**
+ * 是否做 common subexpression elimination，預設為 true
+ * @details 同一個 statement 中重複出現、沒有副作用的 subexpression 只計算一次，結果存進暫存區域變數
+ */
+extern bool Enable_CSE;
+
+/**
+ * 是否依照需要的 operand stack 格數決定二元運算的計算順序（--no-stack-order 可關閉），預設為 true
+ * @details Sethi–Ullman 標號：先計算需要比較多格的運算元，兩邊都沒有副作用時才交換；
+ *          可交換的運算直接交換，-, /, % 用 swap 換回來，比較運算改用相反方向的比較
+ */
+extern bool Enable_Stack_Ordering;
+
 /**
  * expression statement的結尾，要把最上面的值pop
  */
@@ -11,6 +28,12 @@ void popExprResult(Type_Info_t type);
  */
 void exprToJasm(ExpressionNode_t* expr);
 
+/**
+ * 每個函數開始產生之前呼叫：比較運算的 label 從 0 開始編號
+ * Note: label 只在 method 中有效，每個函數各自編號，函數的 JASM 就和其他函數無關
+ */
+void resetExprLabels(void);
+
 // ASSIGN /////////////////////////
 void assignToJasm(const char* identifier, int localVariableIndex, ExpressionNode_t* expr);
 
@@ -27,6 +50,13 @@ void ge_ToJasm(ExpressionNode_t* L, ExpressionNode_t* R);
 void gt_ToJasm(ExpressionNode_t* L, ExpressionNode_t* R);
 void ne_ToJasm(ExpressionNode_t* L, ExpressionNode_t* R);
 
+// CONDITIONAL JUMP ///////////////
+/**
+ * 依據 cond 的結果跳躍：jumpIfTrue 為 true 時，cond 成立就跳到 `labelPrefix labelID`，否則 cond 不成立時才跳
+ * @details 比較運算子會直接產生 if_icmpXX / ifXX，不經過中間的 boolean；常數條件只會產生 goto 或什麼都不產生
+ */
+void condJumpToJasm(ExpressionNode_t* cond, bool jumpIfTrue, const char* labelPrefix, int labelID);
+
 // ARITHMETIC /////////////////////
 void addToJasm(ExpressionNode_t* L, ExpressionNode_t* R);
 void subToJasm(ExpressionNode_t* L, ExpressionNode_t* R);
@@ -1,7 +1,10 @@
 #include "expression.h"
+#include "constEval.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
 
 // decl
 void yyerror(char* msg);
@@ -134,20 +137,112 @@ static inline ExpressionNode_t* allocNewOperatorNode(
     return newNode;
 }
 
-void dumpExprTree(FILE* file, ExpressionNode_t *root)
+// int 的除法和取餘能不能在編譯時期計算（除以 0 要留到執行時期丟出例外；INT_MIN / -1 在 C 中是 undefined behavior）
+static inline bool isFoldableIntDivision(ExpressionNode_t* L, ExpressionNode_t* R) {
+    if (L->resultTypeInfo.type != pIntType)
+        return true;
+    return R->cIval != 0 && !(L->cIval == INT_MIN && R->cIval == -1);
+}
+
+// float / double 的計算結果為 inf 或 NaN 時 ldc 無法表示，留到執行時期計算
+static inline void unfoldNonFinite(ExpressionNode_t* N) {
+    if ((N->resultTypeInfo.type == pFloatType && !isfinite(N->cFval)) || (N->resultTypeInfo.type == pDoubleType && !isfinite(N->cDval)))
+        N->isConstExpr = false;
+}
+
+// Traversal ////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// 走訪運算樹用的 explicit stack
+typedef struct ExprStack_t {
+    ExpressionNode_t** nodes;
+    unsigned size;
+    unsigned capacity;
+} ExprStack_t;
+
+static void pushExpr(ExprStack_t* stack, ExpressionNode_t* node)
 {
-    if (root == NULL)
-        return;
+    if (stack->size == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->nodes = realloc(stack->nodes, stack->capacity * sizeof(ExpressionNode_t*));
+    }
+    stack->nodes[stack->size++] = node;
+}
+
+unsigned postorderExprTree(ExpressionNode_t* root, ExpressionNode_t*** order)
+{
+    ExprStack_t stack = { 0 };
+    ExprStack_t result = { 0 };
+
+    // 「節點、最後一個運算元、...、第一個運算元」的前序反過來就是後序
+    if (root)
+        pushExpr(&stack, root);
+    while (stack.size > 0) {
+        ExpressionNode_t* node = stack.nodes[--stack.size];
+        pushExpr(&result, node);
+
+        if (node->leftOperand)
+            pushExpr(&stack, node->leftOperand);
+        for (ExpressionNode_t* operand = node->rightOperand; operand; operand = operand->nextExpression) {
+            pushExpr(&stack, operand);
+            if (!node->isArrayIndexOP && !node->isFuncCallOP)
+                break;
+        }
+    }
+    free(stack.nodes);
 
+    for (unsigned i = 0, j = result.size; i + 1 < j; ++i, --j) {
+        ExpressionNode_t* temp = result.nodes[i];
+        result.nodes[i] = result.nodes[j - 1];
+        result.nodes[j - 1] = temp;
+    }
+
+    *order = result.nodes;
+    return result.size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// dumpExprTree 還沒輸出的部分
+typedef enum DumpItemKind_t {
+    dumpNode,       // 整個節點
+    dumpText,       // 固定的字串
+    dumpOperator,   // 節點的運算子
+    dumpValue,      // 節點在編譯時期的計算結果
+} DumpItemKind_t;
+
+typedef struct DumpItem_t {
+    DumpItemKind_t kind;
+    ExpressionNode_t* node;
+    const char* text;
+} DumpItem_t;
+
+typedef struct DumpStack_t {
+    DumpItem_t* items;
+    unsigned size;
+    unsigned capacity;
+} DumpStack_t;
+
+static void pushDumpItem(DumpStack_t* stack, DumpItemKind_t kind, ExpressionNode_t* node, const char* text)
+{
+    if (stack->size == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->items = realloc(stack->items, stack->capacity * sizeof(DumpItem_t));
+    }
+    stack->items[stack->size++] = (DumpItem_t){ kind, node, text };
+}
+
+// 節點的 token 之後、運算結果之前的部分，依照輸出的順序 push（呼叫者再整段反轉）
+static void pushDumpOperands(DumpStack_t* stack, FILE* file, ExpressionNode_t* root)
+{
     // Array Index /////////////////////////////////
     if (root->isArrayIndexOP) {
         fprintf(file, " %s", root->sval);  // Array Name
 
         // index 組成的 linked list 放在 root->rightOperand                移至下個 index
         for (ExpressionNode_t* indexHead = root->rightOperand; indexHead; indexHead = indexHead->nextExpression) {
-            fprintf(file, "[");
-            dumpExprTree(file, indexHead);
-            fprintf(file, "]");
+            pushDumpItem(stack, dumpText, NULL, "[");
+            pushDumpItem(stack, dumpNode, indexHead, NULL);
+            pushDumpItem(stack, dumpText, NULL, "]");
         }
     }
     // Function Call ///////////////////////////////
@@ -158,30 +253,33 @@ void dumpExprTree(FILE* file, ExpressionNode_t *root)
         unsigned counter = 0;
         for (ExpressionNode_t* paramHead = root->rightOperand; paramHead; paramHead = paramHead->nextExpression) {
             if (counter++) 
-                fprintf(file, ",");
+                pushDumpItem(stack, dumpText, NULL, ",");
 
-            dumpExprTree(file, paramHead);
+            pushDumpItem(stack, dumpNode, paramHead, NULL);
         }
 
-        fprintf(file, ") ");
+        pushDumpItem(stack, dumpText, NULL, ") ");
     }
     // Operator ////////////////////////////////////
     else if (root->isOP) {
         fprintf(file, " ( ");
-        dumpExprTree(file, root->leftOperand);   // 左運算元
-        fprintf(file, " %s ", root->OP);         // 運算子
-        dumpExprTree(file, root->rightOperand);  // 右運算元
-        fprintf(file, " ) ");
+        pushDumpItem(stack, dumpNode, root->leftOperand, NULL);   // 左運算元
+        pushDumpItem(stack, dumpOperator, root, NULL);            // 運算子
+        pushDumpItem(stack, dumpNode, root->rightOperand, NULL);  // 右運算元
+        pushDumpItem(stack, dumpText, NULL, " ) ");
     }
     // Variable Name ///////////////////////////////
     else if (root->isID) {
         fprintf(file, " %s ", root->sval); // 印出 ID
     }
-    
-    // 如果不是編譯時期常數，則結束；否則，繼續往下並印出值
-    if (!root->isConstExpr)
-        return;
 
+    // 如果是編譯時期常數，最後印出值
+    if (root->isConstExpr)
+        pushDumpItem(stack, dumpValue, root, NULL);
+}
+
+static void dumpExprValue(FILE* file, ExpressionNode_t *root)
+{
     // 加上 => 以區分原始 token 及運算結果
     if (root->isID || root->isOP)
         fprintf(file, "\e[35m=>");
@@ -197,26 +295,68 @@ void dumpExprTree(FILE* file, ExpressionNode_t *root)
     fprintf(file, "\e[m");
 }
 
-void freeExprTree(ExpressionNode_t *root)
+void dumpExprTree(FILE* file, ExpressionNode_t *root)
 {
-    if (root == NULL)
-        return;
-
-    freeExprTree(root->leftOperand);
-    freeExprTree(root->rightOperand);
-    freeExprTree(root->nextExpression);
+    DumpStack_t stack = { 0 };
+    pushDumpItem(&stack, dumpNode, root, NULL);
+
+    while (stack.size > 0) {
+        const DumpItem_t item = stack.items[--stack.size];
+
+        switch (item.kind) {
+        case dumpText:     fputs(item.text, file);                       break;
+        case dumpOperator: fprintf(file, " %s ", item.node->OP);        break;
+        case dumpValue:    dumpExprValue(file, item.node);               break;
+        case dumpNode:
+            if (item.node == NULL)
+                break;
+
+            // 之後要輸出的部分反過來放，最先輸出的在最上面
+            const unsigned begin = stack.size;
+            pushDumpOperands(&stack, file, item.node);
+            for (unsigned i = begin, j = stack.size; i + 1 < j; ++i, --j) {
+                const DumpItem_t temp = stack.items[i];
+                stack.items[i] = stack.items[j - 1];
+                stack.items[j - 1] = temp;
+            }
+            break;
+        }
+    }
 
-    // 䆁放 ID / Array Name / Function Name 的字串
-    if (root->isID || root->isArrayIndexOP || root->isFuncCallOP)
-        free(root->sval);
+    free(stack.items);
+}
 
-    // 䆁放字串運算結果
-    // Note:  root 是 ID，代表 root->cSval 指向 symbol table 內的字串，這時不應該䆁放
-    if (root->isConstExpr && root->resultTypeInfo.type == pStringType && !root->isID)
-        free(root->cSval);
+void freeExprTree(ExpressionNode_t *root)
+{
+    ExprStack_t stack = { 0 };
+    if (root)
+        pushExpr(&stack, root);
+
+    while (stack.size > 0) {
+        ExpressionNode_t* node = stack.nodes[--stack.size];
+
+        // 運算元和 linked list 的下一個之後再䆁放
+        if (node->leftOperand)
+            pushExpr(&stack, node->leftOperand);
+        if (node->rightOperand)
+            pushExpr(&stack, node->rightOperand);
+        if (node->nextExpression)
+            pushExpr(&stack, node->nextExpression);
+
+        // 䆁放 ID / Array Name / Function Name 的字串
+        if (node->isID || node->isArrayIndexOP || node->isFuncCallOP)
+            free(node->sval);
+
+        // 䆁放字串運算結果
+        // Note:  node 是 ID，代表 node->cSval 指向 symbol table 內的字串，這時不應該䆁放
+        if (node->isConstExpr && node->resultTypeInfo.type == pStringType && !node->isID)
+            free(node->cSval);
+
+        // 䆁放node
+        free(node);
+    }
 
-    // 䆁放root
-    free(root);
+    free(stack.nodes);
 }
 
 bool isExprLvalue(ExpressionNode_t *root)
@@ -244,6 +384,377 @@ bool isExprHasSideEffect(ExpressionNode_t *root)
 }
 
 
+bool isExprPure(ExpressionNode_t *root)
+{
+    if (root == NULL)
+        return true;
+
+    // 函數可能有副作用
+    if (root->isFuncCallOP)
+        return false;
+
+    if (root->isArrayIndexOP) {
+        for (ExpressionNode_t* index = root->rightOperand; index; index = index->nextExpression)
+            if (!isExprPure(index))
+                return false;
+        return true;
+    }
+
+    if (root->isOP && (strcmp(root->OP, "=") == 0 || strcmp(root->OP, "++") == 0 || strcmp(root->OP, "--") == 0))
+        return false;
+
+    return isExprPure(root->leftOperand) && isExprPure(root->rightOperand);
+}
+
+// FNV-1a
+static unsigned hashBytes(unsigned hash, const void* bytes, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= ((const unsigned char*)bytes)[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+unsigned hashExprTree(ExpressionNode_t *root, unsigned (*operandHash)(ExpressionNode_t* operand))
+{
+    if (root == NULL)
+        return 0;
+
+    const unsigned kind = root->isArrayIndexOP | root->isFuncCallOP << 1 | root->isOP << 2 | root->isConstExpr << 3 | root->isID << 4;
+    unsigned hash = hashBytes(2166136261u, &kind, sizeof(kind));
+    hash = hashBytes(hash, &root->resultTypeInfo.type, sizeof(root->resultTypeInfo.type));
+
+    if (root->isConstExpr) {
+        switch (root->resultTypeInfo.type) {
+        case pIntType:    return hashBytes(hash, &root->cIval, sizeof(root->cIval));
+        case pFloatType:  return hashBytes(hash, &root->cFval, sizeof(root->cFval));
+        case pDoubleType: return hashBytes(hash, &root->cDval, sizeof(root->cDval));
+        case pBoolType:   return hashBytes(hash, &root->cBval, sizeof(root->cBval));
+        case pStringType: return hashBytes(hash, root->cSval, strlen(root->cSval));
+        default:          return hash;
+        }
+    }
+
+    if (root->isOP)
+        hash = hashBytes(hash, root->OP, strlen(root->OP));
+    else if (root->isID || root->isArrayIndexOP || root->isFuncCallOP)
+        hash = hashBytes(hash, root->sval, strlen(root->sval));
+
+    hash = hash * 31 + operandHash(root->leftOperand);
+
+    // ArrayIndexOP 和 FuncCallOP 的 rightOperand 是 linked list
+    for (ExpressionNode_t* operand = root->rightOperand; operand; operand = operand->nextExpression) {
+        hash = hash * 31 + operandHash(operand);
+        if (!root->isArrayIndexOP && !root->isFuncCallOP)
+            break;
+    }
+
+    return hash;
+}
+
+// 只比較節點本身（不含運算元）是否相同
+static bool isSameExprNode(ExpressionNode_t *A, ExpressionNode_t *B)
+{
+    if (A->isArrayIndexOP != B->isArrayIndexOP || A->isFuncCallOP != B->isFuncCallOP || A->isOP != B->isOP
+        || A->isConstExpr != B->isConstExpr || A->isID != B->isID || A->resultTypeInfo.type != B->resultTypeInfo.type)
+        return false;
+
+    if (A->isConstExpr) {
+        switch (A->resultTypeInfo.type) {
+        case pIntType:    return A->cIval == B->cIval;
+        case pFloatType:  return memcmp(&A->cFval, &B->cFval, sizeof(A->cFval)) == 0;  // 0.0 和 -0.0 不同
+        case pDoubleType: return memcmp(&A->cDval, &B->cDval, sizeof(A->cDval)) == 0;
+        case pBoolType:   return A->cBval == B->cBval;
+        case pStringType: return strcmp(A->cSval, B->cSval) == 0;
+        default:          return false;
+        }
+    }
+
+    if (A->isOP && strcmp(A->OP, B->OP) != 0)
+        return false;
+    if ((A->isID || A->isArrayIndexOP || A->isFuncCallOP) && strcmp(A->sval, B->sval) != 0)
+        return false;
+    if (A->isID)
+        return A->localVariableIndex == B->localVariableIndex;
+    return true;
+}
+
+bool isSameExprTree(ExpressionNode_t *A, ExpressionNode_t *B)
+{
+    // 還沒比較的節點，兩棵樹的節點成對放在一起
+    ExprStack_t stack = { 0 };
+    pushExpr(&stack, A);
+    pushExpr(&stack, B);
+
+    bool isSame = true;
+    while (isSame && stack.size > 0) {
+        ExpressionNode_t* b = stack.nodes[--stack.size];
+        ExpressionNode_t* a = stack.nodes[--stack.size];
+
+        if (a == NULL || b == NULL) {
+            isSame = a == b;
+            continue;
+        }
+
+        isSame = isSameExprNode(a, b);
+        if (!isSame || a->isConstExpr || a->isID)
+            continue;
+
+        pushExpr(&stack, a->leftOperand);
+        pushExpr(&stack, b->leftOperand);
+
+        if (!a->isArrayIndexOP && !a->isFuncCallOP) {
+            pushExpr(&stack, a->rightOperand);
+            pushExpr(&stack, b->rightOperand);
+            continue;
+        }
+
+        // ArrayIndexOP 和 FuncCallOP 的 rightOperand 是 linked list，長度也要相同
+        ExpressionNode_t* x = a->rightOperand;
+        ExpressionNode_t* y = b->rightOperand;
+        for (; x && y; x = x->nextExpression, y = y->nextExpression) {
+            pushExpr(&stack, x);
+            pushExpr(&stack, y);
+        }
+        isSame = x == y;
+    }
+
+    free(stack.nodes);
+    return isSame;
+}
+
+// Simplification /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool Enable_Expr_Simplification = true;
+
+// N 是否為值等於 value 的常數（int, float, double）
+static inline bool isNumericConstant(ExpressionNode_t* N, int value) {
+    if (!N->isConstExpr)
+        return false;
+
+    switch (N->resultTypeInfo.type) {
+    case pIntType:    return N->cIval == value;
+    case pFloatType:  return N->cFval == value;
+    case pDoubleType: return N->cDval == value;
+    default:          return false;
+    }
+}
+
+// N 是否為「非常數」的二元運算 OP，且右運算元為 int 常數（如 x + 3）
+static inline bool isOperatorWithIntConstant(ExpressionNode_t* N, const char* OP) {
+    return N->isOP && !N->isConstExpr && N->leftOperand && strcmp(N->OP, OP) == 0
+        && N->rightOperand->isConstExpr && N->rightOperand->resultTypeInfo.type == pIntType;
+}
+
+// N 計算時是否可能丟出例外（int 的除法、取餘，除數不是非 0 的常數）
+static bool isExprMayThrow(ExpressionNode_t* N) {
+    if (N == NULL || N->isConstExpr)
+        return false;
+
+    if (N->isOP && N->leftOperand && (strcmp(N->OP, "/") == 0 || strcmp(N->OP, "%") == 0) && N->resultTypeInfo.type == pIntType
+        && !(N->rightOperand->isConstExpr && N->rightOperand->cIval != 0))
+        return true;
+
+    return isExprMayThrow(N->leftOperand) || isExprMayThrow(N->rightOperand) || isExprMayThrow(N->nextExpression);
+}
+
+// N 是否可以不計算，直接丟掉（沒有副作用，也不會丟出例外）
+static inline bool isExprRemovable(ExpressionNode_t* N) {
+    return isExprPure(N) && !isExprMayThrow(N);
+}
+
+static ExpressionNode_t* allocIntConstantNode(int value) {
+    ExpressionNode_t* newNode = calloc(1, sizeof(ExpressionNode_t));
+    newNode->isConstExpr = true;
+    newNode->resultTypeInfo = INT_TYPE;
+    newNode->ival = value;
+    newNode->cIval = value;
+    return newNode;
+}
+
+// 只留下 N 的運算元 keep，其餘部分（包含 N）都䆁放
+static ExpressionNode_t* keepOperand(ExpressionNode_t* N, ExpressionNode_t* keep) {
+    if (N->leftOperand == keep)
+        N->leftOperand = NULL;
+    else
+        N->rightOperand = NULL;
+    freeExprTree(N);
+
+    // Note: 化簡前是運算結果，不能因為化簡就變成 lvalue（例如 `x + 0 = 1`）
+    keep->resultTypeInfo.isConst = true;
+    return keep;
+}
+
+// 將 N 換成 int 常數 value（只有 N 沒有副作用時才能這樣做）
+static ExpressionNode_t* replaceWithIntConstant(ExpressionNode_t* N, int value) {
+    freeExprTree(N);
+    return allocIntConstantNode(value);
+}
+
+// 將二元運算 N 變成 -L（N 的右運算元會被䆁放）
+static ExpressionNode_t* turnIntoNegative(ExpressionNode_t* N) {
+    freeExprTree(N->rightOperand);
+    N->rightOperand = N->leftOperand;
+    N->leftOperand = NULL;
+    strcpy(N->OP, "-");
+    return N;
+}
+
+/**
+ * 化簡「不是常數」的運算子節點 N（運算元已經化簡過），回傳化簡後的樹（N 可能會被䆁放）
+ * 
+ * 1. 恆等式：x + 0, x - 0, x * 1, x / 1, +x, -(-x), !!b, b && true, b || false
+ * 2. 運算元沒有副作用、也不會丟出例外（int 除以 0）時：x * 0, x % 1, b && false, b || true
+ * 3. int 常數的重新結合：c + x -> x + c, x - c -> x + (-c), (x + c1) + c2 -> x + (c1 + c2), (x * c1) * c2 -> x * (c1 * c2)
+ * 
+ * Note: float / double 只做 IEEE 754 下仍然成立的化簡（x + 0.0 在 x 為 -0.0 時不成立，x * 0.0 在 x 為 NaN 時不成立）
+ */
+static ExpressionNode_t* simplifyOperatorNode(ExpressionNode_t* N)
+{
+    if (!Enable_Expr_Simplification || N == NULL || N->isConstExpr)
+        return N;
+
+    ExpressionNode_t* L = N->leftOperand;
+    ExpressionNode_t* R = N->rightOperand;
+    const bool isInt = N->resultTypeInfo.type == pIntType;
+
+    // ADD /////////////////////////////////////////////////////////
+    if (strcmp(N->OP, "+") == 0 && L) {
+        // c + x -> x + c
+        if (isInt && L->isConstExpr) {
+            N->leftOperand = R;
+            N->rightOperand = L;
+            return simplifyOperatorNode(N);
+        }
+        // (x + c1) + c2 -> x + (c1 + c2)（Note: 用 unsigned 計算，和 JVM 一樣 overflow）
+        if (isInt && R->isConstExpr && isOperatorWithIntConstant(L, "+")) {
+            const int sum = (int)((unsigned)L->rightOperand->cIval + (unsigned)R->cIval);
+            freeExprTree(L->rightOperand);
+            L->rightOperand = allocIntConstantNode(sum);
+
+            N->leftOperand = NULL;
+            freeExprTree(N);
+            return simplifyOperatorNode(L);
+        }
+        // x + 0
+        if (isInt && isNumericConstant(R, 0))
+            return keepOperand(N, L);
+    }
+    // SUB /////////////////////////////////////////////////////////
+    else if (strcmp(N->OP, "-") == 0 && L) {
+        // x - c -> x + (-c)
+        if (isInt && R->isConstExpr && R->cIval != INT_MIN) {
+            const int negative = -R->cIval;
+            freeExprTree(R);
+            N->rightOperand = allocIntConstantNode(negative);
+            strcpy(N->OP, "+");
+            return simplifyOperatorNode(N);
+        }
+        // x - 0
+        if (isNumericConstant(R, 0))
+            return keepOperand(N, L);
+        // 0 - x -> -x
+        if (isInt && isNumericConstant(L, 0)) {
+            N->leftOperand = NULL;
+            freeExprTree(L);
+            return simplifyOperatorNode(N);
+        }
+    }
+    // MUL /////////////////////////////////////////////////////////
+    else if (strcmp(N->OP, "*") == 0) {
+        // c * x -> x * c
+        if (isInt && L->isConstExpr) {
+            N->leftOperand = R;
+            N->rightOperand = L;
+            return simplifyOperatorNode(N);
+        }
+        // (x * c1) * c2 -> x * (c1 * c2)
+        if (isInt && R->isConstExpr && isOperatorWithIntConstant(L, "*")) {
+            const int product = (int)((unsigned)L->rightOperand->cIval * (unsigned)R->cIval);
+            freeExprTree(L->rightOperand);
+            L->rightOperand = allocIntConstantNode(product);
+
+            N->leftOperand = NULL;
+            freeExprTree(N);
+            return simplifyOperatorNode(L);
+        }
+        // x * 1, 1 * x
+        if (isNumericConstant(R, 1))
+            return keepOperand(N, L);
+        if (isNumericConstant(L, 1))
+            return keepOperand(N, R);
+        // x * 0
+        if (isInt && isNumericConstant(R, 0) && isExprRemovable(L))
+            return replaceWithIntConstant(N, 0);
+        // x * -1 -> -x
+        if (isInt && isNumericConstant(R, -1))
+            return simplifyOperatorNode(turnIntoNegative(N));
+    }
+    // DIV /////////////////////////////////////////////////////////
+    else if (strcmp(N->OP, "/") == 0) {
+        // x / 1
+        if (isNumericConstant(R, 1))
+            return keepOperand(N, L);
+        // x / -1 -> -x（INT_MIN / -1 和 -INT_MIN 都是 INT_MIN）
+        if (isInt && isNumericConstant(R, -1))
+            return simplifyOperatorNode(turnIntoNegative(N));
+    }
+    // MOD /////////////////////////////////////////////////////////
+    else if (strcmp(N->OP, "%") == 0) {
+        // x % 1, x % -1
+        if ((isNumericConstant(R, 1) || isNumericConstant(R, -1)) && isExprRemovable(L))
+            return replaceWithIntConstant(N, 0);
+    }
+    // UNARY + - ///////////////////////////////////////////////////
+    else if (strcmp(N->OP, "+") == 0) {
+        return keepOperand(N, R);
+    }
+    else if (strcmp(N->OP, "-") == 0) {
+        // -(-x)
+        if (R->isOP && !R->isConstExpr && !R->leftOperand && strcmp(R->OP, "-") == 0) {
+            ExpressionNode_t* X = R->rightOperand;
+            R->rightOperand = NULL;
+            freeExprTree(N);
+            X->resultTypeInfo.isConst = true;
+            return X;
+        }
+    }
+    // LOGIC ///////////////////////////////////////////////////////
+    else if (strcmp(N->OP, "!") == 0) {
+        // !!b
+        if (R->isOP && !R->isConstExpr && strcmp(R->OP, "!") == 0) {
+            ExpressionNode_t* B = R->rightOperand;
+            R->rightOperand = NULL;
+            freeExprTree(N);
+            B->resultTypeInfo.isConst = true;
+            return B;
+        }
+    }
+    else if (strcmp(N->OP, "&&") == 0 || strcmp(N->OP, "||") == 0) {
+        // b && true, b || false：結果就是 b
+        // b && false, b || true：結果是常數，但 b 必須沒有副作用
+        const bool identity = N->OP[0] == '&';
+        ExpressionNode_t* constant = L->isConstExpr ? L : (R->isConstExpr ? R : NULL);
+        ExpressionNode_t* other = constant == L ? R : L;
+
+        if (constant && constant->cBval == identity)
+            return keepOperand(N, other);
+
+        if (constant && isExprRemovable(other)) {
+            freeExprTree(N);
+            ExpressionNode_t* newNode = calloc(1, sizeof(ExpressionNode_t));
+            newNode->isConstExpr = true;
+            newNode->resultTypeInfo = BOOL_TYPE;
+            newNode->bval = !identity;
+            newNode->cBval = !identity;
+            return newNode;
+        }
+    }
+
+    return N;
+}
+
 // ASSIGN /////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 ExpressionNode_t *exprAssign(ExpressionNode_t *leftOperand, ExpressionNode_t *rightOperand)
@@ -279,7 +790,7 @@ ExpressionNode_t *exprOR(ExpressionNode_t *leftOperand, ExpressionNode_t *rightO
         newNode->cBval = (leftOperand->cBval || rightOperand->cBval);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprAND(ExpressionNode_t *leftOperand, ExpressionNode_t *rightOperand)
@@ -299,7 +810,7 @@ ExpressionNode_t *exprAND(ExpressionNode_t *leftOperand, ExpressionNode_t *right
         newNode->cBval = (leftOperand->cBval && rightOperand->cBval);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprNOT(ExpressionNode_t *rightOperand)
@@ -317,7 +828,7 @@ ExpressionNode_t *exprNOT(ExpressionNode_t *rightOperand)
         newNode->cBval = (! rightOperand->cBval);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 // COMPARE ////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -526,9 +1037,10 @@ ExpressionNode_t *exprAdd(ExpressionNode_t *leftOperand, ExpressionNode_t *right
                 strcat(newNode->cSval, rightOperand->cSval);
             }
         }
+        unfoldNonFinite(newNode);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprMinus(ExpressionNode_t *leftOperand, ExpressionNode_t *rightOperand)
@@ -555,9 +1067,10 @@ ExpressionNode_t *exprMinus(ExpressionNode_t *leftOperand, ExpressionNode_t *rig
             case pFloatType:  newNode->cFval = leftOperand->cFval - rightOperand->cFval;   break;
             case pDoubleType: newNode->cDval = leftOperand->cDval - rightOperand->cDval;   break;
         }
+        unfoldNonFinite(newNode);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprMultiply(ExpressionNode_t *leftOperand, ExpressionNode_t *rightOperand)
@@ -584,9 +1097,10 @@ ExpressionNode_t *exprMultiply(ExpressionNode_t *leftOperand, ExpressionNode_t *
             case pFloatType:  newNode->cFval = leftOperand->cFval * rightOperand->cFval;   break;
             case pDoubleType: newNode->cDval = leftOperand->cDval * rightOperand->cDval;   break;
         }
+        unfoldNonFinite(newNode);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprDivide(ExpressionNode_t *leftOperand, ExpressionNode_t *rightOperand)
@@ -605,7 +1119,7 @@ ExpressionNode_t *exprDivide(ExpressionNode_t *leftOperand, ExpressionNode_t *ri
     ExpressionNode_t* newNode = allocNewOperatorNode(leftOperand->resultTypeInfo, "/", leftOperand, rightOperand);
 
     /* 編譯時期計算 */
-    if (leftOperand->isConstExpr && rightOperand->isConstExpr) {
+    if (leftOperand->isConstExpr && rightOperand->isConstExpr && isFoldableIntDivision(leftOperand, rightOperand)) {
         newNode->isConstExpr = true;
 
         switch (leftOperand->resultTypeInfo.type) {
@@ -613,9 +1127,10 @@ ExpressionNode_t *exprDivide(ExpressionNode_t *leftOperand, ExpressionNode_t *ri
             case pFloatType:  newNode->cFval = leftOperand->cFval / rightOperand->cFval;   break;
             case pDoubleType: newNode->cDval = leftOperand->cDval / rightOperand->cDval;   break;
         }
+        unfoldNonFinite(newNode);
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprMod(ExpressionNode_t *leftOperand, ExpressionNode_t *rightOperand)
@@ -630,12 +1145,12 @@ ExpressionNode_t *exprMod(ExpressionNode_t *leftOperand, ExpressionNode_t *right
     ExpressionNode_t* newNode = allocNewOperatorNode(INT_TYPE, "%", leftOperand, rightOperand);
 
     /* 編譯時期運算 */
-    if (leftOperand->isConstExpr && rightOperand->isConstExpr) {
+    if (leftOperand->isConstExpr && rightOperand->isConstExpr && isFoldableIntDivision(leftOperand, rightOperand)) {
         newNode->isConstExpr = true;
         newNode->cIval = leftOperand->cIval % rightOperand->cIval;
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprPositive(ExpressionNode_t *rightOperand)
@@ -662,7 +1177,7 @@ ExpressionNode_t *exprPositive(ExpressionNode_t *rightOperand)
         }
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 ExpressionNode_t *exprNegative(ExpressionNode_t *rightOperand)
@@ -689,7 +1204,7 @@ ExpressionNode_t *exprNegative(ExpressionNode_t *rightOperand)
         }
     }
 
-    return newNode;
+    return simplifyOperatorNode(newNode);
 }
 
 // INCR && DECR
@@ -831,5 +1346,46 @@ ExpressionNode_t *exprFuncCallOP(char *identifier, const Function_Type_Info_t T,
         return NULL;
     }
 
+    // 參數都是常數時，嘗試在編譯時期執行
+    return foldConstFuncCall(result);
+}
+
+// Refold /////////////////////////////////////////////////////////////////////////////////////////
+
+ExpressionNode_t *refoldOperatorNode(ExpressionNode_t *N)
+{
+    if (!N->isOP || N->isConstExpr)
+        return N;
+
+    ExpressionNode_t* L = N->leftOperand;
+    ExpressionNode_t* R = N->rightOperand;
+    ExpressionNode_t* (*binary)(ExpressionNode_t*, ExpressionNode_t*) = NULL;
+    ExpressionNode_t* (*unary)(ExpressionNode_t*) = NULL;
+
+    if      (strcmp(N->OP, "||") == 0) binary = exprOR;
+    else if (strcmp(N->OP, "&&") == 0) binary = exprAND;
+    else if (strcmp(N->OP, "!")  == 0) unary  = exprNOT;
+    else if (strcmp(N->OP, "<")  == 0) binary = exprLT;
+    else if (strcmp(N->OP, "<=") == 0) binary = exprLE;
+    else if (strcmp(N->OP, "==") == 0) binary = exprEQ;
+    else if (strcmp(N->OP, ">=") == 0) binary = exprGE;
+    else if (strcmp(N->OP, ">")  == 0) binary = exprGT;
+    else if (strcmp(N->OP, "!=") == 0) binary = exprNE;
+    else if (strcmp(N->OP, "+")  == 0) { if (L) binary = exprAdd;   else unary = exprPositive; }
+    else if (strcmp(N->OP, "-")  == 0) { if (L) binary = exprMinus; else unary = exprNegative; }
+    else if (strcmp(N->OP, "*")  == 0) binary = exprMultiply;
+    else if (strcmp(N->OP, "/")  == 0) binary = exprDivide;
+    else if (strcmp(N->OP, "%")  == 0) binary = exprMod;
+    // =, ++, -- 不需要重新計算
+    else
+        return N;
+
+    // 運算元已經檢查過型別，重新建立節點一定會成功
+    const unsigned isConst = N->resultTypeInfo.isConst;
+    free(N);
+    ExpressionNode_t* result = binary ? binary(L, R) : unary(R);
+
+    // Note: 化簡過的運算結果不是 lvalue，重建後也不能變成 lvalue
+    result->resultTypeInfo.isConst |= isConst;
     return result;
 }
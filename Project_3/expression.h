@@ -8,6 +8,7 @@
  * 
  *          isConstExpr 為真 => 輸入的token為literal || 輸入的token為const variable || 一個以上的ConstExpr作運算
  *          「陣列」、「陣列存取」和「函數的回傳值」不會是ConstExpr（太麻煩 = = ）
+ *          Note: 參數都是常數、且可以在編譯時期執行的函數呼叫例外，會直接換成回傳值的常數（見 constEval.h）
  */
 typedef struct ExpressionNode_t {
     unsigned isArrayIndexOP : 1;  // 是否為陣列存取運算子（如果是的話，sval 存 Array    Name，rightOperand 存所有 index expression 的 linked list）
@@ -43,6 +44,13 @@ typedef struct ExpressionNode_t {
     struct ExpressionNode_t* leftOperand;
     struct ExpressionNode_t* rightOperand;
     struct ExpressionNode_t* nextExpression; // 串成 linked list 時使用，只有 ArrayIndexOP 和 FuncCallOP 要用到
+
+    // 產生 JASM 時的標號：每個最外層的 expression 開始產生時，由 exprToJasm 走訪一次整棵樹算出來，之後才有意義
+    unsigned isPureTree : 1;      // 整棵樹沒有副作用（同 isExprPure）
+    unsigned isReadsWritten : 1;  // 讀到的變數可能在同一個 expression 中被寫入（CSE 用）
+    unsigned stackNeed;           // 計算這個節點時 operand stack 最多用到幾格（Sethi–Ullman 標號）
+    unsigned treeHash;            // hashExprTree
+    unsigned cseEntry;            // 所屬的 CSE entry 的 index + 1，0 代表沒有
 } ExpressionNode_t;
 
 /**
@@ -54,6 +62,14 @@ void dumpExprTree(FILE* file, ExpressionNode_t* root);
  */
 void freeExprTree(ExpressionNode_t* root);
 
+/**
+ * 依照後序（左運算元、右運算元、節點本身）排列 root 的所有節點，回傳節點數（*order 由呼叫者 free）
+ * @details 陣列存取的 index、函數呼叫的參數依序都是右運算元；不包含 root 本身的 nextExpression
+ *          Note: 走訪運算樹的函數（印出、䆁放、hash、比較、產生 JASM）都用 explicit stack 而不是遞迴，
+ *                機器產生的很深的 expression（例如上萬個連續的 +）也不會用完 C 的 stack
+ */
+unsigned postorderExprTree(ExpressionNode_t* root, ExpressionNode_t*** order);
+
 /**
  * Expression 是否為 lvalue （可出現在等號左邊）
  * 
@@ -67,6 +83,29 @@ bool isExprLvalue(ExpressionNode_t* root);
  */
 bool isExprHasSideEffect(ExpressionNode_t* root);
 
+/**
+ * Expression 是否沒有副作用（整棵樹都沒有 =, ++, -- 和函數呼叫），可以省略或重複計算
+ */
+bool isExprPure(ExpressionNode_t* root);
+
+/**
+ * 依據樹的結構計算 hash（結構相同的樹 hash 相同）
+ * @details 由節點本身和每個運算元的 hash 組成，運算元的 hash 由 operandHash 提供（運算元為 NULL 時也會呼叫），
+ *          由下往上計算時直接傳回算好的值，整棵樹只要走訪一次
+ */
+unsigned hashExprTree(ExpressionNode_t* root, unsigned (*operandHash)(ExpressionNode_t* operand));
+
+/**
+ * 兩棵樹的結構是否相同（同樣的運算子、變數和常數）
+ */
+bool isSameExprTree(ExpressionNode_t* A, ExpressionNode_t* B);
+
+/**
+ * 是否化簡 expression（恆等式、常數重新結合、乘除 2 的次方改成 shift），預設為 true
+ * @details 化簡在建立運算子節點時進行，所以下面的函數回傳的可能不是新的運算子節點
+ */
+extern bool Enable_Expr_Simplification;
+
 // ASSIGN
 ExpressionNode_t* exprAssign(ExpressionNode_t* leftOperand, ExpressionNode_t* rightOperand);
 // LOGIC
@@ -98,3 +137,8 @@ ExpressionNode_t* exprArrayIndexOP(char* identifier, const Type_Info_t T, Expres
 // FuncCallOP
 ExpressionNode_t* exprFuncCallOP(char* identifier, const Function_Type_Info_t T, ExpressionNode_t* params);
 
+/**
+ * 運算元被換掉（例如變數換成常數）之後，重新建立運算子節點 N，讓它重新做編譯時期計算和化簡
+ * @details N 會被䆁放（運算元保留），回傳新的節點；=, ++, --, 陣列存取和函數呼叫直接回傳 N
+ */
+ExpressionNode_t* refoldOperatorNode(ExpressionNode_t* N);
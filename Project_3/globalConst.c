@@ -0,0 +1,324 @@
+#include "globalConst.h"
+#include "jasmCode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+bool Enable_Global_Promotion = true;
+
+// Helper /////////////////////////////////////////////////////////////////////////////////////////
+
+static void removeLine(JasmLine_t* line)
+{
+    setJasmInstruction(line, NULL, NULL);
+}
+
+// 是否為 push int 常數的指令（ldc, iconst_N, bipush, sipush），是的話把值存進 value
+static bool getIntConstant(const JasmLine_t* line, int* value)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    if (isJasmOpcode(line, "ldc") || isJasmOpcode(line, "bipush") || isJasmOpcode(line, "sipush")) {
+        char* end = NULL;
+        long v = strtol(line->operand, &end, 10);
+        if (end == line->operand || *end != '\0' || v < INT_MIN || v > INT_MAX)
+            return false;
+        *value = (int)v;
+        return true;
+    }
+
+    if (isJasmOpcode(line, "iconst_m1")) {
+        *value = -1;
+        return true;
+    }
+    if (strncmp(line->opcode, "iconst_", 7) == 0 && line->opcode[7] >= '0' && line->opcode[7] <= '5' && line->opcode[8] == '\0') {
+        *value = line->opcode[7] - '0';
+        return true;
+    }
+    return false;
+}
+
+static void setIntConstant(JasmLine_t* line, int value)
+{
+    char operand[16];
+    sprintf(operand, "%d", value);
+    setJasmInstruction(line, "ldc", operand);
+}
+
+// 依照 JVM 的規則計算 A op B（overflow 時 wrap around），無法計算（除以 0、不是 int 運算）回傳 false
+static bool foldIntOperator(const char* op, int A, int B, int* result)
+{
+    unsigned a = (unsigned)A, b = (unsigned)B;
+
+    if      (strcmp(op, "iadd") == 0) *result = (int)(a + b);
+    else if (strcmp(op, "isub") == 0) *result = (int)(a - b);
+    else if (strcmp(op, "imul") == 0) *result = (int)(a * b);
+    else if (strcmp(op, "iand") == 0) *result = A & B;
+    else if (strcmp(op, "ior")  == 0) *result = A | B;
+    else if (strcmp(op, "ixor") == 0) *result = A ^ B;
+    else if (strcmp(op, "ishl") == 0) *result = (int)(a << (b & 31));
+    else if (strcmp(op, "ishr") == 0) *result = A >> (B & 31);
+    else if (strcmp(op, "iushr") == 0) *result = (int)(a >> (b & 31));
+    else if (strcmp(op, "idiv") == 0 || strcmp(op, "irem") == 0) {
+        if (B == 0)
+            return false;
+        // Note: INT_MIN / -1 在 C 中是 undefined behavior，JVM 的結果是 INT_MIN（餘數為 0）
+        if (A == INT_MIN && B == -1)
+            *result = op[1] == 'd' ? INT_MIN : 0;
+        else
+            *result = op[1] == 'd' ? A / B : A % B;
+    }
+    else
+        return false;
+
+    return true;
+}
+
+// cond 為 eq, ne, lt, ge, gt, le 其中之一，回傳 A cond B；cond 不合法時回傳 -1
+static int compareInt(const char* cond, int A, int B)
+{
+    if (strcmp(cond, "eq") == 0) return A == B;
+    if (strcmp(cond, "ne") == 0) return A != B;
+    if (strcmp(cond, "lt") == 0) return A <  B;
+    if (strcmp(cond, "ge") == 0) return A >= B;
+    if (strcmp(cond, "gt") == 0) return A >  B;
+    if (strcmp(cond, "le") == 0) return A <= B;
+    return -1;
+}
+
+// 常數 condition 的跳躍：成立時換成 goto，否則刪掉
+static void foldBranch(JasmLine_t* branch, bool isTaken)
+{
+    if (isTaken) {
+        char* target = strdup(branch->operand);
+        setJasmInstruction(branch, "goto", target);
+        free(target);
+    }
+    else
+        removeLine(branch);
+}
+
+// 執行完這個指令後不會執行下一行
+static bool isUnconditionalJump(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    size_t len = strlen(line->opcode);
+    return isJasmOpcode(line, "goto") || isJasmOpcode(line, "athrow") || (len >= 6 && strcmp(line->opcode + len - 6, "return") == 0);
+}
+
+// Constant Folding ///////////////////////////////////////////////////////////////////////////////
+
+// 對 lines[begin, end)（一個函數的 body）套用一輪規則，回傳是否有改變
+static bool foldOnce(JasmLine_t* lines, unsigned begin, unsigned end)
+{
+    bool changed = false;
+
+    for (unsigned i = begin; i < end; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (line->opcode == NULL)
+            continue;
+
+        int j = nextJasmInstruction(lines, end, i);
+        int k = j >= 0 ? nextJasmInstruction(lines, end, j) : -1;
+        int A, B, result;
+
+        if (getIntConstant(line, &A)) {
+            // ldc a; ldc b; op
+            if (j >= 0 && getIntConstant(&lines[j], &B) && k >= 0 && lines[k].opcode) {
+                if (foldIntOperator(lines[k].opcode, A, B, &result)) {
+                    setIntConstant(line, result);
+                    removeLine(&lines[j]);
+                    removeLine(&lines[k]);
+                    changed = true;
+                }
+                else if (strncmp(lines[k].opcode, "if_icmp", 7) == 0 && compareInt(lines[k].opcode + 7, A, B) >= 0) {
+                    foldBranch(&lines[k], compareInt(lines[k].opcode + 7, A, B));
+                    removeLine(line);
+                    removeLine(&lines[j]);
+                    changed = true;
+                }
+            }
+            // ldc a; dup -> ldc a; ldc a
+            else if (j >= 0 && isJasmOpcode(&lines[j], "dup")) {
+                setIntConstant(&lines[j], A);
+                changed = true;
+            }
+            // ldc a; ineg
+            else if (j >= 0 && isJasmOpcode(&lines[j], "ineg")) {
+                setIntConstant(line, (int)(0u - (unsigned)A));
+                removeLine(&lines[j]);
+                changed = true;
+            }
+            // ldc a; ifXX
+            else if (j >= 0 && lines[j].opcode && strncmp(lines[j].opcode, "if", 2) == 0 && compareInt(lines[j].opcode + 2, A, 0) >= 0) {
+                foldBranch(&lines[j], compareInt(lines[j].opcode + 2, A, 0));
+                removeLine(line);
+                changed = true;
+            }
+        }
+
+        if (line->opcode == NULL || !isUnconditionalJump(line))
+            continue;
+
+        // goto, return 之後到下一個 label 之前都無法到達
+        for (unsigned u = i + 1; u < end && lines[u].label == NULL; ++u) {
+            if (lines[u].opcode) {
+                removeLine(&lines[u]);
+                changed = true;
+            }
+            else if (lines[u].text && lines[u].text[0] != '\0')
+                break;
+        }
+
+        // 跳到下一行的 goto
+        if (isJasmOpcode(line, "goto")) {
+            unsigned u = i + 1;
+            while (u < end && lines[u].label == NULL && lines[u].opcode == NULL && (lines[u].text == NULL || lines[u].text[0] == '\0'))
+                ++u;
+
+            if (u < end && lines[u].label && strcmp(lines[u].label, line->operand) == 0) {
+                removeLine(line);
+                changed = true;
+            }
+        }
+    }
+
+    return changed;
+}
+
+// 對每個函數的 body（`{` 和 `}` 之間）做常數計算
+static void foldConstants(JasmLine_t* lines, unsigned lineNum)
+{
+    for (unsigned i = 0; i < lineNum; ++i) {
+        if (lines[i].opcode || lines[i].text == NULL || strcmp(lines[i].text, "{") != 0)
+            continue;
+
+        unsigned end = i + 1;
+        while (end < lineNum && !(lines[end].opcode == NULL && lines[end].text && lines[end].text[0] == '}'))
+            ++end;
+
+        while (foldOnce(lines, i + 1, end))
+            ;
+        i = end;
+    }
+}
+
+// 是否有指令跳到 label（跳躍指令的 operand，或是 tableswitch / lookupswitch 中的一行）
+static bool isLabelUsed(const JasmLine_t* lines, unsigned lineNum, const char* label)
+{
+    for (unsigned i = 0; i < lineNum; ++i) {
+        if (lines[i].opcode && (strcmp(lines[i].opcode, label) == 0 || strcmp(lines[i].operand, label) == 0))
+            return true;
+        if (lines[i].text && strstr(lines[i].text, label))
+            return true;
+    }
+    return false;
+}
+
+// 刪掉沒有被跳到的 label（之後前面的 goto, return 就能刪掉後面的 code）和沒有 label 的 nop，回傳是否有改變
+static bool removeUnusedLabels(JasmLine_t* lines, unsigned lineNum)
+{
+    bool changed = false;
+
+    for (unsigned i = 0; i < lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+
+        // Note: tableswitch, lookupswitch 的 `default:` 不是 label
+        if (line->label && strcmp(line->label, "default") != 0 && !isLabelUsed(lines, lineNum, line->label)) {
+            free(line->label);
+            line->label = NULL;
+            changed = true;
+        }
+        if (line->label == NULL && isJasmOpcode(line, "nop")) {
+            removeLine(line);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+char* foldJasmConstants(const char* body)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+
+    do {
+        while (foldOnce(lines, 0, lineNum))
+            ;
+    } while (removeUnusedLabels(lines, lineNum));
+
+    char* result = joinJasmLines(lines, lineNum);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
+
+// Promotion //////////////////////////////////////////////////////////////////////////////////////
+
+// 在 lines 中是否有 `opcode <typeAndName>`
+static bool hasFieldAccess(const JasmLine_t* lines, unsigned lineNum, const char* opcode, const char* typeAndName)
+{
+    for (unsigned i = 0; i < lineNum; ++i)
+        if (isJasmOpcode(&lines[i], opcode) && strcmp(lines[i].operand, typeAndName) == 0)
+            return true;
+    return false;
+}
+
+// 嘗試把 lines[fieldLine]（`field static <type> <name> [= <value>]`）換成常數，回傳是否成功
+static bool promoteField(JasmLine_t* lines, unsigned lineNum, unsigned fieldLine)
+{
+    char type[64], name[256], value[64] = "";
+    int n = sscanf(lines[fieldLine].operand, "static %63s %255s = %63s", type, name, value);
+    if (n < 2)
+        return false;
+
+    // 沒有初始值：JVM 的預設值
+    if (n == 2) {
+        if      (strcmp(type, "float") == 0)  strcpy(value, "0.000000e+00f");
+        else if (strcmp(type, "double") == 0) strcpy(value, "0.000000e+00");
+        else if (strcmp(type, "int") == 0 || strcmp(type, "boolean") == 0) strcpy(value, "0");
+        else return false;
+    }
+
+    char typeAndName[sizeof(type) + sizeof(name) + 1];
+    sprintf(typeAndName, "%s %s", type, name);
+
+    if (hasFieldAccess(lines, lineNum, "putstatic", typeAndName))
+        return false;
+
+    for (unsigned i = 0; i < lineNum; ++i)
+        if (isJasmOpcode(&lines[i], "getstatic") && strcmp(lines[i].operand, typeAndName) == 0)
+            setJasmInstruction(&lines[i], "ldc", value);
+
+    // 刪掉 field，以及它前面的註解（`/* int g */`）和後面的空行
+    removeLine(&lines[fieldLine]);
+    if (fieldLine > 0 && lines[fieldLine - 1].opcode == NULL && lines[fieldLine - 1].label == NULL
+        && lines[fieldLine - 1].text && strncmp(lines[fieldLine - 1].text, "/*", 2) == 0)
+        removeLine(&lines[fieldLine - 1]);
+    if (fieldLine + 1 < lineNum && lines[fieldLine + 1].opcode == NULL && lines[fieldLine + 1].label == NULL
+        && lines[fieldLine + 1].text && lines[fieldLine + 1].text[0] == '\0')
+        removeLine(&lines[fieldLine + 1]);
+
+    return true;
+}
+
+char* promoteReadOnlyGlobals(const char* classBody)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(classBody, &lineNum);
+    bool isPromoted = false;
+
+    for (unsigned i = 0; i < lineNum; ++i)
+        if (isJasmOpcode(&lines[i], "field") && promoteField(lines, lineNum, i))
+            isPromoted = true;
+
+    if (isPromoted)
+        foldConstants(lines, lineNum);
+
+    char* result = joinJasmLines(lines, lineNum);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdbool.h>
+
+/**
+ * 將整個程式中都沒有被寫入的全域變數換成常數
+ *
+ * @details 整個 class 都 parse 完之後才做（全域變數可能在任何函數中被修改）：
+ *          找出沒有任何 putstatic（`=`, `++`, `--`, foreach 的迴圈變數都會產生 putstatic）的 `field static`，
+ *          把讀取它的 getstatic 換成 ldc 初始值（沒有初始值則為 0），然後刪掉這個 field。
+ *          換完之後再對每個函數的 JASM 做一次 int 常數的計算：
+ *          - `ldc a; ldc b; iadd`      -> `ldc a+b`（其他 int 運算、ineg 也一樣，`ldc a; dup` 當成 `ldc a; ldc a`）
+ *          - `ldc a; ldc b; if_icmpXX` -> `goto` 或是整個刪掉（ifXX 也一樣）
+ *          - goto, return 之後到下一個 label 之前的指令刪掉，跳到下一行的 goto 也刪掉
+ */
+
+/**
+ * 是否將沒被寫入的全域變數換成常數（--no-global-promotion 可關閉），預設為 true
+ */
+extern bool Enable_Global_Promotion;
+
+/**
+ * classBody 是 class 的 `{` 和 `}` 之間所有的 JASM code，回傳處理後的 code（呼叫者負責 free）
+ */
+char* promoteReadOnlyGlobals(const char* classBody);
+
+/**
+ * 對一個函數的 body（`{` 和 `}` 之間的 JASM）做上面的 int 常數計算，回傳處理後的 body（呼叫者負責 free）
+ * 另外也會刪掉沒有被跳到的 label 和多餘的 nop，讓只能從被刪掉的分支跳進去的 code 也一起被刪掉
+ */
+char* foldJasmConstants(const char* body);
@@ -0,0 +1,215 @@
+#include "inliner.h"
+#include "exprToJasm.h"
+#include "jasmCode.h"
+#include "symbol_table.h"
+#include "type_info.h"
+#include "parallelCodegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern FILE* JASM_FILE;
+extern SymbolTable_t* Symbol_Table;
+
+unsigned Inline_Budget = 24;
+
+// Candidate //////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct InlineCandidate_t {
+    char* name;
+    char* body;
+    unsigned localNum;
+    struct InlineCandidate_t* next;
+} InlineCandidate_t;
+
+static InlineCandidate_t* Candidates = NULL;
+static unsigned Inline_Id = 0;
+
+// body 中是否呼叫了 name
+static bool isCalls(const char* body, const char* name)
+{
+    size_t len = strlen(name);
+
+    for (const char* p = strstr(body, "invokestatic "); p; p = strstr(p + 1, "invokestatic ")) {
+        // invokestatic <type> <name>(
+        const char* lineEnd = strchr(p, '\n');
+        const char* paren = strchr(p, '(');
+        if (paren == NULL || (lineEnd && paren > lineEnd) || (size_t)(paren - p) < len + 1)
+            continue;
+
+        if (strncmp(paren - len, name, len) == 0 && paren[-len - 1] == ' ')
+            return true;
+    }
+    return false;
+}
+
+static bool isReturn(const JasmLine_t* line)
+{
+    return line->opcode && (strcmp(line->opcode, "return") == 0 || strcmp(line->opcode, "ireturn") == 0
+                            || strcmp(line->opcode, "freturn") == 0 || strcmp(line->opcode, "dreturn") == 0);
+}
+
+// 每個 return 執行時 stack 上是否只有回傳值（ireturn, freturn 1 格，dreturn 2 格，return 0 格）
+// Note: generic foreach 中的 return 下面還有迴圈的結束值，換成 goto 之後不同路徑到達結尾時 stack 的格數不同
+static bool isReturnsOnlyResult(const char* body)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+    int* depths = malloc((lineNum + 1) * sizeof(int));
+    bool result = computeJasmStackDepths(lines, lineNum, depths) >= 0;
+
+    for (unsigned i = 0; i < lineNum && result; ++i) {
+        if (!isReturn(&lines[i]) || depths[i] < 0)
+            continue;
+
+        const char type = lines[i].opcode[0];
+        result = depths[i] == (type == 'r' ? 0 : type == 'd' ? 2 : 1);
+    }
+
+    free(depths);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
+
+void registerInlineCandidate(const char* name, const char* body, unsigned localNum)
+{
+    if (Inline_Budget == 0 || countJasmLines(body) > Inline_Budget || isCalls(body, name) || !isReturnsOnlyResult(body))
+        return;
+
+    InlineCandidate_t* candidate = calloc(1, sizeof(InlineCandidate_t));
+    candidate->name = strdup(name);
+    candidate->body = strdup(body);
+    candidate->localNum = localNum;
+    candidate->next = Candidates;
+    Candidates = candidate;
+}
+
+static InlineCandidate_t* findCandidate(const char* name)
+{
+    for (InlineCandidate_t* candidate = Candidates; candidate; candidate = candidate->next)
+        if (strcmp(candidate->name, name) == 0)
+            return candidate;
+    return NULL;
+}
+
+// Inline /////////////////////////////////////////////////////////////////////////////////////////
+
+static bool isLocalAccess(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    const char* op = line->opcode;
+    return ((op[0] == 'i' || op[0] == 'f' || op[0] == 'd') && (strcmp(op + 1, "load") == 0 || strcmp(op + 1, "store") == 0))
+           || strcmp(op, "iinc") == 0;
+}
+
+// 把 body 的區域變數 index 加上 base，return 換成 `goto endLabel`（最後一個指令的 return 直接刪掉）
+// *hasJump 會設為是否有產生 goto endLabel
+static char* rewriteBody(const char* body, unsigned base, const char* endLabel, bool* hasJump)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+
+    int lastInstruction = -1;
+    for (unsigned i = 0; i < lineNum; ++i)
+        if (lines[i].opcode)
+            lastInstruction = i;
+
+    *hasJump = false;
+    for (unsigned i = 0; i < lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+
+        if (isLocalAccess(line)) {
+            // Xload k, Xstore k, iinc k delta
+            char operand[64];
+            char* rest = NULL;
+            long index = strtol(line->operand, &rest, 10);
+            snprintf(operand, sizeof(operand), "%ld%s", index + base, rest);
+
+            char* opcode = strdup(line->opcode);
+            setJasmInstruction(line, opcode, operand);
+            free(opcode);
+        }
+        else if (isReturn(line)) {
+            if ((int)i == lastInstruction && line->label == NULL)
+                setJasmInstruction(line, NULL, NULL);
+            else {
+                setJasmInstruction(line, "goto", endLabel);
+                *hasJump = true;
+            }
+        }
+    }
+
+    char* result = joinJasmLines(lines, lineNum);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
+
+bool inlineFuncCallToJasm(ExpressionNode_t* funcCallExpr)
+{
+    // 在 global scope 沒有區域變數可以用
+    if (Inline_Budget == 0 || Symbol_Table == NULL || Symbol_Table->parent == NULL)
+        return false;
+
+    // callee 可能還在執行 function pass（見 parallelCodegen.h）
+    waitForFunction(funcCallExpr->sval);
+    InlineCandidate_t* candidate = findCandidate(funcCallExpr->sval);
+    if (candidate == NULL)
+        return false;
+
+    unsigned mark = getScratchMark(Symbol_Table);
+    if (mark + candidate->localNum > JASM_MAX_LOCALS)
+        return false;
+
+    // 參數
+    unsigned paramNum = 0;
+    for (ExpressionNode_t* param = funcCallExpr->rightOperand; param; param = param->nextExpression) {
+        exprToJasm(param);
+        ++paramNum;
+    }
+
+    // 分配 callee 的區域變數：base ~ base + localNum - 1
+    unsigned base = mark;
+    for (unsigned i = 0; i < candidate->localNum; ++i)
+        assignScratchIndex(Symbol_Table, pIntType);
+
+    // 參數的 index（和 assignIndex 的規則相同），由後往前存
+    ExpressionNode_t** params = malloc((paramNum + 1) * sizeof(ExpressionNode_t*));
+    unsigned* paramIndex = malloc((paramNum + 1) * sizeof(unsigned));
+    unsigned next = base;
+    paramNum = 0;
+    for (ExpressionNode_t* param = funcCallExpr->rightOperand; param; param = param->nextExpression) {
+        params[paramNum] = param;
+        paramIndex[paramNum++] = next;
+        next += param->resultTypeInfo.type == pDoubleType ? 2 : 1;
+    }
+
+    for (unsigned i = paramNum; i-- > 0; ) {
+        switch (params[i]->resultTypeInfo.type) {
+        case pIntType: case pBoolType: fprintf(JASM_FILE, "istore %u\n", paramIndex[i]); break;
+        case pFloatType:               fprintf(JASM_FILE, "fstore %u\n", paramIndex[i]); break;
+        case pDoubleType:              fprintf(JASM_FILE, "dstore %u\n", paramIndex[i]); break;
+        }
+    }
+    free(params);
+    free(paramIndex);
+
+    // body
+    const unsigned id = Inline_Id++;
+    char endLabel[32], suffix[32];
+    sprintf(endLabel, "INLINE_END%u", id);
+    sprintf(suffix, "_INLINE%u", id);
+
+    bool hasJump;
+    char* body = rewriteBody(candidate->body, base, endLabel, &hasJump);
+    printJasmWithLabelSuffix(JASM_FILE, body, suffix, NULL);
+    free(body);
+
+    if (hasJump)
+        fprintf(JASM_FILE, "%s: nop\n", endLabel);
+
+    // 回傳值已經在 stack 上，callee 的區域變數可以給之後的 statement 使用
+    releaseScratchIndex(Symbol_Table, mark);
+    return true;
+}
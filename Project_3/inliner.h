@@ -0,0 +1,29 @@
+#pragma once
+#include <stdbool.h>
+#include "expression.h"
+
+/**
+ * 小函數的 inline
+ *
+ * @details 每個函數定義完之後（已經做過 dead store elimination）記下它的 JASM body；
+ *          之後呼叫它時，如果 body 不超過 Inline_Budget 行、不會呼叫自己、每個 return 時 stack 上只有回傳值、且區域變數放得下，就不產生 invokestatic，而是：
+ *          1. 依序計算參數（和一般的呼叫一樣）
+ *          2. 由後往前把參數存進新分配的暫存區域變數（callee 的區域變數 index 全部加上 base）
+ *          3. 複製 body（label 加上 suffix），return 換成跳到 body 之後的 continuation label，回傳值留在 stack 上
+ *          Note: 函數只能呼叫已經定義過的函數，所以只要 body 中沒有呼叫自己就不會有遞迴
+ */
+
+/**
+ * body 最多幾行 JASM 才會被 inline（--inline-budget=N），0 代表不 inline
+ */
+extern unsigned Inline_Budget;
+
+/**
+ * 函數 name 定義結束時呼叫，body 是 `{` 和 `}` 之間的 JASM，localNum 是它用到的區域變數數量（包含參數）
+ */
+void registerInlineCandidate(const char* name, const char* body, unsigned localNum);
+
+/**
+ * 嘗試把 funcCallExpr inline，成功時輸出 JASM 並回傳 true；不能 inline 時什麼都不輸出，回傳 false
+ */
+bool inlineFuncCallToJasm(ExpressionNode_t* funcCallExpr);
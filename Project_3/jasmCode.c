@@ -0,0 +1,786 @@
+#include "jasmCode.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+extern FILE* JASM_FILE;
+
+// Capture ////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct JasmCapture_t {
+    FILE* outerFile;  // 暫存前的 JASM_FILE
+    char* buffer;     // open_memstream 的 buffer
+    size_t size;
+    struct JasmCapture_t* outer;
+} JasmCapture_t;
+
+static JasmCapture_t* Capture_Stack = NULL;
+
+void beginJasmCapture(void)
+{
+    JasmCapture_t* capture = calloc(1, sizeof(JasmCapture_t));
+    capture->outerFile = JASM_FILE;
+    capture->outer = Capture_Stack;
+    Capture_Stack = capture;
+
+    JASM_FILE = open_memstream(&capture->buffer, &capture->size);
+}
+
+char* endJasmCapture(void)
+{
+    JasmCapture_t* capture = Capture_Stack;
+    Capture_Stack = capture->outer;
+
+    fclose(JASM_FILE);
+    JASM_FILE = capture->outerFile;
+
+    char* code = capture->buffer;
+    free(capture);
+    return code;
+}
+
+// Line Helper ////////////////////////////////////////////////////////////////////////////////////
+
+// 找到這一行的結尾（'\n' 或 '\0'）
+static const char* findLineEnd(const char* line)
+{
+    while (*line && *line != '\n')
+        ++line;
+    return line;
+}
+
+// 跳過空白
+static const char* skipSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+// 讀一個 identifier，回傳它結束的位置（若不是 identifier 則回傳 p）
+static const char* scanIdentifier(const char* p, const char* end)
+{
+    if (p >= end || !(isalpha((unsigned char)*p) || *p == '_'))
+        return p;
+
+    while (p < end && (isalnum((unsigned char)*p) || *p == '_'))
+        ++p;
+    return p;
+}
+
+// 如果 [p, end) 是 label 定義（`LABEL:`），回傳 label 結束的位置，否則回傳 NULL
+static const char* scanLabelDefinition(const char* p, const char* end)
+{
+    const char* labelEnd = scanIdentifier(p, end);
+    if (labelEnd == p)
+        return NULL;
+
+    const char* colon = skipSpace(labelEnd, end);
+    return colon < end && *colon == ':' ? labelEnd : NULL;
+}
+
+// 是否為跳躍指令（goto, ifXX, if_icmpXX）
+static bool isBranchOpcode(const char* p, const char* opEnd)
+{
+    size_t len = opEnd - p;
+    return (len == 4 && strncmp(p, "goto", 4) == 0) || (len > 2 && strncmp(p, "if", 2) == 0);
+}
+
+// 同一個指令行中，跳躍的目標 label 位置（[*begin, *end)），沒有的話回傳 false
+static bool findBranchTarget(const char* line, const char* lineEnd, const char** begin, const char** end)
+{
+    const char* p = skipSpace(line, lineEnd);
+
+    // 跳過行首的 label（line 也可能剛好從 label 後的 ':' 開始）
+    const char* labelEnd = scanLabelDefinition(p, lineEnd);
+    if (labelEnd)
+        p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+    else if (p < lineEnd && *p == ':')
+        p = skipSpace(p + 1, lineEnd);
+
+    const char* opEnd = scanIdentifier(p, lineEnd);
+    if (!isBranchOpcode(p, opEnd))
+        return false;
+
+    *begin = skipSpace(opEnd, lineEnd);
+    *end = scanIdentifier(*begin, lineEnd);
+    return *end != *begin;
+}
+
+// 是否為 tableswitch / lookupswitch：之後到 `default : <label>` 為止的每一行都是跳躍的目標，不是指令
+static bool isSwitchLine(const char* line, const char* lineEnd)
+{
+    const char* p = skipSpace(line, lineEnd);
+    const char* labelEnd = scanLabelDefinition(p, lineEnd);
+    if (labelEnd)
+        p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+
+    size_t len = scanIdentifier(p, lineEnd) - p;
+    return (len == 11 && strncmp(p, "tableswitch", 11) == 0) || (len == 12 && strncmp(p, "lookupswitch", 12) == 0);
+}
+
+// switch 的一行（`<label>`, `<值> : <label>` 或 `default : <label>`）中跳躍的目標 label 位置
+static bool findSwitchTarget(const char* line, const char* lineEnd, const char** begin, const char** end)
+{
+    const char* colon = memchr(line, ':', lineEnd - line);
+    *begin = skipSpace(colon ? colon + 1 : line, lineEnd);
+    *end = scanIdentifier(*begin, lineEnd);
+    return *end != *begin;
+}
+
+// 是否為 switch 的最後一行 `default : <label>`
+static bool isSwitchDefault(const char* line, const char* lineEnd)
+{
+    const char* p = skipSpace(line, lineEnd);
+    return scanLabelDefinition(p, lineEnd) == p + 7 && strncmp(p, "default", 7) == 0;
+}
+
+// Label Set //////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct LabelSet_t {
+    char** labels;
+    unsigned size;
+    unsigned capacity;
+} LabelSet_t;
+
+static void addLabel(LabelSet_t* set, const char* label, size_t len)
+{
+    if (set->size == set->capacity) {
+        set->capacity = set->capacity ? set->capacity * 2 : 16;
+        set->labels = realloc(set->labels, set->capacity * sizeof(char*));
+    }
+
+    set->labels[set->size] = calloc(len + 1, sizeof(char));
+    strncpy(set->labels[set->size], label, len);
+    ++set->size;
+}
+
+static bool hasLabel(const LabelSet_t* set, const char* label, size_t len)
+{
+    for (unsigned i = 0; i < set->size; ++i)
+        if (strlen(set->labels[i]) == len && strncmp(set->labels[i], label, len) == 0)
+            return true;
+    return false;
+}
+
+static void freeLabelSet(LabelSet_t* set)
+{
+    for (unsigned i = 0; i < set->size; ++i)
+        free(set->labels[i]);
+    free(set->labels);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void printJasmWithLabelSuffix(FILE* file, const char* code, const char* suffix, const char* extraLabel)
+{
+    LabelSet_t definedLabels = { NULL, 0, 0 };
+    bool isInSwitch = false; // 目前是否在 tableswitch / lookupswitch 的跳躍目標之中
+
+    // 找出 code 內定義的所有 label（switch 的 `default :` 不是 label）
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+
+        if (isInSwitch)
+            isInSwitch = !isSwitchDefault(line, lineEnd);
+        else {
+            if (labelEnd)
+                addLabel(&definedLabels, p, labelEnd - p);
+            isInSwitch = isSwitchLine(line, lineEnd);
+        }
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    if (extraLabel)
+        addLabel(&definedLabels, extraLabel, strlen(extraLabel));
+
+    // 輸出，並在 label 的定義及跳躍目標後加上 suffix
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+        const char* targetBegin = NULL;
+        const char* targetEnd = NULL;
+
+        // switch 的每一行只有跳躍目標
+        if (isInSwitch) {
+            isInSwitch = !isSwitchDefault(line, lineEnd);
+            if (findSwitchTarget(line, lineEnd, &targetBegin, &targetEnd) && hasLabel(&definedLabels, targetBegin, targetEnd - targetBegin)) {
+                fwrite(line, sizeof(char), targetEnd - line, file);
+                fputs(suffix, file);
+                line = targetEnd;
+            }
+            fwrite(line, sizeof(char), lineEnd - line, file);
+            fputc('\n', file);
+
+            line = *lineEnd ? lineEnd + 1 : lineEnd;
+            continue;
+        }
+        isInSwitch = isSwitchLine(line, lineEnd);
+
+        if (labelEnd && hasLabel(&definedLabels, p, labelEnd - p)) {
+            fwrite(line, sizeof(char), labelEnd - line, file);
+            fputs(suffix, file);
+            line = labelEnd;
+        }
+
+        if (findBranchTarget(line, lineEnd, &targetBegin, &targetEnd) && hasLabel(&definedLabels, targetBegin, targetEnd - targetBegin)) {
+            fwrite(line, sizeof(char), targetEnd - line, file);
+            fputs(suffix, file);
+            line = targetEnd;
+        }
+
+        fwrite(line, sizeof(char), lineEnd - line, file);
+        fputc('\n', file);
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    freeLabelSet(&definedLabels);
+}
+
+unsigned countJasmLines(const char* code)
+{
+    unsigned count = 0;
+
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+
+        if (skipSpace(line, lineEnd) != lineEnd)
+            ++count;
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    return count;
+}
+
+unsigned countJasmLocals(const char* code)
+{
+    unsigned count = 0;
+
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+        if (labelEnd)
+            p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+
+        const char* opEnd = scanIdentifier(p, lineEnd);
+        size_t len = opEnd - p;
+        bool isLocal = (len == 5 && strchr("ifd", *p) && strncmp(p + 1, "load", 4) == 0)
+                    || (len == 6 && strchr("ifd", *p) && strncmp(p + 1, "store", 5) == 0)
+                    || (len == 4 && strncmp(p, "iinc", 4) == 0);
+
+        if (isLocal) {
+            const unsigned end = atoi(opEnd) + (*p == 'd' ? 2 : 1);
+            if (count < end)
+                count = end;
+        }
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    return count;
+}
+
+bool isJasmWritesLocal(const char* code, int index)
+{
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+        if (labelEnd)
+            p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+
+        const char* opEnd = scanIdentifier(p, lineEnd);
+        size_t len = opEnd - p;
+        bool isStore = (len == 6 && (strncmp(p, "istore", 6) == 0 || strncmp(p, "fstore", 6) == 0 || strncmp(p, "dstore", 6) == 0))
+                    || (len == 4 && strncmp(p, "iinc", 4) == 0);
+
+        if (isStore && atoi(opEnd) == index)
+            return true;
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    return false;
+}
+
+bool isJasmWritesGlobal(const char* code, const char* name)
+{
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+        if (labelEnd)
+            p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+
+        const char* opEnd = scanIdentifier(p, lineEnd);
+        size_t len = opEnd - p;
+
+        // 呼叫的函數可能會修改全域變數
+        if (len == 12 && strncmp(p, "invokestatic", 12) == 0)
+            return true;
+
+        // putstatic <type> <name>
+        if (len == 9 && strncmp(p, "putstatic", 9) == 0) {
+            const char* fieldName = lineEnd;
+            while (fieldName > opEnd && fieldName[-1] != ' ' && fieldName[-1] != '\t')
+                --fieldName;
+
+            if ((size_t)(lineEnd - fieldName) == strlen(name) && strncmp(fieldName, name, lineEnd - fieldName) == 0)
+                return true;
+        }
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    return false;
+}
+
+char* replaceJasmLocalLoads(const char* code, int index, const char* replacement)
+{
+    char* result = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&result, &size);
+
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+        if (labelEnd)
+            p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+
+        const char* opEnd = scanIdentifier(p, lineEnd);
+        size_t len = opEnd - p;
+        bool isLoad = len == 5 && (strncmp(p, "iload", 5) == 0 || strncmp(p, "fload", 5) == 0 || strncmp(p, "dload", 5) == 0);
+
+        // 保留行首的 label 和縮排，只換掉指令
+        if (isLoad && atoi(opEnd) == index) {
+            fwrite(line, sizeof(char), p - line, file);
+            fputs(replacement, file);
+        }
+        else
+            fwrite(line, sizeof(char), lineEnd - line, file);
+        fputc('\n', file);
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    fclose(file);
+    return result;
+}
+
+// Line Parsing ///////////////////////////////////////////////////////////////////////////////////
+
+// 複製 [begin, end)
+static char* copyRange(const char* begin, const char* end)
+{
+    char* result = calloc(end - begin + 1, sizeof(char));
+    strncpy(result, begin, end - begin);
+    return result;
+}
+
+JasmLine_t* parseJasmLines(const char* code, unsigned* lineNum)
+{
+    unsigned capacity = 64;
+    JasmLine_t* lines = malloc(capacity * sizeof(JasmLine_t));
+    *lineNum = 0;
+
+    for (const char* line = code; *line; ) {
+        const char* lineEnd = findLineEnd(line);
+        const char* p = skipSpace(line, lineEnd);
+        const char* labelEnd = scanLabelDefinition(p, lineEnd);
+
+        if (*lineNum == capacity) {
+            capacity *= 2;
+            lines = realloc(lines, capacity * sizeof(JasmLine_t));
+        }
+        JasmLine_t* L = &lines[(*lineNum)++];
+        memset(L, 0, sizeof(JasmLine_t));
+
+        if (labelEnd) {
+            L->label = copyRange(p, labelEnd);
+            p = skipSpace(strchr(labelEnd, ':') + 1, lineEnd);
+        }
+
+        const char* opEnd = scanIdentifier(p, lineEnd);
+        if (opEnd != p) {
+            L->opcode = copyRange(p, opEnd);
+            L->operand = copyRange(skipSpace(opEnd, lineEnd), lineEnd);
+        }
+        else
+            L->text = copyRange(p, lineEnd);  // 空行、註解等等，原樣保留
+
+        line = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+
+    return lines;
+}
+
+void setJasmInstruction(JasmLine_t* line, const char* opcode, const char* operand)
+{
+    free(line->opcode);
+    free(line->operand);
+    free(line->text);
+    line->opcode = opcode ? strdup(opcode) : NULL;
+    line->operand = opcode ? strdup(operand ? operand : "") : NULL;
+    line->text = NULL;
+}
+
+bool isJasmOpcode(const JasmLine_t* line, const char* opcode)
+{
+    return line->opcode && strcmp(line->opcode, opcode) == 0;
+}
+
+char* joinJasmLines(const JasmLine_t* lines, unsigned lineNum)
+{
+    char* result = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&result, &size);
+
+    for (unsigned i = 0; i < lineNum; ++i) {
+        const JasmLine_t* L = &lines[i];
+
+        // 被刪掉的指令（沒有 label）整行不輸出
+        if (L->label == NULL && L->opcode == NULL && L->text == NULL)
+            continue;
+
+        if (L->label)
+            fprintf(file, "%s:%s", L->label, L->opcode || (L->text && *L->text) ? " " : "");
+
+        if (L->opcode)
+            fprintf(file, *L->operand ? "%s %s" : "%s", L->opcode, L->operand);
+        else if (L->text)
+            fputs(L->text, file);
+        fputc('\n', file);
+    }
+
+    fclose(file);
+    return result;
+}
+
+int nextJasmInstruction(const JasmLine_t* lines, unsigned lineNum, unsigned line)
+{
+    for (unsigned i = line + 1; i < lineNum; ++i) {
+        const JasmLine_t* L = &lines[i];
+
+        // 已經刪掉的指令、空行
+        if (L->label == NULL && L->opcode == NULL && (L->text == NULL || L->text[0] == '\0'))
+            continue;
+
+        return L->label == NULL && L->opcode ? (int)i : -1;
+    }
+    return -1;
+}
+
+void freeJasmLines(JasmLine_t* lines, unsigned lineNum)
+{
+    for (unsigned i = 0; i < lineNum; ++i) {
+        free(lines[i].label);
+        free(lines[i].opcode);
+        free(lines[i].operand);
+        free(lines[i].text);
+    }
+    free(lines);
+}
+
+// Label Index ////////////////////////////////////////////////////////////////////////////////////
+
+static int compareLabelLine(const void* a, const void* b)
+{
+    const JasmLabelLine_t* x = a;
+    const JasmLabelLine_t* y = b;
+    const int result = strcmp(x->label, y->label);
+    return result ? result : x->line - y->line;
+}
+
+JasmLabelIndex_t* indexJasmLabels(const JasmLine_t* lines, unsigned lineNum)
+{
+    JasmLabelIndex_t* index = calloc(1, sizeof(JasmLabelIndex_t));
+    index->labels = malloc((lineNum + 1) * sizeof(JasmLabelLine_t));
+    for (unsigned i = 0; i < lineNum; ++i)
+        if (lines[i].label)
+            index->labels[index->labelNum++] = (JasmLabelLine_t){ strdup(lines[i].label), (int)i };
+
+    qsort(index->labels, index->labelNum, sizeof(JasmLabelLine_t), compareLabelLine);
+    return index;
+}
+
+int findJasmLabel(const JasmLabelIndex_t* index, const char* label)
+{
+    unsigned low = 0, high = index->labelNum;
+    while (low < high) {
+        const unsigned mid = (low + high) / 2;
+        if (strcmp(index->labels[mid].label, label) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < index->labelNum && strcmp(index->labels[low].label, label) == 0 ? index->labels[low].line : -1;
+}
+
+void freeJasmLabelIndex(JasmLabelIndex_t* index)
+{
+    if (index == NULL)
+        return;
+
+    for (unsigned i = 0; i < index->labelNum; ++i)
+        free(index->labels[i].label);
+    free(index->labels);
+    free(index);
+}
+
+// Operand Stack //////////////////////////////////////////////////////////////////////////////////
+
+// 固定改變 operand stack 格數的指令（push 的格數 - pop 的格數）
+typedef struct StackDelta_t {
+    const char* opcode;
+    int delta;
+} StackDelta_t;
+
+static const StackDelta_t Stack_Deltas[] = {
+    { "nop", 0 }, { "goto", 0 }, { "iinc", 0 }, { "swap", 0 },
+    { "iload", 1 }, { "fload", 1 }, { "dload", 2 },
+    { "istore", -1 }, { "fstore", -1 }, { "dstore", -2 },
+    { "dup", 1 }, { "dup2", 2 }, { "pop", -1 }, { "pop2", -2 },
+    { "iadd", -1 }, { "isub", -1 }, { "imul", -1 }, { "idiv", -1 }, { "irem", -1 },
+    { "ishl", -1 }, { "ishr", -1 }, { "iushr", -1 }, { "iand", -1 }, { "ior", -1 }, { "ixor", -1 },
+    { "fadd", -1 }, { "fsub", -1 }, { "fmul", -1 }, { "fdiv", -1 }, { "frem", -1 },
+    { "dadd", -2 }, { "dsub", -2 }, { "dmul", -2 }, { "ddiv", -2 }, { "drem", -2 },
+    { "ineg", 0 }, { "fneg", 0 }, { "dneg", 0 },
+    { "fcmpl", -1 }, { "fcmpg", -1 }, { "dcmpl", -3 }, { "dcmpg", -3 },
+    { "i2f", 0 }, { "f2i", 0 }, { "i2d", 1 }, { "f2d", 1 }, { "d2i", -1 }, { "d2f", -1 },
+    { "ifeq", -1 }, { "ifne", -1 }, { "iflt", -1 }, { "ifle", -1 }, { "ifgt", -1 }, { "ifge", -1 },
+    { "if_icmpeq", -2 }, { "if_icmpne", -2 }, { "if_icmplt", -2 }, { "if_icmple", -2 }, { "if_icmpgt", -2 }, { "if_icmpge", -2 },
+};
+
+// 型別 [type, type + len) 的值佔幾格
+static int typeWords(const char* type, size_t len)
+{
+    if (len == 4 && strncmp(type, "void", 4) == 0)
+        return 0;
+    if (len == 6 && strncmp(type, "double", 6) == 0)
+        return 2;
+    return 1;
+}
+
+int getJasmLdcWords(const char* operand)
+{
+    const size_t len = strlen(operand);
+    if (operand[0] == '"')
+        return 1;
+    if (len > 0 && operand[len - 1] == 'f' && !(len >= 3 && strcmp(operand + len - 3, "inf") == 0))
+        return 1;
+    return strpbrk(operand, ".eE") || strstr(operand, "inf") || strstr(operand, "nan") ? 2 : 1;
+}
+
+// invokestatic / invokevirtual 的 operand `<type> <name>(<types>)`：回傳值的格數 - 參數的格數（不含 invokevirtual 的物件）
+static bool invokeStackDelta(const char* operand, int* delta)
+{
+    const char* space = strchr(operand, ' ');
+    const char* paren = strchr(operand, '(');
+    if (space == NULL || paren == NULL)
+        return false;
+
+    *delta = typeWords(operand, space - operand);
+    for (const char* p = paren + 1; *p && *p != ')'; ) {
+        while (*p == ' ' || *p == ',')
+            ++p;
+        if (*p == ')' || *p == '\0')
+            break;
+
+        const char* end = p;
+        while (*end && *end != ',' && *end != ')' && *end != ' ')
+            ++end;
+        *delta -= typeWords(p, end - p);
+
+        while (*end && *end != ',' && *end != ')')
+            ++end;
+        p = end;
+    }
+    return true;
+}
+
+// 一個指令改變 operand stack 的格數，不認得的指令回傳 false
+static bool stackDelta(const JasmLine_t* line, int* delta)
+{
+    const char* opcode = line->opcode;
+
+    if (strncmp(opcode, "iconst_", 7) == 0) {
+        *delta = 1;
+        return true;
+    }
+    if (strcmp(opcode, "ldc") == 0) {
+        *delta = getJasmLdcWords(line->operand);
+        return true;
+    }
+    if (strcmp(opcode, "getstatic") == 0 || strcmp(opcode, "putstatic") == 0) {
+        const char* space = strchr(line->operand, ' ');
+        const int words = typeWords(line->operand, space ? (size_t)(space - line->operand) : strlen(line->operand));
+        *delta = opcode[0] == 'g' ? words : -words;
+        return true;
+    }
+    if (strcmp(opcode, "invokestatic") == 0)
+        return invokeStackDelta(line->operand, delta);
+    if (strcmp(opcode, "invokevirtual") == 0) {
+        if (!invokeStackDelta(line->operand, delta))
+            return false;
+        *delta -= 1;
+        return true;
+    }
+
+    for (unsigned i = 0; i < sizeof(Stack_Deltas) / sizeof(Stack_Deltas[0]); ++i) {
+        if (strcmp(opcode, Stack_Deltas[i].opcode) == 0) {
+            *delta = Stack_Deltas[i].delta;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 執行到 line 時 stack 有 depth 格；第一次到達時加進 worklist，從不同的路徑到達時格數必須相同
+static bool reachLine(int* depths, unsigned* worklist, unsigned* worklistNum, int line, int depth)
+{
+    if (line < 0 || depth < 0)
+        return false;
+
+    if (depths[line] < 0) {
+        depths[line] = depth;
+        worklist[(*worklistNum)++] = line;
+        return true;
+    }
+    return depths[line] == depth;
+}
+
+const char* getJasmSwitchTarget(const JasmLine_t* line)
+{
+    // `default : <label>` 和 tableswitch 的 `<label>` 拆開後 label 在 opcode 的位置
+    if (line->opcode)
+        return line->opcode;
+
+    // lookupswitch 的 `<值> : <label>` 不是 label 的定義，整行都在 text
+    const char* colon = line->text ? strchr(line->text, ':') : NULL;
+    return colon ? colon + 1 + strspn(colon + 1, " \t") : NULL;
+}
+
+int computeJasmStackDepths(const JasmLine_t* lines, unsigned lineNum, int* depths)
+{
+    if (lineNum == 0)
+        return 0;
+
+    JasmLabelIndex_t* labels = indexJasmLabels(lines, lineNum);
+    unsigned* worklist = malloc(lineNum * sizeof(unsigned));
+    unsigned worklistNum = 0;
+    for (unsigned i = 0; i < lineNum; ++i)
+        depths[i] = -1;
+
+    int maxStack = 0;
+    bool isValid = reachLine(depths, worklist, &worklistNum, 0, 0);
+
+    while (isValid && worklistNum > 0) {
+        const unsigned i = worklist[--worklistNum];
+        const JasmLine_t* line = &lines[i];
+        int depth = depths[i];
+
+        // 沒有指令：直接往下走
+        if (line->opcode == NULL) {
+            if (i + 1 < lineNum)
+                isValid = reachLine(depths, worklist, &worklistNum, i + 1, depth);
+            continue;
+        }
+
+        if (strcmp(line->opcode, "return") == 0 || strcmp(line->opcode, "ireturn") == 0
+            || strcmp(line->opcode, "freturn") == 0 || strcmp(line->opcode, "dreturn") == 0)
+            continue;
+
+        // tableswitch <low> <high> 之後每一行是一個 case 的 label，lookupswitch 之後每一行是 `<值> : <label>`，
+        // 最後是 `default: <label>`
+        if (strcmp(line->opcode, "tableswitch") == 0 || strcmp(line->opcode, "lookupswitch") == 0) {
+            unsigned j = i + 1;
+            for (; j < lineNum && isValid && lines[j].label == NULL; ++j) {
+                const char* target = getJasmSwitchTarget(&lines[j]);
+                if (target == NULL)
+                    break;
+                isValid = reachLine(depths, worklist, &worklistNum, findJasmLabel(labels, target), depth - 1);
+            }
+            isValid = isValid && j < lineNum && lines[j].label && strcmp(lines[j].label, "default") == 0 && lines[j].opcode
+                && reachLine(depths, worklist, &worklistNum, findJasmLabel(labels, lines[j].opcode), depth - 1);
+            continue;
+        }
+
+        int delta;
+        if (!stackDelta(line, &delta)) {
+            isValid = false;
+            break;
+        }
+        depth += delta;
+        if (depth > maxStack)
+            maxStack = depth;
+
+        if (strcmp(line->opcode, "goto") == 0) {
+            isValid = reachLine(depths, worklist, &worklistNum, findJasmLabel(labels, line->operand), depth);
+            continue;
+        }
+        if (line->opcode[0] == 'i' && line->opcode[1] == 'f')
+            isValid = reachLine(depths, worklist, &worklistNum, findJasmLabel(labels, line->operand), depth);
+        if (isValid && i + 1 < lineNum)
+            isValid = reachLine(depths, worklist, &worklistNum, i + 1, depth);
+    }
+
+    freeJasmLabelIndex(labels);
+    free(worklist);
+    return isValid ? maxStack : -1;
+}
+
+int computeJasmMaxStack(const char* code)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(code, &lineNum);
+    int* depths = malloc((lineNum + 1) * sizeof(int));
+
+    const int maxStack = computeJasmStackDepths(lines, lineNum, depths);
+    free(depths);
+    freeJasmLines(lines, lineNum);
+    return maxStack;
+}
+
+// Constant ///////////////////////////////////////////////////////////////////////////////////////
+
+// 沒有小數點時補上 `.0`（有指數時補在 e 的前面）
+static void appendPoint(char* buffer)
+{
+    if (strchr(buffer, '.') || strstr(buffer, "inf") || strstr(buffer, "nan"))
+        return;
+
+    char* exponent = strchr(buffer, 'e');
+    if (exponent == NULL)
+        exponent = buffer + strlen(buffer);
+    memmove(exponent + 2, exponent, strlen(exponent) + 1);
+    memcpy(exponent, ".0", 2);
+}
+
+void formatJasmDouble(char* buffer, double value)
+{
+    for (int precision = 1; precision <= 17; ++precision) {
+        snprintf(buffer, JASM_NUMBER_SIZE - 2, "%.*g", precision, value);
+        if (strtod(buffer, NULL) == value)
+            break;
+    }
+    appendPoint(buffer);
+}
+
+void formatJasmFloat(char* buffer, float value)
+{
+    for (int precision = 1; precision <= 9; ++precision) {
+        snprintf(buffer, JASM_NUMBER_SIZE - 3, "%.*g", precision, value);
+        if (strtof(buffer, NULL) == value)
+            break;
+    }
+    appendPoint(buffer);
+    strcat(buffer, "f");
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+
+/**
+ * 開始暫存 JASM code：之後寫進 JASM_FILE 的內容會先存進暫存區，直到呼叫 endJasmCapture 為止
+ * @details 可以巢狀呼叫（後開始的先結束）
+ */
+void beginJasmCapture(void);
+
+/**
+ * 結束暫存並還原 JASM_FILE，回傳暫存到的 JASM code（呼叫者負責 free）
+ */
+char* endJasmCapture(void);
+
+/**
+ * 將 code 輸出到 file。
+ * 「在 code 中定義的 label」和 extraLabel（可為 NULL）都會被加上 suffix，讓同一段 code 可以輸出多次。
+ */
+void printJasmWithLabelSuffix(FILE* file, const char* code, const char* suffix, const char* extraLabel);
+
+/**
+ * code 有幾行指令（不含空行）
+ */
+unsigned countJasmLines(const char* code);
+
+/**
+ * code 中的指令（xload, xstore, iinc）用到的區域變數 index 的最大值 + 1（double 佔 2 格），沒有用到區域變數時回傳 0
+ */
+unsigned countJasmLocals(const char* code);
+
+/**
+ * code 中是否有指令會寫入 index 號區域變數（istore, fstore, dstore, iinc）
+ */
+bool isJasmWritesLocal(const char* code, int index);
+
+/**
+ * code 中是否可能寫入全域變數 name（putstatic，或呼叫了函數）
+ */
+bool isJasmWritesGlobal(const char* code, const char* name);
+
+/**
+ * 將 code 中讀取 index 號區域變數的指令（iload, fload, dload）換成 replacement，回傳新的 code（呼叫者負責 free）
+ */
+char* replaceJasmLocalLoads(const char* code, int index, const char* replacement);
+
+/**
+ * 執行 code（一個 method `{` 和 `}` 之間的 JASM）時 operand stack 最多用到幾格（double 佔 2 格），也就是 method 的 max_stack
+ * @details 從第一行開始沿著所有跳躍（包含 tableswitch / lookupswitch 的每個 case）模擬每個指令 push / pop 的格數；
+ *          有不認得的指令、跳到不存在的 label，或是從不同路徑到達同一行時格數不同，回傳 -1
+ */
+int computeJasmMaxStack(const char* code);
+
+// Line Parsing ///////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * 拆開後的一行 JASM code
+ */
+typedef struct JasmLine_t {
+    char* label;    // 行首定義的 label，沒有則為 NULL
+    char* opcode;   // 指令，這行沒有指令（空行、註解、只有 label）則為 NULL
+    char* operand;  // 指令後面的內容（opcode 為 NULL 時也是 NULL）
+    char* text;     // 沒有指令時，label 之後原本的內容（opcode 不為 NULL 時是 NULL）
+} JasmLine_t;
+
+/**
+ * 將 code 拆成一行一行，行數存進 lineNum（呼叫者用 freeJasmLines 䆁放）
+ */
+JasmLine_t* parseJasmLines(const char* code, unsigned* lineNum);
+
+/**
+ * 將 line 的指令換成 opcode operand（operand 可為 NULL）；opcode 為 NULL 代表刪除這個指令，只保留 label
+ */
+void setJasmInstruction(JasmLine_t* line, const char* opcode, const char* operand);
+
+/**
+ * line 的指令是否為 opcode
+ */
+bool isJasmOpcode(const JasmLine_t* line, const char* opcode);
+
+/**
+ * 把 lines 組回 JASM code（呼叫者負責 free）
+ */
+char* joinJasmLines(const JasmLine_t* lines, unsigned lineNum);
+
+/**
+ * lines[line] 之後的下一個指令（跳過已刪除的指令、空行）的 index；
+ * 如果它有 label（可能從其他地方跳進來）、中間隔著其他內容（例如 `}`）或是沒有下一個指令，回傳 -1
+ */
+int nextJasmInstruction(const JasmLine_t* lines, unsigned lineNum, unsigned line);
+
+/**
+ * tableswitch / lookupswitch 之後的一行（`<label>`、`<值> : <label>` 或最後的 `default : <label>`）跳躍的目標 label，
+ * 不是這種格式時回傳 NULL
+ */
+const char* getJasmSwitchTarget(const JasmLine_t* line);
+
+/**
+ * 和 computeJasmMaxStack 相同，但以拆開後的 lines 為單位，並把執行第 i 行之前 stack 的格數存進 depths[i]（走不到的行為 -1）
+ * @return max_stack，無法分析時回傳 -1（此時 depths 的內容沒有意義）
+ */
+int computeJasmStackDepths(const JasmLine_t* lines, unsigned lineNum, int* depths);
+
+/**
+ * ldc 的常數佔 operand stack 幾格：字串、int、float（結尾為 f）為 1 格，double（包含 inf、nan）為 2 格
+ */
+int getJasmLdcWords(const char* operand);
+
+/**
+ * 䆁放 parseJasmLines 的結果
+ */
+void freeJasmLines(JasmLine_t* lines, unsigned lineNum);
+
+// Label Index ////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct JasmLabelLine_t {
+    char* label;
+    int line;
+} JasmLabelLine_t;
+
+/**
+ * label 和所在的行，依照 label 排序（同名的依照行號），找跳躍目標時用二分搜尋
+ * Note: 很長的 bool expression 會產生非常多 label，逐行比對會變成 O(n^2)
+ */
+typedef struct JasmLabelIndex_t {
+    JasmLabelLine_t* labels;
+    unsigned labelNum;
+} JasmLabelIndex_t;
+
+/**
+ * 建出 lines 中所有 label 的索引，用 freeJasmLabelIndex 䆁放
+ * @note label 會另外複製一份，之後修改或刪掉 lines 的 label 不會影響索引（但也不會跟著更新）
+ */
+JasmLabelIndex_t* indexJasmLabels(const JasmLine_t* lines, unsigned lineNum);
+
+/**
+ * 第一個 label 為 label 的行，沒有則回傳 -1
+ */
+int findJasmLabel(const JasmLabelIndex_t* index, const char* label);
+
+/**
+ * 䆁放 indexJasmLabels 的結果（可為 NULL）
+ */
+void freeJasmLabelIndex(JasmLabelIndex_t* index);
+
+// Constant ///////////////////////////////////////////////////////////////////////////////////////
+
+// formatJasmDouble / formatJasmFloat 的 buffer 至少要幾個 char
+#define JASM_NUMBER_SIZE 32
+
+/**
+ * ldc 的 double 常數：印出可以還原成同一個值的最短寫法（最多 17 位有效數字），一定有小數點（不會被當成 int）
+ */
+void formatJasmDouble(char* buffer, double value);
+
+/**
+ * ldc 的 float 常數：和 formatJasmDouble 相同（最多 9 位有效數字），結尾加上 f
+ */
+void formatJasmFloat(char* buffer, float value);
@@ -0,0 +1,330 @@
+#include "liveness.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool Enable_Dead_Store_Elim = true;
+
+// Opcode Helper //////////////////////////////////////////////////////////////////////////////////
+
+// 是否為 iload, fload, dload（回傳讀取的 slot 數，否則回傳 0）
+static unsigned loadSize(const JasmLine_t* line)
+{
+    if (isJasmOpcode(line, "iload") || isJasmOpcode(line, "fload")) return 1;
+    if (isJasmOpcode(line, "dload")) return 2;
+    return 0;
+}
+
+// 是否為 istore, fstore, dstore（回傳寫入的 slot 數，否則回傳 0）
+static unsigned storeSize(const JasmLine_t* line)
+{
+    if (isJasmOpcode(line, "istore") || isJasmOpcode(line, "fstore")) return 1;
+    if (isJasmOpcode(line, "dstore")) return 2;
+    return 0;
+}
+
+// 沒有副作用、只 push 一個值的指令：回傳 push 的 slot 數，否則回傳 0
+static unsigned pureLoadSize(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return 0;
+
+    if (loadSize(line))
+        return loadSize(line);
+
+    if (strncmp(line->opcode, "iconst_", 7) == 0 || isJasmOpcode(line, "bipush") || isJasmOpcode(line, "sipush"))
+        return 1;
+
+    if (isJasmOpcode(line, "ldc"))
+        return getJasmLdcWords(line->operand);
+
+    // getstatic <type> <name>
+    if (isJasmOpcode(line, "getstatic"))
+        return strncmp(line->operand, "double ", 7) == 0 ? 2 : 1;
+
+    return 0;
+}
+
+static bool isPop(const JasmLine_t* line, unsigned size)
+{
+    return isJasmOpcode(line, size == 2 ? "pop2" : "pop");
+}
+
+static bool isDup(const JasmLine_t* line, unsigned size)
+{
+    return isJasmOpcode(line, size == 2 ? "dup2" : "dup");
+}
+
+// 執行完這個指令後不會執行下一行（goto, athrow, return, ireturn, ...）
+static bool isUnconditionalJump(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    size_t len = strlen(line->opcode);
+    return isJasmOpcode(line, "goto") || isJasmOpcode(line, "athrow") || (len >= 6 && strcmp(line->opcode + len - 6, "return") == 0);
+}
+
+static bool isBranch(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "goto") || (line->opcode && strncmp(line->opcode, "if", 2) == 0);
+}
+
+static bool isSwitch(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "tableswitch") || isJasmOpcode(line, "lookupswitch");
+}
+
+// 目前無法分析的控制流程
+static bool isUnsupportedJump(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "jsr") || isJasmOpcode(line, "ret");
+}
+
+// Bitset /////////////////////////////////////////////////////////////////////////////////////////
+
+static void setBit(uint32_t* set, int index)
+{
+    set[index / 32] |= 1u << (index % 32);
+}
+
+static void clearBit(uint32_t* set, int index)
+{
+    set[index / 32] &= ~(1u << (index % 32));
+}
+
+static bool testBit(const uint32_t* set, int index)
+{
+    return (set[index / 32] >> (index % 32)) & 1u;
+}
+
+// Liveness ///////////////////////////////////////////////////////////////////////////////////////
+
+JasmLiveness_t* analyzeJasmLiveness(const char* code)
+{
+    JasmLiveness_t* L = calloc(1, sizeof(JasmLiveness_t));
+    L->lines = parseJasmLines(code, &L->lineNum);
+    L->labels = indexJasmLabels(L->lines, L->lineNum);
+
+    // 後繼的行：下一行（-1 代表沒有）和跳躍的目標
+    // Note: tableswitch / lookupswitch 之後的每一行看成「跳到這一行的目標，或繼續看下一行」，最後一行 `default : <label>` 不會往下走，
+    //       所以 switch 執行後 live 的就是所有目標執行前 live 的聯集
+    int* next = malloc((L->lineNum + 1) * sizeof(int));
+    int* target = malloc((L->lineNum + 1) * sizeof(int));
+    bool isInSwitch = false;
+
+    for (unsigned i = 0; i < L->lineNum; ++i) {
+        const JasmLine_t* line = &L->lines[i];
+        next[i] = isUnconditionalJump(line) || i + 1 == L->lineNum ? -1 : (int)i + 1;
+        target[i] = -1;
+
+        if (isInSwitch) {
+            const char* label = getJasmSwitchTarget(line);
+            isInSwitch = line->label == NULL;
+            if (!isInSwitch)
+                next[i] = -1;
+            target[i] = label ? findJasmLabel(L->labels, label) : -1;
+            if (target[i] < 0 || (isInSwitch && next[i] < 0) || (!isInSwitch && strcmp(line->label, "default") != 0)) {
+                free(next); free(target);
+                freeJasmLiveness(L);
+                return NULL;
+            }
+            continue;
+        }
+        isInSwitch = isSwitch(line);
+
+        if (isUnsupportedJump(line)) {
+            free(next); free(target);
+            freeJasmLiveness(L);
+            return NULL;
+        }
+
+        if (isBranch(line)) {
+            target[i] = findJasmLabel(L->labels, line->operand);
+            if (target[i] < 0) {
+                free(next); free(target);
+                freeJasmLiveness(L);
+                return NULL;
+            }
+        }
+
+        if (loadSize(line) || storeSize(line) || isJasmOpcode(line, "iinc")) {
+            unsigned end = atoi(line->operand) + (loadSize(line) == 2 || storeSize(line) == 2 ? 2 : 1);
+            if (L->localNum < end)
+                L->localNum = end;
+        }
+    }
+
+    L->words = L->localNum / 32 + 1;
+    L->liveIn = calloc(L->lineNum * L->words + 1, sizeof(uint32_t));
+    L->liveOut = calloc(L->lineNum * L->words + 1, sizeof(uint32_t));
+
+    // 由後往前更新，直到不再改變
+    // liveOut[i] = 所有後繼的 liveIn 的聯集；liveIn[i] = use[i] + (liveOut[i] - def[i])
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (int i = (int)L->lineNum - 1; i >= 0; --i) {
+            const JasmLine_t* line = &L->lines[i];
+            uint32_t* in = &L->liveIn[i * L->words];
+            uint32_t* out = &L->liveOut[i * L->words];
+
+            for (unsigned w = 0; w < L->words; ++w) {
+                uint32_t value = 0;
+                if (next[i] >= 0)   value |= L->liveIn[next[i] * L->words + w];
+                if (target[i] >= 0) value |= L->liveIn[target[i] * L->words + w];
+                out[w] = value;
+            }
+
+            uint32_t* newIn = malloc(L->words * sizeof(uint32_t));
+            memcpy(newIn, out, L->words * sizeof(uint32_t));
+
+            if (storeSize(line)) {
+                int index = atoi(line->operand);
+                clearBit(newIn, index);
+                if (storeSize(line) == 2)
+                    clearBit(newIn, index + 1);
+            }
+            else if (loadSize(line)) {
+                int index = atoi(line->operand);
+                setBit(newIn, index);
+                if (loadSize(line) == 2)
+                    setBit(newIn, index + 1);
+            }
+            else if (isJasmOpcode(line, "iinc"))
+                setBit(newIn, atoi(line->operand));
+
+            if (memcmp(newIn, in, L->words * sizeof(uint32_t)) != 0) {
+                memcpy(in, newIn, L->words * sizeof(uint32_t));
+                changed = true;
+            }
+            free(newIn);
+        }
+    }
+
+    free(next);
+    free(target);
+    return L;
+}
+
+bool isLocalLiveBefore(const JasmLiveness_t* liveness, unsigned line, int index)
+{
+    if (index < 0 || (unsigned)index >= liveness->localNum)
+        return false;
+    return testBit(&liveness->liveIn[line * liveness->words], index);
+}
+
+bool isLocalLiveAfter(const JasmLiveness_t* liveness, unsigned line, int index)
+{
+    if (index < 0 || (unsigned)index >= liveness->localNum)
+        return false;
+    return testBit(&liveness->liveOut[line * liveness->words], index);
+}
+
+void freeJasmLiveness(JasmLiveness_t* liveness)
+{
+    freeJasmLines(liveness->lines, liveness->lineNum);
+    freeJasmLabelIndex(liveness->labels);
+    free(liveness->liveIn);
+    free(liveness->liveOut);
+    free(liveness);
+}
+
+// Dead Store Elimination /////////////////////////////////////////////////////////////////////////
+
+static void removeInstruction(JasmLine_t* line)
+{
+    setJasmInstruction(line, NULL, NULL);
+}
+
+// 套用一輪規則，回傳是否有改變
+static bool eliminateOnce(JasmLiveness_t* L)
+{
+    JasmLine_t* lines = L->lines;
+    bool changed = false;
+
+    for (unsigned i = 0; i < L->lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (line->opcode == NULL)
+            continue;
+
+        int j = nextJasmInstruction(lines, L->lineNum, i);
+        int k = j >= 0 ? nextJasmInstruction(lines, L->lineNum, j) : -1;
+        unsigned size;
+
+        // Xstore n; Xload n -> dup; Xstore n
+        if ((size = storeSize(line)) && j >= 0 && loadSize(&lines[j]) == size
+            && line->opcode[0] == lines[j].opcode[0] && atoi(line->operand) == atoi(lines[j].operand)) {
+            char* store = strdup(line->opcode);
+            char* operand = strdup(line->operand);
+            setJasmInstruction(line, size == 2 ? "dup2" : "dup", NULL);
+            setJasmInstruction(&lines[j], store, operand);
+            free(store);
+            free(operand);
+            changed = true;
+        }
+        // dup; Xstore n; pop -> Xstore n
+        else if ((isDup(line, 1) || isDup(line, 2)) && j >= 0 && (size = storeSize(&lines[j])) && isDup(line, size)
+                 && k >= 0 && isPop(&lines[k], size)) {
+            removeInstruction(line);
+            removeInstruction(&lines[k]);
+            changed = true;
+        }
+        // dead store -> pop
+        else if ((size = storeSize(line)) && !isLocalLiveAfter(L, i, atoi(line->operand))
+                 && (size == 1 || !isLocalLiveAfter(L, i, atoi(line->operand) + 1))) {
+            setJasmInstruction(line, size == 2 ? "pop2" : "pop", NULL);
+            changed = true;
+        }
+        // dead iinc
+        else if (isJasmOpcode(line, "iinc") && !isLocalLiveAfter(L, i, atoi(line->operand))) {
+            removeInstruction(line);
+            changed = true;
+        }
+        // dup; pop
+        else if ((isDup(line, 1) && j >= 0 && isPop(&lines[j], 1)) || (isDup(line, 2) && j >= 0 && isPop(&lines[j], 2))) {
+            removeInstruction(line);
+            removeInstruction(&lines[j]);
+            changed = true;
+        }
+        // 沒有副作用的 push; pop
+        else if ((size = pureLoadSize(line)) && j >= 0 && isPop(&lines[j], size)) {
+            removeInstruction(line);
+            removeInstruction(&lines[j]);
+            changed = true;
+        }
+        // 沒有副作用的 push; iinc; pop -> iinc（後置的 ++, -- 當成 statement）
+        else if ((size = pureLoadSize(line)) && j >= 0 && isJasmOpcode(&lines[j], "iinc") && k >= 0 && isPop(&lines[k], size)) {
+            removeInstruction(line);
+            removeInstruction(&lines[k]);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+char* eliminateDeadStores(const char* code)
+{
+    char* result = strdup(code);
+
+    // 每一輪都重新分析（刪掉 load 之後，更多 store 會變成 dead）
+    while (true) {
+        JasmLiveness_t* liveness = analyzeJasmLiveness(result);
+        if (liveness == NULL)
+            break;
+
+        bool changed = eliminateOnce(liveness);
+        if (changed) {
+            free(result);
+            result = joinJasmLines(liveness->lines, liveness->lineNum);
+        }
+        freeJasmLiveness(liveness);
+
+        if (!changed)
+            break;
+    }
+
+    return result;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "jasmCode.h"
+
+/**
+ * 區域變數的 liveness analysis（以一個函數的 JASM code 為單位）
+ *
+ * @details 把 code 拆成一行一行（每行最多一個指令），依照 goto, ifXX, tableswitch, lookupswitch 建出控制流程，
+ *          再由後往前不斷更新「每一行執行前 / 執行後還會被讀到的區域變數」直到不再改變。
+ *          iload, fload 讀取 index；dload 讀取 index 和 index + 1；iinc 先讀再寫；istore, fstore, dstore 寫入
+ */
+typedef struct JasmLiveness_t {
+    JasmLine_t* lines;
+    unsigned lineNum;
+    JasmLabelIndex_t* labels;   // lines 中的 label
+    unsigned localNum;          // code 中出現的最大的區域變數 index + 1
+    unsigned words;             // 每一行的 bitset 有幾個 uint32_t
+    uint32_t* liveIn;           // 第 i 行執行前 live 的區域變數：liveIn[i * words ...]
+    uint32_t* liveOut;          // 第 i 行執行後 live 的區域變數
+} JasmLiveness_t;
+
+/**
+ * 分析 code（一個函數的 body）
+ * @return 分析結果，用 freeJasmLiveness 䆁放；code 中有無法分析的控制流程（例如找不到跳躍的目標）時回傳 NULL
+ */
+JasmLiveness_t* analyzeJasmLiveness(const char* code);
+
+/**
+ * 第 line 行執行前，區域變數 index 的值之後是否可能被讀取
+ */
+bool isLocalLiveBefore(const JasmLiveness_t* liveness, unsigned line, int index);
+
+/**
+ * 第 line 行執行後，區域變數 index 的值之後是否可能被讀取
+ */
+bool isLocalLiveAfter(const JasmLiveness_t* liveness, unsigned line, int index);
+
+/**
+ * 䆁放分析結果
+ */
+void freeJasmLiveness(JasmLiveness_t* liveness);
+
+// Dead Store Elimination /////////////////////////////////////////////////////////////////////////
+
+/**
+ * 是否刪除 dead store（--no-dead-store-elim 可關閉），預設為 true
+ */
+extern bool Enable_Dead_Store_Elim;
+
+/**
+ * 刪除 code（一個函數的 body）中寫入後不會再被讀取的 store，回傳新的 code（呼叫者負責 free）
+ *
+ * @details 被寫入的值仍然會計算（保留函數呼叫等副作用），只是把 store 換成 pop；
+ *          接著反覆套用以下規則，直到沒有變化：
+ *          - `Xstore k; Xload k`   -> `dup; Xstore k`（之後的 Xload 被省掉，store 也可能因此變成 dead）
+ *          - `dup; Xstore k; pop`  -> `Xstore k`
+ *          - dead 的 `Xstore k`    -> `pop`，dead 的 `iinc` 直接刪除
+ *          - `dup; pop`、沒有副作用的 push（load, ldc, getstatic）接著 `pop` -> 全部刪除
+ *          Note: 除了第一行以外，規則中的指令不能有 label（可能有其他地方跳進來）
+ */
+char* eliminateDeadStores(const char* code);
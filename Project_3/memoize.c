@@ -0,0 +1,196 @@
+#include "memoize.h"
+#include "callGraph.h"
+#include "exprToJasm.h"
+#include "jasmCode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool Enable_Memoization = false;
+unsigned Memo_Table_Size = 64;
+
+#define MEMO_MISS   "MEMO_MISS"
+#define MEMO_STORE  "MEMO_STORE"
+#define MEMO_RETURN "MEMO_RETURN"
+
+// Purity /////////////////////////////////////////////////////////////////////////////////////////
+
+// body 中是否有呼叫 name
+static bool isCalls(const JasmLine_t* lines, unsigned lineNum, const char* name)
+{
+    for (unsigned i = 0; i < lineNum; ++i) {
+        if (lines[i].opcode == NULL || strcmp(lines[i].opcode, "invokestatic") != 0)
+            continue;
+
+        // invokestatic <type> <name>(...)
+        const char* begin = strchr(lines[i].operand, ' ');
+        const char* end = strchr(lines[i].operand, '(');
+        if (begin && end && begin < end && (size_t)(end - begin - 1) == strlen(name) && strncmp(begin + 1, name, end - begin - 1) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Memo Table /////////////////////////////////////////////////////////////////////////////////////
+
+// 每個 int 參數的範圍 [0, *radix)，回傳 memo table 的格數；無法 memoize 時回傳 0
+static unsigned getTableSize(const Function_Type_Info_t* info, unsigned* radix)
+{
+    unsigned intNum = 0, boolNum = 0;
+    for (unsigned i = 0; i < info->parameterNum; ++i) {
+        const Type_Info_t* param = &info->parameters[i];
+        if (param->dimension > 0)
+            return 0;
+        if (param->type == pIntType)
+            ++intNum;
+        else if (param->type == pBoolType)
+            ++boolNum;
+        else
+            return 0;
+    }
+
+    unsigned boolSize = 1;
+    for (unsigned i = 0; i < boolNum; ++i)
+        boolSize *= 2;
+    if (boolSize > Memo_Table_Size)
+        return 0;
+
+    // 最大的 R 使得 R^intNum * 2^boolNum <= Memo_Table_Size
+    unsigned size = boolSize;
+    *radix = 1;
+    if (intNum > 0) {
+        for (unsigned r = 2; ; ++r) {
+            unsigned long long product = boolSize;
+            for (unsigned i = 0; i < intNum && product <= Memo_Table_Size; ++i)
+                product *= r;
+            if (product > Memo_Table_Size)
+                break;
+            *radix = r;
+            size = (unsigned)product;
+        }
+        if (*radix < 2)
+            return 0;
+    }
+
+    return size >= 2 ? size : 0;
+}
+
+static char typePrefix(unsigned short type)
+{
+    return type == pFloatType ? 'f' : type == pDoubleType ? 'd' : 'i';
+}
+
+// 函數開頭：算出 key 存進 keyIndex，已經算過就直接回傳
+static void printLookup(FILE* file, const char* name, const Function_Type_Info_t* info, unsigned radix, unsigned size, unsigned keyIndex)
+{
+    const char prefix = typePrefix(info->returnType.type);
+    const char* type = JASM_TypeStr[info->returnType.type];
+
+    fprintf(file, "iconst_m1\nistore %u\n", keyIndex);
+
+    // 先檢查範圍（stack 為空時才能跳），再算 key
+    for (unsigned i = 0; i < info->parameterNum; ++i) {
+        if (info->parameters[i].type == pIntType)
+            fprintf(file, "iload %u\niflt %s\niload %u\nldc %u\nif_icmpge %s\n", i, MEMO_MISS, i, radix, MEMO_MISS);
+    }
+
+    fprintf(file, "iconst_0\n");
+    for (unsigned i = 0; i < info->parameterNum; ++i)
+        fprintf(file, "ldc %u\nimul\niload %u\niadd\n", info->parameters[i].type == pIntType ? radix : 2, i);
+    fprintf(file, "istore %u\n", keyIndex);
+
+    fprintf(file, "iload %u\ntableswitch 0 %u\n", keyIndex, size - 1);
+    for (unsigned i = 0; i < size; ++i)
+        fprintf(file, "MEMO_LOOKUP%u\n", i);
+    fprintf(file, "default : %s\n", MEMO_MISS);
+
+    for (unsigned i = 0; i < size; ++i) {
+        fprintf(file, "MEMO_LOOKUP%u:\n", i);
+        fprintf(file, "getstatic boolean " MEMO_FIELD_PREFIX "%s__set__%u\nifeq %s\n", name, i, MEMO_MISS);
+        fprintf(file, "getstatic %s " MEMO_FIELD_PREFIX "%s__%u\n%creturn\n", type, name, i, prefix);
+    }
+    fprintf(file, "%s: nop\n", MEMO_MISS);
+}
+
+// 結尾：回傳值存進 valueIndex 和 key 對應的 field 後 return
+static void printStore(FILE* file, const char* name, const Function_Type_Info_t* info, unsigned size, unsigned keyIndex, unsigned valueIndex)
+{
+    const char prefix = typePrefix(info->returnType.type);
+    const char* type = JASM_TypeStr[info->returnType.type];
+
+    fprintf(file, "%s: %cstore %u\n", MEMO_STORE, prefix, valueIndex);
+    fprintf(file, "iload %u\ntableswitch 0 %u\n", keyIndex, size - 1);
+    for (unsigned i = 0; i < size; ++i)
+        fprintf(file, "MEMO_SAVE%u\n", i);
+    fprintf(file, "default : %s\n", MEMO_RETURN);
+
+    for (unsigned i = 0; i < size; ++i) {
+        fprintf(file, "MEMO_SAVE%u: %cload %u\n", i, prefix, valueIndex);
+        fprintf(file, "putstatic %s " MEMO_FIELD_PREFIX "%s__%u\n", type, name, i);
+        fprintf(file, "iconst_1\nputstatic boolean " MEMO_FIELD_PREFIX "%s__set__%u\n", name, i);
+        fprintf(file, "goto %s\n", MEMO_RETURN);
+    }
+    fprintf(file, "%s: %cload %u\n%creturn\n", MEMO_RETURN, prefix, valueIndex, prefix);
+}
+
+static char* printFields(const char* name, const Function_Type_Info_t* info, unsigned size)
+{
+    char* result = NULL;
+    size_t resultSize = 0;
+    FILE* file = open_memstream(&result, &resultSize);
+
+    fprintf(file, "/* memo table of %s */\n", name);
+    for (unsigned i = 0; i < size; ++i) {
+        fprintf(file, "field static %s " MEMO_FIELD_PREFIX "%s__%u\n", JASM_TypeStr[info->returnType.type], name, i);
+        fprintf(file, "field static boolean " MEMO_FIELD_PREFIX "%s__set__%u\n", name, i);
+    }
+    fprintf(file, "\n");
+
+    fclose(file);
+    return result;
+}
+
+char* memoizeFunction(const char* body, const char* name, const Function_Type_Info_t* info, unsigned localNum, char** fields)
+{
+    *fields = NULL;
+
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+
+    const unsigned short returnType = info->returnType.type;
+    const unsigned keyIndex = localNum, valueIndex = localNum + 1;
+    unsigned radix = 1, size = 0;
+
+    // 不會呼叫自己的函數沒有重複計算的問題
+
+    if (!Enable_Memoization || getFunctionEffects(name) != 0 || !isCalls(lines, lineNum, name) || info->returnType.dimension > 0
+        || returnType == pVoidType || returnType == pStringType
+        || valueIndex + (returnType == pDoubleType ? 2 : 1) > JASM_MAX_LOCALS
+        || (size = getTableSize(info, &radix)) == 0) {
+        freeJasmLines(lines, lineNum);
+        return strdup(body);
+    }
+
+    char* result = NULL;
+    size_t resultSize = 0;
+    FILE* file = open_memstream(&result, &resultSize);
+
+    printLookup(file, name, info, radix, size, keyIndex);
+
+    // 所有 return 改成跳到結尾存進 memo table
+    for (unsigned i = 0; i < lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (line->opcode && line->opcode[0] == typePrefix(returnType) && strcmp(line->opcode + 1, "return") == 0)
+            setJasmInstruction(line, "goto", MEMO_STORE);
+    }
+    char* newBody = joinJasmLines(lines, lineNum);
+    fputs(newBody, file);
+    free(newBody);
+
+    printStore(file, name, info, size, keyIndex, valueIndex);
+    fclose(file);
+
+    *fields = printFields(name, info, size);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include "type_info.h"
+
+/**
+ * 對沒有副作用的遞迴函數做 memoization
+ *
+ * @details 只處理參數都是 int / bool、有回傳值、會呼叫自己，而且沒有副作用的函數：
+ *          body 中沒有 print / read（invokevirtual）、沒有讀寫全域變數（getstatic, putstatic），
+ *          呼叫的其他函數也都沒有副作用（見 callGraph.h 的 getFunctionEffects）。
+ *          JASM 沒有陣列，所以 memo table 是 Memo_Table_Size 組 static field（`memo__<name>__<i>` 存回傳值，
+ *          `memo__<name>__set__<i>` 記錄是否已經算過），用 tableswitch 依照 key 跳到對應的 field：
+ *          - 函數開頭：參數都在範圍內時算出 key（每個 int 參數的範圍是 [0, R)，bool 為 [0, 2)，key 是以此為進位的數字），
+ *                      存進新的區域變數，已經算過就直接回傳 field 的值；不在範圍內時 key 為 -1，照常執行
+ *          - 所有 return 改成跳到結尾：把回傳值存進對應的 field 後再 return
+ */
+
+// memo table 的 field 名稱的開頭
+#define MEMO_FIELD_PREFIX "memo__"
+
+/**
+ * 是否做 memoization（--memoize 開啟），預設為 false
+ */
+extern bool Enable_Memoization;
+
+/**
+ * 每個函數的 memo table 最多幾格（--memo-size=N），預設 64
+ */
+extern unsigned Memo_Table_Size;
+
+/**
+ * body 是函數 name（型別為 info，使用了 localNum 個區域變數）的 `{` 和 `}` 之間的 JASM，回傳處理後的 body（呼叫者負責 free）
+ * 有 memoize 時，*fields 會設為 memo table 的 field 定義（要輸出在 method 外面，呼叫者負責 free），否則為 NULL
+ *
+ * @note 呼叫前必須先用 registerFunctionEffects 記下 name 的副作用
+ */
+char* memoizeFunction(const char* body, const char* name, const Function_Type_Info_t* info, unsigned localNum, char** fields);
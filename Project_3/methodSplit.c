@@ -0,0 +1,528 @@
+#include "methodSplit.h"
+#include "jasmCode.h"
+#include "liveness.h"
+#include "exprToJasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+unsigned Method_Split_Size = 8000;
+
+// 區域變數的 index 上限（超過的 method 不處理）
+#define MAX_LOCAL_NUM 256
+
+// Opcode Helper //////////////////////////////////////////////////////////////////////////////////
+
+static bool isBranch(const JasmLine_t* line)
+{
+    return isJasmOpcode(line, "goto") || (line->opcode && strncmp(line->opcode, "if", 2) == 0);
+}
+
+// 不能搬進新的 method 的指令：return（會變成從新的 method 回傳）和跳躍目標不只一個的指令
+static bool isBarrier(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    const size_t len = strlen(line->opcode);
+    return (len >= 6 && strcmp(line->opcode + len - 6, "return") == 0)
+        || isJasmOpcode(line, "tableswitch") || isJasmOpcode(line, "lookupswitch") || isJasmOpcode(line, "jsr") || isJasmOpcode(line, "ret");
+}
+
+// 讀寫區域變數的指令：回傳區域變數的型別（'i', 'f', 'd'），index 存進 *index，是否寫入存進 *isWrite；其他指令回傳 0
+static char localAccess(const JasmLine_t* line, int* index, bool* isWrite)
+{
+    static const char* const loads[] = { "iload", "fload", "dload" };
+    static const char* const stores[] = { "istore", "fstore", "dstore" };
+    static const char types[] = { 'i', 'f', 'd' };
+
+    if (line->opcode == NULL)
+        return 0;
+
+    *index = atoi(line->operand);
+    for (unsigned i = 0; i < 3; ++i) {
+        if (strcmp(line->opcode, loads[i]) == 0 || strcmp(line->opcode, stores[i]) == 0) {
+            *isWrite = line->opcode[1] == 's';
+            return types[i];
+        }
+    }
+    if (strcmp(line->opcode, "iinc") == 0) {
+        *isWrite = true;
+        return 'i';
+    }
+    return 0;
+}
+
+static const char* typeName(char type)
+{
+    return type == 'd' ? "double" : type == 'f' ? "float" : "int";
+}
+
+// 估計一個指令編碼後的 byte 數
+static unsigned instructionSize(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return 0;
+
+    int index;
+    bool isWrite;
+    if (isJasmOpcode(line, "iinc"))
+        return 3;
+    if (localAccess(line, &index, &isWrite))
+        return index <= 3 ? 1 : 2;
+
+    if (isJasmOpcode(line, "ldc")) {
+        // ldc2_w（double）為 3 byte，int / float / 字串以 ldc 為 2 byte
+        return getJasmLdcWords(line->operand) == 2 ? 3 : 2;
+    }
+    if (isJasmOpcode(line, "bipush"))
+        return 2;
+    if (isJasmOpcode(line, "sipush") || isBranch(line))
+        return 3;
+    if (isJasmOpcode(line, "getstatic") || isJasmOpcode(line, "putstatic") || isJasmOpcode(line, "invokestatic") || isJasmOpcode(line, "invokevirtual"))
+        return 3;
+    // opcode、對齊和 default（之後每個 case 另外計算，見 analyzeMethod）
+    if (isJasmOpcode(line, "tableswitch") || isJasmOpcode(line, "lookupswitch"))
+        return 16;
+    return 1;
+}
+
+// Region /////////////////////////////////////////////////////////////////////////////////////////
+
+// 一個 method 的 body 和分析的結果
+typedef struct SplitMethod_t {
+    JasmLiveness_t* liveness;  // 也是拆開後的 lines
+    unsigned* sizes;           // 每一行的 byte 數
+    int* depths;               // 執行每一行之前 operand stack 的格數
+    int* targets;              // 跳躍的目標（不是跳躍則為 -1）；tableswitch / lookupswitch 的每個 case 是它那一行的目標
+    int* minSources;           // 跳到這一行的跳躍中最前面 / 最後面的一個（沒有則為 -1）
+    int* maxSources;
+} SplitMethod_t;
+
+// 搬進新的 method 的一段 code [begin, end)
+typedef struct SplitRegion_t {
+    unsigned begin, end;
+    char types[MAX_LOCAL_NUM];    // 用到的區域變數的型別（double 的第二格為 '-'），沒用到則為 0
+    bool isWritten[MAX_LOCAL_NUM];
+} SplitRegion_t;
+
+// 把第 line 行用到的區域變數加進 region，型別不一致時回傳 false
+static bool addRegionLocal(SplitRegion_t* region, const JasmLine_t* line)
+{
+    int index;
+    bool isWrite;
+    const char type = localAccess(line, &index, &isWrite);
+    if (type == 0)
+        return true;
+    if (index < 0 || index + 1 >= MAX_LOCAL_NUM)
+        return false;
+
+    if ((region->types[index] && region->types[index] != type) || (type == 'd' && region->types[index + 1] && region->types[index + 1] != '-'))
+        return false;
+    region->types[index] = type;
+    if (type == 'd')
+        region->types[index + 1] = '-';
+    region->isWritten[index] |= isWrite;
+    return true;
+}
+
+// 從 begin 開始、不超過 maxSize byte 的最長一段可以搬出去的 code，結尾存進 region->end；沒有（或都小於 minSize byte）時回傳 false
+static bool findRegion(const SplitMethod_t* method, unsigned begin, unsigned minSize, unsigned maxSize, SplitRegion_t* region)
+{
+    const JasmLiveness_t* L = method->liveness;
+    if (method->depths[begin] != 0)
+        return false;
+
+    SplitRegion_t current;
+    memset(&current, 0, sizeof(SplitRegion_t));
+    current.begin = begin;
+
+    int maxTarget = begin;  // 裡面的跳躍最遠跳到哪一行
+    int maxSource = begin;  // 跳進裡面（開頭以外）的跳躍最遠從哪一行跳過來
+    unsigned size = 0;
+    bool isFound = false;
+
+    for (unsigned end = begin + 1; end < L->lineNum; ++end) {
+        const unsigned i = end - 1;
+        const JasmLine_t* line = &L->lines[i];
+
+        // 之後再延長也不會成立的情況直接結束
+        size += method->sizes[i];
+        if (isBarrier(line) || size > maxSize || !addRegionLocal(&current, line))
+            break;
+        if (method->targets[i] >= 0) {
+            if (method->targets[i] < (int)begin)
+                break;
+            if (method->targets[i] > maxTarget)
+                maxTarget = method->targets[i];
+        }
+        if (i > begin && method->minSources[i] >= 0) {
+            if (method->minSources[i] < (int)begin)
+                break;
+            if (method->maxSources[i] > maxSource)
+                maxSource = method->maxSources[i];
+        }
+
+        if (method->depths[end] == 0 && maxTarget <= (int)end && maxSource < (int)end && size >= minSize) {
+            current.end = end;
+            *region = current;
+            isFound = true;
+        }
+    }
+    return isFound;
+}
+
+// Output /////////////////////////////////////////////////////////////////////////////////////////
+
+// 開頭 live、region 中有用到的區域變數（參數）
+static bool isRegionParameter(const SplitMethod_t* method, const SplitRegion_t* region, int index)
+{
+    const char type = region->types[index];
+    return type && type != '-' && isLocalLiveBefore(method->liveness, region->begin, index);
+}
+
+// region 中寫入、結尾之後還 live 的區域變數（回傳值）
+static bool isRegionResult(const SplitMethod_t* method, const SplitRegion_t* region, int index)
+{
+    return region->isWritten[index] && isLocalLiveBefore(method->liveness, region->end, index);
+}
+
+// 新的 method 的參數型別 `(<type>, <type>)`
+static void printParameterTypes(FILE* file, const SplitMethod_t* method, const SplitRegion_t* region)
+{
+    unsigned num = 0;
+    fputc('(', file);
+    for (int k = 0; k < MAX_LOCAL_NUM; ++k)
+        if (isRegionParameter(method, region, k))
+            fprintf(file, "%s%s", num++ ? ", " : "", typeName(region->types[k]));
+    fputc(')', file);
+}
+
+// 輸出新的 method `helper` 和存回傳值的 field；region 中的區域變數會被重新編號
+static void printHelperMethod(FILE* file, SplitMethod_t* method, const SplitRegion_t* region, const char* helper, unsigned resultNum)
+{
+    JasmLine_t* lines = method->liveness->lines;
+
+    // 參數從 0 開始排，接著是其他用到的區域變數
+    int newIndices[MAX_LOCAL_NUM];
+    int nextIndex = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int k = 0; k < MAX_LOCAL_NUM; ++k) {
+            const char type = region->types[k];
+            if (type == 0 || type == '-' || isRegionParameter(method, region, k) != (pass == 0))
+                continue;
+            newIndices[k] = nextIndex;
+            nextIndex += type == 'd' ? 2 : 1;
+        }
+    }
+
+    for (unsigned i = region->begin; i < region->end; ++i) {
+        int index;
+        bool isWrite;
+        if (!localAccess(&lines[i], &index, &isWrite))
+            continue;
+
+        char operand[32];
+        const char* space = strchr(lines[i].operand, ' ');
+        snprintf(operand, sizeof(operand), "%d%s", newIndices[index], space ? space : "");
+        char* opcode = strdup(lines[i].opcode);
+        setJasmInstruction(&lines[i], opcode, operand);
+        free(opcode);
+    }
+
+    char* body = NULL;
+    size_t size = 0;
+    FILE* bodyFile = open_memstream(&body, &size);
+    char* code = joinJasmLines(&lines[region->begin], region->end - region->begin);
+    fputs(code, bodyFile);
+    free(code);
+
+    // 跳到結尾的下一行改成跳到這裡
+    if (lines[region->end].label)
+        fprintf(bodyFile, "%s:\n", lines[region->end].label);
+
+    char returnType = 0;
+    for (int k = 0; k < MAX_LOCAL_NUM; ++k) {
+        if (!isRegionResult(method, region, k))
+            continue;
+
+        const char type = region->types[k];
+        fprintf(bodyFile, "%cload %d\n", type, newIndices[k]);
+        if (resultNum == 1)
+            returnType = type;
+        else
+            fprintf(bodyFile, "putstatic %s %s$%d\n", typeName(type), helper, k);
+    }
+    if (returnType)
+        fprintf(bodyFile, "%creturn\n", returnType);
+    else
+        fprintf(bodyFile, "return\n");
+    fclose(bodyFile);
+
+    const int maxStack = computeJasmMaxStack(body);
+    fprintf(file, "\nmethod public static %s %s ", returnType ? typeName(returnType) : "void", helper);
+    printParameterTypes(file, method, region);
+    fprintf(file, "\nmax_stack %d\nmax_locals %d\n{\n", maxStack >= 0 ? maxStack : JASM_MAX_STACK, JASM_MAX_LOCALS);
+    fputs(body, file);
+    fprintf(file, "} /* end of %s */\n", helper);
+    free(body);
+
+    if (resultNum > 1) {
+        for (int k = 0; k < MAX_LOCAL_NUM; ++k)
+            if (isRegionResult(method, region, k))
+                fprintf(file, "field static %s %s$%d\n", typeName(region->types[k]), helper, k);
+    }
+}
+
+// 在呼叫者中取代 region 的 code：載入參數、呼叫 helper、存回回傳值
+static void printHelperCall(FILE* file, const SplitMethod_t* method, const SplitRegion_t* region, const char* helper, unsigned resultNum)
+{
+    const JasmLine_t* first = &method->liveness->lines[region->begin];
+    if (first->label)
+        fprintf(file, "%s:\n", first->label);
+
+    for (int k = 0; k < MAX_LOCAL_NUM; ++k)
+        if (isRegionParameter(method, region, k))
+            fprintf(file, "%cload %d\n", region->types[k], k);
+
+    char returnType = 0;
+    for (int k = 0; k < MAX_LOCAL_NUM && resultNum == 1; ++k)
+        if (isRegionResult(method, region, k))
+            returnType = region->types[k];
+
+    fprintf(file, "invokestatic %s %s", returnType ? typeName(returnType) : "void", helper);
+    printParameterTypes(file, method, region);
+    fputc('\n', file);
+
+    for (int k = 0; k < MAX_LOCAL_NUM; ++k) {
+        if (!isRegionResult(method, region, k))
+            continue;
+
+        const char type = region->types[k];
+        if (resultNum > 1)
+            fprintf(file, "getstatic %s %s$%d\n", typeName(type), helper, k);
+        fprintf(file, "%cstore %d\n", type, k);
+    }
+}
+
+// Method /////////////////////////////////////////////////////////////////////////////////////////
+
+// 分析 body，無法分析時回傳 false
+static bool analyzeMethod(SplitMethod_t* method, const char* body)
+{
+    memset(method, 0, sizeof(SplitMethod_t));
+    method->liveness = analyzeJasmLiveness(body);
+    if (method->liveness == NULL || method->liveness->localNum >= MAX_LOCAL_NUM)
+        return false;
+
+    const JasmLiveness_t* L = method->liveness;
+    method->sizes = malloc((L->lineNum + 1) * sizeof(unsigned));
+    method->depths = malloc((L->lineNum + 1) * sizeof(int));
+    method->targets = malloc((L->lineNum + 1) * sizeof(int));
+    method->minSources = malloc((L->lineNum + 1) * sizeof(int));
+    method->maxSources = malloc((L->lineNum + 1) * sizeof(int));
+
+    if (computeJasmStackDepths(L->lines, L->lineNum, method->depths) < 0)
+        return false;
+
+    const char* switchOpcode = NULL; // 目前在哪一種 switch 的 case 之中
+    for (unsigned i = 0; i < L->lineNum; ++i) {
+        const JasmLine_t* line = &L->lines[i];
+        method->minSources[i] = method->maxSources[i] = -1;
+
+        // case 的 offset 為 4 byte，lookupswitch 還要加上 4 byte 的值；default 已經算在 switch 中
+        if (switchOpcode) {
+            method->sizes[i] = line->label ? 0 : strcmp(switchOpcode, "tableswitch") == 0 ? 4 : 8;
+            method->targets[i] = getJasmSwitchTarget(line) ? findJasmLabel(L->labels, getJasmSwitchTarget(line)) : -1;
+            if (line->label)
+                switchOpcode = NULL;
+            continue;
+        }
+        if (isJasmOpcode(line, "tableswitch") || isJasmOpcode(line, "lookupswitch"))
+            switchOpcode = line->opcode;
+
+        method->sizes[i] = instructionSize(line);
+        method->targets[i] = isBranch(line) ? findJasmLabel(L->labels, line->operand) : -1;
+    }
+    for (unsigned i = 0; i < L->lineNum; ++i) {
+        const int target = method->targets[i];
+        if (target < 0)
+            continue;
+        if (method->minSources[target] < 0 || method->minSources[target] > (int)i)
+            method->minSources[target] = i;
+        if (method->maxSources[target] < (int)i)
+            method->maxSources[target] = i;
+    }
+    return true;
+}
+
+static void freeSplitMethod(SplitMethod_t* method)
+{
+    if (method->liveness)
+        freeJasmLiveness(method->liveness);
+    free(method->sizes);
+    free(method->depths);
+    free(method->targets);
+    free(method->minSources);
+    free(method->maxSources);
+}
+
+// 拆開 method name 的 body，新的 method 輸出到 helpers；回傳新的 body，不用拆（或拆不了）時回傳 NULL
+static char* splitMethod(const char* name, const char* body, FILE* helpers)
+{
+    SplitMethod_t method;
+    if (!analyzeMethod(&method, body)) {
+        freeSplitMethod(&method);
+        return NULL;
+    }
+
+    const JasmLiveness_t* L = method.liveness;
+    unsigned size = 0;
+    for (unsigned i = 0; i < L->lineNum; ++i)
+        size += method.sizes[i];
+
+    // 每一段至少要有 1/8 的大小，避免拆出一大堆很小的 method
+    // Note: 新的 method 結尾要存回傳值，留一些空間
+    const unsigned minSize = Method_Split_Size / 8;
+    const unsigned maxSize = Method_Split_Size > 64 ? Method_Split_Size - 32 : Method_Split_Size;
+
+    SplitRegion_t* regions = NULL;
+    unsigned regionNum = 0;
+    for (unsigned begin = 0; begin < L->lineNum && size > Method_Split_Size; ) {
+        SplitRegion_t region;
+        if (!findRegion(&method, begin, minSize, maxSize, &region)) {
+            ++begin;
+            continue;
+        }
+
+        regions = realloc(regions, (regionNum + 1) * sizeof(SplitRegion_t));
+        regions[regionNum++] = region;
+        for (unsigned i = region.begin; i < region.end; ++i)
+            size -= method.sizes[i];
+        size += 8;  // 呼叫（大約）
+        begin = region.end;
+    }
+
+    char* result = NULL;
+    if (regionNum > 0) {
+        size_t resultSize = 0;
+        FILE* file = open_memstream(&result, &resultSize);
+        unsigned line = 0;
+
+        for (unsigned r = 0; r < regionNum; ++r) {
+            const SplitRegion_t* region = &regions[r];
+            char helper[256];
+            snprintf(helper, sizeof(helper), "%s$split_%u", name, r);
+
+            unsigned resultNum = 0;
+            for (int k = 0; k < MAX_LOCAL_NUM; ++k)
+                resultNum += isRegionResult(&method, region, k);
+
+            char* code = joinJasmLines(&L->lines[line], region->begin - line);
+            fputs(code, file);
+            free(code);
+            printHelperCall(file, &method, region, helper, resultNum);
+            printHelperMethod(helpers, &method, region, helper, resultNum);
+            line = region->end;
+        }
+
+        char* code = joinJasmLines(&L->lines[line], L->lineNum - line);
+        fputs(code, file);
+        free(code);
+        fclose(file);
+    }
+
+    free(regions);
+    freeSplitMethod(&method);
+    return result;
+}
+
+// Class //////////////////////////////////////////////////////////////////////////////////////////
+
+// `method public static <type> <name> (...)` 的 name
+static char* getMethodName(const JasmLine_t* line)
+{
+    const char* end = strchr(line->operand, '(');
+    if (end == NULL)
+        return NULL;
+    while (end > line->operand && end[-1] == ' ')
+        --end;
+
+    const char* begin = end;
+    while (begin > line->operand && begin[-1] != ' ')
+        --begin;
+    return begin < end ? strndup(begin, end - begin) : NULL;
+}
+
+static bool isTextLine(const JasmLine_t* line, const char* prefix)
+{
+    return line->opcode == NULL && line->text && strncmp(line->text, prefix, strlen(prefix)) == 0;
+}
+
+char* splitLargeMethods(const char* classBody)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(classBody, &lineNum);
+
+    char* result = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&result, &size);
+
+    for (unsigned i = 0; i < lineNum; ) {
+        // method <header> / max_stack / max_locals / { / body / } /* end of <name> */
+        unsigned brace = i + 1, end = lineNum;
+        if (isJasmOpcode(&lines[i], "method")) {
+            while (brace < lineNum && !isTextLine(&lines[brace], "{") && lines[brace].opcode && strncmp(lines[brace].opcode, "max_", 4) == 0)
+                ++brace;
+            if (brace < lineNum && isTextLine(&lines[brace], "{"))
+                for (end = brace + 1; end < lineNum && !isTextLine(&lines[end], "} /* end of "); ++end)
+                    ;
+        }
+
+        char* name = end < lineNum ? getMethodName(&lines[i]) : NULL;
+        if (name == NULL) {
+            char* code = joinJasmLines(&lines[i], 1);
+            fputs(code, file);
+            free(code);
+            ++i;
+            continue;
+        }
+
+        char* helpers = NULL;
+        size_t helperSize = 0;
+        FILE* helperFile = open_memstream(&helpers, &helperSize);
+        char* body = joinJasmLines(&lines[brace + 1], end - brace - 1);
+        char* newBody = splitMethod(name, body, helperFile);
+        fclose(helperFile);
+
+        if (newBody) {
+            for (unsigned k = i; k < brace; ++k) {
+                if (isJasmOpcode(&lines[k], "max_stack")) {
+                    const int maxStack = computeJasmMaxStack(newBody);
+                    fprintf(file, "max_stack %d\n", maxStack >= 0 ? maxStack : JASM_MAX_STACK);
+                    continue;
+                }
+                char* code = joinJasmLines(&lines[k], 1);
+                fputs(code, file);
+                free(code);
+            }
+            fprintf(file, "{\n%s} /* end of %s */\n%s", newBody, name, helpers);
+        }
+        else {
+            char* code = joinJasmLines(&lines[i], end - i + 1);
+            fputs(code, file);
+            free(code);
+        }
+
+        free(name);
+        free(body);
+        free(newBody);
+        free(helpers);
+        i = end + 1;
+    }
+
+    fclose(file);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+/**
+ * 把太大的 method 拆成多個 method
+ *
+ * @details JVM 不接受超過 64 KB bytecode 的 method，HotSpot 預設也不 JIT 超過 8000 bytes 的 method（-XX:-DontCompileHugeMethods），
+ *          很長的 main（例如展開後的迴圈、大量的 print）只能一直用 interpreter 執行。
+ *          整個 class 產生完之後估計每個 method 的 bytecode 大小（依照每個指令的編碼長度），超過 Method_Split_Size 的 method
+ *          從前面開始，把 operand stack 為空的兩行（statement 的邊界）之間的一段 code 搬進新的 method `<函數名>$split_<n>`：
+ *          - 這段 code 之外不能跳進中間，裡面也只能跳到這段 code 之內或結尾的下一行，而且不能有 return 和 tableswitch / lookupswitch
+ *          - 開頭 live、這段 code 中有讀寫的區域變數當成參數傳進去（在新的 method 中從 0 重新編號）
+ *          - 這段 code 中寫入、結尾之後還 live 的區域變數傳回來：只有一個時當成回傳值；
+ *            JVM 的 method 只能回傳一個值，有兩個以上時存進 static field `<新的 method>$<區域變數>` 再 return，呼叫之後讀回來
+ *          每一段盡量大（不超過 Method_Split_Size），拆到剩下的部分不超過 Method_Split_Size 為止；拆出來的 method 不會再拆
+ *          Note: 沒辦法做 liveness analysis 或模擬 operand stack 的 method 不處理；switch 的每個 case 都算是從 switch 那一行跳過去
+ */
+
+/**
+ * method 的 bytecode 最多幾個 byte（--split-size=N），預設 8000，0 代表不拆
+ */
+extern unsigned Method_Split_Size;
+
+/**
+ * classBody 是 class 的 `{` 和 `}` 之間所有的 JASM code，回傳處理後的 code（呼叫者負責 free）
+ */
+char* splitLargeMethods(const char* classBody);
@@ -0,0 +1,252 @@
+#include "parallelCodegen.h"
+#include "passManager.h"
+#include "exprToJasm.h"
+#include "jasmCode.h"
+#include "callGraph.h"
+#include "memoize.h"
+#include "inliner.h"
+#include "constEval.h"
+#include "specialize.h"
+#include "cfg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+extern FILE* JASM_FILE;
+
+unsigned Codegen_Jobs = 1;
+
+// 一個已經產生完 body 的函數
+typedef struct FunctionTask_t {
+    char* name;
+    Function_Type_Info_t info;
+    unsigned localNum;
+
+    char* before;        // 上一個函數之後寫進 JASM_FILE 的內容（包含這個函數 method 的宣告）
+    char* body;          // codegen 的結果，執行完 function pass 之後換成 pass 的結果
+    char* dump;          // --dump-after 的輸出
+    char* method;        // 完成之後的輸出（max_stack 到 memo table 的 field）
+    bool isPassDone;     // function pass 已經執行完（由 worker 設定）
+
+    struct FunctionTask_t* next;
+} FunctionTask_t;
+
+// 所有交出去的函數，依照原始碼的順序
+static FunctionTask_t* Tasks = NULL;
+static FunctionTask_t** Tasks_Tail = &Tasks;
+// 下一個要執行 function pass 的函數（worker 從這裡取）
+static FunctionTask_t* Next_Pass_Task = NULL;
+// 下一個要在 parse 的 thread 上完成的函數
+static FunctionTask_t* Next_Finish_Task = NULL;
+
+static pthread_t* Workers = NULL;
+static unsigned Worker_Num = 0;
+static bool Is_Shutdown = false;
+
+static pthread_mutex_t Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Task_Added = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t Pass_Done = PTHREAD_COND_INITIALIZER;
+
+// Finish /////////////////////////////////////////////////////////////////////////////////////////
+
+// function pass 之後的部分，依照原始碼的順序在 parse 的 thread 上執行，method 的其餘部分寫進 file
+static void finishFunction(const char* name, const Function_Type_Info_t* info, unsigned localNum, char* body, FILE* file)
+{
+    if (Cfg_Dot_File)
+        dumpCfgDot(Cfg_Dot_File, name, body);
+
+    // Note: memo table 會讀寫 field，inline、編譯時期計算和特化都使用沒有 memoize 的 body
+    registerFunctionEffects(name, body);
+    char* memoFields = NULL;
+    char* memoBody = memoizeFunction(body, name, info, localNum, &memoFields);
+
+    // max_stack 依照最後的 body 計算，無法分析時使用 JASM_MAX_STACK
+    const int maxStack = computeJasmMaxStack(memoBody);
+    fprintf(file, "max_stack %d\nmax_locals %d\n{\n", maxStack >= 0 ? maxStack : JASM_MAX_STACK, JASM_MAX_LOCALS);
+    fputs(memoBody, file);
+    free(memoBody);
+    registerInlineCandidate(name, body, localNum);
+    registerConstEvalFunction(name, body);
+    registerSpecializationCandidate(name, body, info);
+    free(body);
+
+    fprintf(file, "} /* end of %s */\n\n", name);
+    if (memoFields) {
+        fputs(memoFields, file);
+        free(memoFields);
+    }
+}
+
+// 等 task 的 function pass 執行完，完成其餘的部分
+static void finishTask(FunctionTask_t* task)
+{
+    pthread_mutex_lock(&Mutex);
+    while (!task->isPassDone)
+        pthread_cond_wait(&Pass_Done, &Mutex);
+    pthread_mutex_unlock(&Mutex);
+
+    fputs(task->dump, stdout);
+    free(task->dump);
+    task->dump = NULL;
+
+    size_t size = 0;
+    FILE* file = open_memstream(&task->method, &size);
+    finishFunction(task->name, &task->info, task->localNum, task->body, file);
+    fclose(file);
+    task->body = NULL;
+}
+
+// 完成 function pass 已經執行完的函數（依照順序，遇到還沒執行完的就停止）
+static void finishDoneTasks(void)
+{
+    while (Next_Finish_Task) {
+        pthread_mutex_lock(&Mutex);
+        const bool isPassDone = Next_Finish_Task->isPassDone;
+        pthread_mutex_unlock(&Mutex);
+        if (!isPassDone)
+            return;
+
+        finishTask(Next_Finish_Task);
+        Next_Finish_Task = Next_Finish_Task->next;
+    }
+}
+
+// Thread Pool ////////////////////////////////////////////////////////////////////////////////////
+
+static void* workerMain(void* arg)
+{
+    pthread_mutex_lock(&Mutex);
+
+    while (true) {
+        while (Next_Pass_Task == NULL && !Is_Shutdown)
+            pthread_cond_wait(&Task_Added, &Mutex);
+        if (Next_Pass_Task == NULL)
+            break;
+
+        FunctionTask_t* task = Next_Pass_Task;
+        Next_Pass_Task = task->next;
+        pthread_mutex_unlock(&Mutex);
+
+        size_t size = 0;
+        FILE* dumpFile = open_memstream(&task->dump, &size);
+        char* body = runFunctionPasses(task->body, task->name, &task->info, dumpFile);
+        fclose(dumpFile);
+        free(task->body);
+        task->body = body;
+
+        pthread_mutex_lock(&Mutex);
+        task->isPassDone = true;
+        pthread_cond_broadcast(&Pass_Done);
+    }
+
+    pthread_mutex_unlock(&Mutex);
+    return NULL;
+}
+
+static void startWorkers(void)
+{
+    Worker_Num = Codegen_Jobs;
+    Workers = malloc(Worker_Num * sizeof(pthread_t));
+
+    for (unsigned i = 0; i < Worker_Num; ++i) {
+        // 建不出 thread 時只用已經建好的
+        if (pthread_create(&Workers[i], NULL, workerMain, NULL) != 0) {
+            Worker_Num = i;
+            break;
+        }
+    }
+}
+
+// Function ///////////////////////////////////////////////////////////////////////////////////////
+
+void submitFunction(const char* name, const Function_Type_Info_t* info, unsigned localNum, char* body)
+{
+    if (Codegen_Jobs > 1 && Workers == NULL)
+        startWorkers();
+
+    // 不平行處理（或一個 thread 都建不出來）：立即處理
+    if (Worker_Num == 0) {
+        char* newBody = runFunctionPasses(body, name, info, stdout);
+        free(body);
+        finishFunction(name, info, localNum, newBody, JASM_FILE);
+        return;
+    }
+
+    FunctionTask_t* task = calloc(1, sizeof(FunctionTask_t));
+    task->name = strdup(name);
+    task->info = *info;
+    task->localNum = localNum;
+    task->body = body;
+
+    // 之前的內容先取出來，之後的內容另外暫存
+    task->before = endJasmCapture();
+    beginJasmCapture();
+
+    pthread_mutex_lock(&Mutex);
+    *Tasks_Tail = task;
+    Tasks_Tail = &task->next;
+    if (Next_Pass_Task == NULL)
+        Next_Pass_Task = task;
+    pthread_cond_signal(&Task_Added);
+    pthread_mutex_unlock(&Mutex);
+
+    if (Next_Finish_Task == NULL)
+        Next_Finish_Task = task;
+    finishDoneTasks();
+}
+
+void waitForFunction(const char* name)
+{
+    FunctionTask_t* target = Next_Finish_Task;
+    while (target && strcmp(target->name, name) != 0)
+        target = target->next;
+    if (target == NULL)
+        return;
+
+    while (Next_Finish_Task != target->next) {
+        finishTask(Next_Finish_Task);
+        Next_Finish_Task = Next_Finish_Task->next;
+    }
+}
+
+void finishFunctions(void)
+{
+    if (Tasks == NULL)
+        return;
+
+    while (Next_Finish_Task) {
+        finishTask(Next_Finish_Task);
+        Next_Finish_Task = Next_Finish_Task->next;
+    }
+
+    pthread_mutex_lock(&Mutex);
+    Is_Shutdown = true;
+    pthread_cond_broadcast(&Task_Added);
+    pthread_mutex_unlock(&Mutex);
+    for (unsigned i = 0; i < Worker_Num; ++i)
+        pthread_join(Workers[i], NULL);
+    free(Workers);
+    Workers = NULL;
+    Worker_Num = 0;
+
+    // 依照原始碼的順序接回去
+    char* rest = endJasmCapture();
+    beginJasmCapture();
+
+    while (Tasks) {
+        FunctionTask_t* task = Tasks;
+        Tasks = task->next;
+
+        fputs(task->before, JASM_FILE);
+        fputs(task->method, JASM_FILE);
+        free(task->before);
+        free(task->method);
+        free(task->name);
+        free(task);
+    }
+    Tasks_Tail = &Tasks;
+
+    fputs(rest, JASM_FILE);
+    free(rest);
+}
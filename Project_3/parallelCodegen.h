@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include "type_info.h"
+
+/**
+ * 每個函數產生完 JASM 之後的處理：function pass、memoize、輸出 method，可以交給 thread pool 平行處理
+ *
+ * @details 函數的 body 要等整個函數 parse 完、依照函數的 symbol table 產生，而且會 inline / 編譯時期計算 / 特化之前的函數，
+ *          所以 codegen 依然在 parse 的 thread 上依序進行；之後的 function pass（tail call elimination、SCCP、block layout、
+ *          dead store elimination）只用到這個函數自己的 JASM（label 也是每個函數各自編號，見 resetExprLabels），
+ *          --jobs 大於 1 時交給 thread pool 執行，parse 的 thread 同時繼續處理下一個函數
+ *
+ *          function pass 執行完之後，依照原始碼的順序在 parse 的 thread 上完成其餘的部分：
+ *          登記副作用、memoize、計算 max_stack，並登記成 inline / 編譯時期計算 / 特化的候選。
+ *          之後的函數要用到某個函數的 body 時（見 waitForFunction）才需要等它處理完，
+ *          所以輸出的 JASM 和 --jobs=1 完全相同
+ *          Note: 平行處理時，--dump-after 的輸出在函數完成時才依照順序輸出，不會和 symbol table 的輸出交錯
+ */
+
+/**
+ * 同時執行 function pass 的 thread 數（--jobs=N），預設為 1（不使用 thread，每個函數產生完立即處理）
+ */
+extern unsigned Codegen_Jobs;
+
+/**
+ * 函數 name（型別為 info，用到 localNum 個區域變數）的 body 產生完、method 的宣告寫進 JASM_FILE 之後呼叫，body 交給這裡 free
+ * 執行 function pass 和 memoize，輸出 method 的其餘部分（max_stack 到 memo table 的 field）
+ *
+ * Note: Codegen_Jobs 大於 1 時，在這之前寫進 JASM_FILE 的內容先取出來，之後的內容另外暫存，
+ *       由 finishFunctions 依照原始碼的順序和 method 接起來；呼叫時 JASM_FILE 必須是整個 class 的暫存區（見 beginJasmCapture）
+ */
+void submitFunction(const char* name, const Function_Type_Info_t* info, unsigned localNum, char* body);
+
+/**
+ * 要使用函數 name 的 body（inline、編譯時期計算、特化）之前呼叫：等到它和它之前的函數都處理完
+ * 不是已經交出去的函數（例如目前正在產生的函數）時直接回傳
+ */
+void waitForFunction(const char* name);
+
+/**
+ * 整個 class parse 完之後（䆁放 global symbol table 之前）呼叫：等所有函數處理完、結束 thread pool，
+ * 把所有 method 依照原始碼的順序接回 JASM_FILE
+ */
+void finishFunctions(void);
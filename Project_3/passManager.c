@@ -0,0 +1,286 @@
+#include "passManager.h"
+#include "expression.h"
+#include "exprToJasm.h"
+#include "constProp.h"
+#include "stmtToJasm.h"
+#include "inliner.h"
+#include "constEval.h"
+#include "specialize.h"
+#include "memoize.h"
+#include "tailCall.h"
+#include "ssa.h"
+#include "cfg.h"
+#include "liveness.h"
+#include "callGraph.h"
+#include "globalConst.h"
+#include "jasmCode.h"
+#include "methodSplit.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+bool Time_Passes = false;
+
+// 不會被 -O 開啟的 pass 的等級
+#define LEVEL_EXPLICIT_ONLY 3
+
+typedef enum PassKind_t {
+    passCodegen,
+    passFunction,
+    passClass,
+} PassKind_t;
+
+typedef struct PassFunction_t {
+    const char* name;
+    const Function_Type_Info_t* info;
+} PassFunction_t;
+
+typedef struct Pass_t {
+    const char* name;
+    PassKind_t kind;
+    unsigned level;              // -O level 大於等於 level 時開啟
+    const char* description;
+
+    // 開關：flag，或是用數值控制的 pass（budget 為 offBudget 時代表關閉，開啟時設成 onBudget）
+    bool* flag;
+    unsigned* budget;
+    unsigned offBudget, onBudget;
+
+    char* (*runFunction)(const char* body, const PassFunction_t* function);
+    char* (*runClass)(const char* classBody);
+
+    bool isDumped;               // --dump-after
+
+    // 統計
+    unsigned runs;
+    unsigned changes;
+    long lineDelta;
+    double seconds;
+} Pass_t;
+
+// Pass ///////////////////////////////////////////////////////////////////////////////////////////
+
+static char* runTailCallElim(const char* body, const PassFunction_t* function)
+{
+    return eliminateSelfTailCalls(body, function->name, function->info);
+}
+
+static char* runSccp(const char* body, const PassFunction_t* function)
+{
+    return propagateSsaConstants(body);
+}
+
+static char* runBlockLayout(const char* body, const PassFunction_t* function)
+{
+    return layoutBlocks(body);
+}
+
+static char* runDeadStoreElim(const char* body, const PassFunction_t* function)
+{
+    return eliminateDeadStores(body);
+}
+
+static char* runUnusedFunctionElim(const char* classBody)
+{
+    return analyzeCallGraph(classBody, Print_Call_Graph ? stdout : NULL);
+}
+
+static Pass_t Passes[] = {
+    { "simplify",             passCodegen,  1, "化簡 expression（恆等式、常數重新結合、strength reduction）", .flag = &Enable_Expr_Simplification },
+    { "cse",                  passCodegen,  2, "common subexpression elimination", .flag = &Enable_CSE },
+    { "stack-order",          passCodegen,  1, "依照需要的 operand stack 格數決定運算元的計算順序", .flag = &Enable_Stack_Ordering },
+    { "const-prop",           passCodegen,  1, "區域變數的 constant / copy propagation", .flag = &Enable_Const_Prop },
+    { "dead-code-elim",       passCodegen,  1, "刪除無法到達的 code 和常數 condition 的分支", .flag = &Eliminate_Dead_Code },
+    { "if-to-switch",         passCodegen,  1, "同一個變數和常數比較的 if-else 串改成 switch（開啟時 --if-switch-arms=4）", .budget = &If_Chain_Switch_Arms, .offBudget = 0, .onBudget = 4 },
+    { "unroll",               passCodegen,  LEVEL_EXPLICIT_ONLY, "展開執行次數已知的迴圈（開啟時 --unroll-factor=4）", .budget = &Unroll_Factor, .offBudget = 1, .onBudget = 4 },
+    { "inline",               passCodegen,  2, "inline 小的函數（開啟時 --inline-budget=24）", .budget = &Inline_Budget, .offBudget = 0, .onBudget = 24 },
+    { "const-eval",           passCodegen,  2, "在編譯時期執行參數都是常數的函數呼叫", .flag = &Enable_Const_Eval },
+    { "specialize",           passCodegen,  2, "依照常數參數特化函數（開啟時 --spec-budget=64）", .budget = &Specialize_Budget, .offBudget = 0, .onBudget = 64 },
+    { "memoize",              passCodegen,  LEVEL_EXPLICIT_ONLY, "memoize 沒有副作用的遞迴函數", .flag = &Enable_Memoization },
+    { "tail-call-elim",       passFunction, 1, "自己呼叫自己的 tail call 換成迴圈", .flag = &Enable_Tail_Call_Elim, .runFunction = runTailCallElim },
+    { "sccp",                 passFunction, 2, "SSA 上的 sparse conditional constant propagation", .flag = &Enable_SSA_Const_Prop, .runFunction = runSccp },
+    { "block-layout",         passFunction, 1, "依照 CFG 整理跳躍和 basic block 的排列", .flag = &Enable_Block_Layout, .runFunction = runBlockLayout },
+    { "dead-store-elim",      passFunction, 1, "刪除寫入後不會再被讀取的區域變數 store", .flag = &Enable_Dead_Store_Elim, .runFunction = runDeadStoreElim },
+    { "unused-function-elim", passClass,    1, "刪除從 main 無法呼叫到的函數", .flag = &Enable_Unused_Function_Elim, .runClass = runUnusedFunctionElim },
+    { "global-promotion",     passClass,    1, "從來沒被寫入的全域變數換成常數", .flag = &Enable_Global_Promotion, .runClass = promoteReadOnlyGlobals },
+    { "method-split",         passClass,    1, "把太大的 method 拆成多個 method（開啟時 --split-size=8000）", .budget = &Method_Split_Size, .offBudget = 0, .onBudget = 8000, .runClass = splitLargeMethods },
+};
+
+#define PASS_NUM (sizeof(Passes) / sizeof(Passes[0]))
+
+// function pass 的執行順序
+// Note: dead store elimination 刪掉 store 之後，常數 condition 留下的分支可能變成空的，所以再整理一次跳躍
+static const char* const Function_Pipeline[] = { "tail-call-elim", "sccp", "block-layout", "dead-store-elim", "block-layout" };
+
+// --dump-after=codegen
+static bool Dump_After_Codegen = false;
+
+// 統計的 lock（--jobs 大於 1 時 function pass 會在多個 thread 同時執行）
+static pthread_mutex_t Statistics_Mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static Pass_t* findPass(const char* name)
+{
+    for (unsigned i = 0; i < PASS_NUM; ++i)
+        if (strcmp(Passes[i].name, name) == 0)
+            return &Passes[i];
+    return NULL;
+}
+
+static bool isPassEnabled(const Pass_t* pass)
+{
+    return pass->flag ? *pass->flag : *pass->budget != pass->offBudget;
+}
+
+void setOptimizationLevel(unsigned level)
+{
+    for (unsigned i = 0; i < PASS_NUM; ++i) {
+        // Note: 等級為 LEVEL_EXPLICIT_ONLY 的 pass 預設就是關閉的，-O 不會改變它們原本的設定
+        if (Passes[i].level == LEVEL_EXPLICIT_ONLY)
+            continue;
+        setPassEnabled(Passes[i].name, level >= Passes[i].level);
+    }
+}
+
+bool setPassEnabled(const char* name, bool isEnabled)
+{
+    Pass_t* pass = findPass(name);
+    if (pass == NULL)
+        return false;
+
+    if (pass->flag)
+        *pass->flag = isEnabled;
+    else if (!isEnabled)
+        *pass->budget = pass->offBudget;
+    else if (*pass->budget == pass->offBudget)
+        *pass->budget = pass->onBudget;
+    return true;
+}
+
+bool addDumpAfter(const char* name)
+{
+    if (strcmp(name, "codegen") == 0) {
+        Dump_After_Codegen = true;
+        return true;
+    }
+
+    if (strcmp(name, "all") == 0) {
+        Dump_After_Codegen = true;
+        for (unsigned i = 0; i < PASS_NUM; ++i)
+            Passes[i].isDumped = Passes[i].kind != passCodegen;
+        return true;
+    }
+
+    Pass_t* pass = findPass(name);
+    if (pass == NULL || pass->kind == passCodegen)
+        return false;
+    pass->isDumped = true;
+    return true;
+}
+
+void printPassList(FILE* file)
+{
+    static const char* const kindStr[] = { "codegen", "function", "class" };
+
+    for (unsigned i = 0; i < PASS_NUM; ++i) {
+        const Pass_t* pass = &Passes[i];
+        fprintf(file, "\t  %-22s%-10s", pass->name, kindStr[pass->kind]);
+        if (pass->level == LEVEL_EXPLICIT_ONLY)
+            fprintf(file, "%-6s", "-");
+        else
+            fprintf(file, "-O%-4u", pass->level);
+        fprintf(file, "%s\n", pass->description);
+    }
+}
+
+// Pipeline ///////////////////////////////////////////////////////////////////////////////////////
+
+// 目前的 thread 用掉的 CPU 時間
+// Note: clock() 是整個 process 的時間，多個 thread 同時執行時會算到其他 thread 的時間
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void dumpCode(FILE* file, const char* stage, const char* name, const char* code)
+{
+    fprintf(file, "/* ---- after %s: %s ---- */\n%s", stage, name, code);
+}
+
+// 執行完一個 pass 之後更新統計，回傳新的 code（舊的 code 會被 free）
+static char* finishPass(Pass_t* pass, char* code, char* newCode, double begin, const char* name, FILE* dumpFile)
+{
+    const double seconds = now() - begin;
+    const bool isChanged = strcmp(code, newCode) != 0;
+    const long lineDelta = isChanged ? (long)countJasmLines(newCode) - (long)countJasmLines(code) : 0;
+
+    pthread_mutex_lock(&Statistics_Mutex);
+    pass->seconds += seconds;
+    ++pass->runs;
+    if (isChanged) {
+        ++pass->changes;
+        pass->lineDelta += lineDelta;
+    }
+    pthread_mutex_unlock(&Statistics_Mutex);
+    free(code);
+
+    if (pass->isDumped)
+        dumpCode(dumpFile, pass->name, name, newCode);
+    return newCode;
+}
+
+char* runFunctionPasses(const char* body, const char* name, const Function_Type_Info_t* info, FILE* dumpFile)
+{
+    const PassFunction_t function = { name, info };
+    char* code = strdup(body);
+
+    if (Dump_After_Codegen)
+        dumpCode(dumpFile, "codegen", name, code);
+
+    for (unsigned i = 0; i < sizeof(Function_Pipeline) / sizeof(Function_Pipeline[0]); ++i) {
+        Pass_t* pass = findPass(Function_Pipeline[i]);
+        if (!isPassEnabled(pass))
+            continue;
+
+        const double begin = now();
+        code = finishPass(pass, code, pass->runFunction(code, &function), begin, name, dumpFile);
+    }
+    return code;
+}
+
+char* runClassPasses(const char* classBody)
+{
+    char* code = strdup(classBody);
+
+    for (unsigned i = 0; i < PASS_NUM; ++i) {
+        Pass_t* pass = &Passes[i];
+        // Note: --call-graph 只要報告時，不刪除函數也要分析
+        const bool isReportOnly = pass->runClass == runUnusedFunctionElim && Print_Call_Graph;
+        if (pass->kind != passClass || !(isPassEnabled(pass) || isReportOnly))
+            continue;
+
+        const double begin = now();
+        code = finishPass(pass, code, pass->runClass(code), begin, "class", stdout);
+    }
+    return code;
+}
+
+void printPassStatistics(FILE* file)
+{
+    double total = 0;
+
+    fprintf(file, "%-22s %8s %8s %8s %12s\n", "pass", "runs", "changed", "lines", "time (ms)");
+    for (unsigned i = 0; i < PASS_NUM; ++i) {
+        const Pass_t* pass = &Passes[i];
+        if (pass->kind == passCodegen) {
+            fprintf(file, "%-22s %8s %8s %8s %12s\n", pass->name, isPassEnabled(pass) ? "codegen" : "off", "-", "-", "-");
+            continue;
+        }
+
+        fprintf(file, "%-22s %8u %8u %+8ld %12.3f\n", pass->name, pass->runs, pass->changes, pass->lineDelta, pass->seconds * 1000);
+        total += pass->seconds;
+    }
+    fprintf(file, "%-22s %8s %8s %8s %12.3f\n", "total", "", "", "", total * 1000);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+#include "type_info.h"
+
+/**
+ * 最佳化的 pass manager
+ *
+ * @details 所有最佳化都登記成一個有名稱的 pass，分成三類：
+ *          - codegen：產生 JASM 時順便做的（expression 化簡、CSE、constant propagation、inline 等），只能開關
+ *          - function：每個函數的 body 產生完之後依序執行（tail call elimination -> SCCP -> block layout -> dead store elimination -> block layout）
+ *          - class：整個 class 產生完之後執行（刪除沒用到的函數、全域變數常數化、拆開太大的 method）
+ *          function 和 class 的 pass 會記錄執行的時間、執行次數、有改變的次數和增減的行數（--time-passes 輸出），
+ *          也可以在任何一個 pass 之後輸出當時的 JASM（--dump-after=<pass>）
+ *
+ *          -O0, -O1, -O2 依照每個 pass 的等級一次設定所有 pass（預設為 -O2）：
+ *          - -O0：全部關閉，parse 完直接輸出 JASM（不建 CFG、不做任何分析），適合 debug
+ *          - -O1：只做局部、便宜的最佳化
+ *          - -O2：全部（memoize 和迴圈展開會改變程式的記憶體用量和大小，只能用 --enable-pass 或原本的選項開啟）
+ *          Note: 選項依照順序套用，後面的覆蓋前面的（例如 `-O1 --enable-pass=inline`）
+ */
+
+/**
+ * 依照 -O level 設定所有 pass 的開關
+ */
+void setOptimizationLevel(unsigned level);
+
+/**
+ * 開啟 / 關閉名稱為 name 的 pass，沒有這個 pass 時回傳 false
+ */
+bool setPassEnabled(const char* name, bool isEnabled);
+
+/**
+ * 在名稱為 name 的 pass（或 `codegen`：剛產生完 JASM 時、`all`：每個 pass）之後輸出 JASM，沒有這個 pass 時回傳 false
+ */
+bool addDumpAfter(const char* name);
+
+/**
+ * 列出所有 pass 的名稱、類別、開啟的 -O level 和說明
+ */
+void printPassList(FILE* file);
+
+/**
+ * 是否記錄每個 pass 的時間（--time-passes），預設為 false
+ */
+extern bool Time_Passes;
+
+/**
+ * 函數 name（型別為 info）的 body 產生完之後呼叫，依序執行所有開啟的 function pass，回傳處理後的 body（呼叫者負責 free）
+ * --dump-after 的輸出寫進 dumpFile
+ * Note: 只會修改 pass 的統計（有 lock），可以在多個 thread 同時呼叫（見 parallelCodegen.h）
+ */
+char* runFunctionPasses(const char* body, const char* name, const Function_Type_Info_t* info, FILE* dumpFile);
+
+/**
+ * 整個 class 產生完之後呼叫（classBody 是 `{` 和 `}` 之間所有的 JASM），執行所有開啟的 class pass，回傳處理後的 code（呼叫者負責 free）
+ */
+char* runClassPasses(const char* classBody);
+
+/**
+ * 輸出每個 pass 的統計（執行次數、有改變的次數、增減的行數、時間）
+ */
+void printPassStatistics(FILE* file);
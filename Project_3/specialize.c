@@ -0,0 +1,279 @@
+#include "specialize.h"
+#include "exprToJasm.h"
+#include "globalConst.h"
+#include "jasmCode.h"
+#include "liveness.h"
+#include "symbol_table.h"
+#include "parallelCodegen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern FILE* JASM_FILE;
+extern SymbolTable_t* Symbol_Table;
+
+unsigned Specialize_Budget = 64;
+
+// Candidate //////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct SpecializedClone_t {
+    char* key;      // 每個參數是否為常數、常數的值，例如 `_,3,_`
+    char* name;     // <name>$spec_<n>
+    struct SpecializedClone_t* next;
+} SpecializedClone_t;
+
+typedef struct SpecializeCandidate_t {
+    char* name;
+    char* body;
+    unsigned short returnType;
+    unsigned parameterNum;
+    unsigned short* parameters;  // 參數的型別
+    unsigned cloneNum;
+    SpecializedClone_t* clones;
+    struct SpecializeCandidate_t* next;
+} SpecializeCandidate_t;
+
+static SpecializeCandidate_t* Candidates = NULL;
+static unsigned Clone_Id = 0;
+
+// 已經產生、還沒輸出的 method
+static char* Pending_Methods = NULL;
+
+void registerSpecializationCandidate(const char* name, const char* body, const Function_Type_Info_t* info)
+{
+    if (Specialize_Budget == 0 || countJasmLines(body) > Specialize_Budget)
+        return;
+
+    SpecializeCandidate_t* candidate = calloc(1, sizeof(SpecializeCandidate_t));
+    candidate->name = strdup(name);
+    candidate->body = strdup(body);
+    candidate->returnType = info->returnType.type;
+    candidate->parameterNum = info->parameterNum;
+    candidate->parameters = malloc((info->parameterNum + 1) * sizeof(unsigned short));
+    for (unsigned i = 0; i < info->parameterNum; ++i)
+        candidate->parameters[i] = info->parameters[i].type;
+    candidate->next = Candidates;
+    Candidates = candidate;
+}
+
+static SpecializeCandidate_t* findCandidate(const char* name)
+{
+    for (SpecializeCandidate_t* candidate = Candidates; candidate; candidate = candidate->next)
+        if (strcmp(candidate->name, name) == 0)
+            return candidate;
+    return NULL;
+}
+
+// Clone //////////////////////////////////////////////////////////////////////////////////////////
+
+static bool isLocalAccess(const JasmLine_t* line)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    const char* op = line->opcode;
+    return ((op[0] == 'i' || op[0] == 'f' || op[0] == 'd') && (strcmp(op + 1, "load") == 0 || strcmp(op + 1, "store") == 0))
+           || strcmp(op, "iinc") == 0;
+}
+
+// 複製 body：第 i 個參數為常數（isConst[i]）時 load 換成 ldc value[i]，其他參數的 index 依序往前移
+static char* cloneBody(const SpecializeCandidate_t* candidate, const bool* isConst, const int* value)
+{
+    // 原本的 index -> 新的 index，常數參數為 -1
+    unsigned paramSize = 0;
+    for (unsigned i = 0; i < candidate->parameterNum; ++i)
+        paramSize += candidate->parameters[i] == pDoubleType ? 2 : 1;
+
+    int* newIndex = malloc((paramSize + 1) * sizeof(int));
+    int* paramOf = malloc((paramSize + 1) * sizeof(int));
+    unsigned oldNext = 0, newNext = 0;
+    for (unsigned i = 0; i < candidate->parameterNum; ++i) {
+        const unsigned size = candidate->parameters[i] == pDoubleType ? 2 : 1;
+        for (unsigned k = 0; k < size; ++k) {
+            newIndex[oldNext + k] = isConst[i] ? -1 : (int)(newNext + k);
+            paramOf[oldNext + k] = i;
+        }
+        oldNext += size;
+        newNext += isConst[i] ? 0 : size;
+    }
+
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(candidate->body, &lineNum);
+
+    for (unsigned i = 0; i < lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        if (!isLocalAccess(line))
+            continue;
+
+        char* rest = NULL;
+        long index = strtol(line->operand, &rest, 10);
+        if (index < 0 || index >= (long)paramSize)
+            continue;
+
+        char operand[64];
+        if (newIndex[index] < 0)
+            snprintf(operand, sizeof(operand), "%d", value[paramOf[index]]);
+        else
+            snprintf(operand, sizeof(operand), "%d%s", newIndex[index], rest);
+
+        // Note: 常數參數不會被寫入，所以只有 load
+        char* opcode = newIndex[index] < 0 ? strdup("ldc") : strdup(line->opcode);
+        setJasmInstruction(line, opcode, operand);
+        free(opcode);
+    }
+
+    char* result = joinJasmLines(lines, lineNum);
+    freeJasmLines(lines, lineNum);
+    free(newIndex);
+    free(paramOf);
+
+    char* folded = foldJasmConstants(result);
+    free(result);
+    if (Enable_Dead_Store_Elim) {
+        result = eliminateDeadStores(folded);
+        free(folded);
+        folded = result;
+    }
+    return folded;
+}
+
+// 把特化的 method 加到 Pending_Methods
+static void addPendingMethod(const SpecializeCandidate_t* candidate, const char* name, const bool* isConst, const char* body)
+{
+    char* method = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&method, &size);
+
+    if (Pending_Methods)
+        fputs(Pending_Methods, file);
+
+    fprintf(file, "method public static %s %s (", JASM_TypeStr[candidate->returnType], name);
+    unsigned n = 0;
+    for (unsigned i = 0; i < candidate->parameterNum; ++i)
+        if (!isConst[i])
+            fprintf(file, n++ ? ", %s" : "%s", JASM_TypeStr[candidate->parameters[i]]);
+    fprintf(file, ")\n");
+    const int maxStack = computeJasmMaxStack(body);
+    fprintf(file, "max_stack %d\nmax_locals %d\n{\n", maxStack >= 0 ? maxStack : JASM_MAX_STACK, JASM_MAX_LOCALS);
+    fputs(body, file);
+    fprintf(file, "} /* end of %s */\n\n", name);
+
+    fclose(file);
+    free(Pending_Methods);
+    Pending_Methods = method;
+}
+
+// 回傳 candidate 在 isConst, value 下的特化 method 名稱；不值得特化時回傳 NULL
+static const char* getClone(SpecializeCandidate_t* candidate, const bool* isConst, const int* value)
+{
+    char* key = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&key, &size);
+    for (unsigned i = 0; i < candidate->parameterNum; ++i) {
+        if (i)
+            fputc(',', file);
+        if (isConst[i])
+            fprintf(file, "%d", value[i]);
+        else
+            fputc('_', file);
+    }
+    fclose(file);
+
+    for (SpecializedClone_t* clone = candidate->clones; clone; clone = clone->next) {
+        if (strcmp(clone->key, key) == 0) {
+            free(key);
+            return clone->name;
+        }
+    }
+
+    if (candidate->cloneNum >= SPECIALIZE_MAX_CLONES) {
+        free(key);
+        return NULL;
+    }
+
+    // 不會變小的也記下來（name 為 NULL），之後同樣的呼叫不用再試一次
+    SpecializedClone_t* clone = calloc(1, sizeof(SpecializedClone_t));
+    clone->key = key;
+    clone->next = candidate->clones;
+    candidate->clones = clone;
+
+    char* body = cloneBody(candidate, isConst, value);
+    if (countJasmLines(body) < countJasmLines(candidate->body)) {
+        char name[256];
+        snprintf(name, sizeof(name), "%s$spec_%u", candidate->name, Clone_Id++);
+        clone->name = strdup(name);
+        ++candidate->cloneNum;
+        addPendingMethod(candidate, clone->name, isConst, body);
+    }
+    free(body);
+
+    return clone->name;
+}
+
+// Call ///////////////////////////////////////////////////////////////////////////////////////////
+
+bool specializedFuncCallToJasm(ExpressionNode_t* funcCallExpr)
+{
+    // 特化的 method 在目前的函數結束後才輸出，global scope 不處理
+    if (Specialize_Budget == 0 || Symbol_Table == NULL || Symbol_Table->parent == NULL)
+        return false;
+
+    // callee 可能還在執行 function pass（見 parallelCodegen.h）
+    waitForFunction(funcCallExpr->sval);
+    SpecializeCandidate_t* candidate = findCandidate(funcCallExpr->sval);
+    if (candidate == NULL || candidate->parameterNum == 0)
+        return false;
+
+    // 哪些參數可以換成常數：int / bool 常數，而且 body 沒有修改它
+    bool* isConst = calloc(candidate->parameterNum, sizeof(bool));
+    int* value = calloc(candidate->parameterNum, sizeof(int));
+    bool hasConst = false;
+    unsigned i = 0, index = 0;
+
+    for (ExpressionNode_t* param = funcCallExpr->rightOperand; param && i < candidate->parameterNum; param = param->nextExpression, ++i) {
+        const unsigned short type = candidate->parameters[i];
+
+        if (param->isConstExpr && (type == pIntType || type == pBoolType) && param->resultTypeInfo.type == type
+            && !isJasmWritesLocal(candidate->body, index)) {
+            isConst[i] = true;
+            value[i] = type == pIntType ? param->cIval : param->cBval;
+            hasConst = true;
+        }
+        index += type == pDoubleType ? 2 : 1;
+    }
+
+    const char* name = hasConst ? getClone(candidate, isConst, value) : NULL;
+    if (name == NULL) {
+        free(isConst);
+        free(value);
+        return false;
+    }
+
+    // 只傳入非常數的參數
+    i = 0;
+    for (ExpressionNode_t* param = funcCallExpr->rightOperand; param; param = param->nextExpression, ++i)
+        if (!isConst[i])
+            exprToJasm(param);
+
+    fprintf(JASM_FILE, "invokestatic %s %s(", JASM_TypeStr[funcCallExpr->resultTypeInfo.type], name);
+    unsigned n = 0;
+    i = 0;
+    for (ExpressionNode_t* param = funcCallExpr->rightOperand; param; param = param->nextExpression, ++i)
+        if (!isConst[i])
+            fprintf(JASM_FILE, n++ ? ", %s" : "%s", JASM_TypeStr[param->resultTypeInfo.type]);
+    fprintf(JASM_FILE, ")\n");
+
+    free(isConst);
+    free(value);
+    return true;
+}
+
+void printSpecializedFunctions(FILE* file)
+{
+    if (Pending_Methods == NULL)
+        return;
+
+    fputs(Pending_Methods, file);
+    free(Pending_Methods);
+    Pending_Methods = NULL;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdio.h>
+#include <stdbool.h>
+#include "expression.h"
+#include "type_info.h"
+
+/**
+ * 常數參數的函數特化（cloning）
+ *
+ * @details 呼叫時有 int / bool 參數是常數（例如 `power(x, 3)`、模式的 flag），而且 body 沒有修改那個參數時，
+ *          複製一份 body，把讀取該參數的 load 換成 `ldc 常數`，再做 int 常數計算（見 globalConst.h 的 foldJasmConstants）
+ *          和 dead store elimination，依照 flag 的分支就會直接消失。
+ *          只有變小了才值得：複製出來的 body 行數必須比原本少，才會產生新的 method `<name>$spec_<n>`，
+ *          它只接收非常數的參數（區域變數 index 依序往前移），呼叫端也只計算、傳入這些參數。
+ *          相同函數、相同常數的呼叫共用同一個 method，每個函數最多 SPECIALIZE_MAX_CLONES 個。
+ *          Note: 函數只能呼叫已經定義過的函數，所以在呼叫時 body 一定已經登記了
+ */
+
+// 每個函數最多特化出幾個 method
+#define SPECIALIZE_MAX_CLONES 8
+
+/**
+ * body 最多幾行 JASM 才會被特化（--spec-budget=N），0 代表不特化
+ */
+extern unsigned Specialize_Budget;
+
+/**
+ * 函數 name（型別為 info）定義結束時呼叫，body 是 `{` 和 `}` 之間的 JASM
+ */
+void registerSpecializationCandidate(const char* name, const char* body, const Function_Type_Info_t* info);
+
+/**
+ * 嘗試呼叫 funcCallExpr 的特化版本，成功時輸出 JASM 並回傳 true；不能特化時什麼都不輸出，回傳 false
+ */
+bool specializedFuncCallToJasm(ExpressionNode_t* funcCallExpr);
+
+/**
+ * 輸出還沒輸出的特化 method（要在 method 外面，每個函數定義結束時呼叫）
+ */
+void printSpecializedFunctions(FILE* file);
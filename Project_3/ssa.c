@@ -0,0 +1,668 @@
+#include "ssa.h"
+#include "liveness.h"
+#include "globalConst.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+bool Enable_SSA_Const_Prop = true;
+
+// Opcode Helper //////////////////////////////////////////////////////////////////////////////////
+
+// Xload, Xstore, iinc 的型別和區域變數：不是區域變數的指令回傳 false
+static bool getLocalAccess(const JasmLine_t* line, PrimitiveType_t* type, int* local, bool* isStore)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    const char* op = line->opcode;
+    if (strcmp(op, "iinc") == 0) {
+        *type = pIntType;
+        *isStore = true;
+    }
+    else if ((op[0] == 'i' || op[0] == 'f' || op[0] == 'd') && (strcmp(op + 1, "load") == 0 || strcmp(op + 1, "store") == 0)) {
+        *type = op[0] == 'i' ? pIntType : op[0] == 'f' ? pFloatType : pDoubleType;
+        *isStore = op[1] == 's';
+    }
+    else
+        return false;
+
+    char* end = NULL;
+    *local = (int)strtol(line->operand, &end, 10);
+    return end != line->operand && *local >= 0;
+}
+
+// 是否為 push int 常數的指令（ldc, iconst_N, bipush, sipush），是的話把值存進 value
+static bool getIntConstant(const JasmLine_t* line, int* value)
+{
+    if (line->opcode == NULL)
+        return false;
+
+    if (isJasmOpcode(line, "ldc") || isJasmOpcode(line, "bipush") || isJasmOpcode(line, "sipush")) {
+        char* end = NULL;
+        long v = strtol(line->operand, &end, 10);
+        if (end == line->operand || *end != '\0' || v < INT_MIN || v > INT_MAX)
+            return false;
+        *value = (int)v;
+        return true;
+    }
+
+    if (isJasmOpcode(line, "iconst_m1")) {
+        *value = -1;
+        return true;
+    }
+    if (strncmp(line->opcode, "iconst_", 7) == 0 && line->opcode[7] >= '0' && line->opcode[7] <= '5' && line->opcode[8] == '\0') {
+        *value = line->opcode[7] - '0';
+        return true;
+    }
+    return false;
+}
+
+// 依照 JVM 的規則計算 A op B（overflow 時 wrap around），無法計算（除以 0、不是 int 運算）回傳 false
+static bool foldIntOperator(const char* op, int A, int B, int* result)
+{
+    unsigned a = (unsigned)A, b = (unsigned)B;
+
+    if      (strcmp(op, "iadd") == 0) *result = (int)(a + b);
+    else if (strcmp(op, "isub") == 0) *result = (int)(a - b);
+    else if (strcmp(op, "imul") == 0) *result = (int)(a * b);
+    else if (strcmp(op, "iand") == 0) *result = A & B;
+    else if (strcmp(op, "ior")  == 0) *result = A | B;
+    else if (strcmp(op, "ixor") == 0) *result = A ^ B;
+    else if (strcmp(op, "ishl") == 0) *result = (int)(a << (b & 31));
+    else if (strcmp(op, "ishr") == 0) *result = A >> (B & 31);
+    else if (strcmp(op, "iushr") == 0) *result = (int)(a >> (b & 31));
+    else if (strcmp(op, "idiv") == 0 || strcmp(op, "irem") == 0) {
+        if (B == 0)
+            return false;
+        // Note: INT_MIN / -1 在 C 中是 undefined behavior，JVM 的結果是 INT_MIN（餘數為 0）
+        if (A == INT_MIN && B == -1)
+            *result = op[1] == 'd' ? INT_MIN : 0;
+        else
+            *result = op[1] == 'd' ? A / B : A % B;
+    }
+    else
+        return false;
+
+    return true;
+}
+
+static bool isIntOperator(const char* op)
+{
+    static const char* ops[] = { "iadd", "isub", "imul", "idiv", "irem", "iand", "ior", "ixor", "ishl", "ishr", "iushr" };
+    for (unsigned i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i)
+        if (strcmp(op, ops[i]) == 0)
+            return true;
+    return false;
+}
+
+// cond 為 eq, ne, lt, ge, gt, le 其中之一，回傳 A cond B；cond 不合法時回傳 -1
+static int compareInt(const char* cond, int A, int B)
+{
+    if (strcmp(cond, "eq") == 0) return A == B;
+    if (strcmp(cond, "ne") == 0) return A != B;
+    if (strcmp(cond, "lt") == 0) return A <  B;
+    if (strcmp(cond, "ge") == 0) return A >= B;
+    if (strcmp(cond, "gt") == 0) return A >  B;
+    if (strcmp(cond, "le") == 0) return A <= B;
+    return -1;
+}
+
+// key 為常數時 switch（lines[line]，之後是跳躍表，見 cfg.c）會跳到的 block，無法判斷時回傳 -1
+static int switchTargetBlock(const Cfg_t* cfg, unsigned line, int key)
+{
+    const JasmLine_t* lines = cfg->lines;
+    const bool isTable = isJasmOpcode(&lines[line], "tableswitch");
+    const char* target = NULL;
+    long low = 0;
+    if (isTable && sscanf(lines[line].operand, "%ld", &low) != 1)
+        return -1;
+
+    // tableswitch 的第 k 行是值為 low + k 的 case，lookupswitch 的每一行是 `<值> : <label>`
+    unsigned i = line + 1;
+    for (long value = low; i < cfg->lineNum && cfg->isSwitchTable[i] && lines[i].label == NULL; ++i, ++value) {
+        if (!isTable) {
+            char* end = NULL;
+            value = strtol(lines[i].text ? lines[i].text : "", &end, 10);
+            if (end == lines[i].text)
+                return -1;
+        }
+        if (target == NULL && value == key)
+            target = getJasmSwitchTarget(&lines[i]);
+    }
+    if (i >= cfg->lineNum || !cfg->isSwitchTable[i])
+        return -1;
+
+    // 沒有對應的 case：最後一行的 default
+    if (target == NULL)
+        target = lines[i].opcode;
+
+    const int labelLine = findJasmLabel(cfg->labels, target);
+    return labelLine < 0 ? -1 : cfg->blockOf[labelLine];
+}
+
+// SSA Construction ///////////////////////////////////////////////////////////////////////////////
+
+typedef struct IntList_t {
+    int* items;
+    unsigned num;
+} IntList_t;
+
+static void pushInt(IntList_t* list, int item)
+{
+    list->items = realloc(list->items, (list->num + 1) * sizeof(int));
+    list->items[list->num++] = item;
+}
+
+static bool hasInt(const IntList_t* list, int item)
+{
+    for (unsigned i = 0; i < list->num; ++i)
+        if (list->items[i] == item)
+            return true;
+    return false;
+}
+
+static int newValue(SsaFunction_t* ssa, SsaValueKind_t kind, PrimitiveType_t type, int local, int block, int line)
+{
+    ssa->values = realloc(ssa->values, (ssa->valueNum + 1) * sizeof(SsaValue_t));
+    SsaValue_t* V = &ssa->values[ssa->valueNum];
+    V->kind = kind;
+    V->type = type;
+    V->local = local;
+    V->block = block;
+    V->line = line;
+    V->operands = NULL;
+    return ssa->valueNum++;
+}
+
+// 每個 block 的 dominance frontier（Cooper, Harvey, Kennedy）
+static IntList_t* computeDominanceFrontiers(const Cfg_t* cfg)
+{
+    IntList_t* frontiers = calloc(cfg->blockNum + 1, sizeof(IntList_t));
+
+    for (unsigned b = 0; b < cfg->blockNum; ++b) {
+        const BasicBlock_t* B = &cfg->blocks[b];
+        if (!B->isReachable || B->predNum < 2)
+            continue;
+
+        for (unsigned p = 0; p < B->predNum; ++p) {
+            int runner = B->preds[p];
+            if (!cfg->blocks[runner].isReachable)
+                continue;
+
+            for (; runner >= 0 && runner != B->idom; runner = cfg->blocks[runner].idom)
+                if (!hasInt(&frontiers[runner], b))
+                    pushInt(&frontiers[runner], b);
+        }
+    }
+    return frontiers;
+}
+
+// 在 local 被寫入的 block 的 iterated dominance frontier 中、且 local 是 live 的 block 開頭放 phi
+static void placePhis(SsaFunction_t* ssa, const JasmLiveness_t* liveness, const IntList_t* frontiers, const PrimitiveType_t* localTypes)
+{
+    const Cfg_t* cfg = ssa->cfg;
+    int* hasPhi = malloc((cfg->blockNum + 1) * sizeof(int));    // 已經放了 phi 的 local + 1
+    int* isQueued = malloc((cfg->blockNum + 1) * sizeof(int));  // 已經放進 worklist 的 local + 1
+    int* worklist = malloc((cfg->blockNum + 1) * sizeof(int));
+
+    for (unsigned b = 0; b < cfg->blockNum; ++b)
+        hasPhi[b] = isQueued[b] = 0;
+
+    // 先一次找出每個 local 被寫入的 block
+    IntList_t* defBlocks = calloc(ssa->localNum + 1, sizeof(IntList_t));
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        PrimitiveType_t type;
+        int local;
+        bool isStore;
+        const int b = cfg->blockOf[i];
+        if (!getLocalAccess(&cfg->lines[i], &type, &local, &isStore) || !isStore || !cfg->blocks[b].isReachable)
+            continue;
+
+        pushInt(&defBlocks[local], b);
+        if (type == pDoubleType)
+            pushInt(&defBlocks[local + 1], b);
+    }
+
+    for (unsigned local = 0; local < ssa->localNum; ++local) {
+        unsigned workNum = 0;
+
+        for (unsigned k = 0; k < defBlocks[local].num; ++k) {
+            const int b = defBlocks[local].items[k];
+            if (isQueued[b] != (int)local + 1) {
+                isQueued[b] = local + 1;
+                worklist[workNum++] = b;
+            }
+        }
+
+        while (workNum > 0) {
+            const int b = worklist[--workNum];
+
+            for (unsigned k = 0; k < frontiers[b].num; ++k) {
+                const int F = frontiers[b].items[k];
+                if (hasPhi[F] == (int)local + 1)
+                    continue;
+                hasPhi[F] = local + 1;
+
+                if (!isLocalLiveBefore(liveness, cfg->blocks[F].begin, local))
+                    continue;
+
+                const int phi = newValue(ssa, ssaPhi, localTypes[local], local, F, -1);
+                ssa->values[phi].operands = malloc((cfg->blocks[F].predNum + 1) * sizeof(int));
+                for (unsigned p = 0; p < cfg->blocks[F].predNum; ++p)
+                    ssa->values[phi].operands[p] = -1;
+
+                SsaBlock_t* S = &ssa->blocks[F];
+                S->phis = realloc(S->phis, (S->phiNum + 1) * sizeof(int));
+                S->phis[S->phiNum++] = phi;
+
+                // phi 也是一個新的定義
+                if (isQueued[F] != (int)local + 1) {
+                    isQueued[F] = local + 1;
+                    worklist[workNum++] = F;
+                }
+            }
+        }
+    }
+
+    for (unsigned local = 0; local < ssa->localNum; ++local)
+        free(defBlocks[local].items);
+    free(defBlocks);
+    free(hasPhi);
+    free(isQueued);
+    free(worklist);
+}
+
+typedef struct RenameState_t {
+    IntList_t* stacks;        // 每個 local 目前的值
+    IntList_t* children;      // dominator tree
+} RenameState_t;
+
+static void setCurrentValue(SsaFunction_t* ssa, RenameState_t* state, int local, int value, IntList_t* pushed)
+{
+    if ((unsigned)local >= ssa->localNum)
+        return;
+    pushInt(&state->stacks[local], value);
+    pushInt(pushed, local);
+}
+
+// 沿著 dominator tree 把每個讀取連到目前的值
+static void renameBlock(SsaFunction_t* ssa, RenameState_t* state, int b)
+{
+    const Cfg_t* cfg = ssa->cfg;
+    const BasicBlock_t* B = &cfg->blocks[b];
+    IntList_t pushed = { 0 };
+
+    for (unsigned k = 0; k < ssa->blocks[b].phiNum; ++k) {
+        const int phi = ssa->blocks[b].phis[k];
+        setCurrentValue(ssa, state, ssa->values[phi].local, phi, &pushed);
+    }
+
+    for (unsigned i = B->begin; i < B->end; ++i) {
+        PrimitiveType_t type;
+        int local;
+        bool isStore;
+        if (!getLocalAccess(&cfg->lines[i], &type, &local, &isStore) || (unsigned)local >= ssa->localNum)
+            continue;
+
+        const bool isIinc = isJasmOpcode(&cfg->lines[i], "iinc");
+        if (!isStore || isIinc)
+            ssa->useOf[i] = state->stacks[local].items[state->stacks[local].num - 1];
+
+        if (isStore) {
+            const int value = newValue(ssa, isIinc ? ssaIinc : ssaStore, type, local, b, i);
+            ssa->defOf[i] = value;
+            setCurrentValue(ssa, state, local, value, &pushed);
+            if (type == pDoubleType)
+                setCurrentValue(ssa, state, local + 1, newValue(ssa, ssaClobber, type, local + 1, b, i), &pushed);
+        }
+    }
+
+    for (unsigned s = 0; s < B->succNum; ++s) {
+        const int S = B->succs[s];
+        unsigned k = 0;
+        while (cfg->blocks[S].preds[k] != b)
+            ++k;
+
+        for (unsigned p = 0; p < ssa->blocks[S].phiNum; ++p) {
+            SsaValue_t* phi = &ssa->values[ssa->blocks[S].phis[p]];
+            const IntList_t* stack = &state->stacks[phi->local];
+            phi->operands[k] = stack->items[stack->num - 1];
+        }
+    }
+
+    for (unsigned c = 0; c < state->children[b].num; ++c)
+        renameBlock(ssa, state, state->children[b].items[c]);
+
+    for (unsigned k = 0; k < pushed.num; ++k)
+        --state->stacks[pushed.items[k]].num;
+    free(pushed.items);
+}
+
+SsaFunction_t* buildSsa(const char* body)
+{
+    Cfg_t* cfg = buildCfg(body);
+    if (cfg == NULL)
+        return NULL;
+
+    JasmLiveness_t* liveness = analyzeJasmLiveness(body);
+    if (liveness == NULL) {
+        freeCfg(cfg);
+        return NULL;
+    }
+
+    SsaFunction_t* ssa = calloc(1, sizeof(SsaFunction_t));
+    ssa->cfg = cfg;
+    ssa->blocks = calloc(cfg->blockNum + 1, sizeof(SsaBlock_t));
+    ssa->useOf = malloc((cfg->lineNum + 1) * sizeof(int));
+    ssa->defOf = malloc((cfg->lineNum + 1) * sizeof(int));
+
+    // 每個 local 的型別以第一次出現的指令為準（entry, phi 的型別）
+    PrimitiveType_t* localTypes = NULL;
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        ssa->useOf[i] = ssa->defOf[i] = -1;
+
+        PrimitiveType_t type;
+        int local;
+        bool isStore;
+        if (!getLocalAccess(&cfg->lines[i], &type, &local, &isStore))
+            continue;
+
+        if ((unsigned)local + 2 > ssa->localNum) {
+            localTypes = realloc(localTypes, (local + 2) * sizeof(PrimitiveType_t));
+            for (unsigned k = ssa->localNum; k < (unsigned)local + 2; ++k)
+                localTypes[k] = pVoidType;
+            ssa->localNum = local + 2;
+        }
+        if (localTypes[local] == pVoidType)
+            localTypes[local] = type;
+    }
+
+    // entry 的值
+    RenameState_t state;
+    state.stacks = calloc(ssa->localNum + 1, sizeof(IntList_t));
+    state.children = calloc(cfg->blockNum + 1, sizeof(IntList_t));
+    for (unsigned local = 0; local < ssa->localNum; ++local)
+        pushInt(&state.stacks[local], newValue(ssa, ssaEntry, localTypes[local] == pVoidType ? pIntType : localTypes[local], local, 0, -1));
+
+    IntList_t* frontiers = computeDominanceFrontiers(cfg);
+    placePhis(ssa, liveness, frontiers, localTypes);
+
+    for (unsigned b = 1; b < cfg->blockNum; ++b)
+        if (cfg->blocks[b].isReachable && cfg->blocks[b].idom >= 0)
+            pushInt(&state.children[cfg->blocks[b].idom], b);
+    renameBlock(ssa, &state, 0);
+
+    for (unsigned local = 0; local < ssa->localNum; ++local)
+        free(state.stacks[local].items);
+    for (unsigned b = 0; b < cfg->blockNum; ++b) {
+        free(state.children[b].items);
+        free(frontiers[b].items);
+    }
+    free(state.stacks);
+    free(state.children);
+    free(frontiers);
+    free(localTypes);
+    freeJasmLiveness(liveness);
+    return ssa;
+}
+
+char* lowerSsa(const SsaFunction_t* ssa)
+{
+    // Note: 每個值都還在原本的區域變數，phi 的 operand 和結果是同一個區域變數，不需要產生任何指令
+    return joinJasmLines(ssa->cfg->lines, ssa->cfg->lineNum);
+}
+
+void freeSsa(SsaFunction_t* ssa)
+{
+    for (unsigned v = 0; v < ssa->valueNum; ++v)
+        free(ssa->values[v].operands);
+    for (unsigned b = 0; b < ssa->cfg->blockNum; ++b)
+        free(ssa->blocks[b].phis);
+    free(ssa->values);
+    free(ssa->blocks);
+    free(ssa->useOf);
+    free(ssa->defOf);
+    freeCfg(ssa->cfg);
+    free(ssa);
+}
+
+// Sparse Conditional Constant Propagation ////////////////////////////////////////////////////////
+
+typedef enum LatticeState_t {
+    latticeTop,       // 還不知道（還沒有執行到的定義）
+    latticeConst,
+    latticeBottom,    // 不是常數
+} LatticeState_t;
+
+typedef struct LatticeValue_t {
+    LatticeState_t state;
+    int constant;
+} LatticeValue_t;
+
+// operand stack 上的值：isKnown 為 false 代表不知道（不是常數，或不是 int）
+typedef struct StackValue_t {
+    bool isKnown;
+    int constant;
+} StackValue_t;
+
+typedef struct Sccp_t {
+    SsaFunction_t* ssa;
+    LatticeValue_t* values;
+    bool* isExecutable;       // block 是否可能執行
+    int* takenSucc;           // block 結尾的跳躍只會走到的 block，兩邊都可能時為 -1，還沒模擬過為 -2
+    StackValue_t* stack;
+    unsigned stackSize;
+    bool changed;
+} Sccp_t;
+
+// 把值 v 往下更新成 meet(原本的值, 新的值)
+static void lowerLattice(Sccp_t* S, int v, LatticeValue_t value)
+{
+    LatticeValue_t* old = &S->values[v];
+
+    if (value.state == latticeTop || old->state == latticeBottom)
+        return;
+    if (old->state == latticeConst && value.state == latticeConst && old->constant == value.constant)
+        return;
+
+    if (old->state == latticeTop)
+        *old = value;
+    else
+        old->state = latticeBottom;
+    S->changed = true;
+}
+
+static void setExecutable(Sccp_t* S, int b)
+{
+    if (!S->isExecutable[b]) {
+        S->isExecutable[b] = true;
+        S->changed = true;
+    }
+}
+
+// 還沒模擬過的 block 出去的 edge 先當成不會執行，模擬之後會再更新
+static bool isEdgeExecutable(const Sccp_t* S, int from, int to)
+{
+    return S->isExecutable[from] && S->takenSucc[from] != -2 && (S->takenSucc[from] == -1 || S->takenSucc[from] == to);
+}
+
+static void push(Sccp_t* S, bool isKnown, int constant)
+{
+    S->stack[S->stackSize].isKnown = isKnown;
+    S->stack[S->stackSize].constant = constant;
+    ++S->stackSize;
+}
+
+// stack 中比已知的部分更下面的值都是不知道
+static StackValue_t pop(Sccp_t* S)
+{
+    StackValue_t unknown = { false, 0 };
+    return S->stackSize > 0 ? S->stack[--S->stackSize] : unknown;
+}
+
+static LatticeValue_t toLattice(StackValue_t value)
+{
+    LatticeValue_t result = { value.isKnown ? latticeConst : latticeBottom, value.constant };
+    return result;
+}
+
+// 模擬 block 的指令，更新 block 中定義的值和會走到的 block
+static void evaluateBlock(Sccp_t* S, int b)
+{
+    const Cfg_t* cfg = S->ssa->cfg;
+    const BasicBlock_t* B = &cfg->blocks[b];
+
+    // phi 合併可能執行到的 edge 進來的值
+    for (unsigned k = 0; k < S->ssa->blocks[b].phiNum; ++k) {
+        const int phi = S->ssa->blocks[b].phis[k];
+        const SsaValue_t* P = &S->ssa->values[phi];
+
+        for (unsigned p = 0; p < B->predNum; ++p) {
+            if (!isEdgeExecutable(S, B->preds[p], b))
+                continue;
+
+            LatticeValue_t bottom = { latticeBottom, 0 };
+            lowerLattice(S, phi, P->type != pIntType || P->operands[p] < 0 ? bottom : S->values[P->operands[p]]);
+        }
+    }
+
+    S->stackSize = 0;
+    int taken = -1;
+
+    for (unsigned i = B->begin; i < B->end; ++i) {
+        const JasmLine_t* line = &cfg->lines[i];
+        const char* op = line->opcode;
+        int constant;
+        if (op == NULL || isJasmOpcode(line, "nop") || isJasmOpcode(line, "goto"))
+            continue;
+
+        if (getIntConstant(line, &constant))
+            push(S, true, constant);
+        else if (isJasmOpcode(line, "iload")) {
+            const LatticeValue_t* V = &S->values[S->ssa->useOf[i]];
+            push(S, V->state == latticeConst, V->constant);
+        }
+        else if (isJasmOpcode(line, "fload") || isJasmOpcode(line, "dload"))
+            push(S, false, 0);
+        else if (isJasmOpcode(line, "istore") || isJasmOpcode(line, "fstore") || isJasmOpcode(line, "dstore")) {
+            StackValue_t value = pop(S);
+            value.isKnown = value.isKnown && op[0] == 'i';
+            lowerLattice(S, S->ssa->defOf[i], toLattice(value));
+        }
+        else if (isJasmOpcode(line, "iinc")) {
+            const LatticeValue_t* V = &S->values[S->ssa->useOf[i]];
+            const char* delta = strchr(line->operand, ' ');
+            LatticeValue_t result = *V;
+            if (result.state == latticeConst && delta)
+                result.constant = (int)((unsigned)result.constant + (unsigned)atoi(delta + 1));
+            lowerLattice(S, S->ssa->defOf[i], result);
+        }
+        else if (isIntOperator(op)) {
+            StackValue_t B = pop(S), A = pop(S);
+            int result;
+            bool isKnown = A.isKnown && B.isKnown && foldIntOperator(op, A.constant, B.constant, &result);
+            push(S, isKnown, isKnown ? result : 0);
+        }
+        else if (isJasmOpcode(line, "ineg")) {
+            StackValue_t A = pop(S);
+            push(S, A.isKnown, (int)(0u - (unsigned)A.constant));
+        }
+        else if (isJasmOpcode(line, "dup")) {
+            StackValue_t A = pop(S);
+            push(S, A.isKnown, A.constant);
+            push(S, A.isKnown, A.constant);
+        }
+        else if (isJasmOpcode(line, "pop"))
+            pop(S);
+        else if (strncmp(op, "if_icmp", 7) == 0) {
+            StackValue_t B = pop(S), A = pop(S);
+            if (A.isKnown && B.isKnown && compareInt(op + 7, A.constant, B.constant) >= 0)
+                taken = compareInt(op + 7, A.constant, B.constant) ? cfg->blockOf[findJasmLabel(cfg->labels, line->operand)] : b + 1;
+        }
+        else if (strncmp(op, "if", 2) == 0 && strlen(op) == 4) {
+            StackValue_t A = pop(S);
+            if (A.isKnown && compareInt(op + 2, A.constant, 0) >= 0)
+                taken = compareInt(op + 2, A.constant, 0) ? cfg->blockOf[findJasmLabel(cfg->labels, line->operand)] : b + 1;
+        }
+        // switch 是 block 的最後一個指令，之後的跳躍表不是指令
+        else if (isJasmOpcode(line, "tableswitch") || isJasmOpcode(line, "lookupswitch")) {
+            StackValue_t key = pop(S);
+            if (key.isKnown)
+                taken = switchTargetBlock(cfg, i, key.constant);
+            break;
+        }
+        else
+            S->stackSize = 0;  // 其他指令：不知道會 pop / push 幾個值，全部當成不知道
+    }
+
+    // Note: 和值一樣只會往下更新，一旦兩邊都可能就不會再變回只走一邊
+    if (S->takenSucc[b] != taken && S->takenSucc[b] != -1) {
+        S->takenSucc[b] = S->takenSucc[b] == -2 ? taken : -1;
+        S->changed = true;
+    }
+
+    for (unsigned s = 0; s < B->succNum; ++s)
+        if (isEdgeExecutable(S, b, B->succs[s]))
+            setExecutable(S, B->succs[s]);
+}
+
+char* propagateSsaConstants(const char* body)
+{
+    SsaFunction_t* ssa = buildSsa(body);
+    if (ssa == NULL)
+        return strdup(body);
+
+    const Cfg_t* cfg = ssa->cfg;
+    Sccp_t S = { 0 };
+    S.ssa = ssa;
+    S.values = calloc(ssa->valueNum + 1, sizeof(LatticeValue_t));
+    S.isExecutable = calloc(cfg->blockNum + 1, sizeof(bool));
+    S.takenSucc = malloc((cfg->blockNum + 1) * sizeof(int));
+    S.stack = malloc((cfg->lineNum + 1) * sizeof(StackValue_t));
+
+    for (unsigned v = 0; v < ssa->valueNum; ++v)
+        S.values[v].state = ssa->values[v].kind == ssaEntry || ssa->values[v].kind == ssaClobber ? latticeBottom : latticeTop;
+    for (unsigned b = 0; b < cfg->blockNum; ++b)
+        S.takenSucc[b] = -2;  // 還沒執行過
+    S.isExecutable[0] = true;
+
+    // 依照原本的順序反覆模擬可能執行的 block，直到不再改變
+    // Note: 每個值、每個跳躍都只會往下更新，所以一定會停止
+    for (S.changed = true; S.changed; ) {
+        S.changed = false;
+        for (unsigned b = 0; b < cfg->blockNum; ++b)
+            if (S.isExecutable[b])
+                evaluateBlock(&S, b);
+    }
+
+    // 讀取常數的 iload 換成 ldc
+    bool isReplaced = false;
+    for (unsigned i = 0; i < cfg->lineNum; ++i) {
+        JasmLine_t* line = &cfg->lines[i];
+        if (!isJasmOpcode(line, "iload") || !S.isExecutable[cfg->blockOf[i]] || S.values[ssa->useOf[i]].state != latticeConst)
+            continue;
+
+        char operand[16];
+        sprintf(operand, "%d", S.values[ssa->useOf[i]].constant);
+        setJasmInstruction(line, "ldc", operand);
+        isReplaced = true;
+    }
+
+    char* result = NULL;
+    if (isReplaced) {
+        char* lowered = lowerSsa(ssa);
+        result = foldJasmConstants(lowered);
+        free(lowered);
+    }
+    else
+        result = strdup(body);
+
+    free(S.values);
+    free(S.isExecutable);
+    free(S.takenSucc);
+    free(S.stack);
+    freeSsa(ssa);
+    return result;
+}
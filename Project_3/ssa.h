@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include "type_info.h"
+#include "cfg.h"
+
+/**
+ * 函數的 SSA 形式
+ *
+ * @details 以 cfg.h 的 CFG 為基礎，把每個 JVM 區域變數的每一次寫入（istore, fstore, dstore, iinc）當成一個新的值
+ *          （有型別的 virtual register），每個讀取（iload, fload, dload, iinc）都指向唯一一個定義它的值：
+ *          - phi：依照 dominance frontier 放在多個定義匯合的 block 開頭，只放在變數 live 的 block（pruned SSA）
+ *          - 改名：沿著 dominator tree 走，每個區域變數維護一個目前的值的 stack
+ *          每個值都記得自己原本的區域變數，所以只要最佳化不把值搬到其他地方（例如只把讀取換成常數），
+ *          lower 回 JASM 時 phi 的所有 operand 都在同一個區域變數，直接拿掉 phi 就好
+ *          Note: JVM 中 bool 也是 int（iload / istore），所以 bool 變數的值型別為 pIntType
+ */
+
+typedef enum SsaValueKind_t {
+    ssaEntry,    // 函數開始時的值（參數，或還沒寫入的區域變數）
+    ssaStore,    // istore, fstore, dstore
+    ssaIinc,     // iinc（讀取原本的值再加上常數）
+    ssaClobber,  // dstore k 同時覆蓋 k + 1
+    ssaPhi,
+} SsaValueKind_t;
+
+typedef struct SsaValue_t {
+    SsaValueKind_t kind;
+    PrimitiveType_t type;   // istore, iinc -> pIntType、fstore -> pFloatType、dstore -> pDoubleType
+    int local;              // 對應的 JVM 區域變數
+    int block;              // 定義這個值的 block（entry 為 block 0）
+    int line;               // 定義這個值的那一行，entry, phi 為 -1
+    int* operands;          // phi：operands[k] 是從 block 的 preds[k] 進來的值，沒有值（pred 走不到）時為 -1
+} SsaValue_t;
+
+typedef struct SsaBlock_t {
+    int* phis;              // 這個 block 開頭的 phi（values 的 index）
+    unsigned phiNum;
+} SsaBlock_t;
+
+typedef struct SsaFunction_t {
+    Cfg_t* cfg;
+    SsaValue_t* values;
+    unsigned valueNum;
+    SsaBlock_t* blocks;     // 和 cfg->blocks 一一對應
+    int* useOf;             // 每一行讀取的值（Xload, iinc），沒有則為 -1
+    int* defOf;             // 每一行定義的值（Xstore, iinc），沒有則為 -1
+    unsigned localNum;      // code 中出現的最大的區域變數 index + 2
+} SsaFunction_t;
+
+/**
+ * 建出 body（一個函數 `{` 和 `}` 之間的 JASM）的 SSA 形式，用 freeSsa 䆁放；CFG 或 liveness 無法分析時回傳 NULL
+ */
+SsaFunction_t* buildSsa(const char* body);
+
+/**
+ * 轉回 JASM body（呼叫者負責 free）：每個值使用它原本的區域變數，phi 直接拿掉
+ */
+char* lowerSsa(const SsaFunction_t* ssa);
+
+/**
+ * 䆁放 buildSsa 的結果
+ */
+void freeSsa(SsaFunction_t* ssa);
+
+// Sparse Conditional Constant Propagation ////////////////////////////////////////////////////////
+
+/**
+ * 是否在 SSA 上做 int 區域變數的 constant propagation（--no-sccp 可關閉），預設為 true
+ */
+extern bool Enable_SSA_Const_Prop;
+
+/**
+ * 對 body 做 sparse conditional constant propagation，回傳新的 body（呼叫者負責 free）
+ *
+ * @details 每個 int 的值是「還不知道」、「常數 c」、「不是常數」其中之一，從 entry 開始只走可能執行到的 edge，
+ *          在 block 中模擬 operand stack 的常數（ldc、常數的運算、讀取常數的值），
+ *          condition 為常數的跳躍只走會執行的一邊（switch 只走會跳到的 case），phi 只合併可能執行到的 edge 進來的值，反覆更新到不再改變
+ *          （TCE 之後的迴圈、inline 進來的參數、跨過迴圈都沒有改變的變數也都能算出來）；
+ *          最後把讀取常數的 iload 換成 ldc，再用 foldJasmConstants 計算常數運算和常數 condition 的跳躍
+ */
+char* propagateSsaConstants(const char* body);
@@ -0,0 +1,56 @@
+#include "statement.h"
+#include "symbol_table.h"
+#include <stdlib.h>
+
+extern SymbolTable_t* Symbol_Table;
+
+StatementNode_t* createStatement(StatementKind_t kind)
+{
+    StatementNode_t* node = calloc(1, sizeof(StatementNode_t));
+    node->kind = kind;
+    node->scratchMark = node->initScratchMark = getScratchMark(Symbol_Table);
+    node->localVariableIndex = -1;
+    return node;
+}
+
+StatementNode_t* appendStatements(StatementNode_t* A, StatementNode_t* B)
+{
+    if (A == NULL)
+        return B;
+
+    StatementNode_t* last = A;
+    while (last->next)
+        last = last->next;
+    last->next = B;
+    return A;
+}
+
+StatementNode_t* statementBody(StatementNode_t* list)
+{
+    if (list && list->next == NULL)
+        return list;
+
+    StatementNode_t* block = createStatement(sBlock);
+    block->body = list;
+    return block;
+}
+
+void freeStatementTree(StatementNode_t* list)
+{
+    while (list) {
+        StatementNode_t* next = list->next;
+
+        freeExprTree(list->expr);
+        freeExprTree(list->cond);
+        freeExprTree(list->init);
+        freeExprTree(list->update);
+        freeExprTree(list->begin);
+        freeExprTree(list->end);
+        free(list->identifier);
+        freeStatementTree(list->body);
+        freeStatementTree(list->elseBody);
+        free(list);
+
+        list = next;
+    }
+}
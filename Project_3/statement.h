@@ -0,0 +1,76 @@
+#pragma once
+#include <stdbool.h>
+#include "expression.h"
+
+/**
+ * 函數本體的 statement 樹
+ *
+ * @details parse 時只檢查語意、更新 symbol table，並把每個 statement 存成節點；
+ *          整個函數 parse 完之後，才由 stmtToJasm.h 的 functionBodyToJasm 依照執行的順序產生 JASM
+ *          （constant propagation、dead code elimination、迴圈展開等也都在那時候做）
+ */
+
+typedef enum StatementKind_t {
+    sExpression,  // expr;
+    sPrint,       // print expr;
+    sPrintln,     // println expr;
+    sReturn,      // return expr;（expr 為 NULL 代表 `return;`）
+    sNop,         // ;
+    sBreak,
+    sContinue,
+    sVarDef,      // 非常數的區域變數定義，expr 是初始值（可為 NULL）
+    sBlock,       // { body }
+    sIf,          // if (cond) body else elseBody（沒有 else 時 elseBody 為 NULL）
+    sWhile,       // while (cond) body
+    sDoWhile,     // do body while (cond);
+    sFor,         // for (init; cond; update) body（init, cond, update 可為 NULL）
+    sForeach,     // foreach (identifier : begin .. end) body
+    sSwitch,      // switch (expr) { body }，body 是所有的 sCase（linked list）
+    sCase,        // case expr: body（expr 為常數；default 的 expr 為 NULL），body 是這個 case 所有的 statement（linked list）
+} StatementKind_t;
+
+typedef struct StatementNode_t {
+    StatementKind_t kind;
+    int id;                 // if, 迴圈, switch 的 control flow ID；break 所在迴圈（或 switch）、continue 所在迴圈的 ID
+    bool hasBreak;          // 迴圈, switch：body 中是否有 break 跳出這個迴圈（或 switch）
+
+    // parse 到這裡時 function scope 的 nextLocalVariableIndex，產生 JASM 時暫存區域變數從這裡開始分配
+    // Note: for 的 init 在 body 之前輸出，用的是 initScratchMark
+    unsigned scratchMark;
+    unsigned initScratchMark;
+
+    ExpressionNode_t* expr;
+    ExpressionNode_t* cond;
+    ExpressionNode_t* init;
+    ExpressionNode_t* update;
+    ExpressionNode_t* begin;
+    ExpressionNode_t* end;
+
+    // sVarDef, sForeach 的變數（localVariableIndex < 0 代表全域變數）
+    char* identifier;
+    int localVariableIndex;
+
+    struct StatementNode_t* body;      // sBlock 的所有 statement（linked list）；if, 迴圈的本體（一個節點）
+    struct StatementNode_t* elseBody;
+    struct StatementNode_t* next;      // 同一個 block 中的下一個 statement
+} StatementNode_t;
+
+/**
+ * 建立 kind 類型的節點，scratchMark 為目前的 nextLocalVariableIndex
+ */
+StatementNode_t* createStatement(StatementKind_t kind);
+
+/**
+ * 把 list B 接在 list A 的後面，回傳新的 list（A, B 都可為 NULL）
+ */
+StatementNode_t* appendStatements(StatementNode_t* A, StatementNode_t* B);
+
+/**
+ * if, 迴圈的本體只能是一個節點：list 不是剛好一個 statement 時（例如 `int a = 1, b = 2;` 或 const 變數的定義），包成 sBlock
+ */
+StatementNode_t* statementBody(StatementNode_t* list);
+
+/**
+ * 䆁放整個 list（包含 expression 和子節點）
+ */
+void freeStatementTree(StatementNode_t* list);
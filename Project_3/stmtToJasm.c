@@ -0,0 +1,939 @@
+#include "stmtToJasm.h"
+#include "exprToJasm.h"
+#include "jasmCode.h"
+#include "constProp.h"
+#include "symbol_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+extern FILE* JASM_FILE;
+extern SymbolTable_t* Symbol_Table;
+
+bool Eliminate_Dead_Code = true;
+unsigned Unroll_Factor = 1;
+unsigned Unroll_Budget = 256;
+unsigned If_Chain_Switch_Arms = 4;
+
+// 目前輸出的位置是否可能被執行到（遇到 return, break, continue 之後為 false）
+static bool Is_Reachable = true;
+
+// condition 是否為常數 true / false（只有開啟 dead code elimination 時才成立）
+#define IS_CONST_TRUE(E)  (Eliminate_Dead_Code && (E)->isConstExpr && (E)->cBval)
+#define IS_CONST_FALSE(E) (Eliminate_Dead_Code && (E)->isConstExpr && !(E)->cBval)
+
+// foreach 的範圍不是常數時，body 要複製成「往上」和「往下」兩份；body 超過這麼多行就不複製
+#define FOREACH_VERSIONING_MAX_LINES 256
+
+// Loop ///////////////////////////////////////////////////////////////////////////////////////////
+
+// foreach 的迴圈變數：全域變數用 getstatic / putstatic，區域變數用 iload / istore
+static void loadForeachVar(const char* identifier, int localVariableIndex)
+{
+    if (localVariableIndex < 0) fprintf(JASM_FILE, "\tgetstatic int %s\n", identifier); else fprintf(JASM_FILE, "\tiload %d\n", localVariableIndex);
+}
+
+static void storeForeachVar(const char* identifier, int localVariableIndex)
+{
+    if (localVariableIndex < 0) fprintf(JASM_FILE, "\tputstatic int %s\n", identifier); else fprintf(JASM_FILE, "\tistore %d\n", localVariableIndex);
+}
+
+// 迴圈變數 += delta
+static void incrForeachVar(const char* identifier, int localVariableIndex, int delta)
+{
+    if (localVariableIndex >= 0) {
+        fprintf(JASM_FILE, "\tiinc %d %d\n", localVariableIndex, delta);
+    }
+    else {
+        fprintf(JASM_FILE, "\tgetstatic int %s\n", identifier);
+        fprintf(JASM_FILE, "\tldc %d\n\tiadd\n", delta);
+        fprintf(JASM_FILE, "\tputstatic int %s\n", identifier);
+    }
+}
+
+/**
+ * 執行次數固定的迴圈：body 執行完後 i += step，只要 i 還不是 stopOperand 就跳回 body（body 至少執行一次）
+ * suffix 不是空字串時，body 內的 label 都會加上 suffix（同一個 body 輸出第二份時使用）
+ */
+static void countedLoopToJasm(int loopID, const char* identifier, int localVariableIndex, int step, const char* stopOperand, const char* body, const char* suffix)
+{
+    fprintf(JASM_FILE, "LOOP_BODY%d%s: nop\n", loopID, suffix);
+
+    if (*suffix) {
+        char continueLabel[32];
+        sprintf(continueLabel, "LOOP_CONTINUE%d", loopID);
+        printJasmWithLabelSuffix(JASM_FILE, body, suffix, continueLabel);
+    }
+    else
+        fputs(body, JASM_FILE);
+
+    fprintf(JASM_FILE, "LOOP_CONTINUE%d%s:\n", loopID, suffix);
+    incrForeachVar(identifier, localVariableIndex, step);
+    loadForeachVar(identifier, localVariableIndex);
+    fprintf(JASM_FILE, "\t%s\n", stopOperand);
+    fprintf(JASM_FILE, "\tif_icmpne LOOP_BODY%d%s\n", loopID, suffix);
+}
+
+/**
+ * 展開執行次數為 tripCount（>= 1）的迴圈，i 的初始值 start 已經存好，結束時 i == start + tripCount * step
+ * 
+ * tripCount 不超過 Unroll_Factor 時完全展開；否則每一輪執行 factor 份 body，剩下不到 factor 次的部分再用一般的迴圈執行。
+ * 每一份 body 的 label（包含 continue 用的 LOOP_CONTINUE）都會加上各自的 suffix，break 則直接跳到 LOOP_BREAK。
+ * 回傳 false 代表超過預算，沒有輸出任何東西
+ */
+static bool unrolledLoopToJasm(int loopID, const char* identifier, int localVariableIndex, int start, int step, long long tripCount, const char* body)
+{
+    // 每一份 body 加上 LOOP_CONTINUE 和 i += step
+    const unsigned linesPerCopy = countJasmLines(body) + 2;
+    unsigned factor;
+
+    if (Unroll_Factor <= 1 || tripCount < 1)
+        return false;
+
+    if (tripCount <= Unroll_Factor && tripCount * linesPerCopy <= Unroll_Budget)
+        factor = tripCount;
+    else {
+        factor = Unroll_Factor < Unroll_Budget / linesPerCopy ? Unroll_Factor : Unroll_Budget / linesPerCopy;
+        if (factor < 2 || tripCount < factor)
+            return false;
+    }
+
+    const long long rounds = tripCount / factor;
+    const long long remainder = tripCount % factor;
+    char suffix[48];
+    char continueLabel[32];
+    sprintf(continueLabel, "LOOP_CONTINUE%d", loopID);
+
+    // 展開的部分
+    if (rounds > 1)
+        fprintf(JASM_FILE, "LOOP_BODY%d: nop\n", loopID);
+
+    for (unsigned k = 0; k < factor; ++k) {
+        sprintf(suffix, "_U%d_%u", loopID, k);
+        printJasmWithLabelSuffix(JASM_FILE, body, suffix, continueLabel);
+        fprintf(JASM_FILE, "LOOP_CONTINUE%d%s:\n", loopID, suffix);
+        incrForeachVar(identifier, localVariableIndex, step);
+    }
+
+    // Note: 用 unsigned 計算，和 iinc 一樣 overflow
+    if (rounds > 1) {
+        loadForeachVar(identifier, localVariableIndex);
+        fprintf(JASM_FILE, "\tldc %d\n", (int)((unsigned)start + (unsigned)(rounds * factor) * (unsigned)step));
+        fprintf(JASM_FILE, "\tif_icmpne LOOP_BODY%d\n", loopID);
+    }
+
+    // 剩下的部分
+    if (remainder > 0) {
+        char stopOperand[32];
+        sprintf(stopOperand, "ldc %d", (int)((unsigned)start + (unsigned)tripCount * (unsigned)step));
+        sprintf(suffix, "_R%d", loopID);
+        countedLoopToJasm(loopID, identifier, localVariableIndex, step, stopOperand, body, suffix);
+    }
+
+    return true;
+}
+
+// 一般的 foreach：I2 留在 operand stack 上，每一輪都重新判斷要加 1 還是減 1
+static void genericForeachToJasm(int loopID, const char* identifier, int localVariableIndex, ExpressionNode_t* begin, ExpressionNode_t* end, const char* body)
+{
+    // I1, I2
+    exprToJasm(begin);
+    exprToJasm(end);
+    fprintf(JASM_FILE, "swap\n");
+    // 將 I1 存進去
+    storeForeachVar(identifier, localVariableIndex);
+    // 第一次執行：直接跳到 FOREACH_BODY
+    fprintf(JASM_FILE, "goto FOREACH_BODY%d\n", loopID);
+
+    fprintf(JASM_FILE, "LOOP_CONTINUE%d:\n", loopID);
+    // 檢查是否達到終點
+    fprintf(JASM_FILE, "\tdup\n");
+    loadForeachVar(identifier, localVariableIndex);
+    fprintf(JASM_FILE, "\tif_icmpeq LOOP_BREAK%d\n", loopID);
+
+    // 檢查是要加1還是減1
+    fprintf(JASM_FILE, "\tdup\n");
+    loadForeachVar(identifier, localVariableIndex);
+    fprintf(JASM_FILE, "\tif_icmplt FOREACH_GODOWN%d\n", loopID);
+    fprintf(JASM_FILE, "\tldc 1\n"); // 加1
+    fprintf(JASM_FILE, "\tgoto FOREACH_MOVE%d\n", loopID);
+    fprintf(JASM_FILE, "FOREACH_GODOWN%d:\n", loopID);
+    fprintf(JASM_FILE, "\tldc -1\n"); // 減1
+    fprintf(JASM_FILE, "FOREACH_MOVE%d:\n", loopID);
+    loadForeachVar(identifier, localVariableIndex);
+    fprintf(JASM_FILE, "\tiadd\n");
+    // 把加1或減1的值存回去
+    storeForeachVar(identifier, localVariableIndex);
+
+    // 接下來是 body
+    fprintf(JASM_FILE, "FOREACH_BODY%d: nop\n", loopID); // FOREACH_BODY
+    fputs(body, JASM_FILE);
+
+    fprintf(JASM_FILE, "\tgoto LOOP_CONTINUE%d\n", loopID);
+    fprintf(JASM_FILE, "LOOP_BREAK%d: pop\n\n", loopID);    // LOOP_BREAK: 結束並pop掉I2的結果
+}
+
+/**
+ * 產生 foreach 迴圈的 JASM，body 是已經產生好的迴圈本體
+ * localVariableIndex < 0 代表迴圈變數為全域變數
+ */
+static void foreachToJasm(int loopID, const char* identifier, int localVariableIndex, ExpressionNode_t* begin, ExpressionNode_t* end, const char* body)
+{
+    const bool isVarWritten = localVariableIndex < 0 ? isJasmWritesGlobal(body, identifier) : isJasmWritesLocal(body, localVariableIndex);
+    char stopOperand[32];
+
+    // 不知道方向時 I2 存進暫存區域變數，不能和 body 用到的區域變數重疊
+    const unsigned mark = getScratchMark(Symbol_Table);
+    const unsigned bodyLocals = countJasmLocals(body);
+    const unsigned tempIndex = mark > bodyLocals ? mark : bodyLocals;
+
+    // body 會修改迴圈變數 -> 方向可能會改變，只能每一輪重新判斷（區域變數不夠用時也一樣）
+    if (isVarWritten || (!(begin->isConstExpr && end->isConstExpr)
+            && (countJasmLines(body) > FOREACH_VERSIONING_MAX_LINES || tempIndex + 1 > JASM_MAX_LOCALS))) {
+        genericForeachToJasm(loopID, identifier, localVariableIndex, begin, end, body);
+        return;
+    }
+
+    // I1, I2 都是常數 -> 編譯時期就知道方向
+    if (begin->isConstExpr && end->isConstExpr) {
+        const int step = begin->cIval <= end->cIval ? 1 : -1;
+        // Note: 用 unsigned 計算，終點為 INT_MAX 或 INT_MIN 時會和 iinc 一樣 overflow
+        sprintf(stopOperand, "ldc %d", (int)((unsigned)end->cIval + (unsigned)step));
+
+        fprintf(JASM_FILE, "ldc %d\n", begin->cIval);
+        storeForeachVar(identifier, localVariableIndex);
+
+        const long long tripCount = llabs((long long)end->cIval - begin->cIval) + 1;
+        if (!unrolledLoopToJasm(loopID, identifier, localVariableIndex, begin->cIval, step, tripCount, body))
+            countedLoopToJasm(loopID, identifier, localVariableIndex, step, stopOperand, body, "");
+        // 正常結束時，讓 i 停在終點
+        incrForeachVar(identifier, localVariableIndex, -step);
+    }
+    // 不知道方向 -> 只判斷一次方向，再進入「往上」或「往下」其中一個迴圈
+    else {
+        while (getScratchMark(Symbol_Table) < tempIndex)
+            assignScratchIndex(Symbol_Table, pIntType);
+        const int temp = assignScratchIndex(Symbol_Table, pIntType);
+        sprintf(stopOperand, "iload %d", temp);
+
+        // I1, I2（I2 存進 temp）
+        exprToJasm(begin);
+        exprToJasm(end);
+        fprintf(JASM_FILE, "istore %d\n", temp);
+        storeForeachVar(identifier, localVariableIndex);
+
+        loadForeachVar(identifier, localVariableIndex);
+        fprintf(JASM_FILE, "iload %d\n", temp);
+        fprintf(JASM_FILE, "if_icmpgt FOREACH_DOWN%d\n", loopID);
+
+        // 往上
+        fprintf(JASM_FILE, "iinc %d 1\n", temp);
+        countedLoopToJasm(loopID, identifier, localVariableIndex, 1, stopOperand, body, "");
+        incrForeachVar(identifier, localVariableIndex, -1);
+        fprintf(JASM_FILE, "\tgoto LOOP_BREAK%d\n", loopID);
+
+        // 往下（Note: suffix 要包含 loopID，否則巢狀的 foreach 複製出來的 label 會重複）
+        char suffix[32];
+        sprintf(suffix, "_DOWN%d", loopID);
+        fprintf(JASM_FILE, "FOREACH_DOWN%d:\n", loopID);
+        fprintf(JASM_FILE, "iinc %d -1\n", temp);
+        countedLoopToJasm(loopID, identifier, localVariableIndex, -1, stopOperand, body, suffix);
+        incrForeachVar(identifier, localVariableIndex, 1);
+        releaseScratchIndex(Symbol_Table, mark);
+    }
+
+    fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", loopID);
+}
+
+// 是否為同一個（非常數的）int 變數
+static bool isSameIntVariable(ExpressionNode_t* A, ExpressionNode_t* B)
+{
+    return A->isID && !A->isConstExpr && B->isID && !B->isConstExpr
+            && A->resultTypeInfo.type == pIntType && strcmp(A->sval, B->sval) == 0;
+}
+
+/**
+ * for 迴圈的 header 是否為 `i = start; i OP stop; update` 的形式（start, stop 為常數，update 為 i++, ++i, i--, --i, i = i +/- 常數），
+ * 是的話回傳迴圈變數 i、每一輪的 step 和執行次數（>= 1）
+ */
+static bool isCountedForHeader(ExpressionNode_t* init, ExpressionNode_t* cond, ExpressionNode_t* update, ExpressionNode_t** var, int* step, long long* tripCount)
+{
+    if (!init || !cond || !update)
+        return false;
+
+    // i = start
+    if (!init->isOP || strcmp(init->OP, "=") != 0 || !init->rightOperand->isConstExpr)
+        return false;
+    ExpressionNode_t* I = init->leftOperand;
+    if (!isSameIntVariable(I, I))
+        return false;
+
+    // update
+    ExpressionNode_t* operand = update->leftOperand ? update->leftOperand : update->rightOperand;
+    if (update->isOP && (strcmp(update->OP, "++") == 0 || strcmp(update->OP, "--") == 0) && isSameIntVariable(I, operand)) {
+        *step = update->OP[0] == '+' ? 1 : -1;
+    }
+    else if (update->isOP && strcmp(update->OP, "=") == 0 && isSameIntVariable(I, update->leftOperand)) {
+        ExpressionNode_t* R = update->rightOperand;
+        if (!R->isOP || !R->leftOperand || (strcmp(R->OP, "+") != 0 && strcmp(R->OP, "-") != 0)
+                || !isSameIntVariable(I, R->leftOperand) || !R->rightOperand->isConstExpr || R->rightOperand->cIval == 0)
+            return false;
+        const long long delta = R->OP[0] == '+' ? R->rightOperand->cIval : -(long long)R->rightOperand->cIval;
+        if (delta > INT_MAX)
+            return false;
+        *step = delta;
+    }
+    else
+        return false;
+
+    // i OP stop（或 stop OP i）
+    if (!cond->isOP || !cond->leftOperand || !cond->rightOperand)
+        return false;
+
+    char OP[3] = "";
+    long long stop;
+    if (isSameIntVariable(I, cond->leftOperand) && cond->rightOperand->isConstExpr) {
+        strcpy(OP, cond->OP);
+        stop = cond->rightOperand->cIval;
+    }
+    else if (isSameIntVariable(I, cond->rightOperand) && cond->leftOperand->isConstExpr) {
+        // 左右交換
+        if      (strcmp(cond->OP, "<")  == 0) strcpy(OP, ">");
+        else if (strcmp(cond->OP, "<=") == 0) strcpy(OP, ">=");
+        else if (strcmp(cond->OP, ">")  == 0) strcpy(OP, "<");
+        else if (strcmp(cond->OP, ">=") == 0) strcpy(OP, "<=");
+        else if (strcmp(cond->OP, "!=") == 0) strcpy(OP, "!=");
+        stop = cond->leftOperand->cIval;
+    }
+    else
+        return false;
+
+    // 算出執行次數（只處理 i 往 stop 前進、不會 overflow 的情況）
+    const long long start = init->rightOperand->cIval;
+    const long long distance = *step > 0 ? stop - start : start - stop;
+    const long long absStep = *step > 0 ? *step : -(long long)*step;
+
+    if ((*step > 0 && strcmp(OP, "<") == 0) || (*step < 0 && strcmp(OP, ">") == 0))
+        *tripCount = distance > 0 ? (distance + absStep - 1) / absStep : 0;
+    else if ((*step > 0 && strcmp(OP, "<=") == 0) || (*step < 0 && strcmp(OP, ">=") == 0))
+        *tripCount = distance >= 0 ? distance / absStep + 1 : 0;
+    else if (strcmp(OP, "!=") == 0 && distance >= 0 && distance % absStep == 0)
+        *tripCount = distance / absStep;
+    else
+        return false;
+
+    *var = I;
+    return *tripCount >= 1;
+}
+
+/**
+ * 產生 for 迴圈的 JASM（init 已經輸出過了），body 是已經產生好的迴圈本體
+ * cond 和 update 可以是 NULL
+ */
+static void forToJasm(int loopID, ExpressionNode_t* init, ExpressionNode_t* cond, ExpressionNode_t* update, const char* body, bool hasBreak)
+{
+    ExpressionNode_t* var = NULL;
+    int step = 0;
+    long long tripCount = 0;
+
+    // body 不會執行
+    if (cond && IS_CONST_FALSE(cond))
+        return;
+
+    // 執行次數已知，且 body 不會修改迴圈變數 -> 嘗試展開
+    if (isCountedForHeader(init, cond, update, &var, &step, &tripCount)) {
+        const bool isVarWritten = var->localVariableIndex < 0 ? isJasmWritesGlobal(body, var->sval) : isJasmWritesLocal(body, var->localVariableIndex);
+
+        if (!isVarWritten && unrolledLoopToJasm(loopID, var->sval, var->localVariableIndex, init->rightOperand->cIval, step, tripCount, body)) {
+            fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", loopID);
+            return;
+        }
+    }
+
+    if (cond) condJumpToJasm(cond, false, "LOOP_BREAK", loopID);  // 若為 false，結束
+    fprintf(JASM_FILE, "FOR_BODY%d: nop\n", loopID);             // FOR_BODY:
+    fputs(body, JASM_FILE);
+
+    fprintf(JASM_FILE, "LOOP_CONTINUE%d: nop\n", loopID); // LOOP_CONTINUE: 當遇到 continue，從 update expression 開始
+    if (update) {
+        exprToJasm(update);
+        popExprResult(update->resultTypeInfo);
+    }
+
+    // 沒有 condition 代表永遠成立
+    if (cond) condJumpToJasm(cond, true, "FOR_BODY", loopID);  // 若為 true，跳回 FOR_BODY
+    else      fprintf(JASM_FILE, "goto FOR_BODY%d\n", loopID);
+
+    // 無窮迴圈又沒有 break 時，LOOP_BREAK 不會被執行到
+    if (!Eliminate_Dead_Code || (cond && !(cond->isConstExpr && cond->cBval)) || hasBreak)
+        fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", loopID);      // LOOP_BREAK
+}
+
+// Switch /////////////////////////////////////////////////////////////////////////////////////////
+
+// switch 的一個 case：值和它在 body 中的順序（label 是 SWITCH_CASE<id>_<index>）
+typedef struct SwitchCase_t {
+    int value;
+    unsigned index;
+} SwitchCase_t;
+
+// case 的值（bool 和 JVM 相同，為 0 / 1）
+static int switchCaseValue(const ExpressionNode_t* expr)
+{
+    return expr->resultTypeInfo.type == pBoolType ? expr->cBval : expr->cIval;
+}
+
+static int compareSwitchCase(const void* A, const void* B)
+{
+    const int a = ((const SwitchCase_t*)A)->value, b = ((const SwitchCase_t*)B)->value;
+    return (a > b) - (a < b);
+}
+
+// 和 javac 相同的估計：tableswitch 的大小（word 數）加上 3 倍的比較次數，不超過 lookupswitch 時用 tableswitch
+static bool isTableSwitchBetter(int low, int high, unsigned caseNum)
+{
+    const long long tableCost = 4 + ((long long)high - low + 1) + 3 * 3;
+    const long long lookupCost = 3 + 2 * (long long)caseNum + 3 * (long long)caseNum;
+    return tableCost <= lookupCost;
+}
+
+// operand stack 上的值跳到對應的 case（cases 已經依照值排序），沒有對應的 case 時跳到 defaultLabel
+static void switchDispatchToJasm(int switchID, const SwitchCase_t* cases, unsigned caseNum, const char* defaultLabel)
+{
+    if (caseNum == 0) {
+        fprintf(JASM_FILE, "pop\ngoto %s\n", defaultLabel);
+        return;
+    }
+
+    const int low = cases[0].value, high = cases[caseNum - 1].value;
+    if (isTableSwitchBetter(low, high, caseNum)) {
+        fprintf(JASM_FILE, "tableswitch %d %d\n", low, high);
+        for (unsigned i = 0; i < caseNum; ++i) {
+            fprintf(JASM_FILE, "SWITCH_CASE%d_%u\n", switchID, cases[i].index);
+            // 中間沒有 case 的值跳到 default
+            if (i + 1 < caseNum)
+                for (long long value = (long long)cases[i].value + 1; value < cases[i + 1].value; ++value)
+                    fprintf(JASM_FILE, "%s\n", defaultLabel);
+        }
+    }
+    else {
+        fprintf(JASM_FILE, "lookupswitch\n");
+        for (unsigned i = 0; i < caseNum; ++i)
+            fprintf(JASM_FILE, "%d : SWITCH_CASE%d_%u\n", cases[i].value, switchID, cases[i].index);
+    }
+    fprintf(JASM_FILE, "default : %s\n", defaultLabel);
+}
+
+// condition 是否為 `x == 常數` 或 `常數 == x`（x 為非常數的 int 變數），是的話回傳 x 和常數的值
+static bool isVarEqualsConst(ExpressionNode_t* cond, ExpressionNode_t** var, int* value)
+{
+    if (!cond->isOP || strcmp(cond->OP, "==") != 0)
+        return false;
+
+    ExpressionNode_t* L = cond->leftOperand;
+    ExpressionNode_t* R = cond->rightOperand;
+    if (R->isConstExpr && isSameIntVariable(L, L)) {
+        *var = L;
+        *value = R->cIval;
+        return true;
+    }
+    if (L->isConstExpr && isSameIntVariable(R, R)) {
+        *var = R;
+        *value = L->cIval;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * if-else 串 `if (x == C1) ... else if (x == C2) ... else ...`：從 S 開始，收集 condition 都是同一個變數 x 和不重複的常數比較的 if，
+ * 回傳 if 的數量，*arms 是這些 if，*cases 是每個 if 的常數（cases[k].index = k），兩者都由呼叫者 free
+ */
+static unsigned collectIfChain(StatementNode_t* S, StatementNode_t*** arms, SwitchCase_t** cases, ExpressionNode_t** var)
+{
+    unsigned armNum = 0, capacity = 0;
+    *arms = NULL;
+    *cases = NULL;
+
+    for (StatementNode_t* A = S; A && A->kind == sIf; A = A->elseBody) {
+        ExpressionNode_t* V;
+        int value;
+        if (!isVarEqualsConst(A->cond, &V, &value) || (armNum > 0 && !isSameIntVariable(V, *var)))
+            break;
+
+        // 重複的常數：之後的 if 留在 else 中照原本的方式比較
+        bool isDuplicate = false;
+        for (unsigned k = 0; k < armNum && !isDuplicate; ++k)
+            isDuplicate = (*cases)[k].value == value;
+        if (isDuplicate)
+            break;
+
+        if (armNum == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            *arms = realloc(*arms, capacity * sizeof(StatementNode_t*));
+            *cases = realloc(*cases, capacity * sizeof(SwitchCase_t));
+        }
+        (*arms)[armNum] = A;
+        (*cases)[armNum] = (SwitchCase_t){ value, armNum };
+        *var = V;
+        ++armNum;
+    }
+    return armNum;
+}
+
+// Statement //////////////////////////////////////////////////////////////////////////////////////
+
+static void statementToJasm(StatementNode_t* S);
+
+// 文法上的一個 Statement：無法到達時一樣要走過（更新 constant propagation 的狀態），但 JASM 會被丟掉
+// Note: if, 迴圈的本體如果只有一個 statement，它不是 Statement，不會單獨判斷
+static void reachableStatementToJasm(StatementNode_t* S)
+{
+    const bool isDead = Eliminate_Dead_Code && !Is_Reachable;
+    if (isDead)
+        beginJasmCapture();
+
+    statementToJasm(S);
+
+    if (isDead) {
+        free(endJasmCapture());
+        Is_Reachable = false;
+    }
+}
+
+static void statementsToJasm(StatementNode_t* list)
+{
+    for (StatementNode_t* S = list; S; S = S->next)
+        reachableStatementToJasm(S);
+}
+
+// propagate 完之後印出來（Debug 用）
+static ExpressionNode_t* propagateAndDump(ExpressionNode_t* expr, const char* title)
+{
+    expr = propagateConstants(expr);
+    printf("\t\e[36m%s\e[m", title);
+    dumpExprTree(stdout, expr);
+    puts("");
+    return expr;
+}
+
+// 至少 If_Chain_Switch_Arms 個 arm 的 if-else 串（見 collectIfChain）改成一次 tableswitch / lookupswitch（原本平均要比較 n / 2 次）：
+// 每個 arm 是一個 case，執行完跳到 END_IFELSE，最後的 else 是 default。condition 都沒有副作用，x 只需要讀一次
+// x 的值已知時不轉換，交給原本的 dead code elimination 只留下會執行的 arm
+static bool ifChainToJasm(StatementNode_t* S)
+{
+    StatementNode_t** arms = NULL;
+    SwitchCase_t* cases = NULL;
+    ExpressionNode_t* var = NULL;
+    const unsigned armNum = If_Chain_Switch_Arms ? collectIfChain(S, &arms, &cases, &var) : 0;
+
+    if (armNum == 0 || armNum < If_Chain_Switch_Arms || isLocalConstKnown(var->localVariableIndex)) {
+        free(arms);
+        free(cases);
+        return false;
+    }
+
+    for (unsigned k = 0; k < armNum; ++k) {
+        printf("\t\e[36mCondition = \e[m");
+        dumpExprTree(stdout, arms[k]->cond);
+        puts("");
+    }
+
+    StatementNode_t* elseBody = arms[armNum - 1]->elseBody;
+    char defaultLabel[64];
+    if (elseBody)
+        snprintf(defaultLabel, sizeof(defaultLabel), "ELSE%d", S->id);
+    else
+        snprintf(defaultLabel, sizeof(defaultLabel), "END_IFELSE%d", S->id);
+
+    qsort(cases, armNum, sizeof(SwitchCase_t), compareSwitchCase);
+    exprToJasm(var);
+    switchDispatchToJasm(S->id, cases, armNum, defaultLabel);
+
+    pushConstState(); // 記下 dispatch 時的狀態
+    beginJasmCapture();
+
+    bool isEndReachable = elseBody == NULL; // 沒有 else 時，沒有對應的常數就直接跳到 END_IFELSE
+    const unsigned bodyNum = armNum + (elseBody != NULL);
+    for (unsigned k = 0; k < bodyNum; ++k) {
+        // 每個 arm 都從 dispatch 時的狀態開始
+        meetConstState(false, true);
+        if (k < armNum)
+            fprintf(JASM_FILE, "SWITCH_CASE%d_%u: nop\n", S->id, k);
+        else
+            fprintf(JASM_FILE, "ELSE%d: nop\n", S->id);
+
+        Is_Reachable = true;
+        statementToJasm(k < armNum ? arms[k]->body : elseBody);
+        isEndReachable = isEndReachable || Is_Reachable;
+
+        // 跳過之後的 arm
+        if ((Is_Reachable || !Eliminate_Dead_Code) && k + 1 < bodyNum)
+            fprintf(JASM_FILE, "goto END_IFELSE%d\n", S->id);
+    }
+
+    char* body = endJasmCapture();
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    // 回到 dispatch 時的狀態，並忘記所有 arm 會修改的變數
+    endLoopConstProp(body, NULL, 0);
+    fputs(body, JASM_FILE);
+    free(body);
+    free(arms);
+    free(cases);
+
+    Is_Reachable = isEndReachable;
+    if (Is_Reachable || !Eliminate_Dead_Code)
+        fprintf(JASM_FILE, "END_IFELSE%d: nop\n\n", S->id); // END_IFELSE: 結束
+    return true;
+}
+
+static void ifToJasm(StatementNode_t* S)
+{
+    if (ifChainToJasm(S))
+        return;
+
+    ExpressionNode_t* cond = S->cond = propagateAndDump(S->cond, "Condition = ");
+
+    if (IS_CONST_FALSE(cond))
+        beginJasmCapture(); // then 不會執行，之後丟掉
+    else
+        condJumpToJasm(cond, false, "ELSE", S->id); // 若為 false，跳到 ELSE
+
+    pushConstState(); // 記下 condition 之後的狀態
+    statementToJasm(S->body);
+
+    if (S->elseBody == NULL) {
+        // 合併 then 結束時和 condition 不成立時的狀態
+        popConstState(!IS_CONST_FALSE(cond) && Is_Reachable, !IS_CONST_TRUE(cond));
+
+        if (IS_CONST_FALSE(cond)) {
+            free(endJasmCapture()); // 丟掉 then
+            Is_Reachable = true;
+        }
+        else if (!IS_CONST_TRUE(cond)) {
+            fprintf(JASM_FILE, "ELSE%d: nop\n/* End Of If */\n\n", S->id); // ELSE: 結束
+            Is_Reachable = true;
+        }
+        return;
+    }
+
+    const bool isThenReachable = Is_Reachable; // then 的結尾是否可能被執行到
+    swapConstState();                          // 記下 then 結束時的狀態，else 從 condition 之後的狀態開始
+
+    if (IS_CONST_TRUE(cond)) {
+        beginJasmCapture(); // 之後丟掉 else
+    }
+    else if (IS_CONST_FALSE(cond)) {
+        free(endJasmCapture()); // 丟掉 then
+    }
+    else {
+        if (Is_Reachable || !Eliminate_Dead_Code)
+            fprintf(JASM_FILE, "goto END_IFELSE%d\n", S->id); // 上面執行完了，跳到 END_IFELSE
+        fprintf(JASM_FILE, "ELSE%d: nop\n", S->id); // ELSE:
+    }
+    Is_Reachable = true;
+
+    statementToJasm(S->elseBody);
+
+    // 合併 then 和 else 結束時的狀態
+    popConstState(!IS_CONST_TRUE(cond) && Is_Reachable, !IS_CONST_FALSE(cond) && isThenReachable);
+
+    if (IS_CONST_TRUE(cond)) {
+        free(endJasmCapture()); // 丟掉 else
+        Is_Reachable = isThenReachable;
+    }
+    else if (!IS_CONST_FALSE(cond)) {
+        Is_Reachable = Is_Reachable || isThenReachable;
+        if (Is_Reachable || !Eliminate_Dead_Code)
+            fprintf(JASM_FILE, "END_IFELSE%d: nop\n\n", S->id); // END_IFELSE: 結束
+    }
+}
+
+// 迴圈經過 rotation：進入前先檢查一次 condition，之後 condition 放在 body 的後面，
+// 每一輪只需要一個「成立就跳回 body」的 conditional jump
+static void whileToJasm(StatementNode_t* S)
+{
+    beginLoopConstProp();
+    S->cond = propagateAndDump(S->cond, "Condition = ");
+
+    // 先產生 body，看過 body 之後才知道 condition 中哪些變數在迴圈中不會改變
+    beginJasmCapture();
+    statementToJasm(S->body);
+    char* body = endJasmCapture();
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    endLoopConstProp(body, &S->cond, 1);
+    body = substituteConstLocals(body);
+    ExpressionNode_t* cond = S->cond;
+
+    // condition 為 false 時整個迴圈都不會執行
+    if (!IS_CONST_FALSE(cond)) {
+        condJumpToJasm(cond, false, "LOOP_BREAK", S->id);      // 如為 false，跳到 LOOP_BREAK
+        fprintf(JASM_FILE, "WHILE_BODY%d: nop\n", S->id);   // WHILE_BODY:
+        fputs(body, JASM_FILE);
+        fprintf(JASM_FILE, "LOOP_CONTINUE%d: nop\n", S->id); // LOOP_CONTINUE:
+        condJumpToJasm(cond, true, "WHILE_BODY", S->id);       // 如為 true，跳回 WHILE_BODY
+    }
+
+    // 無窮迴圈只能透過 break 離開
+    Is_Reachable = !(cond->isConstExpr && cond->cBval) || S->hasBreak;
+    if (!IS_CONST_FALSE(cond) && (Is_Reachable || !Eliminate_Dead_Code))
+        fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", S->id);  // LOOP_BREAK: 結束
+    free(body);
+}
+
+static void doWhileToJasm(StatementNode_t* S)
+{
+    beginLoopConstProp();
+    beginJasmCapture();
+    statementToJasm(S->body);
+    continueLoopConstProp();
+    S->cond = propagateAndDump(S->cond, "Condition = ");
+    char* body = endJasmCapture();
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    endLoopConstProp(body, &S->cond, 1);
+    body = substituteConstLocals(body);
+    ExpressionNode_t* cond = S->cond;
+
+    fprintf(JASM_FILE, "DO_BODY%d: nop\n", S->id);      // DO_BODY:
+    fputs(body, JASM_FILE);
+    fprintf(JASM_FILE, "LOOP_CONTINUE%d: nop\n", S->id); // LOOP_CONTINUE:
+    condJumpToJasm(cond, true, "DO_BODY", S->id);          // 如為 true，跳回 DO_BODY
+
+    Is_Reachable = !(cond->isConstExpr && cond->cBval) || S->hasBreak;
+    if (Is_Reachable || !Eliminate_Dead_Code)
+        fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", S->id);  // LOOP_BREAK: 結束
+    free(body);
+}
+
+// 和 while 一樣經過 rotation，update expression 和 condition 都放在 body 的後面
+static void forStatementToJasm(StatementNode_t* S)
+{
+    if (S->init) {
+        resetScratchMark(Symbol_Table, S->initScratchMark);
+        S->init = propagateAndDump(S->init, "Initial Expression =  ");
+        exprToJasm(S->init);
+        popExprResult(S->init->resultTypeInfo);
+    }
+
+    beginLoopConstProp();
+    if (S->cond)
+        S->cond = propagateAndDump(S->cond, "Condition = ");
+    else
+        puts("\t\e[36mCondition =  true\e[m");
+
+    // 先產生 body，看過 body 之後才決定要不要展開迴圈
+    // Note: update 在 body 之後才執行（continue 也會跳過來），所以 body 之後才 propagate，它的 assign 不能影響 body
+    beginJasmCapture();
+    statementToJasm(S->body);
+    continueLoopConstProp();
+    if (S->update)
+        S->update = propagateAndDump(S->update, "Update Expression =  ");
+    char* body = endJasmCapture();
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    ExpressionNode_t* headers[] = { S->cond, S->update };
+    endLoopConstProp(body, headers, 2);
+    S->cond = headers[0];
+    S->update = headers[1];
+    body = substituteConstLocals(body);
+
+    forToJasm(S->id, S->init, S->cond, S->update, body, S->hasBreak);
+
+    // 沒有 condition 也是無窮迴圈
+    Is_Reachable = (S->cond && !(S->cond->isConstExpr && S->cond->cBval)) || S->hasBreak;
+    free(body);
+}
+
+static void foreachStatementToJasm(StatementNode_t* S)
+{
+    S->begin = propagateAndDump(S->begin, "Integer Expression = ");
+    S->end = propagateAndDump(S->end, "Integer Expression = ");
+    printf("\t\e[36mForeach \e[m%s\n", S->identifier);
+    beginLoopConstProp();
+
+    // 先產生 body，看過 body 之後才決定怎麼產生迴圈
+    beginJasmCapture();
+    statementToJasm(S->body);
+    char* body = endJasmCapture();
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    // 迴圈變數由迴圈本身修改，不會出現在 body 的 JASM 中
+    endLoopConstProp(body, NULL, 0);
+    killLocalConstProp(S->localVariableIndex);
+    body = substituteConstLocals(body);
+
+    foreachToJasm(S->id, S->identifier, S->localVariableIndex, S->begin, S->end, body);
+    Is_Reachable = true;
+    free(body);
+}
+
+// case 依照原始碼的順序輸出（沒有 break 時繼續執行下一個 case），前面是跳到各個 case 的 tableswitch / lookupswitch；
+// expression 為常數時直接 goto 到會執行的 case，其他的 case 只能從前一個 case 執行下來
+static void switchToJasm(StatementNode_t* S)
+{
+    ExpressionNode_t* expr = S->expr = propagateAndDump(S->expr, "Switch = ");
+
+    // 依照值排序的 case，以及 default 在 body 中的順序
+    unsigned caseNum = 0, index = 0, defaultIndex = UINT_MAX;
+    for (StatementNode_t* C = S->body; C; C = C->next)
+        caseNum += C->expr != NULL;
+
+    SwitchCase_t* cases = malloc((caseNum ? caseNum : 1) * sizeof(SwitchCase_t));
+    caseNum = 0;
+    for (StatementNode_t* C = S->body; C; C = C->next, ++index) {
+        if (C->expr)
+            cases[caseNum++] = (SwitchCase_t){ switchCaseValue(C->expr), index };
+        else
+            defaultIndex = index;
+    }
+    qsort(cases, caseNum, sizeof(SwitchCase_t), compareSwitchCase);
+
+    // 沒有 default 時，沒有對應的 case 就直接跳出 switch
+    char defaultLabel[64];
+    if (defaultIndex != UINT_MAX)
+        snprintf(defaultLabel, sizeof(defaultLabel), "SWITCH_DEFAULT%d", S->id);
+    else
+        snprintf(defaultLabel, sizeof(defaultLabel), "LOOP_BREAK%d", S->id);
+
+    // expression 為常數時只會跳到 constTarget 這個 case（UINT_MAX 代表直接跳出 switch）
+    const bool isConst = Eliminate_Dead_Code && expr->isConstExpr;
+    unsigned constTarget = defaultIndex;
+    if (isConst) {
+        const int value = switchCaseValue(expr);
+        for (unsigned i = 0; i < caseNum; ++i)
+            if (cases[i].value == value)
+                constTarget = cases[i].index;
+
+        if (constTarget == defaultIndex)
+            fprintf(JASM_FILE, "goto %s\n", defaultLabel);
+        else
+            fprintf(JASM_FILE, "goto SWITCH_CASE%d_%u\n", S->id, constTarget);
+    }
+    else {
+        exprToJasm(expr);
+        switchDispatchToJasm(S->id, cases, caseNum, defaultLabel);
+    }
+    free(cases);
+
+    pushConstState(); // 記下 dispatch 時的狀態
+    beginJasmCapture();
+    Is_Reachable = false;
+
+    index = 0;
+    for (StatementNode_t* C = S->body; C; C = C->next, ++index) {
+        const bool isTarget = !isConst || index == constTarget;
+
+        // 合併從上一個 case 執行下來和從 dispatch 跳進來的狀態
+        meetConstState(Is_Reachable, isTarget);
+        if (C->expr) {
+            printf("\t\e[36mcase \e[m");
+            dumpExprTree(stdout, C->expr);
+            puts("");
+            if (isTarget)
+                fprintf(JASM_FILE, "SWITCH_CASE%d_%u: nop\n", S->id, index);
+        }
+        else {
+            puts("\t\e[36mdefault\e[m");
+            if (isTarget)
+                fprintf(JASM_FILE, "SWITCH_DEFAULT%d: nop\n", S->id);
+        }
+
+        Is_Reachable = Is_Reachable || isTarget;
+        statementsToJasm(C->body);
+    }
+
+    const bool isFallThrough = Is_Reachable; // 最後一個 case 的結尾是否可能被執行到
+    char* body = endJasmCapture();
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    // 回到 dispatch 時的狀態，並忘記 body 會修改的變數
+    endLoopConstProp(body, NULL, 0);
+    fputs(body, JASM_FILE);
+    free(body);
+
+    // 從最後一個 case 執行下來、break，或是沒有對應的 case 時離開 switch
+    Is_Reachable = isFallThrough || S->hasBreak || (isConst ? constTarget : defaultIndex) == UINT_MAX;
+    if (Is_Reachable || !Eliminate_Dead_Code)
+        fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", S->id); // LOOP_BREAK: 結束
+}
+
+static void statementToJasm(StatementNode_t* S)
+{
+    resetScratchMark(Symbol_Table, S->scratchMark);
+
+    switch (S->kind) {
+    case sExpression:
+        S->expr = propagateAndDump(S->expr, "Expr = ");
+        exprToJasm(S->expr);
+        popExprResult(S->expr->resultTypeInfo);
+        break;
+    case sPrint:
+        S->expr = propagateAndDump(S->expr, "print ");
+        printToJasm(S->expr);
+        break;
+    case sPrintln:
+        S->expr = propagateAndDump(S->expr, "println ");
+        printlnToJasm(S->expr);
+        break;
+    case sReturn:
+        if (S->expr) {
+            S->expr = propagateAndDump(S->expr, "return ");
+            returnToJasm(S->expr);
+        }
+        else {
+            printf("\t\e[36mreturn\e[m\n");
+            fprintf(JASM_FILE, "return\n");
+        }
+        Is_Reachable = false;
+        break;
+    case sNop:
+        fprintf(JASM_FILE, "nop\n");
+        break;
+    case sBreak:
+        fprintf(JASM_FILE, "goto LOOP_BREAK%d\n", S->id);
+        Is_Reachable = false;
+        break;
+    case sContinue:
+        fprintf(JASM_FILE, "goto LOOP_CONTINUE%d\n", S->id);
+        Is_Reachable = false;
+        break;
+    case sVarDef:
+        if (S->expr) {
+            S->expr = propagateConstants(S->expr);
+            assignToJasm(S->identifier, S->localVariableIndex, S->expr);
+            popExprResult(S->expr->resultTypeInfo);
+        }
+        // 記錄區域變數的初始值
+        defineLocalConstProp(S->identifier, S->localVariableIndex, S->expr);
+        break;
+    case sBlock:    statementsToJasm(S->body);      break;
+    case sIf:       ifToJasm(S);                    break;
+    case sWhile:    whileToJasm(S);                 break;
+    case sDoWhile:  doWhileToJasm(S);               break;
+    case sFor:      forStatementToJasm(S);          break;
+    case sForeach:  foreachStatementToJasm(S);      break;
+    case sSwitch:   switchToJasm(S);                break;
+    case sCase:     break; // 由 switchToJasm 處理
+    }
+}
+
+// Function ///////////////////////////////////////////////////////////////////////////////////////
+
+char* functionBodyToJasm(StatementNode_t* statements, bool isVoid)
+{
+    Is_Reachable = true;
+    resetConstProp();
+    resetExprLabels();
+    beginJasmCapture();
+
+    statementsToJasm(statements);
+
+    if (isVoid && (Is_Reachable || !Eliminate_Dead_Code))
+        fprintf(JASM_FILE, "return\n");
+
+    return endJasmCapture();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdbool.h>
+#include "statement.h"
+
+/**
+ * 從 statement 樹產生函數本體的 JASM
+ *
+ * @details 函數整個 parse 完之後才呼叫，依照執行的順序走訪 statement：
+ *          - 區域變數的 constant / copy propagation（見 constProp.h）
+ *          - Dead code elimination：無法到達的 statement 一樣要走過（更新 propagation 的狀態），但 JASM 會被丟掉；
+ *                                   condition 為常數的 if / while / for 只輸出會執行的那一邊
+ *          - 迴圈：先產生 body 的 JASM，再依照 body 決定迴圈的形式（展開、foreach 的方向）
+ *          - switch：case 的值夠密集時用 tableswitch，否則用 lookupswitch（和 javac 相同的估計）
+ *          - 同一個變數和很多個常數比較的 if-else 串也改成 switch
+ */
+
+/**
+ * Dead code elimination（--no-dead-code-elim 可關閉），預設為 true
+ */
+extern bool Eliminate_Dead_Code;
+
+/**
+ * 迴圈展開（--unroll-factor, --unroll-budget）
+ * 執行次數在編譯時期已知的 for / foreach，body 最多複製 Unroll_Factor 份，且複製出來的 code 不超過 Unroll_Budget 行
+ * Unroll_Factor <= 1 代表不展開
+ */
+extern unsigned Unroll_Factor;
+extern unsigned Unroll_Budget;
+
+/**
+ * if-else 串轉成 switch（--if-switch-arms=N）
+ * `if (x == C1) ... else if (x == C2) ... else ...` 的 condition 都是同一個 int 變數 x 和不重複的常數比較時，
+ * 至少 If_Chain_Switch_Arms 個 if 就改成 tableswitch / lookupswitch，預設為 4，0 代表不轉換
+ */
+extern unsigned If_Chain_Switch_Arms;
+
+/**
+ * 產生函數本體（`{` 和 `}` 之間）的 JASM 並回傳（呼叫者負責 free），statements 是函數中所有的 statement
+ * isVoid 為 true 時，結尾可能被執行到的話會補上 return
+ *
+ * @note Symbol_Table 必須是函數的 symbol table（暫存區域變數從它分配）
+ */
+char* functionBodyToJasm(StatementNode_t* statements, bool isVoid);
@@ -32,44 +32,75 @@ static struct SymbolTableNode_t* AllocNode() {
     return Result;
 }
 
-static void FreeNode(SymbolTableNode_t* N) {
+// 走訪 trie 用的 explicit stack
+// Note: trie 的深度是 identifier 的長度，identifier 很長時遞迴可能用光 C 的 stack
+typedef struct NodeFrame_t {
+    SymbolTableNode_t* node;
+    int depth;      // node 代表的名稱長度
+    char last;      // 名稱的最後一個字元
+} NodeFrame_t;
+
+typedef struct NodeStack_t {
+    NodeFrame_t* frames;
+    unsigned frameNum;
+    unsigned capacity;
+} NodeStack_t;
+
+static void PushNode(NodeStack_t* stack, SymbolTableNode_t* N, int depth, char last) {
     if (N == NULL)
         return;
 
-    // free children
-    for (unsigned i = 0; i < ID_CHARS; ++i)
-        FreeNode(N->child[i]);
+    if (stack->frameNum == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->frames = realloc(stack->frames, stack->capacity * sizeof(NodeFrame_t));
+    }
+    stack->frames[stack->frameNum++] = (NodeFrame_t){ N, depth, last };
+}
 
-    // 䆁放預設值
-    if (N->hasDefaultValue) {
-        // free sval
-        if (N->defaultValueIsConstExpr && N->typeInfo.type == pStringType)
-            free(N->sval);
+static void FreeNode(SymbolTableNode_t* root) {
+    NodeStack_t stack = { NULL, 0, 0 };
+    PushNode(&stack, root, 0, '\0');
 
-        // free expr
-        if (!N->defaultValueIsConstExpr)
-            freeExprTree(N->expr);
-    }
+    while (stack.frameNum > 0) {
+        SymbolTableNode_t* N = stack.frames[--stack.frameNum].node;
 
-    // free Type_Info
-    // NOTE: 參數的 Type_Info 會同時存進 PARAM_Buffer，這裡要避免重覆刪除
-    if (!N->isFunction && !N->isParameter)
-        free(N->typeInfo.DIMS);
-    
-    // free Function_Type_Info
-    if (N->isFunction) {
-        free(N->functionTypeInfo.returnType.DIMS);
+        // free children（放回 memory pool 之後 child 會被覆蓋，所以先記下來）
+        for (unsigned i = 0; i < ID_CHARS; ++i)
+            PushNode(&stack, N->child[i], 0, '\0');
+
+        // 䆁放預設值
+        if (N->hasDefaultValue) {
+            // free sval
+            if (N->defaultValueIsConstExpr && N->typeInfo.type == pStringType)
+                free(N->sval);
 
-        for (unsigned i = 0; i < N->functionTypeInfo.parameterNum; ++i)
-            free(N->functionTypeInfo.parameters[i].DIMS);
+            // free expr
+            if (!N->defaultValueIsConstExpr)
+                freeExprTree(N->expr);
+        }
+
+        // free Type_Info
+        // NOTE: 參數的 Type_Info 會同時存進 PARAM_Buffer，這裡要避免重覆刪除
+        if (!N->isFunction && !N->isParameter)
+            free(N->typeInfo.DIMS);
+        
+        // free Function_Type_Info
+        if (N->isFunction) {
+            free(N->functionTypeInfo.returnType.DIMS);
+
+            for (unsigned i = 0; i < N->functionTypeInfo.parameterNum; ++i)
+                free(N->functionTypeInfo.parameters[i].DIMS);
 
-        free(N->functionTypeInfo.parameters);
+            free(N->functionTypeInfo.parameters);
+        }
+
+        // 將 N 放回 Memory Pool
+        union Internal_Memory_t* newHead = (union Internal_Memory_t*)N;
+        newHead->next = MemoryPool;
+        MemoryPool = newHead;
     }
 
-    // 將 N 放回 Memory Pool
-    union Internal_Memory_t* newHead = (union Internal_Memory_t*)N;
-    newHead->next = MemoryPool;
-    MemoryPool = newHead;
+    free(stack.frames);
 }
 
 ///////////////////////////////////
@@ -165,65 +196,75 @@ SymbolTableNode_t* insert(struct SymbolTable_t* table, const char* S) {
 
 /////////////////////////////////////////////////
 
-static char internal_buf[256];
-static int buf_len = 0;
-static void DumpNode(struct SymbolTableNode_t* N) {
-    if (N == NULL) 
-        return;
+// 依照字母順序輸出 root（名稱的第一個字元為 first）底下所有的 symbol
+static void DumpNode(struct SymbolTableNode_t* root, char first) {
+    NodeStack_t stack = { NULL, 0, 0 };
+    char* name = NULL;
+    int nameCapacity = 0;
 
-    if (N->isEnd) {
-        printf("%s        type = (", internal_buf);
+    PushNode(&stack, root, 1, first);
 
-        if (N->isFunction)
-            printFunctionTypeInfo(stdout, N->functionTypeInfo);
-        else
-            printTypeInfo(stdout, N->typeInfo);
+    while (stack.frameNum > 0) {
+        const NodeFrame_t frame = stack.frames[--stack.frameNum];
+        struct SymbolTableNode_t* N = frame.node;
 
-        printf(")");
+        // 前 depth - 1 個字元就是 parent 的名稱（前序走訪，parent 之後才輪到它的 children）
+        if (frame.depth + 1 > nameCapacity) {
+            nameCapacity = (frame.depth + 1) * 2;
+            name = realloc(name, nameCapacity);
+        }
+        name[frame.depth - 1] = frame.last;
+        name[frame.depth] = '\0';
 
-        if (N->hasDefaultValue) {
-            printf("    %s Value = ", N->typeInfo.isConst ? "Const" : "Default");
-
-            if (N->defaultValueIsConstExpr) {
-                switch (N->typeInfo.type) {
-                    case pIntType:      printf("%i" , N->ival); break;
-                    case pFloatType:    printf("%gf", N->fval); break;
-                    case pDoubleType:   printf("%g" , N->dval); break;
-                    case pBoolType:     printf("%s" , N->bval ? "true" : "false"); break;
-                    case pStringType:   printf("\"%s\"" , N->sval); break;
+        if (N->isEnd) {
+            printf("%s        type = (", name);
+
+            if (N->isFunction)
+                printFunctionTypeInfo(stdout, N->functionTypeInfo);
+            else
+                printTypeInfo(stdout, N->typeInfo);
+
+            printf(")");
+
+            if (N->hasDefaultValue) {
+                printf("    %s Value = ", N->typeInfo.isConst ? "Const" : "Default");
+
+                if (N->defaultValueIsConstExpr) {
+                    switch (N->typeInfo.type) {
+                        case pIntType:      printf("%i" , N->ival); break;
+                        case pFloatType:    printf("%gf", N->fval); break;
+                        case pDoubleType:   printf("%g" , N->dval); break;
+                        case pBoolType:     printf("%s" , N->bval ? "true" : "false"); break;
+                        case pStringType:   printf("\"%s\"" , N->sval); break;
+                    }
                 }
+                else
+                    dumpExprTree(stdout, N->expr);
             }
-            else
-                dumpExprTree(stdout, N->expr);
-        }
 
-        if (N->isParameter)
-            printf("  (Parameter)");
+            if (N->isParameter)
+                printf("  (Parameter)");
+
+            if (N->localVariableIndex >= 0) {
+                printf(" (local variable index = %d)", N->localVariableIndex);
+            }
 
-        if (N->localVariableIndex >= 0) {
-            printf(" (local variable index = %d)", N->localVariableIndex);
+            printf("\n");
         }
 
-        printf("\n");
+        // 反過來 push，才會依照 index 的順序輸出
+        for (int i = ID_CHARS - 1; i >= 0; --i)
+            PushNode(&stack, N->child[i], frame.depth + 1, Idx2Char(i));
     }
 
-    for (int i = 0; i < ID_CHARS; ++i) {
-        internal_buf[buf_len++] = Idx2Char(i);
-        DumpNode(N->child[i]);
-        internal_buf[buf_len--] = '\0';
-    }
+    free(stack.frames);
+    free(name);
 }
 
 void dump(const struct SymbolTable_t* table) {
-    internal_buf[0] = '\0';
-    buf_len = 0;
-
     puts("\nSymbol Table:");
-    for (int i = 0; i < ID_FIRST_CHARS; ++i) {
-        internal_buf[buf_len++] = Idx2Char(i);
-        DumpNode(table->root[i]);
-        internal_buf[buf_len--] = '\0';
-    }
+    for (int i = 0; i < ID_FIRST_CHARS; ++i)
+        DumpNode(table->root[i], Idx2Char(i));
     puts("");
 }
 
@@ -251,4 +292,42 @@ void assignIndex(SymbolTableNode_t *node, SymbolTable_t *table)
         table->nextLocalVariableIndex += 2;
         break;
     }
+
+    if (table->maxLocalVariableIndex < table->nextLocalVariableIndex)
+        table->maxLocalVariableIndex = table->nextLocalVariableIndex;
+}
+
+// 回傳 Function scope 的 symbol table
+static SymbolTable_t* functionScope(SymbolTable_t* table)
+{
+    while (table->parent->parent != NULL)
+        table = table->parent;
+    return table;
+}
+
+int assignScratchIndex(SymbolTable_t *table, PrimitiveType_t type)
+{
+    table = functionScope(table);
+
+    int index = table->nextLocalVariableIndex;
+    table->nextLocalVariableIndex += (type == pDoubleType ? 2 : 1);
+
+    if (table->maxLocalVariableIndex < table->nextLocalVariableIndex)
+        table->maxLocalVariableIndex = table->nextLocalVariableIndex;
+    return index;
+}
+
+unsigned getScratchMark(SymbolTable_t *table)
+{
+    return functionScope(table)->nextLocalVariableIndex;
+}
+
+void releaseScratchIndex(SymbolTable_t *table, unsigned mark)
+{
+    functionScope(table)->nextLocalVariableIndex = mark;
+}
+
+void resetScratchMark(SymbolTable_t *table, unsigned mark)
+{
+    releaseScratchIndex(table, mark);
 }
@@ -40,6 +40,7 @@ typedef struct SymbolTableNode_t {
  */
 typedef struct SymbolTable_t {
     unsigned nextLocalVariableIndex; // 下一個可分配的區域變數 index（Note: 只有 parent->parent == NULL 才可分配 index）
+    unsigned maxLocalVariableIndex;  // 曾經分配過的區域變數 index 的最大值 + 1（包含已經歸還的暫存變數）
     struct SymbolTable_t* parent;
     struct SymbolTableNode_t* root[ID_FIRST_CHARS];
 } SymbolTable_t;
@@ -80,3 +81,24 @@ void dump(const SymbolTable_t* table);
  * 替 node 指定區域變數的 index
  */
 void assignIndex(SymbolTableNode_t* node, SymbolTable_t* table);
+
+/**
+ * 分配一個只在單一 statement 內使用的暫存區域變數，回傳它的 index
+ * @details statement 結束後用 releaseScratchIndex 歸還，之後定義的變數可以重複使用這個 index
+ */
+int assignScratchIndex(SymbolTable_t* table, PrimitiveType_t type);
+
+/**
+ * 目前的 nextLocalVariableIndex，用來在之後歸還暫存區域變數
+ */
+unsigned getScratchMark(SymbolTable_t* table);
+
+/**
+ * 歸還 index >= mark 的暫存區域變數
+ */
+void releaseScratchIndex(SymbolTable_t* table, unsigned mark);
+
+/**
+ * 產生一個 statement 的 JASM 前呼叫：之後的暫存區域變數從 mark（parse 到這個 statement 時的 nextLocalVariableIndex）開始分配
+ */
+void resetScratchMark(SymbolTable_t* table, unsigned mark);
@@ -0,0 +1,137 @@
+#include "tailCall.h"
+#include "jasmCode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool Enable_Tail_Call_Elim = true;
+
+// 函數開頭的 label
+#define TAIL_CALL_ENTRY "TAIL_CALL_ENTRY"
+
+// 呼叫 name 的 invokestatic 的 operand（和 funcCallToJasm 產生的格式相同）
+static char* selfCallOperand(const char* name, const Function_Type_Info_t* info)
+{
+    char* result = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&result, &size);
+
+    fprintf(file, "%s %s(", JASM_TypeStr[info->returnType.type], name);
+    for (unsigned i = 0; i < info->parameterNum; ++i)
+        fprintf(file, i ? ", %s" : "%s", JASM_TypeStr[info->parameters[i].type]);
+    fprintf(file, ")");
+
+    fclose(file);
+    return result;
+}
+
+static bool isReturn(const JasmLine_t* line)
+{
+    return line->opcode && (strcmp(line->opcode, "return") == 0 || strcmp(line->opcode, "ireturn") == 0
+                            || strcmp(line->opcode, "freturn") == 0 || strcmp(line->opcode, "dreturn") == 0);
+}
+
+// lines[line] 之後的第一個指令如果是 return 就回傳它的位置，否則回傳 -1
+// （中間可以有 label，從其他地方跳到那裡的和 tail call 無關）
+static int findFollowingReturn(const JasmLine_t* lines, unsigned lineNum, unsigned line)
+{
+    for (unsigned i = line + 1; i < lineNum; ++i) {
+        if (lines[i].opcode)
+            return isReturn(&lines[i]) ? (int)i : -1;
+        if (lines[i].label == NULL && lines[i].text && lines[i].text[0] != '\0')
+            return -1;
+    }
+    return -1;
+}
+
+// 由後往前把 stack 上的參數存回參數的區域變數，然後跳回開頭
+static void printTailJump(FILE* file, const Function_Type_Info_t* info)
+{
+    unsigned* index = malloc((info->parameterNum + 1) * sizeof(unsigned));
+    unsigned next = 0;
+
+    for (unsigned i = 0; i < info->parameterNum; ++i) {
+        index[i] = next;
+        next += info->parameters[i].type == pDoubleType ? 2 : 1;
+    }
+
+    for (unsigned i = info->parameterNum; i-- > 0; ) {
+        switch (info->parameters[i].type) {
+        case pIntType: case pBoolType: fprintf(file, "istore %u\n", index[i]); break;
+        case pFloatType:               fprintf(file, "fstore %u\n", index[i]); break;
+        case pDoubleType:              fprintf(file, "dstore %u\n", index[i]); break;
+        }
+    }
+    fprintf(file, "goto %s\n", TAIL_CALL_ENTRY);
+
+    free(index);
+}
+
+// 參數總共佔幾格（double 佔 2 格）
+static int parameterWords(const Function_Type_Info_t* info)
+{
+    int words = 0;
+    for (unsigned i = 0; i < info->parameterNum; ++i)
+        words += info->parameters[i].type == pDoubleType ? 2 : 1;
+    return words;
+}
+
+char* eliminateSelfTailCalls(const char* body, const char* name, const Function_Type_Info_t* info)
+{
+    unsigned lineNum;
+    JasmLine_t* lines = parseJasmLines(body, &lineNum);
+    char* operand = selfCallOperand(name, info);
+
+    // 呼叫時 stack 上只能有參數（例如 generic foreach 的 body 中，stack 底下還有迴圈的結束值），
+    // 否則跳回開頭時 stack 的格數和第一次進入時不同；無法分析 stack 時不轉換
+    int* depths = malloc((lineNum + 1) * sizeof(int));
+    const bool isStackKnown = computeJasmStackDepths(lines, lineNum, depths) >= 0;
+    const int argWords = parameterWords(info);
+
+    char* result = NULL;
+    size_t size = 0;
+    FILE* file = open_memstream(&result, &size);
+    bool hasTailCall = false;
+
+    for (unsigned i = 0; i < lineNum; ++i) {
+        JasmLine_t* line = &lines[i];
+        int returnLine;
+
+        if (line->opcode && strcmp(line->opcode, "invokestatic") == 0 && strcmp(line->operand, operand) == 0
+            && isStackKnown && depths[i] == argWords
+            && (returnLine = findFollowingReturn(lines, lineNum, i)) >= 0) {
+            if (line->label)
+                fprintf(file, "%s:\n", line->label);
+            printTailJump(file, info);
+            hasTailCall = true;
+
+            // 沒有其他地方會跳到的 return 已經無法到達了
+            if (lines[returnLine].label == NULL)
+                setJasmInstruction(&lines[returnLine], NULL, NULL);
+        }
+        else {
+            char* text = joinJasmLines(line, 1);
+            fputs(text, file);
+            free(text);
+        }
+    }
+    fclose(file);
+
+    // 有 tail call 時才需要開頭的 label，否則維持原本的 body
+    if (!hasTailCall) {
+        free(result);
+        result = strdup(body);
+    }
+    else {
+        char* withEntry = malloc(strlen(result) + sizeof(TAIL_CALL_ENTRY ": nop\n"));
+        strcpy(withEntry, TAIL_CALL_ENTRY ": nop\n");
+        strcat(withEntry, result);
+        free(result);
+        result = withEntry;
+    }
+
+    free(depths);
+    free(operand);
+    freeJasmLines(lines, lineNum);
+    return result;
+}
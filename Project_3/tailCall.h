@@ -0,0 +1,22 @@
+#pragma once
+#include <stdbool.h>
+#include "type_info.h"
+
+/**
+ * 自己呼叫自己的 tail call 換成迴圈
+ *
+ * @details `return f(args);`（或 void 函數中，最後一個動作是呼叫 f）在 JASM 中是 `invokestatic ... f(...)` 後面緊接著 return。
+ *          這時參數已經依序在 stack 上了，所以改成由後往前存回參數的區域變數（和 assignIndex 一樣，第 i 個參數從 index 0 開始依序排列），
+ *          再 `goto` 到函數 body 的開頭，遞迴就變成只用固定大小 stack 的迴圈。
+ *          呼叫時 stack 上除了參數還有其他的值（例如 generic foreach 中的迴圈結束值）就不轉換
+ */
+
+/**
+ * 是否做 tail call elimination（--no-tail-call-elim 可關閉），預設為 true
+ */
+extern bool Enable_Tail_Call_Elim;
+
+/**
+ * body 是函數 name（型別為 info）的 `{` 和 `}` 之間的 JASM，回傳處理後的 body（呼叫者負責 free）
+ */
+char* eliminateSelfTailCalls(const char* body, const char* name, const Function_Type_Info_t* info);
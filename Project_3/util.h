@@ -1,8 +1,11 @@
 #pragma once
 #include <stdlib.h>
+#include <stdbool.h>
 
 typedef struct LoopList {
   int loopID;
+  bool hasBreak;          // body 中是否有 break 跳出這個迴圈
+  bool isSwitch;          // 是 switch 而不是迴圈（break 跳出 switch，continue 要找外層的迴圈）
   struct LoopList* outer; // 指向上一層
 } LoopList;
 
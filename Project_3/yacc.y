@@ -4,10 +4,28 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
 #include "symbol_table.h"
 #include "expression.h"
 #include "exprToJasm.h"
 #include "util.h"
+#include "jasmCode.h"
+#include "constProp.h"
+#include "liveness.h"
+#include "globalConst.h"
+#include "inliner.h"
+#include "tailCall.h"
+#include "constEval.h"
+#include "memoize.h"
+#include "specialize.h"
+#include "callGraph.h"
+#include "statement.h"
+#include "stmtToJasm.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "passManager.h"
+#include "parallelCodegen.h"
+#include "methodSplit.h"
 
 extern int linenum;
 struct SymbolTable_t* Symbol_Table = NULL;
@@ -18,7 +36,7 @@ char* JASM_CLASS_NAME = NULL;
 
 // 當有新的 Control Flow，給他這個編號
 static int NEXT_CONTROL_FLOW_ID = 0;
-// 將所有遇到的 loop 由內至外串成 List，以利 break 和 continue 的判斷
+// 將所有遇到的 loop（和 switch）由內至外串成 List，以利 break 和 continue 的判斷
 static LoopList* Loop_List = NULL;
 
 int yylex();
@@ -28,6 +46,11 @@ void yyerror(char*);
  * 若失敗回傳 false。
  */
 bool addVariable(const char* identifier, ExpressionNode_t* defaultValue);
+/**
+ * 檢查 switch 的所有 case：case 的型別和 switch 的 expression 相同、沒有重複的 case、最多一個 default
+ * 若失敗回傳 false。
+ */
+bool checkSwitchCases(const ExpressionNode_t* expr, const StatementNode_t* cases);
 
 // 確認該 Identifier 沒有在當前 scope 出現過
 #define CHECK_NOT_IN_CURRENT_SCOPE(ID) { \
@@ -90,6 +113,9 @@ static Type_Info_t PARAM_Buffer[MAX_PARAMETER_NUM];
 // 函式中有幾個return
 static unsigned numOfReturn = 0;
 
+// Var_Def 定義的區域變數（addVariable 建立的 sVarDef 節點）
+static StatementNode_t* Var_Def_Statements = NULL;
+
 %}
 
 %union {
@@ -98,6 +124,7 @@ static unsigned numOfReturn = 0;
     double  dval;
     char*   sval;
     ExpressionNode_t* expr;
+    StatementNode_t* stmt;
 }
 
 // Keyword
@@ -112,10 +139,14 @@ static unsigned numOfReturn = 0;
 %token <sval> STRING_LITERAL ID
 
 %type <expr> Default_Value Expression Integer_Expression
+%type <expr> Condition_Expression For_Initial_Expression For_Condition_Expression For_Update_Expression
 %type <expr> ArrayIndexOP ArrayIndexOP_Suffix
 %type <expr> FuncCallOP FuncCallOP_Params FuncCallOP_Params_Suffix
 
-%type <ival> Control_Flow_ID
+%type <stmt> Statements Statement One_Simple_Statement Block_of_Statements Var_Def Control_Flow Control_Flow_Body
+%type <stmt> Switch_Cases Case_Clause
+
+%type <ival> Control_Flow_ID If_Begin_Then
 
 // 優先級低
 %right '='
@@ -142,6 +173,8 @@ Global_Def_Tail :   // Function
                     { // Reset + Return Type + 為函數本體建立 symbol table（會儲存參數、區域變數）
                       memset(&Function_Info, 0, sizeof(Function_Info));
                       numOfReturn = 0;
+                      // Control Flow 的編號只用在 label，每個函數各自編號（見 resetExprLabels）
+                      NEXT_CONTROL_FLOW_ID = 0;
 
                       // Return type
                       if (Type_Info.type == pVoidType && (Type_Info.dimension > 0 || Type_Info.isConst)) {
@@ -158,17 +191,30 @@ Global_Def_Tail :   // Function
                     }
                     Parameter_Def_List
                     ')' 
-                    {  // 將函數加入 Global Symbol Table + 生成 JASM
+                    {  // 將函數加入 Global Symbol Table
                       SymbolTableNode_t* function = insert(Symbol_Table->parent, Global_Level_ID);
                       function->isFunction = true;
                       function->functionTypeInfo = Function_Info;
                       assignIndex(function, Symbol_Table->parent);
 
-                      // JASM Function //////////////////////////////////////////////////////////////////
                       // 檢查 main()
                       if (strcmp(Global_Level_ID, "main") == 0) {
                         if (Function_Info.parameterNum != 0) { yyerror("main() cannot have parameters."); YYERROR; }
                         if (Function_Info.returnType.type != pVoidType) { yyerror("return type of main() must be void"); YYERROR; }
+                      }
+                    }
+                    '{' Statements '}'
+                    { 
+                      dump(Symbol_Table);
+
+                      // non-void 必須有 return
+                      if (Function_Info.returnType.type != pVoidType && numOfReturn == 0) {
+                        yyerror("Expect return inside non-void function!");
+                        YYERROR;
+                      }
+
+                      // JASM Function //////////////////////////////////////////////////////////////////
+                      if (strcmp(Global_Level_ID, "main") == 0) {
                         fprintf(JASM_FILE, "method public static void main(java.lang.String[])\n");
                       }
                       else {
@@ -180,22 +226,16 @@ Global_Def_Tail :   // Function
                         fprintf(JASM_FILE, ")\n");
                       }
 
-                      fprintf(JASM_FILE, "max_stack 15\nmax_locals 15\n{\n");
-                    }
-                    '{' Statements '}'
-                    { // 䆁放 Symbol Table，回到 global scope
-                      dump(Symbol_Table);
+                      // 整個函數 parse 完才產生本體，之後執行 pass manager 中的 function pass（見 passManager.h），最後再做 memoization
+                      // Note: 暫存區域變數從函數的 symbol table 分配，所以產生完才能䆁放 Symbol Table，回到 global scope
+                      char* body = functionBodyToJasm($7, Function_Info.returnType.type == pVoidType);
+                      freeStatementTree($7);
+                      const unsigned localNum = Symbol_Table->maxLocalVariableIndex;
                       Symbol_Table = freeSymbolTable(Symbol_Table);
 
-                      // non-void 必須有 return
-                      if (Function_Info.returnType.type != pVoidType && numOfReturn == 0) {
-                        yyerror("Expect return inside non-void function!");
-                        YYERROR;
-                      }
-
-                      //////////////////////////////////////////////////////////
-                      if (Function_Info.returnType.type == pVoidType) fprintf(JASM_FILE, "return\n");
-                      fprintf(JASM_FILE, "} /* end of %s */\n\n", Global_Level_ID);
+                      // function pass 之後的部分（--jobs 大於 1 時交給 thread pool，見 parallelCodegen.h）
+                      submitFunction(Global_Level_ID, &Function_Info, localNum, body);
+                      printSpecializedFunctions(JASM_FILE);
                     }
                   | // Variable Definition
                     {
@@ -215,7 +255,14 @@ Global_Def_Tail :   // Function
 
 
 // 變數定義 //////////////////////////////////////////////////////////////////////////// 
-Var_Def: Type ID_Def_List ';';
+// Note: 區域變數的型別不能省略（省略時是 void，本來就不合法），否則 statement 開頭的 ID 無法決定是 Var_Def 還是 Expression
+Var_Def: Var_Type ID_Def_List ';' { $$ = Var_Def_Statements; Var_Def_Statements = NULL; } ;
+
+Var_Type: { memset(&Type_Info, 0, sizeof(Type_Info)); }
+          Var_Type_Internal;
+
+Var_Type_Internal: CONST { Type_Info.isConst = true; } PType
+                 | Non_Empty_PType ;
 
 ID_Def_List: ID Array_Dimensions Default_Value
              { 
@@ -282,21 +329,24 @@ Non_Empty_Parameter_List:
 Non_Empty_Parameter_Def_List_Suffix: ',' Non_Empty_Parameter_List | /* Empty */ ;
 
 // Statements /////////////////////////////////////////////////////////////////////////////
-Statements: One_Simple_Statement Statements 
-          | Block_of_Statements Statements
-          | /* Empty */ ;
+// Note: 這裡只檢查語意、更新 symbol table，並建立 statement 樹；整個函數 parse 完之後才產生 JASM（見 stmtToJasm.h）
+Statements: Statement Statements { $$ = appendStatements($1, $2); }
+          | /* Empty */          { $$ = NULL; } ;
+
+Statement: One_Simple_Statement
+         | Block_of_Statements
+         ;
 
 One_Simple_Statement:
-               Expression ';'         { CHECK_EXPR_HAS_SIDE_EFFECT($1); printf("\t\e[36mExpr = \e[m");  dumpExprTree(stdout, $1); puts(""); exprToJasm($1);    popExprResult($1->resultTypeInfo); freeExprTree($1); }
-             | PRINT Expression ';'   { CHECK_NOT_VOID_EXPR($2);        printf("\t\e[36mprint \e[m");   dumpExprTree(stdout, $2); puts(""); printToJasm($2);                                      freeExprTree($2); }
-             | PRINTLN Expression ';' { CHECK_NOT_VOID_EXPR($2);        printf("\t\e[36mprintln \e[m"); dumpExprTree(stdout, $2); puts(""); printlnToJasm($2);                                    freeExprTree($2); }
+               Expression ';'         { CHECK_EXPR_HAS_SIDE_EFFECT($1); $$ = createStatement(sExpression); $$->expr = $1; }
+             | PRINT Expression ';'   { CHECK_NOT_VOID_EXPR($2);        $$ = createStatement(sPrint);      $$->expr = $2; }
+             | PRINTLN Expression ';' { CHECK_NOT_VOID_EXPR($2);        $$ = createStatement(sPrintln);    $$->expr = $2; }
              | RETURN Expression ';'
              { 
                 if (isSameTypeInfo_WithoutConst(Function_Info.returnType, $2->resultTypeInfo)) {
-                  printf("\t\e[36mreturn \e[m");  dumpExprTree(stdout, $2); puts("");
-                  returnToJasm($2);
+                  $$ = createStatement(sReturn);
+                  $$->expr = $2;
                   ++numOfReturn;
-                  freeExprTree($2); 
                 }
                 else {
                   yyerror("Type Error!");
@@ -311,8 +361,7 @@ One_Simple_Statement:
              | RETURN ';'
              {
                 if (Function_Info.returnType.type == pVoidType) {
-                  printf("\t\e[36mreturn\e[m\n");
-                  fprintf(JASM_FILE, "return\n");
+                  $$ = createStatement(sReturn);
                   ++numOfReturn;
                 }
                 else {
@@ -338,16 +387,24 @@ One_Simple_Statement:
                   YYERROR;
                 }
              } */
-             | ';' { fprintf(JASM_FILE, "nop\n"); }
+             | ';' { $$ = createStatement(sNop); }
              | BREAK ';' 
              { 
-                if (Loop_List == NULL) { yyerror("break outside loop"); YYERROR; }  
-                fprintf(JASM_FILE, "goto LOOP_BREAK%d\n", Loop_List->loopID); 
+                if (Loop_List == NULL) { yyerror("break outside loop or switch"); YYERROR; }  
+                $$ = createStatement(sBreak);
+                $$->id = Loop_List->loopID;
+                Loop_List->hasBreak = true;
              }
              | CONTINUE ';'
              { 
-                if (Loop_List == NULL) { yyerror("continue outside loop"); YYERROR; }  
-                fprintf(JASM_FILE, "goto LOOP_CONTINUE%d\n", Loop_List->loopID); 
+                // continue 不屬於 switch，找最內層的迴圈
+                LoopList* loop = Loop_List;
+                while (loop && loop->isSwitch)
+                  loop = loop->outer;
+
+                if (loop == NULL) { yyerror("continue outside loop"); YYERROR; }  
+                $$ = createStatement(sContinue);
+                $$->id = loop->loopID;
              }
              | Var_Def
              | Control_Flow
@@ -355,72 +412,91 @@ One_Simple_Statement:
 
 Block_of_Statements: '{'         { Symbol_Table = create(Symbol_Table); } 
                      Statements 
-                     '}'         { dump(Symbol_Table); Symbol_Table = freeSymbolTable(Symbol_Table); }
+                     '}'         
+                     { 
+                       dump(Symbol_Table); 
+                       Symbol_Table = freeSymbolTable(Symbol_Table);
+                       $$ = createStatement(sBlock);
+                       $$->body = $3;
+                     }
                      ;
 
 Control_Flow: /************************************************************
               * If
+              * Note: 文法中唯一的 shift/reduce conflict 是 dangling else（預設 shift，else 屬於最內層的 if）
               *************************************************************/
-              Control_Flow_ID IF '(' Condition_Expression ')' If_False_Goto_Else
+              Control_Flow_ID IF '(' Condition_Expression ')' If_Begin_Then
               Control_Flow_Body 
               {
-                fprintf(JASM_FILE, "ELSE%d: nop\n/* End Of If */\n\n", $1); // ELSE: 結束
+                $$ = createStatement(sIf);
+                $$->id = $1;
+                $$->scratchMark = $6;
+                $$->cond = $4;
+                $$->body = $7;
               }
             /********************************************************
             * If / else
             *********************************************************/
-            | Control_Flow_ID IF '(' Condition_Expression ')' If_False_Goto_Else
+            | Control_Flow_ID IF '(' Condition_Expression ')' If_Begin_Then
               Control_Flow_Body 
               ELSE 
-              {
-                fprintf(JASM_FILE, "goto END_IFELSE%d\n", $1); // 上面執行完了，跳到 END_IFELSE
-                fprintf(JASM_FILE, "ELSE%d: nop\n", $1); // ELSE:
-              }
               Control_Flow_Body
               {
-                fprintf(JASM_FILE, "END_IFELSE%d: nop\n\n", $1); // END_IFELSE: 結束
+                $$ = createStatement(sIf);
+                $$->id = $1;
+                $$->scratchMark = $6;
+                $$->cond = $4;
+                $$->body = $7;
+                $$->elseBody = $9;
               }
             /********************************************************
             * While
             *********************************************************/
-            | Control_Flow_ID WHILE '(' 
-              {
-                Loop_List = createLoopList($1, Loop_List);
-                fprintf(JASM_FILE, "LOOP_CONTINUE%d: nop\n", $1); // LOOP_CONTINUE:
-              }
-              Condition_Expression
+            | Control_Flow_ID WHILE '(' Condition_Expression ')'
+              { Loop_List = createLoopList($1, Loop_List); }
+              Control_Flow_Body
               {
-                fprintf(JASM_FILE, "ifeq LOOP_BREAK%d\n", $1); // 如為 false，跳到 LOOP_BREAK
+                $$ = createStatement(sWhile);
+                $$->id = $1;
+                $$->hasBreak = Loop_List->hasBreak;
+                $$->cond = $4;
+                $$->body = $7;
+                Loop_List = freeLoopList(Loop_List);
               }
-              ')' Control_Flow_Body
+            /********************************************************
+            * Do While
+            *********************************************************/
+            | Control_Flow_ID DO
+              { Loop_List = createLoopList($1, Loop_List); }
+              Control_Flow_Body WHILE '(' Condition_Expression ')' ';'
               {
-                fprintf(JASM_FILE, "goto LOOP_CONTINUE%d\n", $1);        // BODY 執行完，跳回 condition
-                fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", $1);  // LOOP_BREAK: 結束
+                $$ = createStatement(sDoWhile);
+                $$->id = $1;
+                $$->hasBreak = Loop_List->hasBreak;
+                $$->cond = $7;
+                $$->body = $4;
                 Loop_List = freeLoopList(Loop_List);
               }
             /*******************************************************
             * For
             ********************************************************/
-            | Control_Flow_ID FOR '(' For_Initial_Expression ';' 
+            | Control_Flow_ID FOR '(' For_Initial_Expression ';' For_Condition_Expression ';' For_Update_Expression ')' 
               {
                 Loop_List = createLoopList($1, Loop_List);
-                fprintf(JASM_FILE, "FOR%d: nop\n", $1); // FOR:
-              }
-              For_Condition_Expression ';' 
-              {
-                fprintf(JASM_FILE, "ifeq LOOP_BREAK%d\n", $1);  // 若為 false，結束
-                fprintf(JASM_FILE, "goto FOR_BODY%d\n", $1); // 執行 BODY
-                fprintf(JASM_FILE, "LOOP_CONTINUE%d: nop\n", $1); // LOOP_CONTINUE: 當遇到 continue，從 update expression 開始
-              }
-              For_Update_Expression ')' 
-              {
-                fprintf(JASM_FILE, "goto FOR%d\n", $1);      // Update執行完，跑回前面的condition
-                fprintf(JASM_FILE, "FOR_BODY%d: nop\n", $1); // FOR_BODY:
+
+                // init 在 body 之前輸出，initScratchMark 是現在的 nextLocalVariableIndex
+                $<stmt>$ = createStatement(sFor);
               }
               Control_Flow_Body
               {
-                fprintf(JASM_FILE, "goto LOOP_CONTINUE%d\n", $1);  // 執行完了，執行 update
-                fprintf(JASM_FILE, "LOOP_BREAK%d: nop\n\n", $1); // LOOP_BREAK
+                $$ = $<stmt>10;
+                $$->scratchMark = getScratchMark(Symbol_Table);
+                $$->id = $1;
+                $$->hasBreak = Loop_List->hasBreak;
+                $$->init = $4;
+                $$->cond = $6;
+                $$->update = $8;
+                $$->body = $11;
                 Loop_List = freeLoopList(Loop_List);
               }
             /*******************************************************
@@ -433,47 +509,7 @@ Control_Flow: /************************************************************
                 CHECK_NODE_NOT_NULL(N, $4);
 
                 if (!N->isFunction && isSameTypeInfo(N->typeInfo, INT_TYPE)) {
-                  const bool isIdGlobal = N->localVariableIndex < 0;  // $4 是否為全域變數
                   Loop_List = createLoopList($1, Loop_List);
-                  printf("\t\e[36mForeach \e[m%s\n", $4);
-
-                  /* JASM */ {
-                    // I1, I2
-                    exprToJasm($6);
-                    exprToJasm($8);
-                    fprintf(JASM_FILE, "swap\n");
-                    // 將 I1 存進去
-                    if (isIdGlobal) fprintf(JASM_FILE, "\tputstatic int %s\n", $4); else fprintf(JASM_FILE, "\tistore %d\n", N->localVariableIndex);                    
-                    // 第一次執行：直接跳到 FOREACH_BODY
-                    fprintf(JASM_FILE, "goto FOREACH_BODY%d\n", $1);
-
-                    fprintf(JASM_FILE, "LOOP_CONTINUE%d:\n", $1);
-                    // 檢查是否達到終點
-                    fprintf(JASM_FILE, "\tdup\n");
-                    if (isIdGlobal) fprintf(JASM_FILE, "\tgetstatic int %s\n", $4); else fprintf(JASM_FILE, "\tiload %d\n", N->localVariableIndex);
-                    fprintf(JASM_FILE, "\tif_icmpeq LOOP_BREAK%d\n", $1);
-
-                    // 檢查是要加1還是減1
-                    fprintf(JASM_FILE, "\tdup\n");
-                    if (isIdGlobal) fprintf(JASM_FILE, "\tgetstatic int %s\n", $4); else fprintf(JASM_FILE, "\tiload %d\n", N->localVariableIndex);
-                    fprintf(JASM_FILE, "\tif_icmplt FOREACH_GODOWN%d\n", $1);
-                    fprintf(JASM_FILE, "\tldc 1\n"); // 加1
-                    fprintf(JASM_FILE, "\tgoto FOREACH_MOVE%d\n", $1);
-                    fprintf(JASM_FILE, "FOREACH_GODOWN%d:\n", $1);
-                    fprintf(JASM_FILE, "\tldc -1\n"); // 減1
-                    fprintf(JASM_FILE, "FOREACH_MOVE%d:\n", $1);
-                    if (isIdGlobal) fprintf(JASM_FILE, "\tgetstatic int %s\n", $4); else fprintf(JASM_FILE, "\tiload %d\n", N->localVariableIndex);
-                    fprintf(JASM_FILE, "\tiadd\n");
-                    // 把加1或減1的值存回去
-                    if (isIdGlobal) fprintf(JASM_FILE, "\tputstatic int %s\n", $4); else fprintf(JASM_FILE, "\tistore %d\n", N->localVariableIndex);
-
-                    // 接下來是 body
-                    fprintf(JASM_FILE, "FOREACH_BODY%d: nop\n", $1); // FOREACH_BODY
-                  }
-
-                  freeExprTree($6);
-                  freeExprTree($8);
-                  free($4);
                 }
                 else {
                   yyerror("Type Error!");
@@ -488,35 +524,110 @@ Control_Flow: /************************************************************
               }
               Control_Flow_Body
               {
-                fprintf(JASM_FILE, "\tgoto LOOP_CONTINUE%d\n", $1);
-                fprintf(JASM_FILE, "LOOP_BREAK%d: pop\n\n", $1);    // LOOP_BREAK: 結束並pop掉I2的結果
+                SymbolTableNode_t* N = lookupRecursive(Symbol_Table, $4);
+
+                $$ = createStatement(sForeach);
+                $$->id = $1;
+                $$->hasBreak = Loop_List->hasBreak;
+                $$->identifier = $4;
+                $$->localVariableIndex = N->localVariableIndex;
+                $$->begin = $6;
+                $$->end = $8;
+                $$->body = $11;
                 Loop_List = freeLoopList(Loop_List);
               }
+            /*******************************************************
+            * Switch
+            ********************************************************/
+            | Control_Flow_ID SWITCH '(' Expression ')'
+              {
+                if (!isSameTypeInfo_WithoutConst($4->resultTypeInfo, INT_TYPE) && !isSameTypeInfo_WithoutConst($4->resultTypeInfo, BOOL_TYPE)) {
+                  yyerror("Type error!");
+                  fprintf(stderr, "\tExpect a integer or boolean expression, but got (Type = ");
+                  printTypeInfo(stderr, $4->resultTypeInfo);
+                  fprintf(stderr, ") ");
+                  dumpExprTree(stderr, $4);
+                  fprintf(stderr, "\n");
+                  YYERROR;
+                }
+                Loop_List = createLoopList($1, Loop_List);
+                Loop_List->isSwitch = true;
+
+                // expression 在所有 case 之前輸出，scratchMark 是現在的 nextLocalVariableIndex
+                $<stmt>$ = createStatement(sSwitch);
+              }
+              '{' Switch_Cases '}'
+              {
+                const bool hasBreak = Loop_List->hasBreak;
+                Loop_List = freeLoopList(Loop_List);
+                if (!checkSwitchCases($4, $8))
+                  YYERROR;
+
+                $$ = $<stmt>6;
+                $$->id = $1;
+                $$->hasBreak = hasBreak;
+                $$->expr = $4;
+                $$->body = $8;
+              }
             ;
 
+// switch 的每個 case 各自是一個 scope（跳進 case 時不會經過其他 case 的變數定義）
+Switch_Cases: Case_Clause Switch_Cases { $$ = appendStatements($1, $2); }
+            | /* Empty */              { $$ = NULL; } ;
+
+Case_Clause: CASE Expression ':'   { Symbol_Table = create(Symbol_Table); }
+             Statements
+             {
+               dump(Symbol_Table);
+               Symbol_Table = freeSymbolTable(Symbol_Table);
+
+               if (!$2->isConstExpr) {
+                 yyerror("Case label must be a constant expression!");
+                 fprintf(stderr, "\tGot: ");
+                 dumpExprTree(stderr, $2);
+                 fprintf(stderr, "\n");
+                 YYERROR;
+               }
+               $$ = createStatement(sCase);
+               $$->expr = $2;
+               $$->body = $5;
+             }
+           | DEFAULT ':'           { Symbol_Table = create(Symbol_Table); }
+             Statements
+             {
+               dump(Symbol_Table);
+               Symbol_Table = freeSymbolTable(Symbol_Table);
+               $$ = createStatement(sCase);
+               $$->body = $4;
+             }
+           ;
+
 Control_Flow_ID: { $$ = NEXT_CONTROL_FLOW_ID++; }
 
-Control_Flow_Body: { Symbol_Table = create(Symbol_Table); } One_Simple_Statement { dump(Symbol_Table); Symbol_Table = freeSymbolTable(Symbol_Table); }
-                 | { Symbol_Table = create(Symbol_Table); } '{' Statements '}'   { dump(Symbol_Table); Symbol_Table = freeSymbolTable(Symbol_Table); }
+// if, 迴圈的本體只有一個節點（見 statementBody）
+Control_Flow_Body: { Symbol_Table = create(Symbol_Table); } One_Simple_Statement { dump(Symbol_Table); Symbol_Table = freeSymbolTable(Symbol_Table); $$ = statementBody($2); }
+                 | { Symbol_Table = create(Symbol_Table); } '{' Statements '}'   
+                   { 
+                     dump(Symbol_Table); 
+                     Symbol_Table = freeSymbolTable(Symbol_Table);
+                     $$ = createStatement(sBlock);
+                     $$->body = $3;
+                   }
 
-// Note: 這裡是一個 dirty trick，因為從 IF 到 Control_Flow_Body 之間不會有其他 Control_Flow，所以 `NEXT_CONTROL_FLOW_ID - 1` 是當前的 ID
-If_False_Goto_Else: { fprintf(JASM_FILE, "ifeq ELSE%d\n", NEXT_CONTROL_FLOW_ID - 1); }
+// condition 在 then 之前輸出：記下這時候的 nextLocalVariableIndex，產生 JASM 時暫存區域變數從這裡開始分配
+If_Begin_Then: { $$ = getScratchMark(Symbol_Table); }
+
+For_Initial_Expression:    Expression
+                         | /* Empty */ { $$ = NULL; };
+For_Condition_Expression : Condition_Expression
+                         | /* Empty */ { $$ = NULL; };
+For_Update_Expression:     Expression
+                         | /* Empty */ { $$ = NULL; };
 
-For_Initial_Expression:    Expression { printf("\t\e[36mInitial Expression =  \e[m"); dumpExprTree(stdout, $1); puts(""); exprToJasm($1); popExprResult($1->resultTypeInfo); freeExprTree($1); }
-                         | /* Empty */;
-For_Condition_Expression : Condition_Expression 
-                         | /* Empty */ { puts("\t\e[36mCondition =  true\e[m"); fprintf(JASM_FILE, "iconst_1\n"); };
-For_Update_Expression:     Expression  { printf("\t\e[36mUpdate Expression =  \e[m");  dumpExprTree(stdout, $1); puts(""); exprToJasm($1); popExprResult($1->resultTypeInfo); freeExprTree($1); }
-                         | /* Empty */;
 
 Condition_Expression: Expression 
                       {
-                        if (isSameTypeInfo_WithoutConst($1->resultTypeInfo, BOOL_TYPE)) {
-                          printf("\t\e[36mCondition = \e[m"); dumpExprTree(stdout, $1); puts("");
-                          exprToJasm($1);
-                          freeExprTree($1);
-                        }
-                        else {
+                        if (!isSameTypeInfo_WithoutConst($1->resultTypeInfo, BOOL_TYPE)) {
                           yyerror("Type error!");
                           fprintf(stderr, "\tExpect a boolean expression, but got (Type = ");
                           printTypeInfo(stderr, $1->resultTypeInfo);
@@ -525,16 +636,13 @@ Condition_Expression: Expression
                           fprintf(stderr, "\n");
                           YYERROR;
                         }
+                        $$ = $1;
                       }
                       ;
 
 Integer_Expression: Expression 
                     {
-                      if (isSameTypeInfo_WithoutConst($1->resultTypeInfo, INT_TYPE)) {
-                        printf("\t\e[36mInteger Expression = \e[m"); dumpExprTree(stdout, $1); puts("");
-                        $$ = $1;
-                      }
-                      else {
+                      if (!isSameTypeInfo_WithoutConst($1->resultTypeInfo, INT_TYPE)) {
                         yyerror("Type error!");
                         fprintf(stderr, "\tExpect a integer expression, but got (Type = ");
                         printTypeInfo(stderr, $1->resultTypeInfo);
@@ -543,6 +651,7 @@ Integer_Expression: Expression
                         fprintf(stderr, "\n");
                         YYERROR;
                       }
+                      $$ = $1;
                     }
                     ;
 
@@ -727,14 +836,16 @@ Type: { memset(&Type_Info, 0, sizeof(Type_Info)); }
 Qualifier: CONST { Type_Info.isConst = true; } | ;
 
 // Primitive Types
-PType: BOOL         { Type_Info.type = pBoolType; } 
-     | FLOAT        { Type_Info.type = pFloatType; } 
-     | INT          { Type_Info.type = pIntType; }
-     | DOUBLE       { Type_Info.type = pDoubleType; }
-     | STRING_yacc  { Type_Info.type = pStringType; }
-     | VOID         { Type_Info.type = pVoidType; }
+PType: Non_Empty_PType
      |              { Type_Info.type = pVoidType; } ;
 
+Non_Empty_PType: BOOL         { Type_Info.type = pBoolType; } 
+               | FLOAT        { Type_Info.type = pFloatType; } 
+               | INT          { Type_Info.type = pIntType; }
+               | DOUBLE       { Type_Info.type = pDoubleType; }
+               | STRING_yacc  { Type_Info.type = pStringType; }
+               | VOID         { Type_Info.type = pVoidType; } ;
+
 // Array
 Array_Dimensions: { // 單純為了初始化
                     Type_Info.dimension = 0;
@@ -863,12 +974,14 @@ bool addVariable(const char* identifier, ExpressionNode_t* defaultValue) {
       Node->hasDefaultValue = true;
       Node->defaultValueIsConstExpr = true;
 
+      // Note: 初始值可能是編譯時期計算的結果（例如 `double g = f(0.1);`），要印出足夠的位數
+      char number[JASM_NUMBER_SIZE];
       switch (Type_Info.type) {
-        //   Type         JASM                                               Store Default Value
-        case pIntType:    fprintf(JASM_FILE, " = %d",  defaultValue->cIval); Node->ival = defaultValue->cIval; break;
-        case pFloatType:  fprintf(JASM_FILE, " = %ef", defaultValue->cFval); Node->fval = defaultValue->cFval; break;
-        case pDoubleType: fprintf(JASM_FILE, " = %e",  defaultValue->cDval); Node->dval = defaultValue->cDval; break;
-        case pBoolType:   fprintf(JASM_FILE, " = %d",  defaultValue->cBval); Node->bval = defaultValue->cBval; break;
+        //   Type         JASM                                                                       Store Default Value
+        case pIntType:    fprintf(JASM_FILE, " = %d",  defaultValue->cIval);                         Node->ival = defaultValue->cIval; break;
+        case pFloatType:  formatJasmFloat(number, defaultValue->cFval);  fprintf(JASM_FILE, " = %s", number); Node->fval = defaultValue->cFval; break;
+        case pDoubleType: formatJasmDouble(number, defaultValue->cDval); fprintf(JASM_FILE, " = %s", number); Node->dval = defaultValue->cDval; break;
+        case pBoolType:   fprintf(JASM_FILE, " = %d",  defaultValue->cBval);                         Node->bval = defaultValue->cBval; break;
         case pStringType: yyerror("Not implemented. - global default value string"); return false;
       }
     }
@@ -876,12 +989,51 @@ bool addVariable(const char* identifier, ExpressionNode_t* defaultValue) {
     fprintf(JASM_FILE, "\n\n");
     freeExprTree(defaultValue);
   }
-  // 有預設值的「非常數」區域變數 /////////////////////////////////////////////////////////////////////
-  else if (defaultValue) {
-    Node->hasDefaultValue = true;
-    Node->expr = defaultValue;
-    assignToJasm(identifier, Node->localVariableIndex, Node->expr);
-    popExprResult(Node->typeInfo);
+  // 「非常數」區域變數：初始值在產生 JASM 時才 propagate、輸出，由 statement 樹持有 ////////////////////////////
+  else {
+    StatementNode_t* varDef = createStatement(sVarDef);
+    varDef->identifier = strdup(identifier);
+    varDef->localVariableIndex = Node->localVariableIndex;
+    varDef->expr = defaultValue;
+    Var_Def_Statements = appendStatements(Var_Def_Statements, varDef);
+  }
+
+  return true;
+}
+
+bool checkSwitchCases(const ExpressionNode_t* expr, const StatementNode_t* cases) {
+  const bool isBool = expr->resultTypeInfo.type == pBoolType;
+  bool hasDefault = false;
+
+  for (const StatementNode_t* C = cases; C; C = C->next) {
+    if (C->expr == NULL) {
+      if (hasDefault) {
+        yyerror("Multiple default labels in switch!");
+        return false;
+      }
+      hasDefault = true;
+      continue;
+    }
+
+    if (!isSameTypeInfo_WithoutConst(C->expr->resultTypeInfo, expr->resultTypeInfo)) {
+      yyerror("Type Error!");
+      fprintf(stderr, "\tSwitch expression type = ");
+      printTypeInfo(stderr, expr->resultTypeInfo);
+      fprintf(stderr, " , but type of case label = ");
+      printTypeInfo(stderr, C->expr->resultTypeInfo);
+      fprintf(stderr, "\n");
+      return false;
+    }
+
+    for (const StatementNode_t* D = cases; D != C; D = D->next) {
+      if (D->expr && (isBool ? D->expr->cBval == C->expr->cBval : D->expr->cIval == C->expr->cIval)) {
+        yyerror("Duplicate case label!");
+        fprintf(stderr, "\tFor Case = ");
+        dumpExprTree(stderr, C->expr);
+        fprintf(stderr, "\n");
+        return false;
+      }
+    }
   }
 
   return true;
@@ -931,34 +1083,180 @@ int main (int argc, char *argv[])
 {
     Symbol_Table = create(Symbol_Table);
 
-    if (argc > 2 || (argc == 2 && strcmp(argv[1], "-h") == 0)) {
-        puts("Usage");
-        puts("\tparser           -> use stdin");
-        puts("\tparser <file>    -> read from file");
-        exit(0);
+    const char* sD_filename = NULL;
+    bool dumpCfg = false;  // 開啟 JASM 檔之後才知道 class 名稱，才能開啟 .dot 檔
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-O0") == 0 || strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0) {
+            setOptimizationLevel(argv[i][2] - '0');
+        }
+        else if (strncmp(argv[i], "--enable-pass=", 14) == 0 || strncmp(argv[i], "--disable-pass=", 15) == 0) {
+            const bool isEnable = argv[i][2] == 'e';
+            if (!setPassEnabled(argv[i] + (isEnable ? 14 : 15), isEnable)) {
+                yyerror("Unknown pass (see -h)");
+                exit(-1);
+            }
+        }
+        else if (strncmp(argv[i], "--dump-after=", 13) == 0) {
+            if (!addDumpAfter(argv[i] + 13)) {
+                yyerror("Unknown function / class pass (see -h)");
+                exit(-1);
+            }
+        }
+        else if (strcmp(argv[i], "--time-passes") == 0) {
+            Time_Passes = true;
+        }
+        else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            Codegen_Jobs = atoi(argv[i] + 7);
+        }
+        else if (strncmp(argv[i], "--unroll-factor=", 16) == 0) {
+            Unroll_Factor = atoi(argv[i] + 16);
+        }
+        else if (strncmp(argv[i], "--unroll-budget=", 16) == 0) {
+            Unroll_Budget = atoi(argv[i] + 16);
+        }
+        else if (strncmp(argv[i], "--if-switch-arms=", 17) == 0) {
+            If_Chain_Switch_Arms = atoi(argv[i] + 17);
+        }
+        else if (strncmp(argv[i], "--inline-budget=", 16) == 0) {
+            Inline_Budget = atoi(argv[i] + 16);
+        }
+        else if (strncmp(argv[i], "--spec-budget=", 14) == 0) {
+            Specialize_Budget = atoi(argv[i] + 14);
+        }
+        else if (strncmp(argv[i], "--split-size=", 13) == 0) {
+            Method_Split_Size = atoi(argv[i] + 13);
+        }
+        else if (strncmp(argv[i], "--memo-size=", 12) == 0) {
+            Memo_Table_Size = atoi(argv[i] + 12);
+        }
+        else if (strcmp(argv[i], "--memoize") == 0) {
+            Enable_Memoization = true;
+        }
+        else if (strcmp(argv[i], "--call-graph") == 0) {
+            Print_Call_Graph = true;
+        }
+        else if (strcmp(argv[i], "--dump-cfg") == 0) {
+            dumpCfg = true;
+        }
+        else if (strcmp(argv[i], "--no-sccp") == 0) {
+            Enable_SSA_Const_Prop = false;
+        }
+        else if (strcmp(argv[i], "--no-block-layout") == 0) {
+            Enable_Block_Layout = false;
+        }
+        else if (strcmp(argv[i], "--no-dead-code-elim") == 0) {
+            Eliminate_Dead_Code = false;
+        }
+        else if (strcmp(argv[i], "--no-simplify") == 0) {
+            Enable_Expr_Simplification = false;
+        }
+        else if (strcmp(argv[i], "--no-cse") == 0) {
+            Enable_CSE = false;
+        }
+        else if (strcmp(argv[i], "--no-stack-order") == 0) {
+            Enable_Stack_Ordering = false;
+        }
+        else if (strcmp(argv[i], "--no-const-prop") == 0) {
+            Enable_Const_Prop = false;
+        }
+        else if (strcmp(argv[i], "--no-dead-store-elim") == 0) {
+            Enable_Dead_Store_Elim = false;
+        }
+        else if (strcmp(argv[i], "--no-global-promotion") == 0) {
+            Enable_Global_Promotion = false;
+        }
+        else if (strcmp(argv[i], "--no-tail-call-elim") == 0) {
+            Enable_Tail_Call_Elim = false;
+        }
+        else if (strcmp(argv[i], "--no-const-eval") == 0) {
+            Enable_Const_Eval = false;
+        }
+        else if (strcmp(argv[i], "--no-unused-function-elim") == 0) {
+            Enable_Unused_Function_Elim = false;
+        }
+        else if (strcmp(argv[i], "-h") == 0 || argv[i][0] == '-' || sD_filename != NULL) {
+            puts("Usage");
+            puts("\tparser [options]           -> use stdin");
+            puts("\tparser [options] <file>    -> read from file");
+            puts("Options（依照順序套用，後面的覆蓋前面的）");
+            puts("\t-O0 / -O1 / -O2            -> 最佳化等級：-O0 全部關閉、-O1 只做便宜的最佳化、-O2 全部（預設）");
+            puts("\t--enable-pass=<pass>       -> 開啟 pass");
+            puts("\t--disable-pass=<pass>      -> 關閉 pass");
+            puts("\t--dump-after=<pass>        -> 在 function / class pass 之後輸出 JASM（codegen：剛產生完時、all：每個 pass）");
+            puts("\t--time-passes              -> 輸出每個 pass 的執行次數、有改變的次數、增減的行數和時間");
+            puts("\t--jobs=N                   -> 用 N 個 thread 平行執行每個函數的 function pass，輸出依照原始碼的順序（預設 1）");
+            puts("\t--unroll-factor=N          -> 執行次數已知的 for / foreach 最多展開 N 份（預設 1，不展開）");
+            puts("\t--unroll-budget=N          -> 展開後的迴圈最多 N 行 JASM（預設 256）");
+            puts("\t--if-switch-arms=N         -> 同一個 int 變數和 N 個以上不同常數比較的 if-else 串改成 switch（預設 4，0 代表不轉換）");
+            puts("\t--inline-budget=N          -> body 不超過 N 行 JASM 的函數會被 inline（預設 24，0 代表不 inline）");
+            puts("\t--spec-budget=N            -> body 不超過 N 行 JASM 的函數可以依照常數參數特化（預設 64，0 代表不特化）");
+            puts("\t--split-size=N             -> bytecode 超過 N byte 的 method 拆成多個 method（預設 8000，0 代表不拆）");
+            puts("\t--memoize                  -> 沒有副作用、參數都是 int / bool 的遞迴函數把算過的結果存起來");
+            puts("\t--memo-size=N              -> 每個 memoize 的函數最多記錄 N 組參數（預設 64）");
+            puts("\t--call-graph               -> 輸出 call graph（SCC、每個函數讀寫的全域變數、I/O、無法呼叫到的函數）");
+            puts("\t--dump-cfg                 -> 把每個函數的 CFG 輸出成 Graphviz 檔（<class 名稱>.dot）");
+            puts("\t--no-sccp                  -> 不在 SSA 上做區域變數的 sparse conditional constant propagation");
+            puts("\t--no-block-layout          -> 不依照 CFG 整理跳躍（jump threading、反轉條件、重新排列 basic block）");
+            puts("\t--no-dead-code-elim        -> 不刪除無法到達的 code 和常數 condition 的分支");
+            puts("\t--no-simplify              -> 不化簡 expression（恆等式、常數重新結合、strength reduction）");
+            puts("\t--no-cse                   -> 不做 common subexpression elimination");
+            puts("\t--no-stack-order           -> 不依照需要的 operand stack 格數調整運算元的計算順序");
+            puts("\t--no-const-prop            -> 不做區域變數的 constant / copy propagation");
+            puts("\t--no-dead-store-elim       -> 不刪除寫入後不會再被讀取的區域變數 store");
+            puts("\t--no-global-promotion      -> 不把從來沒被寫入的全域變數換成常數");
+            puts("\t--no-tail-call-elim        -> 不把 `return 自己(...)` 的遞迴換成迴圈");
+            puts("\t--no-const-eval            -> 不在編譯時期執行參數都是常數的函數呼叫");
+            puts("\t--no-unused-function-elim  -> 不刪除從 main 無法呼叫到的函數");
+            puts("Passes（名稱、類別、開啟的 -O level、說明）");
+            printPassList(stdout);
+            exit(0);
+        }
+        else {
+            sD_filename = argv[i];
+        }
     }
 
     /* open the source program file & output JASM file */
-    if (argc == 2) {
-        yyin = fopen(argv[1], "r"); /* open input file */
+    if (sD_filename) {
+        yyin = fopen(sD_filename, "r"); /* open input file */
 
         if (yyin == NULL) {
             yyerror("Cannot open file");
             exit(-1);
         }
 
-        openJasmAndPrintHeader(argv[1]);
+        openJasmAndPrintHeader(sD_filename);
     }
     else {
         openJasmAndPrintHeader("stdin");
     }
 
+    if (dumpCfg) {
+        char* dotFilename = calloc(strlen(JASM_CLASS_NAME) + 5 /* .dot\0 */, sizeof(char));
+        strcpy(dotFilename, JASM_CLASS_NAME);
+        strcat(dotFilename, ".dot");
+        Cfg_Dot_File = fopen(dotFilename, "w");
+        free(dotFilename);
+
+        if (Cfg_Dot_File == NULL) {
+            yyerror("Cannot open CFG dot file");
+            exit(-1);
+        }
+        fprintf(Cfg_Dot_File, "digraph \"%s\" {\n  node [fontname = monospace];\n", JASM_CLASS_NAME);
+    }
+
     /* perform parsing */
+    // 暫存整個 class 的內容，parse 完之後才能知道哪些全域變數從來沒被寫入
+    beginJasmCapture();
+
     if (yyparse() == 1) /* parsing */ {
         fprintf(stderr, "\e[31mError at line No. %i\e[m\n", linenum); /* syntax error */
         return -1;
     }
     else {
+        // Note: 函數的參數型別存在 global symbol table，要在䆁放之前處理完所有函數
+        finishFunctions();
         dump(Symbol_Table);
         
         SymbolTableNode_t* N = lookup(Symbol_Table, "main");
@@ -973,7 +1271,21 @@ int main (int argc, char *argv[])
         Symbol_Table = freeSymbolTable(Symbol_Table);
     }
 
+    char* classBody = endJasmCapture();
+    char* newBody = runClassPasses(classBody);
+    free(classBody);
+    classBody = newBody;
+    fputs(classBody, JASM_FILE);
+    free(classBody);
+
+    if (Time_Passes)
+        printPassStatistics(stdout);
+
     fprintf(JASM_FILE, "} /* end of class %s */\n", JASM_CLASS_NAME);
     fclose(JASM_FILE);
+    if (Cfg_Dot_File) {
+        fprintf(Cfg_Dot_File, "}\n");
+        fclose(Cfg_Dot_File);
+    }
     free(JASM_CLASS_NAME);
 }